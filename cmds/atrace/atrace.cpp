@@ -28,8 +28,8 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
-#include <zlib.h>
 
+#include <algorithm>
 #include <fstream>
 #include <memory>
 
@@ -51,6 +51,8 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 
+#include "trace_io.h"
+
 using namespace android;
 using pdx::default_transport::ServiceUtility;
 using hardware::hidl_vec;
@@ -269,6 +271,7 @@ static const char* g_categoriesFile = nullptr;
 static const char* g_kernelTraceFuncs = nullptr;
 static const char* g_debugAppCmdLine = "";
 static const char* g_outputFile = nullptr;
+static const char* g_rawDir = nullptr;
 
 /* Global state */
 static bool g_tracePdx = false;
@@ -891,22 +894,20 @@ static void stopTrace()
     setTracingEnabled(false);
 }
 
-// Read data from the tracing pipe and forward to stdout
+// Move data from the tracing pipe to stdout
 static void streamTrace()
 {
-    char trace_data[4096];
     int traceFD = open((g_traceFolder + k_traceStreamPath).c_str(), O_RDWR);
     if (traceFD == -1) {
         fprintf(stderr, "error opening %s: %s (%d)\n", k_traceStreamPath,
                 strerror(errno), errno);
         return;
     }
+    fflush(stdout);
+    TraceCopier copier(traceFD, STDOUT_FILENO);
     while (!g_traceAborted) {
-        ssize_t bytes_read = read(traceFD, trace_data, 4096);
-        if (bytes_read > 0) {
-            write(STDOUT_FILENO, trace_data, bytes_read);
-            fflush(stdout);
-        } else {
+        ssize_t bytes_read = copier.copy(TraceCopier::kChunkSize);
+        if (bytes_read <= 0) {
             if (!g_traceAborted) {
                 fprintf(stderr, "read returned %zd bytes err %d (%s)\n",
                         bytes_read, errno, strerror(errno));
@@ -914,6 +915,7 @@ static void streamTrace()
             break;
         }
     }
+    close(traceFD);
 }
 
 // Read the current kernel trace and write it to stdout.
@@ -928,91 +930,10 @@ static void dumpTrace(int outFd)
     }
 
     if (g_compress) {
-        z_stream zs;
-        memset(&zs, 0, sizeof(zs));
-
-        int result = deflateInit(&zs, Z_DEFAULT_COMPRESSION);
-        if (result != Z_OK) {
-            fprintf(stderr, "error initializing zlib: %d\n", result);
-            close(traceFD);
-            return;
-        }
-
-        constexpr size_t bufSize = 64*1024;
-        std::unique_ptr<uint8_t> in(new uint8_t[bufSize]);
-        std::unique_ptr<uint8_t> out(new uint8_t[bufSize]);
-        if (!in || !out) {
-            fprintf(stderr, "couldn't allocate buffers\n");
-            close(traceFD);
-            return;
-        }
-
-        int flush = Z_NO_FLUSH;
-
-        zs.next_out = reinterpret_cast<Bytef*>(out.get());
-        zs.avail_out = bufSize;
-
-        do {
-
-            if (zs.avail_in == 0) {
-                // More input is needed.
-                result = read(traceFD, in.get(), bufSize);
-                if (result < 0) {
-                    fprintf(stderr, "error reading trace: %s (%d)\n",
-                            strerror(errno), errno);
-                    result = Z_STREAM_END;
-                    break;
-                } else if (result == 0) {
-                    flush = Z_FINISH;
-                } else {
-                    zs.next_in = reinterpret_cast<Bytef*>(in.get());
-                    zs.avail_in = result;
-                }
-            }
-
-            if (zs.avail_out == 0) {
-                // Need to write the output.
-                result = write(outFd, out.get(), bufSize);
-                if ((size_t)result < bufSize) {
-                    fprintf(stderr, "error writing deflated trace: %s (%d)\n",
-                            strerror(errno), errno);
-                    result = Z_STREAM_END; // skip deflate error message
-                    zs.avail_out = bufSize; // skip the final write
-                    break;
-                }
-                zs.next_out = reinterpret_cast<Bytef*>(out.get());
-                zs.avail_out = bufSize;
-            }
-
-        } while ((result = deflate(&zs, flush)) == Z_OK);
-
-        if (result != Z_STREAM_END) {
-            fprintf(stderr, "error deflating trace: %s\n", zs.msg);
-        }
-
-        if (zs.avail_out < bufSize) {
-            size_t bytes = bufSize - zs.avail_out;
-            result = write(outFd, out.get(), bytes);
-            if ((size_t)result < bytes) {
-                fprintf(stderr, "error writing deflated trace: %s (%d)\n",
-                        strerror(errno), errno);
-            }
-        }
-
-        result = deflateEnd(&zs);
-        if (result != Z_OK) {
-            fprintf(stderr, "error cleaning up zlib: %d\n", result);
-        }
+        compressTrace(traceFD, outFd, std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
     } else {
-        char buf[4096];
-        ssize_t rc;
-        while ((rc = TEMP_FAILURE_RETRY(read(traceFD, buf, sizeof(buf)))) > 0) {
-            if (!android::base::WriteFully(outFd, buf, rc)) {
-                fprintf(stderr, "error writing trace: %s\n", strerror(errno));
-                break;
-            }
-        }
-        if (rc == -1) {
+        TraceCopier copier(traceFD, outFd);
+        if (!copier.drain()) {
             fprintf(stderr, "error dumping trace: %s\n", strerror(errno));
         }
     }
@@ -1080,6 +1001,9 @@ static void showHelp(const char *cmd)
                     "                  list the available tracing categories\n"
                     " -o filename      write the trace to the specified file instead\n"
                     "                    of stdout.\n"
+                    "  --raw_dir dir   write the raw per-CPU trace buffers to dir/cpuN\n"
+                    "                    instead of the text trace; can't be used\n"
+                    "                    with -z or -o.\n"
             );
 }
 
@@ -1210,6 +1134,7 @@ int main(int argc, char **argv)
             {"only_userspace",    no_argument, nullptr,  0 },
             {"list_categories",   no_argument, nullptr,  0 },
             {"stream",            no_argument, nullptr,  0 },
+            {"raw_dir",     required_argument, nullptr,  0 },
             {nullptr,                       0, nullptr,  0 }
         };
 
@@ -1285,6 +1210,8 @@ int main(int argc, char **argv)
                 } else if (!strcmp(long_options[option_index].name, "stream")) {
                     traceStream = true;
                     traceDump = false;
+                } else if (!strcmp(long_options[option_index].name, "raw_dir")) {
+                    g_rawDir = optarg;
                 } else if (!strcmp(long_options[option_index].name, "list_categories")) {
                     listSupportedCategories();
                     exit(0);
@@ -1307,6 +1234,11 @@ int main(int argc, char **argv)
         }
     }
 
+    if (g_rawDir && (g_compress || g_outputFile)) {
+        fprintf(stderr, "--raw_dir can't be used with -z or -o\n");
+        exit(1);
+    }
+
     registerSigHandler();
 
     if (g_initialSleepSecs > 0) {
@@ -1366,17 +1298,23 @@ int main(int argc, char **argv)
         if (!g_traceAborted) {
             printf(" done\n");
             fflush(stdout);
-            int outFd = STDOUT_FILENO;
-            if (g_outputFile) {
-                outFd = open(g_outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            }
-            if (outFd == -1) {
-                printf("Failed to open '%s', err=%d", g_outputFile, errno);
+            if (g_rawDir) {
+                if (!dumpRawBuffers(g_traceFolder, g_rawDir)) {
+                    fprintf(stderr, "error dumping raw trace to %s\n", g_rawDir);
+                }
             } else {
-                dprintf(outFd, "TRACE:\n");
-                dumpTrace(outFd);
+                int outFd = STDOUT_FILENO;
                 if (g_outputFile) {
-                    close(outFd);
+                    outFd = open(g_outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                }
+                if (outFd == -1) {
+                    printf("Failed to open '%s', err=%d", g_outputFile, errno);
+                } else {
+                    dprintf(outFd, "TRACE:\n");
+                    dumpTrace(outFd);
+                    if (g_outputFile) {
+                        close(outFd);
+                    }
                 }
             }
         } else {
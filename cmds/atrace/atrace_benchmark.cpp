@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <memory>
+#include <random>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/macros.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+
+#include "trace_io.h"
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+namespace android {
+
+static constexpr int kCpus = 8;
+static constexpr size_t kTraceSize = 64 * 1024 * 1024;
+static constexpr size_t kRawSize = 16 * 1024 * 1024;
+
+// A tracefs-like folder with a text trace and per-CPU raw buffers in it,
+// made up of regular files that read the same every time.
+class SyntheticTracefs {
+  public:
+    SyntheticTracefs() {
+        std::mt19937 rng(42);
+        const char* tasks[] = { "surfaceflinger", "RenderThread", "system_server",
+                "kworker/u16:3", "binder:601_2", "android.bg" };
+        const char* events[] = { "sched_switch", "sched_wakeup", "tracing_mark_write",
+                "cpu_frequency", "cpu_idle", "irq_handler_entry" };
+        std::string trace;
+        double timestamp = 1000.0;
+        while (trace.size() < kTraceSize) {
+            timestamp += (rng() % 1000) / 1e6;
+            int pid = 500 + rng() % 3000;
+            trace += StringPrintf("%16s-%-5d (%5d) [%03d] d..%d %12.6f: %s: arg=%u\n",
+                    tasks[rng() % arraysize(tasks)], pid, pid, int(rng() % kCpus),
+                    int(rng() % 4), timestamp, events[rng() % arraysize(events)],
+                    unsigned(rng() % 100000));
+        }
+        CHECK(android::base::WriteStringToFile(trace, path() + "trace"));
+
+        for (int cpu = 0; cpu < kCpus; cpu++) {
+            std::string dir = StringPrintf("%sper_cpu/cpu%d", path().c_str(), cpu);
+            CHECK(mkdir((path() + "per_cpu").c_str(), 0755) == 0 || errno == EEXIST);
+            CHECK(mkdir(dir.c_str(), 0755) == 0);
+            // Ring buffer pages of small records with some repetition
+            std::string raw(kRawSize, '\0');
+            for (size_t i = 0; i < raw.size(); i += 16) {
+                uint32_t record[4] = { uint32_t(i), uint32_t(rng() % 64), uint32_t(cpu),
+                        uint32_t(rng()) };
+                memcpy(&raw[i], record, sizeof(record));
+            }
+            CHECK(android::base::WriteStringToFile(raw, dir + "/trace_pipe_raw"));
+        }
+        CHECK(mkdir(out().c_str(), 0755) == 0);
+    }
+
+    std::string path() const { return std::string(mDir.path) + "/"; }
+    std::string out() const { return path() + "out"; }
+
+  private:
+    TemporaryDir mDir;
+};
+
+static const SyntheticTracefs& tracefs() {
+    static SyntheticTracefs* tracefs = new SyntheticTracefs();
+    return *tracefs;
+}
+
+// How atrace -z deflated the trace before it was done in parallel.
+static bool deflateSerially(int inFd, int outFd) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    constexpr size_t bufSize = 64 * 1024;
+    std::unique_ptr<uint8_t[]> in(new uint8_t[bufSize]);
+    std::unique_ptr<uint8_t[]> out(new uint8_t[bufSize]);
+    int flush = Z_NO_FLUSH;
+    int result = Z_OK;
+    do {
+        if (zs.avail_in == 0) {
+            ssize_t size = read(inFd, in.get(), bufSize);
+            if (size < 0) {
+                break;
+            } else if (size == 0) {
+                flush = Z_FINISH;
+            }
+            zs.next_in = in.get();
+            zs.avail_in = size;
+        }
+        zs.next_out = out.get();
+        zs.avail_out = bufSize;
+        result = deflate(&zs, flush);
+        size_t size = bufSize - zs.avail_out;
+        if (!android::base::WriteFully(outFd, out.get(), size)) {
+            break;
+        }
+    } while (result == Z_OK);
+    deflateEnd(&zs);
+    return result == Z_STREAM_END;
+}
+
+static void BM_DeflateSerially(benchmark::State& state) {
+    const std::string trace = tracefs().path() + "trace";
+    unique_fd out(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    for (auto _ : state) {
+        unique_fd in(open(trace.c_str(), O_RDONLY | O_CLOEXEC));
+        CHECK(deflateSerially(in, out));
+    }
+    state.SetBytesProcessed(state.iterations() * kTraceSize);
+}
+BENCHMARK(BM_DeflateSerially)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_CompressTrace(benchmark::State& state) {
+    const std::string trace = tracefs().path() + "trace";
+    unique_fd out(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    for (auto _ : state) {
+        unique_fd in(open(trace.c_str(), O_RDONLY | O_CLOEXEC));
+        CHECK(compressTrace(in, out, state.range(0)));
+    }
+    state.SetBytesProcessed(state.iterations() * kTraceSize);
+}
+BENCHMARK(BM_CompressTrace)->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// How the per-CPU buffers would be read with plain reads, one after another.
+static void BM_DumpRawReadWrite(benchmark::State& state) {
+    char buf[4096];
+    for (auto _ : state) {
+        for (int cpu = 0; cpu < kCpus; cpu++) {
+            std::string in_path = StringPrintf("%sper_cpu/cpu%d/trace_pipe_raw",
+                    tracefs().path().c_str(), cpu);
+            std::string out_path = StringPrintf("%s/cpu%d", tracefs().out().c_str(), cpu);
+            unique_fd in(open(in_path.c_str(), O_RDONLY | O_CLOEXEC));
+            unique_fd out(open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+            ssize_t size;
+            while ((size = read(in, buf, sizeof(buf))) > 0) {
+                CHECK(android::base::WriteFully(out, buf, size));
+            }
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kCpus * kRawSize);
+}
+BENCHMARK(BM_DumpRawReadWrite)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_DumpRawBuffers(benchmark::State& state) {
+    for (auto _ : state) {
+        CHECK(dumpRawBuffers(tracefs().path(), tracefs().out()));
+    }
+    state.SetBytesProcessed(state.iterations() * kCpus * kRawSize);
+}
+BENCHMARK(BM_DumpRawBuffers)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  // namespace android
+
+BENCHMARK_MAIN();
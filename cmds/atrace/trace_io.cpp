@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace_io.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <android-base/file.h>
+
+using android::base::unique_fd;
+
+namespace android {
+
+namespace {
+
+constexpr size_t kBufferSize = 64 * 1024;
+
+// Size of the blocks deflated on their own, and of the window of input
+// before each that it may refer back to.
+constexpr size_t kBlockSize = 256 * 1024;
+constexpr size_t kWindowSize = 32 * 1024;
+
+// A zlib header for the default compression level and window size, and an
+// empty final block of fixed codes to end the deflate stream with.
+constexpr uint8_t kZlibHeader[] = { 0x78, 0x9c };
+constexpr uint8_t kFinalBlock[] = { 0x03, 0x00 };
+
+struct Block {
+    std::string input;
+    std::string dictionary;
+    std::string output;
+    uLong check = 0;
+    bool done = false;
+    bool ok = false;
+};
+
+// Deflates a block as raw deflate data that ends on a byte boundary, so that
+// blocks can be put one after another.
+bool deflateBlock(Block* block) {
+    block->check = adler32(adler32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(block->input.data()), block->input.size());
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    bool ok = block->dictionary.empty() || deflateSetDictionary(&zs,
+            reinterpret_cast<const Bytef*>(block->dictionary.data()),
+            block->dictionary.size()) == Z_OK;
+
+    zs.next_in = reinterpret_cast<Bytef*>(&block->input[0]);
+    zs.avail_in = block->input.size();
+    block->output.resize(deflateBound(&zs, block->input.size()) + 16);
+    size_t used = 0;
+    while (ok) {
+        if (used == block->output.size()) {
+            block->output.resize(used * 2);
+        }
+        zs.next_out = reinterpret_cast<Bytef*>(&block->output[used]);
+        zs.avail_out = block->output.size() - used;
+        int result = deflate(&zs, Z_SYNC_FLUSH);
+        used = block->output.size() - zs.avail_out;
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            ok = false;
+        } else if (zs.avail_out != 0) {
+            // Everything was flushed
+            break;
+        }
+    }
+    block->output.resize(used);
+    deflateEnd(&zs);
+    return ok;
+}
+
+// Reads until size bytes are read or the input ends.
+ssize_t readBlock(int fd, char* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, data + total, size - total));
+        if (n < 0) {
+            return -1;
+        } else if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+bool dumpRawBuffer(const std::string& inPath, const std::string& outPath) {
+    unique_fd inFd(open(inPath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+    if (inFd == -1) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", inPath.c_str(),
+                strerror(errno), errno);
+        return false;
+    }
+    unique_fd outFd(open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (outFd == -1) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", outPath.c_str(),
+                strerror(errno), errno);
+        return false;
+    }
+    TraceCopier copier(inFd, outFd);
+    if (!copier.drain()) {
+        fprintf(stderr, "error dumping %s: %s (%d)\n", inPath.c_str(),
+                strerror(errno), errno);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+TraceCopier::TraceCopier(int inFd, int outFd) : mIn(inFd), mOut(outFd), mSplice(false) {
+    struct stat st;
+    if (fstat(outFd, &st) != 0) {
+        return;
+    }
+    if (S_ISFIFO(st.st_mode)) {
+        mSplice = true;
+        return;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISSOCK(st.st_mode)) {
+        return;
+    }
+    // splice() refuses to write to files opened for appending, as with >>
+    const int flags = fcntl(outFd, F_GETFL);
+    if (flags == -1 || (flags & O_APPEND)) {
+        return;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return;
+    }
+    mPipeRead.reset(fds[0]);
+    mPipeWrite.reset(fds[1]);
+    // A larger pipe moves more per call, if we're allowed one
+    fcntl(mPipeWrite, F_SETPIPE_SZ, kChunkSize);
+    mSplice = true;
+}
+
+ssize_t TraceCopier::copy(size_t size) {
+    if (!mSplice) {
+        return readWrite(size);
+    }
+    if (mPipeWrite == -1) {
+        ssize_t n = splice(mIn, nullptr, mOut, nullptr, size, SPLICE_F_MOVE);
+        if (n == -1 && errno == EINVAL) {
+            // The input can't be spliced from
+            mSplice = false;
+            return readWrite(size);
+        }
+        return n;
+    }
+
+    ssize_t n = splice(mIn, nullptr, mPipeWrite, nullptr, size, SPLICE_F_MOVE);
+    if (n == -1 && errno == EINVAL) {
+        mSplice = false;
+        return readWrite(size);
+    }
+    for (ssize_t left = n; left > 0;) {
+        ssize_t moved = splice(mPipeRead, nullptr, mOut, nullptr, left, SPLICE_F_MOVE);
+        if (moved == -1 && errno == EINTR) {
+            continue;
+        } else if (moved == -1 && errno == EINVAL) {
+            // The output can't be spliced to after all. What's already in
+            // the pipe is passed on by hand, and the rest read and written.
+            mSplice = false;
+            return emptyPipe(left) ? n : -1;
+        } else if (moved <= 0) {
+            return -1;
+        }
+        left -= moved;
+    }
+    return n;
+}
+
+bool TraceCopier::emptyPipe(size_t size) {
+    mBuffer.resize(kBufferSize);
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(mPipeRead, mBuffer.data(),
+                std::min(size, mBuffer.size())));
+        if (n <= 0 || !android::base::WriteFully(mOut, mBuffer.data(), n)) {
+            return false;
+        }
+        size -= n;
+    }
+    return true;
+}
+
+ssize_t TraceCopier::readWrite(size_t size) {
+    mBuffer.resize(kBufferSize);
+    ssize_t n = read(mIn, mBuffer.data(), std::min(size, mBuffer.size()));
+    if (n > 0 && !android::base::WriteFully(mOut, mBuffer.data(), n)) {
+        return -1;
+    }
+    return n;
+}
+
+bool TraceCopier::drain() {
+    auto copyAll = [this]() {
+        ssize_t n;
+        while ((n = TEMP_FAILURE_RETRY(copy(kChunkSize))) > 0) {
+        }
+        return n == 0 || errno == EAGAIN;
+    };
+    if (!copyAll()) {
+        return false;
+    }
+    if (mSplice) {
+        // splice() only takes whole pages out of trace_pipe_raw, leaving the
+        // last one, which is likely partly filled, to read()
+        mSplice = false;
+        return copyAll();
+    }
+    return true;
+}
+
+bool dumpRawBuffers(const std::string& traceFolder, const std::string& outDir) {
+    const std::string perCpu = traceFolder + "per_cpu/";
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(perCpu.c_str()), closedir);
+    if (!dir) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", perCpu.c_str(),
+                strerror(errno), errno);
+        return false;
+    }
+    std::vector<std::string> cpus;
+    struct dirent* de;
+    while ((de = readdir(dir.get())) != nullptr) {
+        if (strncmp(de->d_name, "cpu", 3) == 0) {
+            cpus.push_back(de->d_name);
+        }
+    }
+
+    // Each CPU has its own buffer, so they can all be emptied at once
+    std::unique_ptr<bool[]> results(new bool[cpus.size()]);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        threads.emplace_back([&, i]() {
+            results[i] = dumpRawBuffer(perCpu + cpus[i] + "/trace_pipe_raw",
+                    outDir + "/" + cpus[i]);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return std::all_of(results.get(), results.get() + cpus.size(), [](bool ok) { return ok; });
+}
+
+bool compressTrace(int inFd, int outFd, int threads) {
+    threads = std::max(1, threads);
+
+    std::mutex lock;
+    std::condition_variable changed;
+    // Blocks waiting to be deflated, and not yet written, both in order.
+    std::deque<std::shared_ptr<Block>> queued;
+    std::deque<std::shared_ptr<Block>> pending;
+    bool finished = false;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            std::unique_lock<std::mutex> guard(lock);
+            while (true) {
+                changed.wait(guard, [&]() { return finished || !queued.empty(); });
+                if (queued.empty()) {
+                    return;
+                }
+                auto block = queued.front();
+                queued.pop_front();
+                guard.unlock();
+                bool ok = deflateBlock(block.get());
+                guard.lock();
+                block->ok = ok;
+                block->done = true;
+                changed.notify_all();
+            }
+        });
+    }
+
+    bool ok = android::base::WriteFully(outFd, kZlibHeader, sizeof(kZlibHeader));
+    if (!ok) {
+        fprintf(stderr, "error writing deflated trace: %s (%d)\n", strerror(errno), errno);
+    }
+    uLong check = adler32(0L, Z_NULL, 0);
+
+    // Writes out the blocks that are done, in order, waiting for more to be
+    // done while over limit are pending.
+    auto flush = [&](size_t limit) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!pending.empty()) {
+            if (!pending.front()->done) {
+                if (pending.size() <= limit) {
+                    break;
+                }
+                changed.wait(guard);
+                continue;
+            }
+            auto block = pending.front();
+            pending.pop_front();
+            guard.unlock();
+            if (ok && !block->ok) {
+                fprintf(stderr, "error deflating trace\n");
+                ok = false;
+            }
+            if (ok && !android::base::WriteFully(outFd, block->output.data(),
+                    block->output.size())) {
+                fprintf(stderr, "error writing deflated trace: %s (%d)\n",
+                        strerror(errno), errno);
+                ok = false;
+            }
+            check = adler32_combine(check, block->check, block->input.size());
+            guard.lock();
+        }
+    };
+
+    std::string window;
+    while (ok) {
+        auto block = std::make_shared<Block>();
+        block->input.resize(kBlockSize);
+        ssize_t size = readBlock(inFd, &block->input[0], kBlockSize);
+        if (size < 0) {
+            fprintf(stderr, "error reading trace: %s (%d)\n", strerror(errno), errno);
+            ok = false;
+            break;
+        } else if (size == 0) {
+            break;
+        }
+        block->input.resize(size);
+        block->dictionary = window;
+        if (block->input.size() >= kWindowSize) {
+            window.assign(block->input, block->input.size() - kWindowSize, kWindowSize);
+        } else {
+            window.append(block->input);
+            if (window.size() > kWindowSize) {
+                window.erase(0, window.size() - kWindowSize);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queued.push_back(block);
+            pending.push_back(block);
+            changed.notify_all();
+        }
+        flush(2 * threads);
+    }
+    flush(0);
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished = true;
+        changed.notify_all();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (ok) {
+        const uint8_t trailer[] = {
+            kFinalBlock[0], kFinalBlock[1],
+            static_cast<uint8_t>(check >> 24), static_cast<uint8_t>(check >> 16),
+            static_cast<uint8_t>(check >> 8), static_cast<uint8_t>(check),
+        };
+        ok = android::base::WriteFully(outFd, trailer, sizeof(trailer));
+        if (!ok) {
+            fprintf(stderr, "error writing deflated trace: %s (%d)\n", strerror(errno), errno);
+        }
+    }
+    return ok;
+}
+
+}  // namespace android
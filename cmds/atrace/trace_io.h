@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORK_NATIVE_CMD_ATRACE_TRACE_IO_H_
+#define FRAMEWORK_NATIVE_CMD_ATRACE_TRACE_IO_H_
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+
+namespace android {
+
+/**
+ * Moves data from one file to another with splice(), so that it never passes
+ * through user space, when the output is a pipe, or a socket or regular file
+ * not opened for appending, and the input supports it; and with read() and
+ * write() otherwise.
+ */
+class TraceCopier {
+  public:
+    TraceCopier(int inFd, int outFd);
+
+    /**
+     * Moves up to size bytes, returning how many, 0 at the end of the input,
+     * or -1 with errno set.
+     */
+    ssize_t copy(size_t size);
+
+    /**
+     * Copies until the end of the input, or until reading it would block,
+     * returning false on error.
+     */
+    bool drain();
+
+    bool usingSplice() const { return mSplice; }
+
+    static constexpr size_t kChunkSize = 1024 * 1024;
+
+  private:
+    ssize_t readWrite(size_t size);
+    // Writes out the next size bytes waiting in the pipe.
+    bool emptyPipe(size_t size);
+
+    const int mIn;
+    const int mOut;
+    bool mSplice;
+    // Stands between the two files when the output isn't a pipe itself.
+    android::base::unique_fd mPipeRead;
+    android::base::unique_fd mPipeWrite;
+    std::vector<char> mBuffer;
+
+    DISALLOW_COPY_AND_ASSIGN(TraceCopier);
+};
+
+/**
+ * Moves what's left in every per_cpu/cpuN/trace_pipe_raw of the trace folder
+ * into outDir/cpuN, one thread per CPU. Returns false if any of them failed.
+ */
+bool dumpRawBuffers(const std::string& traceFolder, const std::string& outDir);
+
+/**
+ * Compresses inFd into outFd as a single zlib stream, like deflate() would,
+ * with blocks of the input deflated on the given number of threads at once.
+ * Returns false on error.
+ */
+bool compressTrace(int inFd, int outFd, int threads);
+
+}  // namespace android
+
+#endif  // FRAMEWORK_NATIVE_CMD_ATRACE_TRACE_IO_H_
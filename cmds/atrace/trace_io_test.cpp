@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <random>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+
+#include "trace_io.h"
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+namespace android {
+namespace {
+
+// The size of the blocks compressTrace() deflates on their own.
+constexpr size_t kBlockSize = 256 * 1024;
+
+// Lines of a text trace, with a run of incompressible bytes now and then.
+std::string makeTrace(size_t size) {
+    std::mt19937 rng(size);
+    std::string trace;
+    while (trace.size() < size) {
+        if (rng() % 8 == 0) {
+            for (int i = 0; i < 64; i++) {
+                trace += static_cast<char>(rng());
+            }
+            continue;
+        }
+        const unsigned pid = rng() % 4000;
+        const unsigned cpu = rng() % 8;
+        const unsigned usecs = rng() % 1000000;
+        trace += StringPrintf("RenderThread-%u [%03u] 1234.%06u: sched_switch: prev_pid=%u\n",
+                pid, cpu, usecs, pid);
+    }
+    trace.resize(size);
+    return trace;
+}
+
+// Fills a temporary file with contents, to be read from the start.
+void writeTempFile(const TemporaryFile& file, const std::string& contents) {
+    ASSERT_TRUE(android::base::WriteStringToFd(contents, file.fd));
+    ASSERT_EQ(0, lseek(file.fd, 0, SEEK_SET));
+}
+
+TEST(TraceIoTest, CompressTraceRoundTrips) {
+    const size_t sizes[] = { 0, 1, kBlockSize - 1, kBlockSize, kBlockSize + 1, 2 * kBlockSize,
+            3 * 1024 * 1024 };
+    for (int threads : { 1, 4 }) {
+        for (size_t size : sizes) {
+            SCOPED_TRACE(StringPrintf("%zu bytes on %d threads", size, threads));
+            const std::string trace = makeTrace(size);
+            TemporaryFile in;
+            TemporaryFile out;
+            writeTempFile(in, trace);
+            ASSERT_TRUE(compressTrace(in.fd, out.fd, threads));
+
+            std::string compressed;
+            ASSERT_TRUE(android::base::ReadFileToString(out.path, &compressed));
+            // A byte to spare shows up anything past the end of the trace
+            std::string uncompressed(size + 1, '\0');
+            uLongf length = uncompressed.size();
+            ASSERT_EQ(Z_OK, uncompress(reinterpret_cast<Bytef*>(&uncompressed[0]), &length,
+                    reinterpret_cast<const Bytef*>(compressed.data()), compressed.size()));
+            ASSERT_EQ(size, length);
+            uncompressed.resize(length);
+            EXPECT_TRUE(trace == uncompressed);
+        }
+    }
+}
+
+TEST(TraceIoTest, DrainSplicesToFile) {
+    const std::string trace = makeTrace(3 * TraceCopier::kChunkSize + 123);
+    TemporaryFile in;
+    TemporaryFile out;
+    writeTempFile(in, trace);
+
+    TraceCopier copier(in.fd, out.fd);
+    EXPECT_TRUE(copier.usingSplice());
+    ASSERT_TRUE(copier.drain());
+
+    std::string copied;
+    ASSERT_TRUE(android::base::ReadFileToString(out.path, &copied));
+    EXPECT_EQ(trace.size(), copied.size());
+    EXPECT_TRUE(trace == copied);
+}
+
+TEST(TraceIoTest, DrainWritesToAppendedFile) {
+    const std::string prefix = "already there\n";
+    const std::string trace = makeTrace(3 * TraceCopier::kChunkSize + 123);
+    TemporaryFile in;
+    TemporaryFile out;
+    writeTempFile(in, trace);
+    writeTempFile(out, prefix);
+
+    // As with atrace >> file, which splice() can't write to.
+    unique_fd append(open(out.path, O_WRONLY | O_APPEND | O_CLOEXEC));
+    ASSERT_NE(-1, append.get());
+    TraceCopier copier(in.fd, append);
+    EXPECT_FALSE(copier.usingSplice());
+    ASSERT_TRUE(copier.drain());
+
+    std::string copied;
+    ASSERT_TRUE(android::base::ReadFileToString(out.path, &copied));
+    EXPECT_EQ(prefix.size() + trace.size(), copied.size());
+    EXPECT_TRUE(prefix + trace == copied);
+}
+
+TEST(TraceIoTest, DrainKeepsPipedDataWhenOutputRefusesSplice) {
+    const std::string trace = makeTrace(3 * TraceCopier::kChunkSize + 123);
+    TemporaryFile in;
+    TemporaryFile out;
+    writeTempFile(in, trace);
+
+    TraceCopier copier(in.fd, out.fd);
+    ASSERT_TRUE(copier.usingSplice());
+    // The first chunk makes it into the pipe before the output turns it down.
+    ASSERT_EQ(0, fcntl(out.fd, F_SETFL, O_APPEND));
+    ASSERT_TRUE(copier.drain());
+    EXPECT_FALSE(copier.usingSplice());
+
+    std::string copied;
+    ASSERT_TRUE(android::base::ReadFileToString(out.path, &copied));
+    EXPECT_EQ(trace.size(), copied.size());
+    EXPECT_TRUE(trace == copied);
+}
+
+TEST(TraceIoTest, DrainReadsAndWritesToTerminal) {
+    // A pseudo-terminal in raw mode passes through what's written to it, and
+    // can't be spliced to.
+    unique_fd master(posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC));
+    ASSERT_NE(-1, master.get());
+    ASSERT_EQ(0, grantpt(master));
+    ASSERT_EQ(0, unlockpt(master));
+    char name[64];
+    ASSERT_EQ(0, ptsname_r(master, name, sizeof(name)));
+    unique_fd slave(open(name, O_RDWR | O_NOCTTY | O_CLOEXEC));
+    ASSERT_NE(-1, slave.get());
+    struct termios tio;
+    ASSERT_EQ(0, tcgetattr(slave, &tio));
+    cfmakeraw(&tio);
+    ASSERT_EQ(0, tcsetattr(slave, TCSANOW, &tio));
+
+    const std::string trace = makeTrace(kBlockSize + 123);
+    TemporaryFile in;
+    writeTempFile(in, trace);
+
+    std::string copied;
+    std::thread reader([&]() {
+        char buffer[4096];
+        struct pollfd pfd = { .fd = slave, .events = POLLIN, .revents = 0 };
+        while (copied.size() < trace.size() && poll(&pfd, 1, 10000) == 1) {
+            ssize_t n = read(slave, buffer, sizeof(buffer));
+            if (n <= 0) {
+                break;
+            }
+            copied.append(buffer, n);
+        }
+    });
+    TraceCopier copier(in.fd, master);
+    EXPECT_FALSE(copier.usingSplice());
+    EXPECT_TRUE(copier.drain());
+    reader.join();
+
+    EXPECT_EQ(trace.size(), copied.size());
+    EXPECT_TRUE(trace == copied);
+}
+
+}  // namespace
+}  // namespace android
@@ -16,6 +16,7 @@
 
 #include "CacheItem.h"
 
+#include <fts.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <sys/xattr.h>
@@ -30,22 +31,19 @@ using android::base::StringPrintf;
 namespace android {
 namespace installd {
 
-CacheItem::CacheItem(FTSENT* p) {
-    level = p->fts_level;
-    directory = S_ISDIR(p->fts_statp->st_mode);
-    size = p->fts_statp->st_blocks * 512;
-    modified = p->fts_statp->st_mtime;
-
-    mParent = static_cast<CacheItem*>(p->fts_parent->fts_pointer);
+CacheItem::CacheItem(CacheItem* parent, const std::string& name, short level, bool directory,
+        int64_t size, time_t modified)
+      : level(level), directory(directory), size(size), modified(modified) {
+    mParent = parent;
     if (mParent) {
         group = mParent->group;
         tombstone = mParent->tombstone;
-        mName = p->fts_name;
+        mName = name;
         mName.insert(0, "/");
     } else {
         group = false;
         tombstone = false;
-        mName = p->fts_path;
+        mName = name;
     }
 }
 
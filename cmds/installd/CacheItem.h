@@ -20,7 +20,6 @@
 #include <memory>
 #include <string>
 
-#include <fts.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -36,7 +35,13 @@ namespace installd {
  */
 class CacheItem {
 public:
-    CacheItem(FTSENT* p);
+    /**
+     * Item for a file or directory named name in the directory of parent,
+     * from whom group and tombstone are inherited. Without parent, name is
+     * the full path.
+     */
+    CacheItem(CacheItem* parent, const std::string& name, short level, bool directory,
+            int64_t size, time_t modified);
     ~CacheItem();
 
     std::string toString();
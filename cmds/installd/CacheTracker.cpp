@@ -18,7 +18,9 @@
 
 #include "CacheTracker.h"
 
-#include <fts.h>
+#include <algorithm>
+#include <deque>
+
 #include <sys/xattr.h>
 #include <utils/Trace.h>
 
@@ -26,6 +28,7 @@
 #include <android-base/stringprintf.h>
 
 #include "QuotaUtils.h"
+#include "TreeWalker.h"
 #include "utils.h"
 
 using android::base::StringPrintf;
@@ -94,75 +97,118 @@ bool CacheTracker::loadQuotaStats() {
     }
 }
 
-void CacheTracker::loadItemsFrom(const std::string& path) {
-    FTS *fts;
-    FTSENT *p;
-    char *argv[] = { (char*) path.c_str(), nullptr };
-    if (!(fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, nullptr))) {
-        PLOG(WARNING) << "Failed to fts_open " << path;
-        return;
+namespace {
+
+// A file or directory found while walking a cache directory. Items are only
+// created once the walk is done, since the contents of groups are folded into
+// them rather than tracked.
+struct CacheNode {
+    std::string name;
+    bool directory;
+    bool group = false;
+    bool tombstone = false;
+    int64_t size;
+    time_t modified;
+    std::vector<CacheNode*> children;
+};
+
+// Creates items in the same order fts_read() reports entries, with group and
+// tombstone inherited and modified times bubbled up to parents.
+class ItemBuilder {
+public:
+    ItemBuilder(const std::shared_ptr<std::deque<CacheItem>>& arena,
+            std::vector<std::shared_ptr<CacheItem>>* items)
+          : mArena(arena), mItems(items) {
     }
-    while ((p = fts_read(fts)) != nullptr) {
-        if (p->fts_level == 0) continue;
-
-        // Create tracking nodes for everything we encounter
-        switch (p->fts_info) {
-        case FTS_D:
-        case FTS_DEFAULT:
-        case FTS_F:
-        case FTS_SL:
-        case FTS_SLNONE: {
-            auto item = std::shared_ptr<CacheItem>(new CacheItem(p));
-            p->fts_pointer = static_cast<void*>(item.get());
-            items.push_back(item);
-        }
+
+    CacheItem* add(const CacheNode& node, CacheItem* parent, const std::string& name,
+            short level) {
+        CacheItem* item = &mArena->emplace_back(parent, name, level, node.directory, node.size,
+                node.modified);
+        // Shares ownership of the arena rather than allocating per item.
+        mItems->push_back(std::shared_ptr<CacheItem>(mArena, item));
+        if (!node.directory) {
+            return item;
         }
 
-        switch (p->fts_info) {
-        case FTS_D: {
-            auto item = static_cast<CacheItem*>(p->fts_pointer);
-            item->group |= (getxattr(p->fts_path, kXattrCacheGroup, nullptr, 0) >= 0);
-            item->tombstone |= (getxattr(p->fts_path, kXattrCacheTombstone, nullptr, 0) >= 0);
-
-            // When group, immediately collect all files under tree
-            if (item->group) {
-                while ((p = fts_read(fts)) != nullptr) {
-                    if (p->fts_info == FTS_DP && p->fts_level == item->level) break;
-                    switch (p->fts_info) {
-                    case FTS_D:
-                    case FTS_DEFAULT:
-                    case FTS_F:
-                    case FTS_SL:
-                    case FTS_SLNONE:
-                        item->size += p->fts_statp->st_blocks * 512;
-                        item->modified = std::max(item->modified, p->fts_statp->st_mtime);
-                    }
-                }
+        item->group |= node.group;
+        item->tombstone |= node.tombstone;
+        if (item->group) {
+            // When group, collect all files under tree
+            for (const auto child : node.children) {
+                addGroup(*child, item);
+            }
+        } else {
+            for (const auto child : node.children) {
+                auto childItem = add(*child, item, child->name, level + 1);
+                item->modified = std::max(item->modified, childItem->modified);
             }
         }
+        return item;
+    }
+
+private:
+    static void addGroup(const CacheNode& node, CacheItem* item) {
+        item->size += node.size;
+        item->modified = std::max(item->modified, node.modified);
+        for (const auto child : node.children) {
+            addGroup(*child, item);
         }
+    }
 
-        // Bubble up modified time to parent
-        CHECK(p != nullptr);
-        switch (p->fts_info) {
-        case FTS_DP:
-        case FTS_DEFAULT:
-        case FTS_F:
-        case FTS_SL:
-        case FTS_SLNONE: {
-            auto item = static_cast<CacheItem*>(p->fts_pointer);
-            auto parent = static_cast<CacheItem*>(p->fts_parent->fts_pointer);
-            if (parent) {
-                parent->modified = std::max(parent->modified, item->modified);
-            }
+    const std::shared_ptr<std::deque<CacheItem>>& mArena;
+    std::vector<std::shared_ptr<CacheItem>>* mItems;
+};
+
+}  // namespace
+
+void CacheTracker::loadItemsFrom(const std::string& path) {
+    // Each thread of the walk allocates nodes from its own arena, and only
+    // appends to the children of the directories it reads.
+    TreeWalker walker;
+    std::vector<std::deque<CacheNode>> arenas(walker.threads());
+    CacheNode* root = nullptr;
+    auto visit = [&](TreeWalker::Entry* entry) {
+        CacheNode& node = arenas[entry->worker].emplace_back();
+        node.name = entry->name;
+        node.directory = S_ISDIR(entry->st->st_mode);
+        node.size = entry->st->st_blocks * 512;
+        node.modified = entry->st->st_mtime;
+        if (entry->parent) {
+            static_cast<CacheNode*>(entry->parent)->children.push_back(&node);
+        } else {
+            root = &node;
         }
+        entry->cookie = &node;
+        return true;
+    };
+    auto enter = [](int fd, void* cookie, size_t) {
+        auto node = static_cast<CacheNode*>(cookie);
+        node->group = (fgetxattr(fd, kXattrCacheGroup, nullptr, 0) >= 0);
+        node->tombstone = (fgetxattr(fd, kXattrCacheTombstone, nullptr, 0) >= 0);
+        return true;
+    };
+    if (walker.walk(path, visit, enter) != 0) {
+        if (errno != ENOENT) {
+            PLOG(WARNING) << "Failed to walk " << path;
         }
+        return;
+    }
+
+    // The root itself isn't tracked, so its children carry the full path.
+    std::string prefix = path;
+    if (prefix.empty() || prefix.back() != '/') {
+        prefix += '/';
+    }
+    ItemBuilder builder(mItemArena, &items);
+    for (const auto child : root->children) {
+        builder.add(*child, nullptr, prefix + child->name, 1);
     }
-    fts_close(fts);
 }
 
 void CacheTracker::loadItems() {
     items.clear();
+    mItemArena = std::make_shared<std::deque<CacheItem>>();
 
     ATRACE_BEGIN("loadItems");
     for (const auto& path : mDataPaths) {
@@ -17,6 +17,7 @@
 #ifndef ANDROID_INSTALLD_CACHE_TRACKER_H
 #define ANDROID_INSTALLD_CACHE_TRACKER_H
 
+#include <deque>
 #include <memory>
 #include <string>
 #include <queue>
@@ -56,6 +57,7 @@ public:
     int64_t cacheUsed;
     int64_t cacheQuota;
 
+    // Items share ownership of the arena they're allocated from.
     std::vector<std::shared_ptr<CacheItem>> items;
 
 private:
@@ -65,6 +67,7 @@ private:
     const std::string& mUuid;
 
     std::vector<std::string> mDataPaths;
+    std::shared_ptr<std::deque<CacheItem>> mItemArena;
 
     bool loadQuotaStats();
     void loadItemsFrom(const std::string& path);
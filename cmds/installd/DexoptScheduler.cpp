@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DexoptScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <android-base/file.h>
+
+namespace android {
+namespace installd {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int64_t toMillis(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+}  // namespace
+
+DexoptScheduler::DexoptScheduler(size_t maxJobs, int maxThreads,
+        const MemoryProbe& availableMemory)
+      : mMaxJobs(std::max<size_t>(1, maxJobs)),
+        mMaxThreads(maxThreads),
+        mAvailableMemory(availableMemory) {
+}
+
+int64_t DexoptScheduler::readAvailableMemory() {
+    std::string meminfo;
+    if (!android::base::ReadFileToString("/proc/meminfo", &meminfo)) {
+        return -1;
+    }
+    const char* line = strstr(meminfo.c_str(), "MemAvailable:");
+    int64_t kb;
+    if (line == nullptr || sscanf(line, "MemAvailable: %" SCNd64 " kB", &kb) != 1) {
+        return -1;
+    }
+    return kb * 1024;
+}
+
+std::vector<DexoptScheduler::Result> DexoptScheduler::run(std::vector<Job> jobs) const {
+    const auto start = Clock::now();
+    std::vector<Result> results(jobs.size());
+    std::vector<bool> started(jobs.size());
+    std::vector<std::thread> workers;
+
+    // Guards everything below, which workers update as they finish.
+    std::mutex lock;
+    std::condition_variable finished;
+    std::set<std::string> busyPackages;
+    size_t running = 0;
+    int threads = 0;
+    int64_t memory = 0;
+
+    // Memory taken by running jobs may be counted twice, as their estimate
+    // and as no longer available, which errs on the side of starting fewer.
+    auto admit = [&](const Job& job) {
+        if (running == 0) {
+            return true;
+        }
+        if (running >= mMaxJobs || threads + job.threads > mMaxThreads) {
+            return false;
+        }
+        const int64_t available = mAvailableMemory ? mAvailableMemory() : -1;
+        return available < 0 || memory + job.memory + kReservedMemory <= available;
+    };
+
+    std::unique_lock<std::mutex> guard(lock);
+    size_t next = 0;
+    while (next < jobs.size()) {
+        // The first job that isn't waiting on its package goes next
+        size_t i = next;
+        while (i < jobs.size() && (started[i] || busyPackages.count(jobs[i].packageName))) {
+            i++;
+        }
+        if (i == jobs.size() || !admit(jobs[i])) {
+            finished.wait(guard);
+            continue;
+        }
+
+        started[i] = true;
+        busyPackages.insert(jobs[i].packageName);
+        running++;
+        threads += jobs[i].threads;
+        memory += jobs[i].memory;
+        workers.emplace_back([&, i] {
+            const auto begin = Clock::now();
+            Result& result = results[i];
+            result.waitMillis = toMillis(begin - start);
+            result.status = jobs[i].run(&result.errorMessage);
+            result.runMillis = toMillis(Clock::now() - begin);
+
+            std::lock_guard<std::mutex> workerGuard(lock);
+            busyPackages.erase(jobs[i].packageName);
+            running--;
+            threads -= jobs[i].threads;
+            memory -= jobs[i].memory;
+            finished.notify_one();
+        });
+        while (next < jobs.size() && started[next]) {
+            next++;
+        }
+    }
+    finished.wait(guard, [&] { return running == 0; });
+    guard.unlock();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return results;
+}
+
+}  // namespace installd
+}  // namespace android
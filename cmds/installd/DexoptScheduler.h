@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_DEXOPT_SCHEDULER_H
+#define ANDROID_INSTALLD_DEXOPT_SCHEDULER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace installd {
+
+/**
+ * Runs a batch of compilations, several at a time, as resources allow.
+ *
+ * Jobs are started in order, each once there are enough compiler threads
+ * left in the budget and enough memory available for it, so that a large
+ * job isn't overtaken forever by smaller ones behind it. Jobs of the same
+ * package never run at once, since they share profiles and output
+ * directories; jobs of a package that's busy are passed over in the
+ * meantime. A job is always started when nothing else is running, however
+ * large it is.
+ */
+class DexoptScheduler {
+public:
+    struct Job {
+        std::string packageName;
+        // Number of compiler threads and bytes of memory the job will use.
+        int threads = 1;
+        int64_t memory = 0;
+        // Runs the job on a thread of its own, returning 0 on success or an
+        // error code along with a message.
+        std::function<int(std::string* error_msg)> run;
+    };
+
+    struct Result {
+        int status = 0;
+        std::string errorMessage;
+        // Time spent waiting to be started since run() was called, and then
+        // running.
+        int64_t waitMillis = 0;
+        int64_t runMillis = 0;
+    };
+
+    // Returns the memory currently available in bytes, or -1 if unknown.
+    using MemoryProbe = std::function<int64_t()>;
+
+    DexoptScheduler(size_t maxJobs, int maxThreads,
+            const MemoryProbe& availableMemory = readAvailableMemory);
+
+    /**
+     * Runs all jobs, returning once they're done with a result for each, in
+     * the same order.
+     */
+    std::vector<Result> run(std::vector<Job> jobs) const;
+
+    // Returns MemAvailable from /proc/meminfo, or -1 when it can't be read.
+    static int64_t readAvailableMemory();
+
+    // Memory left for the rest of the system when admitting jobs.
+    static constexpr int64_t kReservedMemory = 256 * 1024 * 1024;
+
+private:
+    const size_t mMaxJobs;
+    const int mMaxThreads;
+    const MemoryProbe mAvailableMemory;
+
+    DISALLOW_COPY_AND_ASSIGN(DexoptScheduler);
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_DEXOPT_SCHEDULER_H
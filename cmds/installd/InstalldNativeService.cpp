@@ -53,7 +53,6 @@
 #include <cutils/properties.h>
 #include <cutils/sched_policy.h>
 #include <log/log.h>               // TODO: Move everything to base/logging.
-#include <logwrap/logwrap.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_projectid_config.h>
 #include <selinux/android.h>
@@ -69,8 +68,10 @@
 
 #include "CacheTracker.h"
 #include "CrateManager.h"
+#include "DexoptScheduler.h"
 #include "MatchExtensionGen.h"
 #include "QuotaUtils.h"
+#include "TreeCopier.h"
 
 #ifndef LOG_TAG
 #define LOG_TAG "installd"
@@ -88,7 +89,6 @@ static constexpr const char* kTestUuid = "TEST";
 
 static constexpr const mode_t kRollbackFolderMode = 0700;
 
-static constexpr const char* kCpPath = "/system/bin/cp";
 static constexpr const char* kXattrDefault = "user.default";
 
 static constexpr const char* kDataMirrorCePath = "/data_mirror/data_ce";
@@ -114,6 +114,10 @@ static constexpr const char* kAppDataIsolationEnabledProperty = "persist.zygote.
 static constexpr const char* kMntSdcardfs = "/mnt/runtime/default/";
 static constexpr const char* kMntFuse = "/mnt/pass_through/0/";
 
+// Most dex2oat invocations dexoptBatch() runs at once, on top of its budget
+// of compiler threads and memory.
+static constexpr size_t kDexoptBatchMaxJobs = 4;
+
 static std::atomic<bool> sAppDataIsolationEnabled(false);
 
 namespace {
@@ -618,6 +622,7 @@ binder::Status InstalldNativeService::clearAppData(const std::unique_ptr<std::st
                 remove_path_xattr(path, kXattrInodeCodeCache);
             }
         }
+        mSizeIndex.invalidate(path);
     }
     if (flags & FLAG_STORAGE_DE) {
         std::string suffix = "";
@@ -636,8 +641,13 @@ binder::Status InstalldNativeService::clearAppData(const std::unique_ptr<std::st
                 res = error("Failed to delete contents of " + path);
             }
         }
+        mSizeIndex.invalidate(path);
     }
     if (flags & FLAG_STORAGE_EXTERNAL) {
+        // Measured through /data/media rather than the mounts cleared below
+        mSizeIndex.invalidate(create_data_media_package_path(uuid_, userId, "data", pkgname));
+        mSizeIndex.invalidate(create_data_media_package_path(uuid_, userId, "media", pkgname));
+
         std::lock_guard<std::recursive_mutex> lock(mMountsLock);
         for (const auto& n : mStorageMounts) {
             auto extPath = n.second;
@@ -728,21 +738,31 @@ binder::Status InstalldNativeService::destroyAppData(const std::unique_ptr<std::
         if (delete_dir_contents_and_dir(path) != 0) {
             res = error("Failed to delete " + path);
         }
+        mSizeIndex.invalidate(path);
     }
     if (flags & FLAG_STORAGE_DE) {
         auto path = create_data_user_de_package_path(uuid_, userId, pkgname);
         if (delete_dir_contents_and_dir(path) != 0) {
             res = error("Failed to delete " + path);
         }
+        mSizeIndex.invalidate(path);
         if ((flags & FLAG_CLEAR_APP_DATA_KEEP_ART_PROFILES) == 0) {
             destroy_app_current_profiles(packageName, userId);
             // TODO(calin): If the package is still installed by other users it's probably
             // beneficial to keep the reference profile around.
             // Verify if it's ok to do that.
             destroy_app_reference_profile(packageName);
+            mSizeIndex.invalidate(create_primary_current_profile_package_dir_path(userId,
+                    packageName));
+            mSizeIndex.invalidate(create_primary_reference_profile_package_dir_path(packageName));
         }
     }
     if (flags & FLAG_STORAGE_EXTERNAL) {
+        // Measured through /data/media rather than the mounts destroyed below
+        for (const char* type : { "data", "media", "obb" }) {
+            mSizeIndex.invalidate(create_data_media_package_path(uuid_, userId, type, pkgname));
+        }
+
         std::lock_guard<std::recursive_mutex> lock(mMountsLock);
         for (const auto& n : mStorageMounts) {
             auto extPath = n.second;
@@ -887,20 +907,16 @@ binder::Status InstalldNativeService::fixupAppData(const std::unique_ptr<std::st
     return ok();
 }
 
+// Copies from into the directory to, preserving what "cp -F -p -R -P -d"
+// would, without forking a cp that copies file contents through userspace.
 static int32_t copy_directory_recursive(const char* from, const char* to) {
-    char *argv[] = {
-        (char*) kCpPath,
-        (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-        (char*) "-p", /* preserve timestamps, ownership, and permissions */
-        (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-        (char*) "-P", /* Do not follow symlinks [default] */
-        (char*) "-d", /* don't dereference symlinks */
-        (char*) from,
-        (char*) to
-    };
-
     LOG(DEBUG) << "Copying " << from << " to " << to;
-    return logwrap_fork_execvp(ARRAY_SIZE(argv), argv, nullptr, false, LOG_ALOG, false, nullptr);
+    ATRACE_BEGIN("copy_directory_recursive");
+    TreeCopier copier;
+    int32_t rc = copier.copy(from, to) == 0 ? 0 : errno;
+    LOG(DEBUG) << "Copied " << copier.files() << " files (" << copier.bytes() << " bytes)";
+    ATRACE_END();
+    return rc;
 }
 
 binder::Status InstalldNativeService::snapshotAppData(
@@ -1626,7 +1642,10 @@ static void collectQuotaStats(const std::string& uuid, int32_t userId,
     }
 }
 
-static void collectManualStats(const std::string& path, struct stats* stats) {
+// Measures the trees in path with index when given one, remembering them for
+// later only while installd runs unless persist is set.
+static void collectManualStats(const std::string& path, struct stats* stats, SizeIndex* index,
+        bool persist) {
     DIR *d;
     int dfd;
     struct dirent *de;
@@ -1657,7 +1676,12 @@ static void collectManualStats(const std::string& path, struct stats* stats) {
             } else {
                 // Measure all children nodes
                 size = 0;
-                calculate_tree_size(StringPrintf("%s/%s", path.c_str(), name), &size);
+                const std::string child = StringPrintf("%s/%s", path.c_str(), name);
+                if (index != nullptr) {
+                    index->calculateTreeSize(child, &size, persist);
+                } else {
+                    calculate_tree_size(child, &size);
+                }
             }
 
             if (!strcmp(name, "cache") || !strcmp(name, "code_cache")) {
@@ -1677,7 +1701,7 @@ static void collectManualStats(const std::string& path, struct stats* stats) {
 }
 
 static void collectManualStatsForUser(const std::string& path, struct stats* stats,
-        bool exclude_apps = false) {
+        SizeIndex* index, bool persist, bool exclude_apps = false) {
     DIR *d;
     int dfd;
     struct dirent *de;
@@ -1703,7 +1727,8 @@ static void collectManualStatsForUser(const std::string& path, struct stats* sta
             } else if (exclude_apps && (user_uid >= AID_APP_START && user_uid <= AID_APP_END)) {
                 continue;
             } else {
-                collectManualStats(StringPrintf("%s/%s", path.c_str(), name), stats);
+                collectManualStats(StringPrintf("%s/%s", path.c_str(), name), stats, index,
+                        persist);
             }
         }
     }
@@ -1791,15 +1816,22 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
         flags &= ~FLAG_USE_QUOTA;
     }
 
+    // The size index only stands in for quotas, so it's left alone when they're used
+    const bool useQuota = flags & FLAG_USE_QUOTA && appId >= AID_APP_START;
+
     ATRACE_BEGIN("obb");
     for (const auto& packageName : packageNames) {
         auto obbCodePath = create_data_media_package_path(uuid_, userId,
                 "obb", packageName.c_str());
-        calculate_tree_size(obbCodePath, &extStats.codeSize);
+        if (useQuota) {
+            calculate_tree_size(obbCodePath, &extStats.codeSize);
+        } else {
+            mSizeIndex.calculateTreeSize(obbCodePath, &extStats.codeSize, false);
+        }
     }
     ATRACE_END();
 
-    if (flags & FLAG_USE_QUOTA && appId >= AID_APP_START) {
+    if (useQuota) {
         ATRACE_BEGIN("code");
         for (const auto& codePath : codePaths) {
             calculate_tree_size(codePath, &stats.codeSize, -1,
@@ -1813,7 +1845,7 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
     } else {
         ATRACE_BEGIN("code");
         for (const auto& codePath : codePaths) {
-            calculate_tree_size(codePath, &stats.codeSize);
+            mSizeIndex.calculateTreeSize(codePath, &stats.codeSize);
         }
         ATRACE_END();
 
@@ -1822,17 +1854,17 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
 
             ATRACE_BEGIN("data");
             auto cePath = create_data_user_ce_package_path(uuid_, userId, pkgname, ceDataInodes[i]);
-            collectManualStats(cePath, &stats);
+            collectManualStats(cePath, &stats, &mSizeIndex, false);
             auto dePath = create_data_user_de_package_path(uuid_, userId, pkgname);
-            collectManualStats(dePath, &stats);
+            collectManualStats(dePath, &stats, &mSizeIndex, true);
             ATRACE_END();
 
             if (!uuid) {
                 ATRACE_BEGIN("profiles");
-                calculate_tree_size(
+                mSizeIndex.calculateTreeSize(
                         create_primary_current_profile_package_dir_path(userId, pkgname),
                         &stats.dataSize);
-                calculate_tree_size(
+                mSizeIndex.calculateTreeSize(
                         create_primary_reference_profile_package_dir_path(pkgname),
                         &stats.codeSize);
                 ATRACE_END();
@@ -1840,9 +1872,9 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
 
             ATRACE_BEGIN("external");
             auto extPath = create_data_media_package_path(uuid_, userId, "data", pkgname);
-            collectManualStats(extPath, &extStats);
+            collectManualStats(extPath, &extStats, &mSizeIndex, false);
             auto mediaPath = create_data_media_package_path(uuid_, userId, "media", pkgname);
-            calculate_tree_size(mediaPath, &extStats.dataSize);
+            mSizeIndex.calculateTreeSize(mediaPath, &extStats.dataSize, false);
             ATRACE_END();
         }
 
@@ -1855,6 +1887,8 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
             }
             ATRACE_END();
         }
+
+        mSizeIndex.save();
     }
 
     std::vector<int64_t> ret;
@@ -2005,9 +2039,9 @@ binder::Status InstalldNativeService::getUserSize(const std::unique_ptr<std::str
 
         ATRACE_BEGIN("data");
         auto cePath = create_data_user_ce_path(uuid_, userId);
-        collectManualStatsForUser(cePath, &stats, true);
+        collectManualStatsForUser(cePath, &stats, nullptr, false, true);
         auto dePath = create_data_user_de_path(uuid_, userId);
-        collectManualStatsForUser(dePath, &stats, true);
+        collectManualStatsForUser(dePath, &stats, nullptr, false, true);
         ATRACE_END();
 
         if (!uuid) {
@@ -2049,26 +2083,26 @@ binder::Status InstalldNativeService::getUserSize(const std::unique_ptr<std::str
     } else {
         ATRACE_BEGIN("obb");
         auto obbPath = create_data_path(uuid_) + "/media/obb";
-        calculate_tree_size(obbPath, &extStats.codeSize);
+        mSizeIndex.calculateTreeSize(obbPath, &extStats.codeSize, false);
         ATRACE_END();
 
         ATRACE_BEGIN("code");
-        calculate_tree_size(create_data_app_path(uuid_), &stats.codeSize);
+        mSizeIndex.calculateTreeSize(create_data_app_path(uuid_), &stats.codeSize);
         ATRACE_END();
 
         ATRACE_BEGIN("data");
         auto cePath = create_data_user_ce_path(uuid_, userId);
-        collectManualStatsForUser(cePath, &stats);
+        collectManualStatsForUser(cePath, &stats, &mSizeIndex, false);
         auto dePath = create_data_user_de_path(uuid_, userId);
-        collectManualStatsForUser(dePath, &stats);
+        collectManualStatsForUser(dePath, &stats, &mSizeIndex, true);
         ATRACE_END();
 
         if (!uuid) {
             ATRACE_BEGIN("profile");
             auto userProfilePath = create_primary_cur_profile_dir_path(userId);
-            calculate_tree_size(userProfilePath, &stats.dataSize);
+            mSizeIndex.calculateTreeSize(userProfilePath, &stats.dataSize);
             auto refProfilePath = create_primary_ref_profile_dir_path();
-            calculate_tree_size(refProfilePath, &stats.codeSize);
+            mSizeIndex.calculateTreeSize(refProfilePath, &stats.codeSize);
             ATRACE_END();
         }
 
@@ -2083,10 +2117,13 @@ binder::Status InstalldNativeService::getUserSize(const std::unique_ptr<std::str
 
         if (!uuid) {
             ATRACE_BEGIN("dalvik");
-            calculate_tree_size(create_data_dalvik_cache_path(), &stats.codeSize);
-            calculate_tree_size(create_primary_cur_profile_dir_path(userId), &stats.dataSize);
+            mSizeIndex.calculateTreeSize(create_data_dalvik_cache_path(), &stats.codeSize);
+            mSizeIndex.calculateTreeSize(create_primary_cur_profile_dir_path(userId),
+                    &stats.dataSize);
             ATRACE_END();
         }
+
+        mSizeIndex.save();
     }
 
     std::vector<int64_t> ret;
@@ -2430,6 +2467,67 @@ binder::Status InstalldNativeService::dexopt(const std::string& apkPath, int32_t
     return res ? error(res, error_msg) : ok();
 }
 
+binder::Status InstalldNativeService::dexoptBatch(
+        const std::vector<android::os::DexoptRequest>& requests,
+        std::vector<android::os::DexoptResult>* _aidl_return) {
+    ENFORCE_UID(AID_SYSTEM);
+    for (const auto& request : requests) {
+        CHECK_ARGUMENT_UUID(request.uuid);
+        CHECK_ARGUMENT_PATH(request.apkPath);
+        if (request.packageName && *request.packageName != "*") {
+            CHECK_ARGUMENT_PACKAGE_NAME(*request.packageName);
+        }
+        CHECK_ARGUMENT_PATH(request.outputPath);
+        CHECK_ARGUMENT_PATH(request.dexMetadataPath);
+    }
+    std::lock_guard<std::recursive_mutex> lock(mLock);
+
+    // Output directories are made here rather than by the jobs, which run on
+    // threads of their own that can't take mLock.
+    std::vector<DexoptScheduler::Job> jobs;
+    for (const auto& request : requests) {
+        const char* oat_dir = getCStr(request.outputPath);
+        if (oat_dir != nullptr
+                && !createOatDir(oat_dir, request.instructionSet).isOk()) {
+            // Can't create oat dir - let dexopt use cache dir.
+            oat_dir = nullptr;
+        }
+
+        DexoptScheduler::Job job;
+        job.packageName = getCStr(request.packageName, "*");
+        get_dex2oat_resources(request.dexFlags, &job.threads, &job.memory);
+        job.run = [&request, oat_dir](std::string* error_msg) {
+            return android::installd::dexopt(request.apkPath.c_str(), request.uid,
+                    getCStr(request.packageName, "*"), request.instructionSet.c_str(),
+                    request.dexoptNeeded, oat_dir, request.dexFlags,
+                    request.compilerFilter.c_str(), getCStr(request.uuid),
+                    getCStr(request.sharedLibraries), getCStr(request.seInfo),
+                    request.downgrade, request.targetSdkVersion, getCStr(request.profileName),
+                    getCStr(request.dexMetadataPath), getCStr(request.compilationReason),
+                    error_msg);
+        };
+        jobs.push_back(std::move(job));
+    }
+
+    const int maxThreads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    DexoptScheduler scheduler(kDexoptBatchMaxJobs, maxThreads);
+    auto results = scheduler.run(std::move(jobs));
+
+    _aidl_return->clear();
+    for (size_t i = 0; i < results.size(); i++) {
+        LOG(DEBUG) << "Dexopt of " << requests[i].apkPath << " waited "
+                << results[i].waitMillis << "ms and ran " << results[i].runMillis
+                << "ms with status " << results[i].status;
+        android::os::DexoptResult result;
+        result.status = results[i].status;
+        result.errorMessage = std::move(results[i].errorMessage);
+        result.waitMillis = results[i].waitMillis;
+        result.runMillis = results[i].runMillis;
+        _aidl_return->push_back(std::move(result));
+    }
+    return ok();
+}
+
 binder::Status InstalldNativeService::compileLayouts(const std::string& apkPath,
                                                      const std::string& packageName,
                                                      const std ::string& outDexFile, int uid,
@@ -29,6 +29,7 @@
 #include <cutils/multiuser.h>
 
 #include "android/os/BnInstalld.h"
+#include "SizeIndex.h"
 #include "installd_constants.h"
 
 namespace android {
@@ -115,6 +116,8 @@ public:
             int32_t targetSdkVersion, const std::unique_ptr<std::string>& profileName,
             const std::unique_ptr<std::string>& dexMetadataPath,
             const std::unique_ptr<std::string>& compilationReason);
+    binder::Status dexoptBatch(const std::vector<android::os::DexoptRequest>& requests,
+            std::vector<android::os::DexoptResult>* _aidl_return);
 
     binder::Status compileLayouts(const std::string& apkPath, const std::string& packageName,
                                   const std::string& outDexFile, int uid, bool* _aidl_return);
@@ -184,6 +187,9 @@ private:
     /* Map from UID to cache quota size */
     std::unordered_map<uid_t, int64_t> mCacheQuotas;
 
+    /* Sizes of trees measured without quotas, guarded by its own lock */
+    SizeIndex mSizeIndex;
+
     std::string findDataMediaPath(const std::unique_ptr<std::string>& uuid, userid_t userid);
 };
 
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SizeIndex.h"
+
+#include <algorithm>
+#include <deque>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "TreeWalker.h"
+
+using android::base::unique_fd;
+
+namespace android {
+namespace installd {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x58444e49455a4953;  // "SIZEINDX" in little endian
+constexpr uint64_t kVersion = 1;
+
+void putInt(std::string* out, uint64_t value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string* out, const std::string& value) {
+    putInt(out, value.size());
+    out->append(value);
+}
+
+// Reads back what putInt() and putString() wrote, failing for good on the
+// first read past the end.
+class Reader {
+public:
+    explicit Reader(const std::string& data) : mData(data) {}
+
+    bool getInt(uint64_t* value) {
+        if (mData.size() - mPos < sizeof(*value)) return false;
+        memcpy(value, mData.data() + mPos, sizeof(*value));
+        mPos += sizeof(*value);
+        return true;
+    }
+
+    // Reads a count of items that each take up at least a word, which can't
+    // be more than what's left.
+    bool getCount(uint64_t* count) {
+        return getInt(count) && *count <= (mData.size() - mPos) / sizeof(uint64_t);
+    }
+
+    bool getString(std::string* value) {
+        uint64_t size;
+        if (!getInt(&size) || mData.size() - mPos < size) return false;
+        value->assign(mData, mPos, size);
+        mPos += size;
+        return true;
+    }
+
+    bool done() const { return mPos == mData.size(); }
+
+private:
+    const std::string& mData;
+    size_t mPos = 0;
+};
+
+bool isDotOrDotDot(const char* name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+}  // namespace
+
+SizeIndex::SizeIndex(const std::string& file) : mFile(file) {
+}
+
+int SizeIndex::calculateTreeSize(const std::string& path, int64_t* size, bool persist) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        const int error = errno;
+        std::lock_guard<std::mutex> lock(mLock);
+        load();
+        auto it = mRoots.find(path);
+        if (it != mRoots.end()) {
+            mDirectories -= it->second.dirs.size();
+            mRoots.erase(it);
+            mDirty = true;
+        }
+        errno = error;
+        return -1;
+    }
+    unique_fd fd;
+    if (S_ISDIR(st.st_mode)) {
+        fd.reset(TEMP_FAILURE_RETRY(open(path.c_str(),
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)));
+    }
+    if (fd < 0) {
+        // Nothing below to remember
+        *size += st.st_blocks * 512;
+        return 0;
+    }
+
+    // The tree is walked on a copy of what's known about it, so that the
+    // lock isn't held while reading directories.
+    Root snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        load();
+        Root& root = mRoots[path];
+        if (root.dev != st.st_dev) {
+            mDirectories -= root.dirs.size();
+            root.dirs.clear();
+            root.dev = st.st_dev;
+        }
+        root.lastUsed = ++mUses;
+        root.generation = ++mGenerations;
+        root.persist = persist;
+        snapshot = root;
+    }
+
+    Counts counts;
+    const time_t now = time(nullptr);
+    if (snapshot.dirs.empty()) {
+        // Nothing to reuse, so every directory is read, by several threads.
+        if (readTree(&snapshot, path, now, size, &counts) != 0) {
+            return -1;
+        }
+    } else {
+        *size += update(&snapshot, fd, st, "", now, &counts);
+    }
+
+    // Whatever wasn't reached is gone
+    for (auto it = snapshot.dirs.begin(); it != snapshot.dirs.end();) {
+        if (it->second.generation != snapshot.generation) {
+            it = snapshot.dirs.erase(it);
+            counts.removed++;
+        } else {
+            ++it;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mRead += counts.read;
+    mReused += counts.reused;
+    auto it = mRoots.find(path);
+    if (it == mRoots.end() || it->second.generation != snapshot.generation) {
+        // Invalidated or walked again in the meantime, which wins; the size
+        // still holds for the caller.
+        return 0;
+    }
+    mDirectories += snapshot.dirs.size();
+    mDirectories -= it->second.dirs.size();
+    it->second.dirs = std::move(snapshot.dirs);
+    if (counts.read > 0 || counts.removed > 0) {
+        mDirty = true;
+    }
+    if (mDirectories > kMaxDirectories) {
+        evict(path);
+    }
+    return 0;
+}
+
+int SizeIndex::readTree(Root* root, const std::string& path, time_t now, int64_t* size,
+        Counts* counts) {
+    // Each thread of the walk allocates directories from its own arena, and
+    // only adds to the directories it reads.
+    struct Node {
+        std::string rel;
+        Directory dir;
+    };
+    TreeWalker walker;
+    std::vector<std::deque<Node>> arenas(walker.threads());
+    auto visit = [&](TreeWalker::Entry* entry) {
+        const int64_t blocks = entry->st->st_blocks * 512;
+        auto parent = static_cast<Node*>(entry->parent);
+        if (!S_ISDIR(entry->st->st_mode) || entry->st->st_dev != root->dev) {
+            if (parent != nullptr) {
+                parent->dir.size += blocks;
+            }
+            return true;
+        }
+        Node& node = arenas[entry->worker].emplace_back();
+        if (parent != nullptr) {
+            node.rel = parent->rel.empty() ? entry->name : parent->rel + "/" + entry->name;
+            parent->dir.subdirs.push_back(entry->name);
+        }
+        node.dir.ino = entry->st->st_ino;
+        node.dir.ctime = entry->st->st_ctim;
+        node.dir.scanned = now;
+        node.dir.size = blocks;
+        node.dir.generation = root->generation;
+        entry->cookie = &node;
+        return true;
+    };
+    auto enter = [](int fd, void* cookie, size_t) {
+        if (fd < 0 && cookie != nullptr) {
+            // Counted but not descended into, and tried again next time.
+            static_cast<Node*>(cookie)->dir.scanned = 0;
+        }
+        return true;
+    };
+    if (walker.walk(path, visit, enter) != 0) {
+        return -1;
+    }
+
+    for (auto& arena : arenas) {
+        for (auto& node : arena) {
+            *size += node.dir.size;
+            root->dirs[std::move(node.rel)] = std::move(node.dir);
+            counts->read++;
+        }
+    }
+    return 0;
+}
+
+int64_t SizeIndex::update(Root* root, int fd, const struct stat& st, const std::string& rel,
+        time_t now, Counts* counts) {
+    Directory& dir = root->dirs[rel];
+    dir.generation = root->generation;
+
+    // A change in the same clock tick as the last read wouldn't show in the
+    // ctime, so only trust directories that had settled by the time they
+    // were read.
+    const bool fresh = dir.ino == st.st_ino
+            && dir.ctime.tv_sec == st.st_ctim.tv_sec
+            && dir.ctime.tv_nsec == st.st_ctim.tv_nsec
+            && dir.ctime.tv_sec < dir.scanned - 1
+            && now >= dir.scanned && now - dir.scanned < kMaxAge;
+    if (fresh) {
+        counts->reused++;
+    } else {
+        counts->read++;
+        dir.ino = st.st_ino;
+        dir.ctime = st.st_ctim;
+        dir.scanned = now;
+        dir.size = st.st_blocks * 512;
+        dir.subdirs.clear();
+
+        unique_fd dirFd(dup(fd));
+        DIR* d = dirFd < 0 ? nullptr : fdopendir(dirFd);
+        if (d == nullptr) {
+            // Counted but not descended into, like calculate_tree_size() does,
+            // and tried again next time.
+            dir.scanned = 0;
+            return dir.size;
+        }
+        dirFd.release();
+        struct dirent* de;
+        while ((de = readdir(d)) != nullptr) {
+            if (isDotOrDotDot(de->d_name)) continue;
+            struct stat s;
+            if (fstatat(fd, de->d_name, &s, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISDIR(s.st_mode) && s.st_dev == root->dev) {
+                dir.subdirs.push_back(de->d_name);
+            } else {
+                dir.size += s.st_blocks * 512;
+            }
+        }
+        closedir(d);
+    }
+
+    // Subdirectories may have changed either way. References to other
+    // entries stay valid as they're added.
+    int64_t total = dir.size;
+    for (const auto& name : dir.subdirs) {
+        unique_fd child(TEMP_FAILURE_RETRY(openat(fd, name.c_str(),
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)));
+        struct stat s;
+        if (child < 0 || fstat(child, &s) != 0) {
+            if (fstatat(fd, name.c_str(), &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                total += s.st_blocks * 512;
+            } else {
+                // Removed while reading; catch up next time
+                dir.scanned = 0;
+            }
+            continue;
+        }
+        if (s.st_dev != root->dev) {
+            // Something was mounted over it since
+            total += s.st_blocks * 512;
+            continue;
+        }
+        total += update(root, child, s, rel.empty() ? name : rel + "/" + name, now, counts);
+    }
+    return total;
+}
+
+void SizeIndex::invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mLock);
+    load();
+
+    auto within = [](const std::string& inner, const std::string& outer) {
+        return inner.size() > outer.size() && inner.compare(0, outer.size(), outer) == 0
+                && inner[outer.size()] == '/';
+    };
+    for (auto it = mRoots.begin(); it != mRoots.end();) {
+        if (it->first == path || within(it->first, path) || within(path, it->first)) {
+            mDirectories -= it->second.dirs.size();
+            it = mRoots.erase(it);
+            mDirty = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SizeIndex::evict(const std::string& keep) {
+    while (mDirectories > kMaxDirectories) {
+        auto oldest = mRoots.end();
+        for (auto it = mRoots.begin(); it != mRoots.end(); ++it) {
+            if (it->first != keep
+                    && (oldest == mRoots.end() || it->second.lastUsed < oldest->second.lastUsed)) {
+                oldest = it;
+            }
+        }
+        if (oldest == mRoots.end()) {
+            break;
+        }
+        mDirectories -= oldest->second.dirs.size();
+        mRoots.erase(oldest);
+        mDirty = true;
+    }
+}
+
+void SizeIndex::save(bool force) {
+    std::lock_guard<std::mutex> lock(mLock);
+    const time_t now = time(nullptr);
+    if (mFile.empty() || !mDirty
+            || (!force && now >= mSaved && now - mSaved < kSaveInterval)) {
+        return;
+    }
+    mSaved = now;
+
+    std::string data;
+    putInt(&data, kMagic);
+    putInt(&data, kVersion);
+    putInt(&data, std::count_if(mRoots.begin(), mRoots.end(),
+            [](const auto& root) { return root.second.persist; }));
+    for (const auto& root : mRoots) {
+        if (!root.second.persist) continue;
+        putString(&data, root.first);
+        putInt(&data, root.second.dev);
+        putInt(&data, root.second.lastUsed);
+        putInt(&data, root.second.dirs.size());
+        for (const auto& entry : root.second.dirs) {
+            const Directory& dir = entry.second;
+            putString(&data, entry.first);
+            putInt(&data, dir.ino);
+            putInt(&data, dir.ctime.tv_sec);
+            putInt(&data, dir.ctime.tv_nsec);
+            putInt(&data, dir.scanned);
+            putInt(&data, dir.size);
+            putInt(&data, dir.subdirs.size());
+            for (const auto& name : dir.subdirs) {
+                putString(&data, name);
+            }
+        }
+    }
+
+    // Written aside and renamed into place, so that a crash leaves either
+    // the old index or the new one.
+    const std::string tmp = mFile + ".tmp";
+    unique_fd fd(TEMP_FAILURE_RETRY(open(tmp.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600)));
+    if (fd < 0 || !android::base::WriteFully(fd, data.data(), data.size())
+            || fsync(fd) != 0 || rename(tmp.c_str(), mFile.c_str()) != 0) {
+        PLOG(WARNING) << "Failed to write " << mFile;
+        unlink(tmp.c_str());
+        return;
+    }
+    mDirty = false;
+}
+
+void SizeIndex::load() {
+    if (mLoaded) {
+        return;
+    }
+    mLoaded = true;
+    std::string data;
+    if (mFile.empty() || !android::base::ReadFileToString(mFile, &data)) {
+        return;
+    }
+
+    Reader reader(data);
+    auto parse = [&]() {
+        uint64_t magic, version, roots;
+        if (!reader.getInt(&magic) || magic != kMagic
+                || !reader.getInt(&version) || version != kVersion
+                || !reader.getCount(&roots)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < roots; i++) {
+            std::string path;
+            uint64_t dev, lastUsed, dirs;
+            if (!reader.getString(&path) || !reader.getInt(&dev)
+                    || !reader.getInt(&lastUsed) || !reader.getCount(&dirs)) {
+                return false;
+            }
+            Root& root = mRoots[path];
+            root.dev = dev;
+            root.lastUsed = lastUsed;
+            mUses = std::max(mUses, lastUsed);
+            for (uint64_t j = 0; j < dirs; j++) {
+                std::string rel;
+                uint64_t ino, ctimeSec, ctimeNsec, scanned, size, subdirs;
+                if (!reader.getString(&rel) || !reader.getInt(&ino)
+                        || !reader.getInt(&ctimeSec) || !reader.getInt(&ctimeNsec)
+                        || !reader.getInt(&scanned) || !reader.getInt(&size)
+                        || !reader.getCount(&subdirs)) {
+                    return false;
+                }
+                Directory& dir = root.dirs[rel];
+                dir.ino = ino;
+                dir.ctime.tv_sec = ctimeSec;
+                dir.ctime.tv_nsec = ctimeNsec;
+                dir.scanned = scanned;
+                dir.size = size;
+                for (uint64_t k = 0; k < subdirs; k++) {
+                    if (!reader.getString(&dir.subdirs.emplace_back())) {
+                        return false;
+                    }
+                }
+            }
+            mDirectories += root.dirs.size();
+        }
+        return reader.done();
+    };
+    if (!parse()) {
+        LOG(WARNING) << "Ignoring malformed " << mFile;
+        mRoots.clear();
+        mDirectories = 0;
+        mUses = 0;
+    }
+}
+
+}  // namespace installd
+}  // namespace android
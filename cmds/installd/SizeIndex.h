@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_SIZE_INDEX_H
+#define ANDROID_INSTALLD_SIZE_INDEX_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace installd {
+
+/**
+ * Remembers the sizes of the trees measured when quotas aren't available, so
+ * that measuring them again only reads the directories that changed since.
+ *
+ * For every directory below a measured root, the index keeps the size of the
+ * directory and of its entries that aren't directories themselves, along with
+ * its inode and ctime. Creating, removing or renaming an entry changes the
+ * ctime of the directory it's in, so as long as both still match, that size
+ * still holds and only the subdirectories need checking. An unchanged tree
+ * then costs one stat per directory rather than one per file.
+ *
+ * Writing to an existing file doesn't touch its directory, so such growth is
+ * only picked up once the directory's entry is older than kMaxAge, or when
+ * invalidate() is called for it. The index is written out now and then so
+ * that it outlives restarts of installd, less the trees not to be persisted.
+ */
+class SizeIndex {
+public:
+    explicit SizeIndex(const std::string& file = kDefaultFile);
+
+    /**
+     * Adds the size of the tree at path to size, exactly as an unfiltered
+     * calculate_tree_size() would, and returns 0; or returns -1 with errno
+     * set when path can't be stat'ed. Trees that aren't to be persisted are
+     * only remembered until installd restarts, for those in credential
+     * encrypted storage, whose names mustn't end up in the index file.
+     *
+     * The index isn't locked while the tree is read, by several threads when
+     * nothing is known about it yet. What's read is dropped rather than
+     * remembered if the tree is invalidated in the meantime.
+     */
+    int calculateTreeSize(const std::string& path, int64_t* size, bool persist = true);
+
+    // Forgets the trees at, below or above path, after they're changed in
+    // ways that directory ctimes don't reflect.
+    void invalidate(const std::string& path);
+
+    // Writes the index out when it has changed, at most every kSaveInterval
+    // unless forced.
+    void save(bool force = false);
+
+    // Number of directories read and reused since creation.
+    int64_t directoriesRead() const { return mRead; }
+    int64_t directoriesReused() const { return mReused; }
+
+    static constexpr const char* kDefaultFile = "/data/misc/installd/size_index";
+    static constexpr time_t kMaxAge = 60 * 60;
+    static constexpr time_t kSaveInterval = 60;
+    static constexpr size_t kMaxDirectories = 64 * 1024;
+
+private:
+    struct Directory {
+        ino_t ino = 0;
+        struct timespec ctime = {};
+        // When the directory was last read, in seconds since the epoch.
+        time_t scanned = 0;
+        // Size of the directory and its entries, less its subdirectories.
+        int64_t size = 0;
+        std::vector<std::string> subdirs;
+        uint32_t generation = 0;
+    };
+
+    struct Root {
+        dev_t dev = 0;
+        uint64_t lastUsed = 0;
+        uint32_t generation = 0;
+        bool persist = true;
+        // Keyed by path relative to the root, which itself is "".
+        std::unordered_map<std::string, Directory> dirs;
+    };
+
+    // What a walk did, added up once it's merged back.
+    struct Counts {
+        int64_t read = 0;
+        int64_t reused = 0;
+        int64_t removed = 0;
+    };
+
+    // Both work on a root no one else can see, and so don't need mLock.
+    static int readTree(Root* root, const std::string& path, time_t now, int64_t* size,
+            Counts* counts);
+    static int64_t update(Root* root, int fd, const struct stat& st, const std::string& rel,
+            time_t now, Counts* counts);
+    void evict(const std::string& keep);
+    void load();
+
+    const std::string mFile;
+
+    std::mutex mLock;
+    std::unordered_map<std::string, Root> mRoots;
+    size_t mDirectories = 0;
+    uint64_t mUses = 0;
+    // Handed out to roots as they're walked, so that a walk can tell
+    // whether its root was invalidated or walked again before it finished.
+    uint32_t mGenerations = 0;
+    bool mLoaded = false;
+    bool mDirty = false;
+    time_t mSaved = 0;
+
+    int64_t mRead = 0;
+    int64_t mReused = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(SizeIndex);
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_SIZE_INDEX_H
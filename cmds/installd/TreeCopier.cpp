@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TreeCopier.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "utils.h"
+
+using android::base::unique_fd;
+
+namespace android {
+namespace installd {
+
+// A directory being copied, whose attributes are only set once its source
+// has been read, and whose timestamps once all its entries are in place. Its
+// copy is opened relative to the copy of its parent, which is kept open until
+// then, as the walker does for the source.
+struct TreeCopier::Directory {
+    std::string from;
+    std::string to;
+    struct stat st;
+    std::shared_ptr<unique_fd> parentFd;
+    std::string name;
+    std::shared_ptr<unique_fd> fd;
+};
+
+namespace {
+
+constexpr size_t kCopyBufferSize = 128 * 1024;
+
+bool shouldCopyXattr(const char* name) {
+    return strncmp(name, "security.", strlen("security.")) != 0
+            && strcmp(name, kXattrInodeCache) != 0
+            && strcmp(name, kXattrInodeCodeCache) != 0;
+}
+
+// Copies extended attributes, then owner and mode, the last so that clearing
+// setuid bits on chown doesn't undo them.
+int copyAttributes(int src, int dst, const struct stat& st) {
+    ssize_t size = flistxattr(src, nullptr, 0);
+    if (size > 0) {
+        std::vector<char> names(size);
+        size = flistxattr(src, names.data(), names.size());
+        std::vector<char> value;
+        for (ssize_t pos = 0; pos < size; pos += strlen(&names[pos]) + 1) {
+            const char* name = &names[pos];
+            if (!shouldCopyXattr(name)) continue;
+            ssize_t len = fgetxattr(src, name, nullptr, 0);
+            if (len < 0) continue;
+            value.resize(len);
+            len = fgetxattr(src, name, value.data(), value.size());
+            if (len < 0) continue;
+            if (fsetxattr(dst, name, value.data(), len, 0) != 0 && errno != ENOTSUP) {
+                return -1;
+            }
+        }
+    }
+    if (fchown(dst, st.st_uid, st.st_gid) != 0) {
+        return -1;
+    }
+    return fchmod(dst, st.st_mode & 07777);
+}
+
+// Copies the attributes and times of a directory that won't be entered.
+int copyDirectoryAttributes(const TreeWalker::Entry& entry, int dstDirFd, const char* dstName) {
+    const struct stat& st = *entry.st;
+    const struct timespec times[2] = { st.st_atim, st.st_mtim };
+    unique_fd src(TEMP_FAILURE_RETRY(openat(entry.dirFd, entry.name,
+            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)));
+    unique_fd dst(TEMP_FAILURE_RETRY(openat(dstDirFd, dstName,
+            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)));
+    if (src < 0 || dst < 0 || copyAttributes(src, dst, st) != 0 || futimens(dst, times) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+bool isDirectory(int dirFd, const char* name) {
+    struct stat st;
+    return fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+}  // namespace
+
+TreeCopier::TreeCopier(size_t maxThreads) : mWalker(maxThreads) {
+}
+
+void TreeCopier::fail(const std::string& message) {
+    int expected = 0;
+    const int error = errno ? errno : EIO;
+    PLOG(ERROR) << message;
+    mError.compare_exchange_strong(expected, error);
+}
+
+int TreeCopier::copyData(int src, int dst) {
+    if (mCanClone) {
+        if (ioctl(dst, FICLONE, src) == 0) {
+            return 0;
+        }
+        if (errno != EOPNOTSUPP && errno != ENOTTY && errno != EXDEV && errno != EINVAL) {
+            return -1;
+        }
+        mCanClone = false;
+    }
+
+    if (mCanCopyRange) {
+        bool copied = false;
+        while (true) {
+            // Not yet wrapped by every libc, so called directly.
+            ssize_t n = syscall(__NR_copy_file_range, src, nullptr, dst, nullptr,
+                    kCopyBufferSize * 64, 0);
+            if (n > 0) {
+                copied = true;
+            } else if (n == 0) {
+                return 0;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (!copied && (errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP
+                    || errno == EINVAL)) {
+                mCanCopyRange = false;
+                break;
+            } else {
+                return -1;
+            }
+        }
+    }
+
+    std::unique_ptr<char[]> buffer(new char[kCopyBufferSize]);
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(read(src, buffer.get(), kCopyBufferSize))) > 0) {
+        if (!android::base::WriteFully(dst, buffer.get(), n)) {
+            return -1;
+        }
+    }
+    return n < 0 ? -1 : 0;
+}
+
+int TreeCopier::copyFile(const TreeWalker::Entry& entry, int dstDirFd, const char* dstName) {
+    const struct stat& st = *entry.st;
+    const struct timespec times[2] = { st.st_atim, st.st_mtim };
+
+    // Replace whatever is in the way, like cp -F
+    if (unlinkat(dstDirFd, dstName, 0) != 0 && errno != ENOENT) {
+        return -1;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        std::string target(st.st_size + 1, '\0');
+        ssize_t len = readlinkat(entry.dirFd, entry.name, &target[0], target.size());
+        if (len < 0) {
+            return -1;
+        }
+        target.resize(len);
+        if (symlinkat(target.c_str(), dstDirFd, dstName) != 0
+                || fchownat(dstDirFd, dstName, st.st_uid, st.st_gid, AT_SYMLINK_NOFOLLOW) != 0
+                || utimensat(dstDirFd, dstName, times, AT_SYMLINK_NOFOLLOW) != 0) {
+            return -1;
+        }
+    } else if (!S_ISREG(st.st_mode)) {
+        // Sockets, fifos and device nodes are recreated rather than read
+        if (mknodat(dstDirFd, dstName, st.st_mode, st.st_rdev) != 0
+                || fchownat(dstDirFd, dstName, st.st_uid, st.st_gid, AT_SYMLINK_NOFOLLOW) != 0
+                || fchmodat(dstDirFd, dstName, st.st_mode & 07777, 0) != 0
+                || utimensat(dstDirFd, dstName, times, AT_SYMLINK_NOFOLLOW) != 0) {
+            return -1;
+        }
+    } else {
+        unique_fd src(TEMP_FAILURE_RETRY(openat(entry.dirFd, entry.name,
+                O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+        if (src < 0) {
+            return -1;
+        }
+        unique_fd dst(TEMP_FAILURE_RETRY(openat(dstDirFd, dstName,
+                O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)));
+        if (dst < 0 || copyData(src, dst) != 0 || copyAttributes(src, dst, st) != 0
+                || futimens(dst, times) != 0) {
+            return -1;
+        }
+    }
+
+    const int64_t files = ++mFiles;
+    const int64_t bytes = (mBytes += st.st_size);
+    if (mProgress && !mProgress(files, bytes)) {
+        cancel();
+    }
+    return 0;
+}
+
+int TreeCopier::copy(const std::string& from, const std::string& to) {
+    mError = 0;
+    mFiles = 0;
+    mBytes = 0;
+
+    const std::string root = to + "/" + android::base::Basename(from);
+    // Each thread allocates the directories it visits from its own arena.
+    std::vector<std::deque<Directory>> arenas(mWalker.threads());
+
+    auto visit = [&](TreeWalker::Entry* entry) {
+        if (mCancelled || mError) {
+            return false;
+        }
+        auto parent = static_cast<Directory*>(entry->parent);
+        const int dstDirFd = parent ? parent->fd->get() : AT_FDCWD;
+        const char* dstName = parent ? entry->name : root.c_str();
+        if (!S_ISDIR(entry->st->st_mode)) {
+            if (copyFile(*entry, dstDirFd, dstName) != 0) {
+                fail("Failed to copy " + (parent ? parent->from + "/" + entry->name : from));
+            }
+            return false;
+        }
+
+        // Merge into an existing directory, like cp -R
+        const std::string to = parent ? parent->to + "/" + entry->name : root;
+        if (mkdirat(dstDirFd, dstName, 0700) != 0) {
+            if (errno != EEXIST || (!isDirectory(dstDirFd, dstName)
+                    && (unlinkat(dstDirFd, dstName, 0) != 0
+                            || mkdirat(dstDirFd, dstName, 0700) != 0))) {
+                fail("Failed to create " + to);
+                return false;
+            }
+        }
+        // The walker doesn't descend into other filesystems, so a mount point
+        // is left empty and never entered, and has to be finished here.
+        if (parent && entry->st->st_dev != parent->st.st_dev) {
+            if (copyDirectoryAttributes(*entry, dstDirFd, dstName) != 0) {
+                fail("Failed to copy attributes to " + to);
+            }
+            return false;
+        }
+        auto& dir = arenas[entry->worker].emplace_back();
+        dir.from = parent ? parent->from + "/" + entry->name : from;
+        dir.to = to;
+        dir.st = *entry->st;
+        dir.parentFd = parent ? parent->fd : nullptr;
+        dir.name = dstName;
+        entry->cookie = &dir;
+        return true;
+    };
+    auto enter = [&](int fd, void* cookie, size_t) {
+        auto dir = static_cast<Directory*>(cookie);
+        const auto parentFd = std::move(dir->parentFd);
+        if (fd < 0) {
+            fail("Failed to open " + dir->from);
+            return false;
+        }
+        dir->fd = std::make_shared<unique_fd>(TEMP_FAILURE_RETRY(openat(
+                parentFd ? parentFd->get() : AT_FDCWD, dir->name.c_str(),
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)));
+        if (*dir->fd < 0 || copyAttributes(fd, *dir->fd, dir->st) != 0) {
+            fail("Failed to copy attributes to " + dir->to);
+            return false;
+        }
+        return !mCancelled && !mError;
+    };
+    auto leave = [&](int, void* cookie, size_t) {
+        auto dir = static_cast<Directory*>(cookie);
+        // All entries are in place, so nothing will touch the times again
+        const struct timespec times[2] = { dir->st.st_atim, dir->st.st_mtim };
+        if (futimens(*dir->fd, times) != 0) {
+            fail("Failed to set times of " + dir->to);
+        }
+        dir->fd.reset();
+    };
+
+    if (mWalker.walk(from, visit, enter, leave) != 0) {
+        PLOG(ERROR) << "Failed to stat " << from;
+        return -1;
+    }
+    if (mError) {
+        errno = mError;
+        return -1;
+    }
+    if (mCancelled) {
+        errno = ECANCELED;
+        return -1;
+    }
+    return 0;
+}
+
+}  // namespace installd
+}  // namespace android
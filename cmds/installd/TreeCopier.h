@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_TREE_COPIER_H
+#define ANDROID_INSTALLD_TREE_COPIER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include <android-base/macros.h>
+
+#include "TreeWalker.h"
+
+namespace android {
+namespace installd {
+
+/**
+ * Copies a tree in process, as "cp -F -p -R -P -d" would: existing files at
+ * the destination are replaced, directories are merged into, symlinks are
+ * copied rather than followed, and owners, modes and timestamps are kept.
+ * Extended attributes are kept as well, except for SELinux labels, which
+ * callers restore, and the inode xattrs installd keeps on app directories.
+ *
+ * File contents are cloned with FICLONE where the filesystem shares extents,
+ * and otherwise copied in the kernel with copy_file_range(). Directories are
+ * spread over the threads of a TreeWalker, so files in different directories
+ * are copied in parallel. Like the walker, the copy doesn't descend into
+ * other filesystems mounted within the tree, whose mount points are copied
+ * as empty directories.
+ */
+class TreeCopier {
+public:
+    // Called after each file is copied, concurrently from all threads, with
+    // the running totals. Returning false cancels the copy.
+    using Progress = std::function<bool(int64_t files, int64_t bytes)>;
+
+    explicit TreeCopier(size_t maxThreads = TreeWalker::kDefaultMaxThreads);
+
+    void setProgress(const Progress& progress) { mProgress = progress; }
+
+    /**
+     * Copies from into the existing directory to, as to/<basename of from>.
+     * Returns 0 on success, or -1 with errno set on the first failure, which
+     * stops the copy and leaves whatever was copied so far in place. Returns
+     * -1 with errno set to ECANCELED once cancelled.
+     */
+    int copy(const std::string& from, const std::string& to);
+
+    // Stops a copy in progress from any thread, and fails any later ones.
+    void cancel() { mCancelled = true; }
+
+    int64_t files() const { return mFiles; }
+    int64_t bytes() const { return mBytes; }
+
+private:
+    struct Directory;
+
+    int copyFile(const TreeWalker::Entry& entry, int dstDirFd, const char* dstName);
+    int copyData(int src, int dst);
+    void fail(const std::string& message);
+
+    const TreeWalker mWalker;
+    Progress mProgress;
+
+    std::atomic<bool> mCancelled{false};
+    std::atomic<int> mError{0};
+    std::atomic<int64_t> mFiles{0};
+    std::atomic<int64_t> mBytes{0};
+
+    // Cleared once the filesystem turns out not to support them, so that
+    // they're not attempted for every file.
+    std::atomic<bool> mCanClone{true};
+    std::atomic<bool> mCanCopyRange{true};
+
+    DISALLOW_COPY_AND_ASSIGN(TreeCopier);
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_TREE_COPIER_H
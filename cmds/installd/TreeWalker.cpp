@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TreeWalker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <android-base/unique_fd.h>
+
+using android::base::unique_fd;
+
+namespace android {
+namespace installd {
+
+namespace {
+
+// Number of directories the calling thread reads on its own before helpers
+// are started, so that the many small trees installd measures don't pay for
+// spinning up threads.
+constexpr size_t kSerialDirectories = 32;
+
+constexpr size_t kDirentBufferSize = 32 * 1024;
+
+// An open directory, kept open while any of its subdirectories still has to
+// be opened relative to it.
+struct Directory {
+    explicit Directory(int fd) : fd(fd) {}
+    unique_fd fd;
+};
+
+// A directory that has been visited and is waiting to be read.
+struct Task {
+    std::shared_ptr<Directory> parent;
+    std::string name;
+    int level;
+    void* cookie;
+};
+
+class Walk {
+public:
+    Walk(size_t threads, dev_t dev, const TreeWalker::Visitor& visit,
+            const TreeWalker::DirectoryVisitor& enter, const TreeWalker::DirectoryCallback& leave)
+          : mQueues(threads), mDev(dev), mVisit(visit), mEnter(enter), mLeave(leave) {
+    }
+
+    void run(Task&& root) {
+        push(0, std::move(root));
+        work(0);
+        for (auto& helper : mHelpers) {
+            helper.join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void work(size_t worker) {
+        std::unique_ptr<char[]> buffer(new char[kDirentBufferSize]);
+        size_t read = 0;
+        Task task;
+        while (true) {
+            if (pop(worker, &task)) {
+                readDirectory(worker, &task, buffer.get());
+                task = Task();
+                if (--mOutstanding == 0) {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mCondition.notify_all();
+                }
+                // Only the calling thread starts helpers, and only once.
+                if (worker == 0 && ++read == kSerialDirectories && mQueued > 0) {
+                    for (size_t i = 1; i < mQueues.size(); i++) {
+                        mHelpers.emplace_back(&Walk::work, this, i);
+                    }
+                }
+                continue;
+            }
+            if (mOutstanding == 0) {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(mLock);
+            mSleepers++;
+            mCondition.wait(lock, [this] { return mQueued > 0 || mOutstanding == 0; });
+            mSleepers--;
+        }
+    }
+
+    void push(size_t worker, Task&& task) {
+        mOutstanding++;
+        {
+            std::lock_guard<std::mutex> lock(mQueues[worker].lock);
+            mQueues[worker].tasks.push_back(std::move(task));
+        }
+        mQueued++;
+        if (mSleepers > 0) {
+            std::lock_guard<std::mutex> lock(mLock);
+            mCondition.notify_one();
+        }
+    }
+
+    // Takes the newest task of the worker's own queue, so that each thread
+    // goes depth-first and keeps few directories open, or else steals the
+    // oldest task of another queue, which tends to be the largest subtree.
+    bool pop(size_t worker, Task* task) {
+        for (size_t i = 0; i < mQueues.size(); i++) {
+            auto& queue = mQueues[(worker + i) % mQueues.size()];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.tasks.empty()) continue;
+            if (i == 0) {
+                *task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                *task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            mQueued--;
+            return true;
+        }
+        return false;
+    }
+
+    void readDirectory(size_t worker, Task* task, char* buffer) {
+        const int parentFd = task->parent ? task->parent->fd.get() : AT_FDCWD;
+        int fd = TEMP_FAILURE_RETRY(openat(parentFd, task->name.c_str(),
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        task->parent.reset();
+        if (fd < 0) {
+            if (mEnter) {
+                mEnter(-1, task->cookie, worker);
+            }
+            return;
+        }
+        auto dir = std::make_shared<Directory>(fd);
+        if (mEnter && !mEnter(fd, task->cookie, worker)) {
+            return;
+        }
+
+        long n;
+        while ((n = syscall(SYS_getdents64, fd, buffer, kDirentBufferSize)) > 0) {
+            for (long pos = 0; pos < n;) {
+                auto de = reinterpret_cast<struct dirent64*>(buffer + pos);
+                pos += de->d_reclen;
+                const char* name = de->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                TreeWalker::Entry entry = {
+                    .dirFd = fd,
+                    .name = name,
+                    .st = &st,
+                    .level = task->level + 1,
+                    .parent = task->cookie,
+                    .cookie = nullptr,
+                    .worker = worker,
+                };
+                if (mVisit(&entry) && S_ISDIR(st.st_mode) && st.st_dev == mDev) {
+                    push(worker, Task{dir, name, entry.level, entry.cookie});
+                }
+            }
+        }
+        if (mLeave) {
+            mLeave(fd, task->cookie, worker);
+        }
+    }
+
+    std::vector<Queue> mQueues;
+    std::vector<std::thread> mHelpers;
+
+    // Directories queued, and queued or being read.
+    std::atomic<size_t> mQueued{0};
+    std::atomic<size_t> mOutstanding{0};
+
+    // Wakes idle threads when work is queued, or when the walk is done.
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::atomic<size_t> mSleepers{0};
+
+    const dev_t mDev;
+    const TreeWalker::Visitor& mVisit;
+    const TreeWalker::DirectoryVisitor& mEnter;
+    const TreeWalker::DirectoryCallback& mLeave;
+};
+
+}  // namespace
+
+TreeWalker::TreeWalker(size_t maxThreads) : mThreads(std::max<size_t>(1, maxThreads)) {
+}
+
+int TreeWalker::walk(const std::string& path, const Visitor& visit,
+        const DirectoryVisitor& enter, const DirectoryCallback& leave) const {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+    Entry root = {
+        .dirFd = AT_FDCWD,
+        .name = path.c_str(),
+        .st = &st,
+        .level = 0,
+        .parent = nullptr,
+        .cookie = nullptr,
+        .worker = 0,
+    };
+    if (visit(&root) && S_ISDIR(st.st_mode)) {
+        Walk(mThreads, st.st_dev, visit, enter, leave).run(Task{nullptr, path, 0, root.cookie});
+    }
+    return 0;
+}
+
+}  // namespace installd
+}  // namespace android
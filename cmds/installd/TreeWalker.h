@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_TREE_WALKER_H
+#define ANDROID_INSTALLD_TREE_WALKER_H
+
+#include <functional>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace installd {
+
+/**
+ * Walks a directory tree the way fts_open() with FTS_PHYSICAL | FTS_XDEV
+ * does: symlinks aren't followed, and directories on other filesystems are
+ * reported but not descended into.
+ *
+ * Directories are read with getdents64() and their entries stat'ed relative
+ * to the open directory, so no path is ever built or resolved past the root.
+ * The calling thread starts out walking alone; once the tree proves large
+ * enough, helper threads join in, each working depth-first through its own
+ * queue of directories and stealing from the others when it runs dry.
+ */
+class TreeWalker {
+public:
+    struct Entry {
+        // Directory the entry is in, open for the duration of the call, and
+        // the name of the entry in it. For the root, dirFd is AT_FDCWD and
+        // name is the path given to walk().
+        int dirFd;
+        const char* name;
+        const struct stat* st;
+        // Depth below the root, which is at level 0.
+        int level;
+        // Cookie set when visiting the directory the entry is in, or nullptr
+        // for the root, much like fts_parent->fts_pointer.
+        void* parent;
+        // May be set when visiting a directory, to be handed to its contents.
+        void* cookie;
+        // Index of the thread making the call, below threads(), so that
+        // visitors can keep per-thread state without locking.
+        size_t worker;
+    };
+
+    // Called for every entry that could be stat'ed, concurrently from all
+    // threads, and always before any of the entry's contents. Returning false
+    // for a directory skips its contents, like FTS_SKIP.
+    using Visitor = std::function<bool(Entry* entry)>;
+
+    // Called once a directory is open, from the thread about to read it,
+    // with the cookie set when visiting it. Returning false skips its
+    // contents. When the directory can't be opened, it's called with an fd
+    // of -1 and errno set, and the contents are skipped regardless.
+    using DirectoryVisitor = std::function<bool(int fd, void* cookie, size_t worker)>;
+
+    // Called from the same thread once all the entries of a directory that
+    // was entered have been visited, though not necessarily their contents.
+    using DirectoryCallback = std::function<void(int fd, void* cookie, size_t worker)>;
+
+    // Threads mostly wait on the filesystem rather than compete for CPUs, so
+    // their number isn't tied to the number of cores.
+    explicit TreeWalker(size_t maxThreads = kDefaultMaxThreads);
+
+    size_t threads() const { return mThreads; }
+
+    /**
+     * Walks the tree at path, returning once every entry has been visited.
+     * Returns 0 on success, or -1 with errno set when the root can't be
+     * stat'ed. Directories that can't be opened are reported and skipped.
+     */
+    int walk(const std::string& path, const Visitor& visit,
+            const DirectoryVisitor& enter = nullptr,
+            const DirectoryCallback& leave = nullptr) const;
+
+    static constexpr size_t kDefaultMaxThreads = 4;
+
+private:
+    const size_t mThreads;
+
+    DISALLOW_COPY_AND_ASSIGN(TreeWalker);
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_TREE_WALKER_H
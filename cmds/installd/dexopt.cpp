@@ -15,6 +15,7 @@
  */
 #define LOG_TAG "installd"
 
+#include <algorithm>
 #include <array>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -32,6 +33,7 @@
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -204,6 +206,15 @@ static const char* get_location_from_path(const char* path) {
     }
 }
 
+bool keep_fds_on_exec(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        if (fcntl(fd, F_SETFD, 0) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // ExecVHelper prepares and holds pointers to parsed command line arguments so that no allocations
 // need to be performed between the fork and exec.
 class ExecVHelper {
@@ -224,6 +235,10 @@ class ExecVHelper {
 
     [[ noreturn ]]
     void Exec(int exit_code) {
+        if (!keep_fds_on_exec(keep_fds_)) {
+            PLOG(ERROR) << "Failed to keep fds open for " << argv_[0];
+            exit(exit_code);
+        }
         execv(argv_[0], (char * const *)&argv_[0]);
         PLOG(ERROR) << "execv(" << argv_[0] << ") failed";
         exit(exit_code);
@@ -244,12 +259,29 @@ class ExecVHelper {
         }
     }
 
+    // Pass an fd on to the binary if it's valid. Files are opened O_CLOEXEC,
+    // and only the ones passed on are left open by Exec().
+    void KeepFd(int fd) {
+        if (fd >= 0) {
+            keep_fds_.push_back(fd);
+        }
+    }
+
+    void KeepFds(const std::vector<unique_fd>& fds) {
+        for (const unique_fd& fd : fds) {
+            KeepFd(fd.get());
+        }
+    }
+
   protected:
     // Holder arrays for backing arg storage.
     std::vector<std::string> args_;
 
     // Argument poiners.
     std::vector<const char*> argv_;
+
+    // Fds the binary gets.
+    std::vector<int> keep_fds_;
 };
 
 static std::string MapPropertyToArg(const std::string& property,
@@ -607,6 +639,11 @@ class RunDex2Oat : public ExecVHelper {
         // Do not add args after dex2oat_flags, they should override others for debugging.
         args_.insert(args_.end(), dex2oat_flags_args.begin(), dex2oat_flags_args.end());
 
+        for (int fd : { zip_fd, oat_fd, input_vdex_fd, output_vdex_fd, image_fd, swap_fd,
+                profile_fd, dex_metadata_fd }) {
+            KeepFd(fd);
+        }
+
         PrepareArgs(dex2oat_bin);
     }
 };
@@ -687,7 +724,9 @@ static unique_fd open_profile(uid_t uid, const std::string& profile, int32_t fla
     // Do not follow symlinks when opening a profile:
     //   - primary profiles should not contain symlinks in their paths
     //   - secondary dex paths should have been already resolved and validated
-    flags |= O_NOFOLLOW;
+    // The fd is handed explicitly to the binary that reads it, rather than
+    // inherited by every child forked meanwhile.
+    flags |= O_NOFOLLOW | O_CLOEXEC;
 
     // Check if we need to create the profile
     // Reference profiles and snapshots are created on the fly; so they might not exist beforehand.
@@ -788,15 +827,18 @@ class RunProfman : public ExecVHelper {
         }
         if (reference_profile_fd != -1) {
             AddArg("--reference-profile-file-fd=" + std::to_string(reference_profile_fd.get()));
+            KeepFd(reference_profile_fd.get());
         }
 
         for (const unique_fd& fd : profile_fds) {
             AddArg("--profile-file-fd=" + std::to_string(fd.get()));
         }
+        KeepFds(profile_fds);
 
         for (const unique_fd& fd : apk_fds) {
             AddArg("--apk-fd=" + std::to_string(fd.get()));
         }
+        KeepFds(apk_fds);
 
         for (const std::string& dex_location : dex_locations) {
             AddArg("--dex-location=" + dex_location);
@@ -859,6 +901,7 @@ class RunProfman : public ExecVHelper {
                    const unique_fd& output_fd) {
         AddArg("--dump-only");
         AddArg(StringPrintf("--dump-output-to-fd=%d", output_fd.get()));
+        KeepFd(output_fd.get());
         SetupArgs(profiles_fd,
                   reference_profile_fd,
                   apk_fds,
@@ -1144,7 +1187,7 @@ static std::string create_vdex_filename(const std::string& oat_path) {
 }
 
 static int open_output_file(const char* file_name, bool recreate, int permissions) {
-    int flags = O_RDWR | O_CREAT;
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC;
     if (recreate) {
         if (unlink(file_name) < 0) {
             if (errno != ENOENT) {
@@ -1483,13 +1526,13 @@ bool open_vdex_files_for_dex2oat(const char* apk_path, const char* out_oat_path,
             !profile_guided;
         if (update_vdex_in_place) {
             // Open the file read-write to be able to update it.
-            in_vdex_wrapper_fd->reset(open(in_vdex_path_str.c_str(), O_RDWR, 0));
+            in_vdex_wrapper_fd->reset(open(in_vdex_path_str.c_str(), O_RDWR | O_CLOEXEC, 0));
             if (in_vdex_wrapper_fd->get() == -1) {
                 // If we failed to open the file, we cannot update it in place.
                 update_vdex_in_place = false;
             }
         } else {
-            in_vdex_wrapper_fd->reset(open(in_vdex_path_str.c_str(), O_RDONLY, 0));
+            in_vdex_wrapper_fd->reset(open(in_vdex_path_str.c_str(), O_RDONLY | O_CLOEXEC, 0));
         }
     }
 
@@ -1645,6 +1688,9 @@ class RunDexoptAnalyzer : public ExecVHelper {
             AddArg(vdex_fd_arg);
         }
         AddArg(zip_fd_arg);
+        KeepFd(oat_fd);
+        KeepFd(vdex_fd);
+        KeepFd(zip_fd);
         if (profile_was_updated) {
             AddArg(assume_profile_changed);
         }
@@ -1914,7 +1960,7 @@ static bool get_class_loader_context_dex_paths(const char* class_loader_context,
 static int open_dex_paths(const std::vector<std::string>& dex_paths,
         /* out */ std::vector<unique_fd>* zip_fds, /* out */ std::string* error_msg) {
     for (const std::string& dex_path : dex_paths) {
-        zip_fds->emplace_back(open(dex_path.c_str(), O_RDONLY));
+        zip_fds->emplace_back(open(dex_path.c_str(), O_RDONLY | O_CLOEXEC));
         if (zip_fds->back().get() < 0) {
             *error_msg = StringPrintf(
                     "installd cannot open '%s' for input during dexopt", dex_path.c_str());
@@ -2033,6 +2079,7 @@ static bool process_secondary_dex_dexopt(const std::string& dex_path, const char
                                               downgrade,
                                               class_loader_context,
                                               join_fds(context_zip_fds));
+        run_dexopt_analyzer.KeepFds(context_zip_fds);
         run_dexopt_analyzer.Exec(kSecondaryDexDexoptAnalyzerSkippedFailExec);
     }
 
@@ -2149,7 +2196,7 @@ int dexopt(const char* dex_path, uid_t uid, const char* pkgname, const char* ins
     }
 
     // Open the input file.
-    unique_fd input_fd(open(dex_path, O_RDONLY, 0));
+    unique_fd input_fd(open(dex_path, O_RDONLY | O_CLOEXEC, 0));
     if (input_fd.get() < 0) {
         *error_msg = StringPrintf("installd cannot open '%s' for input during dexopt", dex_path);
         LOG(ERROR) << *error_msg;
@@ -2215,7 +2262,8 @@ int dexopt(const char* dex_path, uid_t uid, const char* pkgname, const char* ins
 
     unique_fd dex_metadata_fd;
     if (dex_metadata_path != nullptr) {
-        dex_metadata_fd.reset(TEMP_FAILURE_RETRY(open(dex_metadata_path, O_RDONLY | O_NOFOLLOW)));
+        dex_metadata_fd.reset(TEMP_FAILURE_RETRY(
+                open(dex_metadata_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
         if (dex_metadata_fd.get() < 0) {
             PLOG(ERROR) << "Failed to open dex metadata file " << dex_metadata_path;
         }
@@ -2245,6 +2293,7 @@ int dexopt(const char* dex_path, uid_t uid, const char* pkgname, const char* ins
                       generate_compact_dex,
                       dex_metadata_fd.get(),
                       compilation_reason);
+    runner.KeepFds(context_input_fds);
 
     pid_t pid = fork();
     if (pid == 0) {
@@ -2281,6 +2330,32 @@ int dexopt(const char* dex_path, uid_t uid, const char* pkgname, const char* ins
     return 0;
 }
 
+void get_dex2oat_resources(int dexopt_flags, int* threads, int64_t* memory) {
+    // Same properties as RunDex2Oat reads for -j and -Xmx
+    bool boot_complete = (dexopt_flags & DEXOPT_BOOTCOMPLETE) != 0;
+    bool for_restore = (dexopt_flags & DEXOPT_FOR_RESTORE) != 0;
+    std::string threads_value = boot_complete
+            ? (for_restore
+                ? MapPropertyToArgWithBackup(
+                        "dalvik.vm.restore-dex2oat-threads",
+                        "dalvik.vm.dex2oat-threads",
+                        "%s")
+                : MapPropertyToArg("dalvik.vm.dex2oat-threads", "%s"))
+            : MapPropertyToArg("dalvik.vm.boot-dex2oat-threads", "%s");
+    if (!android::base::ParseInt(threads_value, threads, 1)) {
+        // dex2oat uses every core when not told otherwise
+        *threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+
+    std::string xmx_value = GetProperty("dalvik.vm.dex2oat-Xmx", "");
+    uint64_t xmx;
+    if (android::base::ParseByteCount(xmx_value, &xmx)) {
+        *memory = xmx;
+    } else {
+        *memory = kDefaultDex2oatMemory;
+    }
+}
+
 // Try to remove the given directory. Log an error if the directory exists
 // and is empty but could not be removed.
 static bool rmdir_if_empty(const char* dir) {
@@ -119,6 +119,19 @@ int dexopt(const char *apk_path, uid_t uid, const char *pkgName, const char *ins
         bool downgrade, int target_sdk_version, const char* profile_name,
         const char* dexMetadataPath, const char* compilation_reason, std::string* error_msg);
 
+// Memory assumed for a dex2oat invocation when dalvik.vm.dex2oat-Xmx isn't set.
+static constexpr int64_t kDefaultDex2oatMemory = 512 * 1024 * 1024;
+
+// Returns the number of compiler threads and the heap size that dexopt() would
+// run dex2oat with for the given flags.
+void get_dex2oat_resources(int dexopt_flags, int* threads, int64_t* memory);
+
+// Clears close-on-exec on fds, which dexopt() opens them with so that the
+// compilers of jobs running at the same time don't inherit each other's
+// files. Called in a forked child right before exec, so it makes nothing but
+// async-signal-safe calls. Returns false if an fd isn't open.
+bool keep_fds_on_exec(const std::vector<int>& fds);
+
 bool calculate_oat_file_path_default(char path[PKG_PATH_MAX], const char *oat_dir,
         const char *apk_path, const char *instruction_set);
 
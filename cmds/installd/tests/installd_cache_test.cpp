@@ -14,17 +14,26 @@
  * limitations under the License.
  */
 
+#include <fts.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/statvfs.h>
 #include <sys/xattr.h>
 
+#include <deque>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <cutils/properties.h>
 #include <gtest/gtest.h>
 
 #include "InstalldNativeService.h"
+#include "SizeIndex.h"
+#include "TreeWalker.h"
 #include "globals.h"
 #include "utils.h"
 
@@ -328,5 +337,238 @@ TEST_F(CacheTest, FreeCache_GroupTombstone) {
     EXPECT_EQ(0, size("com.example/cache/tomb/group/dir/file2"));
 }
 
+// Enough directories for the walk to bring in helper threads.
+static void makeWideTree() {
+    mkdir("com.example");
+    mkdir("com.example/cache");
+    for (int i = 0; i < 64; i++) {
+        const std::string dir = StringPrintf("com.example/cache/dir%d", i);
+        mkdir(dir.c_str());
+        mkdir((dir + "/sub").c_str());
+        touch((dir + "/file").c_str(), 4 * kKbInBytes, 0);
+        touch((dir + "/sub/file").c_str(), (i + 1) * kKbInBytes, 0);
+    }
+    symlink("/data/local/tmp/user/0/com.example", "/data/local/tmp/user/0/com.example/cache/link");
+}
+
+TEST_F(CacheTest, TreeWalker_MatchesFts) {
+    makeWideTree();
+    const std::string root = "/data/local/tmp/user/0/com.example";
+
+    std::set<std::string> expected;
+    char* argv[] = { (char*) root.c_str(), nullptr };
+    FTS* fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, nullptr);
+    ASSERT_NE(nullptr, fts);
+    FTSENT* p;
+    while ((p = fts_read(fts)) != nullptr) {
+        if (p->fts_info == FTS_DP) continue;
+        if (p->fts_info == FTS_D && !strcmp(p->fts_name, "sub")) {
+            fts_set(fts, p, FTS_SKIP);
+        }
+        expected.insert(p->fts_path);
+    }
+    fts_close(fts);
+
+    TreeWalker walker(4);
+    std::vector<std::deque<std::string>> paths(walker.threads());
+    auto visit = [&](TreeWalker::Entry* entry) {
+        auto parent = static_cast<std::string*>(entry->parent);
+        auto& path = paths[entry->worker].emplace_back(
+                parent ? *parent + "/" + entry->name : entry->name);
+        entry->cookie = &path;
+        return strcmp(entry->name, "sub") != 0;
+    };
+    ASSERT_EQ(0, walker.walk(root, visit));
+
+    std::set<std::string> actual;
+    for (const auto& worker : paths) {
+        for (const auto& path : worker) {
+            EXPECT_TRUE(actual.insert(path).second) << path;
+        }
+    }
+    EXPECT_EQ(expected, actual);
+
+    errno = 0;
+    EXPECT_EQ(-1, walker.walk(root + "/missing", visit));
+    EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_F(CacheTest, CalculateTreeSize_Wide) {
+    makeWideTree();
+    const std::string root = "/data/local/tmp/user/0/com.example";
+
+    int64_t expected = 0;
+    char* argv[] = { (char*) root.c_str(), nullptr };
+    FTS* fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, nullptr);
+    ASSERT_NE(nullptr, fts);
+    FTSENT* p;
+    while ((p = fts_read(fts)) != nullptr) {
+        if (p->fts_info != FTS_DP) {
+            expected += p->fts_statp->st_blocks * 512;
+        }
+    }
+    fts_close(fts);
+
+    int64_t size = 0;
+    EXPECT_EQ(0, calculate_tree_size(root, &size));
+    EXPECT_EQ(expected, size);
+
+    size = 0;
+    EXPECT_EQ(0, calculate_tree_size(root, &size, -1, getgid()));
+    EXPECT_EQ(0, size);
+}
+
+static int64_t treeSize(const std::string& path) {
+    int64_t size = 0;
+    calculate_tree_size(path, &size);
+    return size;
+}
+
+TEST_F(CacheTest, SizeIndex_Incremental) {
+    makeWideTree();
+    const std::string root = "/data/local/tmp/user/0/com.example";
+    // Directories changed within the last second aren't trusted
+    sleep(2);
+
+    SizeIndex index("");
+    int64_t size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_EQ(treeSize(root), size);
+    // The package, its cache, and two directories per entry in it
+    const int64_t dirs = 2 + 64 * 2;
+    EXPECT_EQ(dirs, index.directoriesRead());
+
+    size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_EQ(treeSize(root), size);
+    EXPECT_EQ(dirs, index.directoriesRead());
+    EXPECT_EQ(dirs, index.directoriesReused());
+
+    touch("com.example/cache/dir3/sub/new", 16 * kKbInBytes, 0);
+    size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_EQ(treeSize(root), size);
+    EXPECT_EQ(dirs + 1, index.directoriesRead());
+
+    system("rm -rf /data/local/tmp/user/0/com.example/cache/dir5");
+    size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_EQ(treeSize(root), size);
+
+    // Growing a file goes unnoticed until invalidated
+    touch("com.example/cache/dir7/file", 64 * kKbInBytes, 0);
+    size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_GT(treeSize(root), size);
+    index.invalidate(root + "/cache/dir7");
+    size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_EQ(treeSize(root), size);
+
+    size = 0;
+    errno = 0;
+    EXPECT_EQ(-1, index.calculateTreeSize(root + "/missing", &size));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(0, size);
+}
+
+TEST_F(CacheTest, SizeIndex_Persisted) {
+    makeWideTree();
+    const std::string root = "/data/local/tmp/user/0/com.example";
+    const std::string file = "/data/local/tmp/user/size_index";
+    sleep(2);
+
+    int64_t expected = 0;
+    {
+        SizeIndex index(file);
+        EXPECT_EQ(0, index.calculateTreeSize(root, &expected));
+        index.save(true);
+    }
+    {
+        SizeIndex index(file);
+        int64_t size = 0;
+        EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+        EXPECT_EQ(expected, size);
+        EXPECT_EQ(0, index.directoriesRead());
+    }
+
+    ASSERT_EQ(0, truncate(file.c_str(), 100));
+    {
+        SizeIndex index(file);
+        int64_t size = 0;
+        EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+        EXPECT_EQ(expected, size);
+        EXPECT_EQ(2 + 64 * 2, index.directoriesRead());
+    }
+}
+
+TEST_F(CacheTest, SizeIndex_NotPersisted) {
+    makeWideTree();
+    const std::string root = "/data/local/tmp/user/0/com.example";
+    const std::string file = "/data/local/tmp/user/size_index";
+    sleep(2);
+
+    int64_t expected = 0;
+    {
+        SizeIndex index(file);
+        EXPECT_EQ(0, index.calculateTreeSize(root, &expected, false));
+        int64_t size = 0;
+        EXPECT_EQ(0, index.calculateTreeSize(root, &size, false));
+        EXPECT_EQ(expected, size);
+        EXPECT_EQ(2 + 64 * 2, index.directoriesReused());
+        index.save(true);
+    }
+
+    // Neither the tree nor the names in it made it to the file
+    std::string data;
+    ASSERT_TRUE(android::base::ReadFileToString(file, &data));
+    EXPECT_EQ(std::string::npos, data.find("com.example"));
+    EXPECT_EQ(std::string::npos, data.find("dir3"));
+    {
+        SizeIndex index(file);
+        int64_t size = 0;
+        EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+        EXPECT_EQ(expected, size);
+        EXPECT_EQ(2 + 64 * 2, index.directoriesRead());
+    }
+}
+
+TEST_F(CacheTest, SizeIndex_Concurrent) {
+    makeWideTree();
+    const std::string root = "/data/local/tmp/user/0/com.example";
+    sleep(2);
+    const int64_t expected = treeSize(root);
+
+    // Walks of the same tree race each other and invalidations of it, and
+    // every one of them still comes up with the whole size.
+    SizeIndex index("");
+    std::vector<std::thread> threads;
+    std::vector<int64_t> sizes(4 * 8, 0);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 8; i++) {
+                EXPECT_EQ(0, index.calculateTreeSize(root, &sizes[t * 8 + i]));
+                if (i % 3 == t % 3) {
+                    index.invalidate(root + "/cache");
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const int64_t size : sizes) {
+        EXPECT_EQ(expected, size);
+    }
+
+    // An invalidation leaves nothing to reuse, whichever walk finished last.
+    index.invalidate(root);
+    const int64_t read = index.directoriesRead();
+    int64_t size = 0;
+    EXPECT_EQ(0, index.calculateTreeSize(root, &size));
+    EXPECT_EQ(expected, size);
+    EXPECT_EQ(read + 2 + 64 * 2, index.directoriesRead());
+}
+
 }  // namespace installd
 }  // namespace android
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures copying synthetic app data trees of 10^3 and 10^4 files of 16KiB,
+// laid out as 50 files per directory, the way snapshotAppData() and
+// restoreAppDataSnapshot() do:
+//  - BM_Cp forks "cp -F -p -R -P -d", as copy_directory_recursive() did.
+//  - BM_TreeCopier copies in process with the given number of threads.
+//
+// Each benchmark runs once per filesystem to compare, given as --dir=<path>
+// and defaulting to /data/local/tmp. To compare against tmpfs, mount one
+// first, e.g.:
+//   adb shell mkdir /data/local/tmp/tmpfs
+//   adb shell mount -t tmpfs tmpfs /data/local/tmp/tmpfs
+//   adb shell installd_copy_benchmark --dir=/data/local/tmp --dir=/data/local/tmp/tmpfs
+//
+// Source trees are left in <dir>/installd_copy_benchmark to be reused by later
+// runs; each copy is removed outside of the timed section.
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/macros.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <cutils/properties.h>
+
+#include "TreeCopier.h"
+#include "utils.h"
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace installd {
+
+int get_property(const char *key, char *value, const char *default_value) {
+    return property_get(key, value, default_value);
+}
+
+bool calculate_oat_file_path(char path[PKG_PATH_MAX] ATTRIBUTE_UNUSED,
+        const char *oat_dir ATTRIBUTE_UNUSED,
+        const char *apk_path ATTRIBUTE_UNUSED,
+        const char *instruction_set ATTRIBUTE_UNUSED) {
+    return false;
+}
+
+bool calculate_odex_file_path(char path[PKG_PATH_MAX] ATTRIBUTE_UNUSED,
+        const char *apk_path ATTRIBUTE_UNUSED,
+        const char *instruction_set ATTRIBUTE_UNUSED) {
+    return false;
+}
+
+bool create_cache_path(char path[PKG_PATH_MAX] ATTRIBUTE_UNUSED,
+        const char *src ATTRIBUTE_UNUSED,
+        const char *instruction_set ATTRIBUTE_UNUSED) {
+    return false;
+}
+
+namespace {
+
+constexpr const char* kCpPath = "/system/bin/cp";
+constexpr const char* kDefaultDir = "/data/local/tmp";
+constexpr int kFilesPerDir = 50;
+constexpr size_t kFileSize = 16 * 1024;
+
+// Returns the package directory of a tree of the given number of files.
+std::string getTree(const std::string& dir, int files) {
+    const std::string root = dir + "/installd_copy_benchmark";
+    const std::string path = StringPrintf("%s/%d", root.c_str(), files);
+    const std::string pkg = path + "/com.example";
+    const std::string done = path + "/done";
+    if (access(done.c_str(), F_OK) == 0) {
+        return pkg;
+    }
+
+    ::mkdir(root.c_str(), 0755);
+    ::mkdir(path.c_str(), 0755);
+    ::mkdir(pkg.c_str(), 0700);
+    const std::string contents(kFileSize, 'x');
+    for (int i = 0; i < files / kFilesPerDir; i++) {
+        const std::string sub = StringPrintf("%s/%d", pkg.c_str(), i);
+        ::mkdir(sub.c_str(), 0700);
+        for (int j = 0; j < kFilesPerDir; j++) {
+            android::base::WriteStringToFile(contents, StringPrintf("%s/file%d", sub.c_str(), j));
+        }
+    }
+    android::base::WriteStringToFile("", done);
+    return pkg;
+}
+
+// Returns an empty directory to copy into, next to the source tree so that
+// both are on the same filesystem.
+std::string resetTarget(const std::string& pkg) {
+    const std::string target = pkg + ".copy";
+    delete_dir_contents_and_dir(target, true);
+    ::mkdir(target.c_str(), 0700);
+    return target;
+}
+
+int forkCp(const std::string& from, const std::string& to) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(kCpPath, kCpPath, "-F", "-p", "-R", "-P", "-d", from.c_str(), to.c_str(), nullptr);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)) != pid) {
+        return -1;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+void BM_Cp(benchmark::State& state, const std::string& dir) {
+    const std::string pkg = getTree(dir, state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        const std::string target = resetTarget(pkg);
+        state.ResumeTiming();
+        if (forkCp(pkg, target) != 0) {
+            state.SkipWithError("cp failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * kFileSize);
+}
+
+void BM_TreeCopier(benchmark::State& state, const std::string& dir) {
+    const std::string pkg = getTree(dir, state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        const std::string target = resetTarget(pkg);
+        TreeCopier copier(state.range(1));
+        state.ResumeTiming();
+        if (copier.copy(pkg, target) != 0) {
+            state.SkipWithError("TreeCopier failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * kFileSize);
+}
+
+}  // namespace
+}  // namespace installd
+}  // namespace android
+
+int main(int argc, char** argv) {
+    using namespace android::installd;
+
+    // Take out our own flags before the benchmark library sees them.
+    std::vector<std::string> dirs;
+    int remaining = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--dir=", strlen("--dir=")) == 0) {
+            dirs.push_back(argv[i] + strlen("--dir="));
+        } else {
+            argv[remaining++] = argv[i];
+        }
+    }
+    argc = remaining;
+    if (dirs.empty()) {
+        dirs.push_back(kDefaultDir);
+    }
+
+    for (const auto& dir : dirs) {
+        auto cp = benchmark::RegisterBenchmark(("BM_Cp/" + dir).c_str(), BM_Cp, dir);
+        cp->ArgName("files")->Arg(1000)->Arg(10000);
+        auto copier = benchmark::RegisterBenchmark(("BM_TreeCopier/" + dir).c_str(),
+                BM_TreeCopier, dir);
+        copier->ArgNames({"files", "threads"});
+        for (int files : {1000, 10000}) {
+            for (int threads : {1, 4}) {
+                copier->Args({files, threads});
+            }
+        }
+        for (auto b : {cp, copier}) {
+            b->Unit(benchmark::kMillisecond)->UseRealTime();
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -15,11 +15,13 @@
  */
 
 #include <cstdlib>
+#include <mutex>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -36,6 +38,7 @@
 #include <selinux/avc.h>
 
 #include "binder_test_utils.h"
+#include "DexoptScheduler.h"
 #include "dexopt.h"
 #include "InstalldNativeService.h"
 #include "globals.h"
@@ -44,6 +47,7 @@
 #include "ziparchive/zip_writer.h"
 
 using android::base::ReadFully;
+using android::base::StringPrintf;
 using android::base::unique_fd;
 
 namespace android {
@@ -653,6 +657,42 @@ TEST_F(DexoptTest, DexoptPrimaryPublicCreateOatDir) {
                         DEX2OAT_FROM_SCRATCH);
 }
 
+TEST_F(DexoptTest, DexoptBatch) {
+    LOG(INFO) << "DexoptBatch";
+    bool prof_result;
+    ASSERT_BINDER_SUCCESS(service_->prepareAppProfile(
+            package_name_, kTestUserId, kTestAppId, "primary.prof", apk_path_,
+            nullptr, &prof_result));
+    ASSERT_TRUE(prof_result);
+
+    std::vector<android::os::DexoptRequest> requests(2);
+    for (auto& request : requests) {
+        request.apkPath = apk_path_;
+        request.uid = kTestAppGid;
+        request.packageName.reset(new std::string(package_name_));
+        request.instructionSet = kRuntimeIsa;
+        request.dexoptNeeded = DEX2OAT_FROM_SCRATCH;
+        request.outputPath.reset(new std::string(app_oat_dir_));
+        request.dexFlags = DEXOPT_BOOTCOMPLETE | DEXOPT_PUBLIC;
+        request.compilerFilter = "verify";
+        request.sharedLibraries.reset(new std::string("&"));
+        request.seInfo.reset(new std::string(se_info_));
+        request.profileName.reset(new std::string("primary.prof"));
+        request.compilationReason.reset(new std::string("test-reason"));
+    }
+    requests[1].apkPath = app_apk_dir_ + "/does_not_exist.apk";
+
+    std::vector<android::os::DexoptResult> results;
+    ASSERT_BINDER_SUCCESS(service_->dexoptBatch(requests, &results));
+    ASSERT_EQ(2u, results.size());
+    ASSERT_EQ(0, results[0].status) << results[0].errorMessage;
+    ASSERT_NE(0, results[1].status);
+    ASSERT_FALSE(results[1].errorMessage.empty());
+
+    CheckFileAccess(GetPrimaryDexArtifact(app_oat_dir_.c_str(), apk_path_, "odex"),
+            kSystemUid, kTestAppGid, S_IFREG | 0644);
+}
+
 TEST_F(DexoptTest, DexoptPrimaryPublicRestore) {
     LOG(INFO) << "DexoptPrimaryPublicRestore";
     CompilePrimaryDexOk("verify",
@@ -1376,5 +1416,193 @@ TEST_F(DexoptTest, select_execution_binary) {
         /*is_debuggable_build=*/ false));
 }
 
+class DexoptSchedulerTest : public testing::Test {
+protected:
+    // Stands in for dex2oat: a child that sleeps a while, then exits with
+    // the given code, counting how many run at once.
+    DexoptScheduler::Job StubJob(const std::string& package_name, int threads,
+            int64_t memory, int exit_code = 0) {
+        DexoptScheduler::Job job;
+        job.packageName = package_name;
+        job.threads = threads;
+        job.memory = memory;
+        job.run = [this, exit_code](std::string* error_msg) {
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                running_++;
+                peak_ = std::max(peak_, running_);
+            }
+            int res = RunStub(StringPrintf("sleep 0.2; exit %d", exit_code), {}, error_msg);
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                running_--;
+            }
+            return res;
+        };
+        return job;
+    }
+
+    // Runs script in a child the way dexopt() runs dex2oat, passing keep_fds
+    // on to it, and returns its exit code.
+    static int RunStub(const std::string& script, const std::vector<int>& keep_fds,
+            std::string* error_msg) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (!keep_fds_on_exec(keep_fds)) {
+                _exit(126);
+            }
+            execl(kShell, kShell, "-c", script.c_str(), nullptr);
+            _exit(127);
+        }
+        int status = -1;
+        waitpid(pid, &status, 0);
+        int res = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        if (res != 0) {
+            *error_msg = StringPrintf("stub compiler failed with %d", res);
+        }
+        return res;
+    }
+
+    static constexpr const char* kShell = "/system/bin/sh";
+    static constexpr int64_t kMB = 1024 * 1024;
+
+    std::mutex lock_;
+    int running_ = 0;
+    int peak_ = 0;
+};
+
+TEST_F(DexoptSchedulerTest, RunsWithinThreadBudget) {
+    DexoptScheduler scheduler(4, 4, [] { return -1; });
+    std::vector<DexoptScheduler::Job> jobs;
+    for (int i = 0; i < 4; i++) {
+        jobs.push_back(StubJob(StringPrintf("com.example.app%d", i), 2, 0));
+    }
+    auto results = scheduler.run(std::move(jobs));
+    ASSERT_EQ(4u, results.size());
+    for (const auto& result : results) {
+        EXPECT_EQ(0, result.status);
+    }
+    EXPECT_EQ(2, peak_);
+}
+
+TEST_F(DexoptSchedulerTest, RunsWithinJobLimit) {
+    DexoptScheduler scheduler(3, 16, [] { return -1; });
+    std::vector<DexoptScheduler::Job> jobs;
+    for (int i = 0; i < 6; i++) {
+        jobs.push_back(StubJob(StringPrintf("com.example.app%d", i), 1, 0));
+    }
+    scheduler.run(std::move(jobs));
+    EXPECT_EQ(3, peak_);
+}
+
+TEST_F(DexoptSchedulerTest, AlwaysRunsOversizedJob) {
+    DexoptScheduler scheduler(4, 2, [] { return 0; });
+    std::vector<DexoptScheduler::Job> jobs;
+    jobs.push_back(StubJob("com.example.app", 8, 4096 * kMB));
+    auto results = scheduler.run(std::move(jobs));
+    ASSERT_EQ(1u, results.size());
+    EXPECT_EQ(0, results[0].status);
+    EXPECT_EQ(1, peak_);
+}
+
+TEST_F(DexoptSchedulerTest, SerializesPackage) {
+    DexoptScheduler scheduler(4, 16, [] { return -1; });
+    std::vector<DexoptScheduler::Job> jobs;
+    jobs.push_back(StubJob("com.example.app", 1, 0));
+    jobs.push_back(StubJob("com.example.app", 1, 0));
+    jobs.push_back(StubJob("com.example.other", 1, 0));
+    auto results = scheduler.run(std::move(jobs));
+    ASSERT_EQ(3u, results.size());
+    EXPECT_EQ(2, peak_);
+    // The second job of the package waits for the first, but the job of the
+    // other package behind it doesn't.
+    EXPECT_GE(results[1].waitMillis, results[0].runMillis);
+    EXPECT_LT(results[2].waitMillis, results[0].runMillis);
+}
+
+TEST_F(DexoptSchedulerTest, WaitsForMemory) {
+    std::vector<DexoptScheduler::Job> jobs;
+    for (int i = 0; i < 3; i++) {
+        jobs.push_back(StubJob(StringPrintf("com.example.app%d", i), 1, 512 * kMB));
+    }
+    DexoptScheduler scheduler(4, 16, [] { return 1024 * kMB; });
+    scheduler.run(std::move(jobs));
+    EXPECT_EQ(1, peak_);
+
+    jobs.clear();
+    for (int i = 0; i < 3; i++) {
+        jobs.push_back(StubJob(StringPrintf("com.example.app%d", i), 1, 512 * kMB));
+    }
+    peak_ = 0;
+    DexoptScheduler roomy_scheduler(4, 16, [] { return 4096 * kMB; });
+    roomy_scheduler.run(std::move(jobs));
+    EXPECT_EQ(3, peak_);
+}
+
+TEST_F(DexoptSchedulerTest, ReportsStatusAndTiming) {
+    DexoptScheduler scheduler(1, 16, [] { return -1; });
+    std::vector<DexoptScheduler::Job> jobs;
+    jobs.push_back(StubJob("com.example.app", 1, 0, 0));
+    jobs.push_back(StubJob("com.example.other", 1, 0, 3));
+    auto results = scheduler.run(std::move(jobs));
+    ASSERT_EQ(2u, results.size());
+
+    EXPECT_EQ(0, results[0].status);
+    EXPECT_TRUE(results[0].errorMessage.empty());
+    EXPECT_EQ(3, results[1].status);
+    EXPECT_EQ("stub compiler failed with 3", results[1].errorMessage);
+
+    EXPECT_GE(results[0].runMillis, 150);
+    EXPECT_GE(results[1].runMillis, 150);
+    EXPECT_GE(results[1].waitMillis, results[0].runMillis);
+}
+
+TEST_F(DexoptSchedulerTest, CompilersSeeOnlyTheirOwnFds) {
+    // A file for each job, all open while the jobs run, opened close-on-exec
+    // as dexopt() opens them.
+    constexpr int kJobs = 4;
+    std::vector<unique_fd> fds;
+    for (int i = 0; i < kJobs; i++) {
+        fds.emplace_back(open("/dev/null", O_RDONLY | O_CLOEXEC));
+        ASSERT_NE(-1, fds.back().get());
+    }
+
+    DexoptScheduler scheduler(kJobs, kJobs, [] { return -1; });
+    std::vector<DexoptScheduler::Job> jobs;
+    for (int i = 0; i < kJobs; i++) {
+        // The stub compiler fails if it's missing its own file, or with the
+        // number of files of the other jobs it can see.
+        std::string others;
+        for (int j = 0; j < kJobs; j++) {
+            if (j != i) {
+                others += StringPrintf(" %d", fds[j].get());
+            }
+        }
+        std::string script = StringPrintf(
+                "sleep 0.2; [ -e /proc/$$/fd/%d ] || exit 100; n=0; "
+                "for fd in%s; do [ -e /proc/$$/fd/$fd ] && n=$((n + 1)); done; exit $n",
+                fds[i].get(), others.c_str());
+        DexoptScheduler::Job job;
+        job.packageName = StringPrintf("com.example.app%d", i);
+        job.run = [script, fd = fds[i].get()](std::string* error_msg) {
+            return RunStub(script, { fd }, error_msg);
+        };
+        jobs.push_back(std::move(job));
+    }
+    auto results = scheduler.run(std::move(jobs));
+    ASSERT_EQ(static_cast<size_t>(kJobs), results.size());
+    for (const auto& result : results) {
+        EXPECT_EQ(0, result.status) << result.errorMessage;
+    }
+}
+
+TEST(DexoptResourcesTest, GetDex2oatResources) {
+    int threads = 0;
+    int64_t memory = 0;
+    get_dex2oat_resources(DEXOPT_BOOTCOMPLETE, &threads, &memory);
+    EXPECT_GE(threads, 1);
+    EXPECT_GT(memory, 0);
+}
+
 }  // namespace installd
 }  // namespace android
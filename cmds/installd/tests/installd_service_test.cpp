@@ -34,6 +34,7 @@
 
 #include "binder_test_utils.h"
 #include "InstalldNativeService.h"
+#include "TreeCopier.h"
 #include "dexopt.h"
 #include "globals.h"
 #include "utils.h"
@@ -249,6 +250,75 @@ TEST_F(ServiceTest, CalculateCache) {
     EXPECT_EQ("/data/dalvik-cache/isa/path@to@file.apk@classes.dex", std::string(buf));
 }
 
+TEST_F(ServiceTest, CopyTree) {
+    mkdir("com.example", 10000, 20000, 0751);
+    mkdir("com.example/dir", 10000, 20000, 0700);
+    mkdir("com.example/dir/sub", 10001, 20001, 0750);
+    touch("com.example/dir/sub/empty", 10001, 20001, 0600);
+    ASSERT_TRUE(android::base::WriteStringToFile("content",
+            get_full_path("com.example/dir/file"), 0640, 10000, 20000, false));
+    ASSERT_EQ(0, symlink("dir/file", get_full_path("com.example/link").c_str()));
+    ASSERT_EQ(0, ::setxattr(get_full_path("com.example/dir").c_str(), kXattrCacheGroup, "", 0, 0));
+    ASSERT_EQ(0, ::setxattr(get_full_path("com.example").c_str(), kXattrInodeCache, "1", 1, 0));
+    const struct timespec times[2] = {{1000, 0}, {2000, 0}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, get_full_path("com.example/dir/file").c_str(), times, 0));
+    ASSERT_EQ(0, utimensat(AT_FDCWD, get_full_path("com.example/dir").c_str(), times, 0));
+    mkdir("copy", 0, 0, 0700);
+    // Replaced rather than written through
+    mkdir("copy/com.example", 0, 0, 0700);
+    ASSERT_EQ(0, symlink("/dev/null", get_full_path("copy/com.example/link").c_str()));
+
+    TreeCopier copier;
+    int64_t progressFiles = 0;
+    copier.setProgress([&progressFiles](int64_t files, int64_t) {
+        progressFiles = files;
+        return true;
+    });
+    ASSERT_EQ(0, copier.copy(get_full_path("com.example"), get_full_path("copy")));
+    EXPECT_EQ(3, copier.files());
+    EXPECT_EQ(3, progressFiles);
+
+    std::string content;
+    EXPECT_TRUE(android::base::ReadFileToString(get_full_path("copy/com.example/dir/file"),
+            &content));
+    EXPECT_EQ("content", content);
+    EXPECT_EQ(0751, stat_mode("copy/com.example"));
+    EXPECT_EQ(0640, stat_mode("copy/com.example/dir/file"));
+    EXPECT_EQ(0750, stat_mode("copy/com.example/dir/sub"));
+    EXPECT_EQ(20000, stat_gid("copy/com.example/dir/file"));
+    EXPECT_EQ(20001, stat_gid("copy/com.example/dir/sub/empty"));
+
+    struct stat st;
+    ASSERT_EQ(0, stat(get_full_path("copy/com.example/dir/file").c_str(), &st));
+    EXPECT_EQ(2000, st.st_mtime);
+    ASSERT_EQ(0, stat(get_full_path("copy/com.example/dir").c_str(), &st));
+    EXPECT_EQ(2000, st.st_mtime);
+
+    std::string target;
+    EXPECT_TRUE(android::base::Readlink(get_full_path("copy/com.example/link"), &target));
+    EXPECT_EQ("dir/file", target);
+    EXPECT_EQ(0, getxattr(get_full_path("copy/com.example/dir").c_str(), kXattrCacheGroup,
+            nullptr, 0));
+    EXPECT_EQ(-1, getxattr(get_full_path("copy/com.example").c_str(), kXattrInodeCache,
+            nullptr, 0));
+}
+
+TEST_F(ServiceTest, CopyTree_Cancel) {
+    mkdir("com.example", 10000, 20000, 0700);
+    touch("com.example/file1", 10000, 20000, 0600);
+    touch("com.example/file2", 10000, 20000, 0600);
+    mkdir("copy", 0, 0, 0700);
+
+    TreeCopier copier;
+    copier.setProgress([](int64_t, int64_t) { return false; });
+    EXPECT_EQ(-1, copier.copy(get_full_path("com.example"), get_full_path("copy")));
+    EXPECT_EQ(ECANCELED, errno);
+    EXPECT_EQ(1, copier.files());
+
+    EXPECT_EQ(-1, copier.copy(get_full_path("missing"), get_full_path("copy")));
+    EXPECT_EQ(ENOENT, errno);
+}
+
 static bool mkdirs(const std::string& path, mode_t mode) {
     struct stat sb;
     if (stat(path.c_str(), &sb) != -1 && S_ISDIR(sb.st_mode)) {
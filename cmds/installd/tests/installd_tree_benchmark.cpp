@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures walking synthetic cache trees of 10^5 and 10^6 files, laid out as
+// 100 files per directory under two levels of directories:
+//  - BM_Fts sums sizes with a serial fts_read(), as calculate_tree_size() did.
+//  - BM_TreeWalker sums sizes with a TreeWalker of the given number of threads.
+//  - BM_CalculateTreeSize and BM_LoadItems measure both call sites.
+//  - BM_SizeIndex measures a SizeIndex measuring the tree again, either
+//    unchanged or with one directory changed before each iteration, to
+//    compare against BM_CalculateTreeSize.
+//
+// The trees are left in /data/local/tmp/installd_tree_benchmark to be reused
+// by later runs, since creating them takes much longer than walking them. The
+// page cache is warm after the first iteration; drop it between runs to
+// measure cold walks.
+
+#include <fts.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/macros.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <cutils/properties.h>
+
+#include "CacheTracker.h"
+#include "SizeIndex.h"
+#include "TreeWalker.h"
+#include "utils.h"
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace installd {
+
+int get_property(const char *key, char *value, const char *default_value) {
+    return property_get(key, value, default_value);
+}
+
+bool calculate_oat_file_path(char path[PKG_PATH_MAX] ATTRIBUTE_UNUSED,
+        const char *oat_dir ATTRIBUTE_UNUSED,
+        const char *apk_path ATTRIBUTE_UNUSED,
+        const char *instruction_set ATTRIBUTE_UNUSED) {
+    return false;
+}
+
+bool calculate_odex_file_path(char path[PKG_PATH_MAX] ATTRIBUTE_UNUSED,
+        const char *apk_path ATTRIBUTE_UNUSED,
+        const char *instruction_set ATTRIBUTE_UNUSED) {
+    return false;
+}
+
+bool create_cache_path(char path[PKG_PATH_MAX] ATTRIBUTE_UNUSED,
+        const char *src ATTRIBUTE_UNUSED,
+        const char *instruction_set ATTRIBUTE_UNUSED) {
+    return false;
+}
+
+namespace {
+
+constexpr const char* kRoot = "/data/local/tmp/installd_tree_benchmark";
+constexpr int kFilesPerDir = 100;
+constexpr int kDirsPerDir = 32;
+
+// Returns the data directory of a tree of the given number of files, whose
+// cache directory holds them all.
+std::string getTree(int files) {
+    const std::string path = StringPrintf("%s/%d", kRoot, files);
+    const std::string done = path + "/done";
+    if (access(done.c_str(), F_OK) == 0) {
+        return path;
+    }
+
+    ::mkdir(kRoot, 0755);
+    ::mkdir(path.c_str(), 0755);
+    ::mkdir((path + "/cache").c_str(), 0755);
+    const int dirs = files / kFilesPerDir;
+    for (int i = 0; i < dirs; i++) {
+        const std::string top = StringPrintf("%s/cache/%d", path.c_str(), i / kDirsPerDir);
+        const std::string dir = StringPrintf("%s/%d", top.c_str(), i % kDirsPerDir);
+        ::mkdir(top.c_str(), 0755);
+        ::mkdir(dir.c_str(), 0755);
+        for (int j = 0; j < kFilesPerDir; j++) {
+            const std::string file = StringPrintf("%s/file%d", dir.c_str(), j);
+            // Enough to take up a block, so that sizes add up to something.
+            android::base::WriteStringToFile(file, file);
+        }
+    }
+    android::base::WriteStringToFile("", done);
+    return path;
+}
+
+int64_t ftsTreeSize(const std::string& path) {
+    int64_t size = 0;
+    char* argv[] = { (char*) path.c_str(), nullptr };
+    FTS* fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, nullptr);
+    FTSENT* p;
+    while ((p = fts_read(fts)) != nullptr) {
+        switch (p->fts_info) {
+        case FTS_D:
+        case FTS_DEFAULT:
+        case FTS_F:
+        case FTS_SL:
+        case FTS_SLNONE:
+            size += p->fts_statp->st_blocks * 512;
+            break;
+        }
+    }
+    fts_close(fts);
+    return size;
+}
+
+void BM_Fts(benchmark::State& state) {
+    const std::string path = getTree(state.range(0)) + "/cache";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ftsTreeSize(path));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_TreeWalker(benchmark::State& state) {
+    const std::string path = getTree(state.range(0)) + "/cache";
+    TreeWalker walker(state.range(1));
+    for (auto _ : state) {
+        std::vector<int64_t> sizes(walker.threads());
+        walker.walk(path, [&sizes](TreeWalker::Entry* entry) {
+            sizes[entry->worker] += entry->st->st_blocks * 512;
+            return true;
+        });
+        benchmark::DoNotOptimize(sizes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_CalculateTreeSize(benchmark::State& state) {
+    const std::string path = getTree(state.range(0)) + "/cache";
+    for (auto _ : state) {
+        int64_t size = 0;
+        calculate_tree_size(path, &size);
+        benchmark::DoNotOptimize(size);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_LoadItems(benchmark::State& state) {
+    const std::string path = getTree(state.range(0));
+    const std::string uuid;
+    for (auto _ : state) {
+        CacheTracker tracker(0, 10000, uuid);
+        tracker.addDataPath(path);
+        tracker.loadItems();
+        benchmark::DoNotOptimize(tracker.items.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_SizeIndex(benchmark::State& state) {
+    const std::string path = getTree(state.range(0)) + "/cache";
+    const std::string changed = path + "/0/0/changed";
+    SizeIndex index("");
+    int64_t size = 0;
+    index.calculateTreeSize(path, &size);
+    for (auto _ : state) {
+        if (state.range(1)) {
+            state.PauseTiming();
+            if (unlink(changed.c_str()) != 0) {
+                android::base::WriteStringToFile(changed, changed);
+            }
+            state.ResumeTiming();
+        }
+        size = 0;
+        index.calculateTreeSize(path, &size);
+        benchmark::DoNotOptimize(size);
+    }
+    unlink(changed.c_str());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void TreeWalkerArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"files", "threads"});
+    for (int files : {100000, 1000000}) {
+        for (int threads : {1, 2, 4, 8}) {
+            b->Args({files, threads});
+        }
+    }
+}
+
+void SizeIndexArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"files", "changed"});
+    for (int files : {100000, 1000000}) {
+        for (int changed : {0, 1}) {
+            b->Args({files, changed});
+        }
+    }
+}
+
+BENCHMARK(BM_Fts)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TreeWalker)
+        ->Apply(TreeWalkerArgs)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_CalculateTreeSize)
+        ->Arg(100000)
+        ->Arg(1000000)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_SizeIndex)
+        ->Apply(SizeIndexArgs)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_LoadItems)
+        ->Arg(100000)
+        ->Arg(1000000)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+}  // namespace
+}  // namespace installd
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -361,6 +361,38 @@ status_t Parcel::setDataCapacity(size_t size)
     return NO_ERROR;
 }
 
+status_t Parcel::reserveCapacity(size_t dataSize, size_t objectsCount)
+{
+    if (dataSize > INT32_MAX || objectsCount > INT32_MAX) {
+        // don't accept size_t values which may have come from an
+        // inadvertent conversion from a negative int.
+        return BAD_VALUE;
+    }
+
+    const size_t desired = mDataSize + dataSize;
+    if (desired > mDataCapacity) {
+        const status_t err = continueWrite(desired);
+        if (err != NO_ERROR) {
+            return err;
+        }
+    }
+
+    // Objects owned by someone else are copied when the data is.
+    if (!mOwner && mObjectsSize + objectsCount > mObjectsCapacity) {
+        const size_t newSize = mObjectsSize + objectsCount;
+        if (newSize > SIZE_MAX / sizeof(binder_size_t)) return NO_MEMORY; // overflow
+        binder_size_t* objects =
+            (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+        if (!objects) {
+            mError = NO_MEMORY;
+            return NO_MEMORY;
+        }
+        mObjects = objects;
+        mObjectsCapacity = newSize;
+    }
+    return NO_ERROR;
+}
+
 status_t Parcel::setData(const uint8_t* buffer, size_t len)
 {
     if (len > INT32_MAX) {
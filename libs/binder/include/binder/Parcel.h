@@ -71,6 +71,13 @@ public:
     void                setDataPosition(size_t pos) const;
     status_t            setDataCapacity(size_t size);
 
+    // Hints that roughly dataSize more bytes and objectsCount more objects
+    // are going to be written, so the writes don't have to grow the parcel
+    // several times.  Callers that write a large payload piece by piece can
+    // reserve its size, or gather the pieces with ParcelGatherer and copy
+    // them in once.
+    status_t            reserveCapacity(size_t dataSize, size_t objectsCount = 0);
+
     status_t            setData(const uint8_t* buffer, size_t len);
 
     status_t            appendFrom(const Parcel *parcel,
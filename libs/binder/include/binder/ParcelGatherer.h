@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PARCEL_GATHERER_H
+#define ANDROID_PARCEL_GATHERER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <binder/Parcel.h>
+#include <utils/Errors.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+/*
+ * Collects the pieces of a large payload and copies them into a Parcel at
+ * once, so the Parcel is grown a single time instead of on every write.
+ *
+ * write() only records a reference to the caller's buffer, which must stay
+ * valid and unchanged until flattenTo().  Small values are kept by the
+ * gatherer itself.  The flattened data is laid out exactly as the same calls
+ * made on the Parcel would lay it out.  Objects such as binders and file
+ * descriptors can't be gathered; write them to the Parcel directly.
+ *
+ * Everything is inline and built on the public Parcel API, so Parcel's layout
+ * and libbinder's exported symbols stay as they are.
+ */
+class ParcelGatherer {
+public:
+    ParcelGatherer() = default;
+    ParcelGatherer(const ParcelGatherer&) = delete;
+    ParcelGatherer& operator=(const ParcelGatherer&) = delete;
+
+    // Same as Parcel::write(), but data is only copied by flattenTo().
+    status_t write(const void* data, size_t len) {
+        if (len > INT32_MAX) {
+            // don't accept size_t values which may have come from an
+            // inadvertent conversion from a negative int.
+            return setError(BAD_VALUE);
+        }
+        if (len > 0) {
+            mPieces.push_back({data, 0, len});
+            mDataSize += padSize(len);
+        }
+        return mError;
+    }
+
+    status_t writeInt32(int32_t val) { return writeValue(val); }
+    status_t writeUint32(uint32_t val) { return writeValue(val); }
+    status_t writeInt64(int64_t val) { return writeValue(val); }
+    status_t writeUint64(uint64_t val) { return writeValue(val); }
+
+    // The number of bytes flattenTo() is going to append, padding included.
+    size_t dataSize() const { return mDataSize; }
+
+    // Appends the gathered data at the data position of parcel, growing it at
+    // most once, and then forgets the pieces.  Returns the first error a write
+    // ran into, if any, without touching parcel.
+    status_t flattenTo(Parcel* parcel) {
+        status_t err = mError;
+        if (err == NO_ERROR) {
+            err = parcel->reserveCapacity(mDataSize);
+        }
+        for (size_t i = 0; err == NO_ERROR && i < mPieces.size(); i++) {
+            const Piece& piece = mPieces[i];
+            void* dest = parcel->writeInplace(piece.len);
+            if (dest == nullptr) {
+                err = NO_MEMORY;
+                break;
+            }
+            const void* src = piece.data != nullptr ? piece.data
+                                                    : mValues.data() + piece.valuesOffset;
+            memcpy(dest, src, piece.len);
+        }
+        clear();
+        return err;
+    }
+
+    void clear() {
+        mPieces.clear();
+        mValues.clear();
+        mDataSize = 0;
+        mError = NO_ERROR;
+    }
+
+private:
+    // A buffer owned by the caller, or a run of values from mValues when
+    // data is null.
+    struct Piece {
+        const void* data;
+        size_t valuesOffset;
+        size_t len;
+    };
+
+    static size_t padSize(size_t len) { return (len + 3) & ~size_t(3); }
+
+    template <typename T>
+    status_t writeValue(T val) {
+        static_assert(sizeof(T) % 4 == 0, "values are never padded");
+        const size_t offset = mValues.size();
+        mValues.resize(offset + sizeof(T));
+        memcpy(mValues.data() + offset, &val, sizeof(T));
+        // Consecutive values are copied into the parcel together.
+        if (!mPieces.empty() && mPieces.back().data == nullptr) {
+            mPieces.back().len += sizeof(T);
+        } else {
+            mPieces.push_back({nullptr, offset, sizeof(T)});
+        }
+        mDataSize += sizeof(T);
+        return mError;
+    }
+
+    status_t setError(status_t err) {
+        if (mError == NO_ERROR) {
+            mError = err;
+        }
+        return err;
+    }
+
+    std::vector<Piece> mPieces;
+    std::vector<uint8_t> mValues;
+    size_t mDataSize = 0;
+    status_t mError = NO_ERROR;
+};
+
+} // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_PARCEL_GATHERER_H
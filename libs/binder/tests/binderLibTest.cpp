@@ -28,6 +28,7 @@
 #include <binder/IBinder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#include <binder/ParcelGatherer.h>
 
 #include <private/binder/binder_module.h>
 #include <sys/epoll.h>
@@ -1096,6 +1097,104 @@ TEST_F(BinderLibTest, VectorSent) {
     EXPECT_EQ(readValue, testValue);
 }
 
+TEST_F(BinderLibTest, ReservedVectorSent) {
+    Parcel data, reply;
+    sp<IBinder> server = addServer();
+    ASSERT_TRUE(server != nullptr);
+
+    std::vector<uint64_t> const testValue(4096, std::numeric_limits<uint64_t>::max());
+    EXPECT_EQ(NO_ERROR, data.reserveCapacity(sizeof(int32_t) +
+                                             testValue.size() * sizeof(uint64_t)));
+    const size_t capacity = data.dataCapacity();
+    EXPECT_EQ(NO_ERROR, data.writeUint64Vector(testValue));
+    // Writing what was reserved doesn't grow the parcel.
+    EXPECT_EQ(capacity, data.dataCapacity());
+
+    status_t ret = server->transact(BINDER_LIB_TEST_ECHO_VECTOR, data, &reply);
+    EXPECT_EQ(NO_ERROR, ret);
+    std::vector<uint64_t> readValue;
+    ret = reply.readUint64Vector(&readValue);
+    EXPECT_EQ(readValue, testValue);
+}
+
+TEST_F(BinderLibTest, ReserveCapacityKeepsContents) {
+    Parcel data;
+    sp<IBinder> server = addServer();
+    ASSERT_TRUE(server != nullptr);
+
+    data.writeInt32(1);
+    data.writeStrongBinder(server);
+    EXPECT_EQ(NO_ERROR, data.reserveCapacity(64 * 1024, 16));
+    EXPECT_LE(data.dataSize() + 64 * 1024, data.dataCapacity());
+    data.writeStrongBinder(server);
+    data.writeInt32(2);
+    EXPECT_EQ(2u, data.objectsCount());
+
+    data.setDataPosition(0);
+    EXPECT_EQ(1, data.readInt32());
+    EXPECT_EQ(server, data.readStrongBinder());
+    EXPECT_EQ(server, data.readStrongBinder());
+    EXPECT_EQ(2, data.readInt32());
+}
+
+TEST_F(BinderLibTest, GatheredVectorSent) {
+    Parcel data, reply;
+    sp<IBinder> server = addServer();
+    ASSERT_TRUE(server != nullptr);
+
+    // Same layout as writeUint64Vector, handed over in two pieces.
+    std::vector<uint64_t> const testValue(4096, std::numeric_limits<uint64_t>::max());
+    const size_t half = testValue.size() / 2;
+    ParcelGatherer gatherer;
+    EXPECT_EQ(NO_ERROR, gatherer.writeInt32(testValue.size()));
+    EXPECT_EQ(NO_ERROR, gatherer.write(testValue.data(), half * sizeof(uint64_t)));
+    EXPECT_EQ(NO_ERROR, gatherer.write(testValue.data() + half,
+                                       (testValue.size() - half) * sizeof(uint64_t)));
+    EXPECT_EQ(sizeof(int32_t) + testValue.size() * sizeof(uint64_t), gatherer.dataSize());
+    EXPECT_EQ(NO_ERROR, gatherer.flattenTo(&data));
+    EXPECT_EQ(0u, gatherer.dataSize());
+
+    status_t ret = server->transact(BINDER_LIB_TEST_ECHO_VECTOR, data, &reply);
+    EXPECT_EQ(NO_ERROR, ret);
+    std::vector<uint64_t> readValue;
+    ret = reply.readUint64Vector(&readValue);
+    EXPECT_EQ(readValue, testValue);
+}
+
+TEST_F(BinderLibTest, GatheredWritesMatchParcelWrites) {
+    const char blob[] = "not a multiple of 4";
+    Parcel written, gathered;
+    written.writeInt32(1);
+    written.write(blob, sizeof(blob));
+    written.writeInt64(2);
+    written.writeUint32(3);
+    written.write(blob, sizeof(blob));
+
+    gathered.writeInt32(1);
+    ParcelGatherer gatherer;
+    gatherer.write(blob, sizeof(blob));
+    gatherer.writeInt64(2);
+    gatherer.writeUint32(3);
+    gatherer.write(blob, sizeof(blob));
+    EXPECT_EQ(written.dataSize() - gathered.dataSize(), gatherer.dataSize());
+    EXPECT_EQ(NO_ERROR, gatherer.flattenTo(&gathered));
+
+    ASSERT_EQ(written.dataSize(), gathered.dataSize());
+    EXPECT_EQ(0, memcmp(written.data(), gathered.data(), written.dataSize()));
+}
+
+TEST_F(BinderLibTest, GatherErrorLeavesParcel) {
+    Parcel data;
+    data.writeInt32(1);
+    const size_t dataSize = data.dataSize();
+
+    ParcelGatherer gatherer;
+    gatherer.writeInt32(2);
+    EXPECT_EQ(BAD_VALUE, gatherer.write(&dataSize, size_t(INT32_MAX) + 1));
+    EXPECT_EQ(BAD_VALUE, gatherer.flattenTo(&data));
+    EXPECT_EQ(dataSize, data.dataSize());
+}
+
 TEST_F(BinderLibTest, BufRejected) {
     Parcel data, reply;
     uint32_t buf;
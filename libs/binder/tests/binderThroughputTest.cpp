@@ -2,11 +2,13 @@
 #include <binder/IBinder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#include <binder/ParcelGatherer.h>
 #include <string>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <tuple>
@@ -111,6 +113,7 @@ struct ProcResults {
     uint64_t m_long_transactions = 0;
     uint64_t m_total_time = 0;
     uint64_t m_best = max_time_bucket;
+    uint64_t m_bytes_copied = 0;
 
     void add_time(uint64_t time) {
         if (time > max_time_bucket) {
@@ -132,6 +135,7 @@ struct ProcResults {
         ret.m_transactions = a.m_transactions + b.m_transactions;
         ret.m_long_transactions = a.m_long_transactions + b.m_long_transactions;
         ret.m_total_time = a.m_total_time + b.m_total_time;
+        ret.m_bytes_copied = a.m_bytes_copied + b.m_bytes_copied;
         return ret;
     }
     void dump() {
@@ -145,6 +149,7 @@ struct ProcResults {
         double worst = (double)m_worst / 1.0E6;
         double average = (double)m_total_time / m_transactions / 1.0E6;
         cout << "average:" << average << "ms worst:" << worst << "ms best:" << best << "ms" << endl;
+        cout << "bytes copied per transaction: " << (double)m_bytes_copied / m_transactions << endl;
 
         uint64_t cur_total = 0;
         float time_per_bucket_ms = time_per_bucket / 1.0E6;
@@ -176,11 +181,61 @@ String16 generateServiceName(int num)
     return serviceName;
 }
 
+// The size of the payload slices the gathering mode hands over separately.
+static const size_t gather_slice_size = 4096;
+
+// Writes the payload to data.  If bytes_copied is set, adds the bytes data
+// copies to it: what is written, and the contents moved whenever the
+// capacity changes.
+void write_payload(Parcel& data,
+                   const vector<uint32_t>& payload,
+                   bool batched,
+                   bool gathered,
+                   bool reserve,
+                   uint64_t* bytes_copied = nullptr)
+{
+    const size_t payload_bytes = payload.size() * sizeof(uint32_t);
+    auto step = [&](auto&& do_write) {
+        if (bytes_copied == nullptr) {
+            do_write();
+            return;
+        }
+        const size_t size = data.dataSize();
+        const size_t capacity = data.dataCapacity();
+        do_write();
+        if (data.dataCapacity() != capacity) {
+            *bytes_copied += size;
+        }
+        *bytes_copied += data.dataSize() - size;
+    };
+
+    if (reserve) {
+        step([&] { data.reserveCapacity(payload_bytes); });
+    }
+    if (gathered) {
+        ParcelGatherer gatherer;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload.data());
+        for (size_t offset = 0; offset < payload_bytes; offset += gather_slice_size) {
+            gatherer.write(bytes + offset, min(gather_slice_size, payload_bytes - offset));
+        }
+        step([&] { gatherer.flattenTo(&data); });
+    } else if (batched) {
+        step([&] { data.write(payload.data(), payload_bytes); });
+    } else {
+        for (uint32_t value : payload) {
+            step([&] { data.writeInt32(value); });
+        }
+    }
+}
+
 void worker_fx(int num,
                int worker_count,
                int iterations,
                int payload_size,
                bool cs_pair,
+               bool batched,
+               bool gathered,
+               bool reserve,
                Pipe p)
 {
     // Create BinderWorkerService and for go.
@@ -210,21 +265,26 @@ void worker_fx(int num,
     // Run the benchmark if client
     ProcResults results;
     chrono::time_point<chrono::high_resolution_clock> start, end;
+    const vector<uint32_t> payload(payload_size / sizeof(uint32_t), 0);
+    // Every transaction copies the same bytes, so count them once, outside
+    // of the timed loop.
+    uint64_t bytes_copied = 0;
+    {
+        Parcel data;
+        write_payload(data, payload, batched, gathered, reserve, &bytes_copied);
+    }
     for (int i = 0; (!cs_pair || num >= server_count) && i < iterations; i++) {
         Parcel data, reply;
         int target = cs_pair ? num % server_count : rand() % workers.size();
-        int sz = payload_size;
 
-        while (sz >= sizeof(uint32_t)) {
-            data.writeInt32(0);
-            sz -= sizeof(uint32_t);
-        }
         start = chrono::high_resolution_clock::now();
+        write_payload(data, payload, batched, gathered, reserve);
         status_t ret = workers[target]->transact(BINDER_NOP, data, &reply);
         end = chrono::high_resolution_clock::now();
 
         uint64_t cur_time = uint64_t(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
         results.add_time(cur_time);
+        results.m_bytes_copied += bytes_copied;
 
         if (ret != NO_ERROR) {
            cout << "thread " << num << " failed " << ret << "i : " << i << endl;
@@ -243,7 +303,8 @@ void worker_fx(int num,
     exit(EXIT_SUCCESS);
 }
 
-Pipe make_worker(int num, int iterations, int worker_count, int payload_size, bool cs_pair)
+Pipe make_worker(int num, int iterations, int worker_count, int payload_size, bool cs_pair,
+                 bool batched, bool gathered, bool reserve)
 {
     auto pipe_pair = Pipe::createPipePair();
     pid_t pid = fork();
@@ -252,7 +313,8 @@ Pipe make_worker(int num, int iterations, int worker_count, int payload_size, bo
         return move(get<0>(pipe_pair));
     } else {
         /* child */
-        worker_fx(num, worker_count, iterations, payload_size, cs_pair, move(get<1>(pipe_pair)));
+        worker_fx(num, worker_count, iterations, payload_size, cs_pair, batched, gathered,
+                  reserve, move(get<1>(pipe_pair)));
         /* never get here */
         return move(get<0>(pipe_pair));
     }
@@ -277,12 +339,16 @@ void run_main(int iterations,
               int workers,
               int payload_size,
               int cs_pair,
+              bool batched,
+              bool gathered,
+              bool reserve,
               bool training_round=false)
 {
     vector<Pipe> pipes;
     // Create all the workers and wait for them to spawn.
     for (int i = 0; i < workers; i++) {
-        pipes.push_back(make_worker(i, iterations, workers, payload_size, cs_pair));
+        pipes.push_back(make_worker(i, iterations, workers, payload_size, cs_pair, batched,
+                                    gathered, reserve));
     }
     wait_all(pipes);
 
@@ -335,6 +401,9 @@ int main(int argc, char *argv[])
     int iterations = 10000;
     int payload_size = 0;
     bool cs_pair = false;
+    bool batched = false;
+    bool gathered = false;
+    bool reserve = false;
     bool training_round = false;
     (void)argc;
     (void)argv;
@@ -345,7 +414,10 @@ int main(int argc, char *argv[])
             cout << "Usage: binderThroughputTest [OPTIONS]" << endl;
             cout << "\t-i N    : Specify number of iterations." << endl;
             cout << "\t-m N    : Specify expected max latency in microseconds." << endl;
+            cout << "\t-b      : Write the payload with a single Parcel::write." << endl;
+            cout << "\t-g      : Gather the payload in slices with ParcelGatherer." << endl;
             cout << "\t-p      : Split workers into client/server pairs." << endl;
+            cout << "\t-r      : Reserve the payload size in the Parcel up front." << endl;
             cout << "\t-s N    : Specify payload size." << endl;
             cout << "\t-t N    : Run training round." << endl;
             cout << "\t-w N    : Specify total number of workers." << endl;
@@ -371,6 +443,20 @@ int main(int argc, char *argv[])
             // the workers become clients and half servers
             cs_pair = true;
         }
+        if (string(argv[i]) == "-b") {
+            // Gather the payload first and copy it into the Parcel at
+            // once, instead of growing the Parcel as it is written.
+            batched = true;
+        }
+        if (string(argv[i]) == "-g") {
+            // Hand the payload over in slices that are copied into the
+            // Parcel together, growing it once.
+            gathered = true;
+        }
+        if (string(argv[i]) == "-r") {
+            // Hint the payload size, so writing it doesn't reallocate.
+            reserve = true;
+        }
         if (string(argv[i]) == "-t") {
             // Run one training round before actually collecting data
             // to get an approximation of max latency.
@@ -392,10 +478,11 @@ int main(int argc, char *argv[])
 
     if (training_round) {
         cout << "Start training round" << endl;
-        run_main(iterations, workers, payload_size, cs_pair, training_round=true);
+        run_main(iterations, workers, payload_size, cs_pair, batched, gathered, reserve,
+                 training_round=true);
         cout << "Completed training round" << endl << endl;
     }
 
-    run_main(iterations, workers, payload_size, cs_pair);
+    run_main(iterations, workers, payload_size, cs_pair, batched, gathered, reserve);
     return 0;
 }
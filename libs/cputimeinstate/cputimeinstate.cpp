@@ -22,8 +22,13 @@
 #include <dirent.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <string.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <numeric>
 #include <optional>
@@ -467,6 +472,207 @@ std::optional<std::unordered_map<uint32_t, concurrent_time_t>> getUidsUpdatedCon
     return ret;
 }
 
+// BPF_MAP_LOOKUP_BATCH and its attributes, from the Linux 5.6 UAPI, which the kernel headers we
+// build against predate.
+static constexpr int BPF_MAP_LOOKUP_BATCH_CMD = 24;
+struct bpf_map_batch_attr_t {
+    uint64_t in_batch;
+    uint64_t out_batch;
+    uint64_t keys;
+    uint64_t values;
+    uint32_t count;
+    uint32_t map_fd;
+    uint64_t elem_flags;
+    uint64_t flags;
+};
+// The kernel's internal "operation not supported" error, which it leaks for unsupported map types.
+static constexpr int ENOTSUPP_KERNEL = 524;
+static constexpr uint32_t INITIAL_BATCH_SIZE = 256;
+
+static std::atomic<bool> gLookupBatchSupported{true};
+
+// Reads every entry of the map with BPF_MAP_LOOKUP_BATCH into keys and values, reusing their
+// memory. Returns the number of entries, or no value if the first batch failed, for example
+// because the kernel doesn't support batch lookups. Sets *error if a later batch fails.
+static std::optional<size_t> lookupMapBatch(int mapFd, size_t keySize, size_t valueSize,
+                                            std::vector<uint8_t> *keys,
+                                            std::vector<uint8_t> *values, bool *error) {
+    uint64_t inBatch = 0, outBatch = 0;
+    uint32_t batchSize = INITIAL_BATCH_SIZE;
+    size_t count = 0;
+    bool first = true;
+    while (true) {
+        if (keys->size() < (count + batchSize) * keySize) {
+            keys->resize((count + batchSize) * keySize);
+            values->resize((count + batchSize) * valueSize);
+        }
+        bpf_map_batch_attr_t attr = {
+                .in_batch = first ? 0 : reinterpret_cast<uint64_t>(&inBatch),
+                .out_batch = reinterpret_cast<uint64_t>(&outBatch),
+                .keys = reinterpret_cast<uint64_t>(keys->data() + count * keySize),
+                .values = reinterpret_cast<uint64_t>(values->data() + count * valueSize),
+                .count = batchSize,
+                .map_fd = static_cast<uint32_t>(mapFd),
+        };
+        if (syscall(__NR_bpf, BPF_MAP_LOOKUP_BATCH_CMD, &attr, sizeof(attr)) == 0) {
+            count += attr.count;
+            inBatch = outBatch;
+            first = false;
+            continue;
+        }
+        // The last batch fails with ENOENT, but still returns its entries.
+        if (errno == ENOENT) return count + attr.count;
+        // A hash bucket didn't fit in the batch; retry it with a larger one.
+        if (errno == ENOSPC && batchSize < UINT32_MAX / 2) {
+            batchSize *= 2;
+            continue;
+        }
+        if (first) {
+            // Let the caller read the map the slow way, which reports any real error.
+            if (errno == EINVAL || errno == ENOTSUPP_KERNEL) gLookupBatchSupported = false;
+            return {};
+        }
+        *error = true;
+        return 0;
+    }
+}
+
+// Reads every entry of the map into keys and values, reusing their memory. keys receives
+// time_key_t's, and values valueSize bytes for each key. Returns no value on error.
+static std::optional<size_t> readAllMapEntries(int mapFd, size_t valueSize,
+                                               std::vector<uint8_t> *keys,
+                                               std::vector<uint8_t> *values) {
+    if (gLookupBatchSupported) {
+        bool error = false;
+        auto count = lookupMapBatch(mapFd, sizeof(time_key_t), valueSize, keys, values, &error);
+        if (error) return {};
+        if (count.has_value()) return count;
+    }
+
+    // Without batch lookups, fall back to reading the entries one at a time.
+    time_key_t key, prevKey;
+    if (getFirstMapKey(mapFd, &key)) {
+        if (errno == ENOENT) return 0;
+        return {};
+    }
+    size_t count = 0;
+    do {
+        if (keys->size() < (count + 1) * sizeof(key)) {
+            keys->resize(std::max<size_t>(INITIAL_BATCH_SIZE, 2 * count) * sizeof(key));
+            values->resize(std::max<size_t>(INITIAL_BATCH_SIZE, 2 * count) * valueSize);
+        }
+        if (findMapEntry(mapFd, &key, values->data() + count * valueSize)) return {};
+        memcpy(keys->data() + count * sizeof(key), &key, sizeof(key));
+        count++;
+    } while (prevKey = key, !getNextMapKey(mapFd, &prevKey, &key));
+    if (errno != ENOENT) return {};
+    return count;
+}
+
+bool UidTimesPoller::poll(uid_time_deltas_t *deltas) {
+    if (!gInitialized && !initGlobals()) return false;
+
+    // The policies don't change, so their layout is worked out on the first poll only.
+    if (mPolicyOffsets.empty()) {
+        mStride = mType == Type::CONCURRENT ? gNCpus : 0;
+        for (uint32_t i = 0; i < gNPolicies; ++i) {
+            mPolicyOffsets.push_back(mStride);
+            mStride += mType == Type::CONCURRENT ? gPolicyCpus[i].size() : gPolicyFreqs[i].size();
+        }
+    }
+    const uint32_t stride = mStride;
+    const std::vector<uint32_t> &policyOffsets = mPolicyOffsets;
+
+    const size_t valueSize = gNCpus *
+            (mType == Type::CONCURRENT ? sizeof(concurrent_val_t) : sizeof(tis_val_t));
+    auto count = readAllMapEntries(mType == Type::CONCURRENT ? gConcurrentMapFd : gTisMapFd,
+                                   valueSize, &mKeys, &mValues);
+    if (!count.has_value()) return false;
+
+    std::fill(mCurrent.begin(), mCurrent.end(), 0);
+    std::fill(mSeen.begin(), mSeen.end(), false);
+    for (size_t i = 0; i < *count; ++i) {
+        time_key_t key;
+        memcpy(&key, mKeys.data() + i * sizeof(key), sizeof(key));
+        auto [it, inserted] = mRows.try_emplace(key.uid, mUids.size());
+        if (inserted) {
+            mUids.push_back(key.uid);
+            mTotals.resize(mTotals.size() + stride, 0);
+            mCurrent.resize(mCurrent.size() + stride, 0);
+            mSeen.push_back(false);
+        }
+        mSeen[it->second] = true;
+        uint64_t *row = mCurrent.data() + it->second * stride;
+        const uint8_t *value = mValues.data() + i * valueSize;
+
+        if (mType == Type::CPU_FREQ) {
+            const tis_val_t *vals = reinterpret_cast<const tis_val_t *>(value);
+            const uint32_t offset = key.bucket * FREQS_PER_ENTRY;
+            for (uint32_t policy = 0; policy < gNPolicies; ++policy) {
+                if (offset >= gPolicyFreqs[policy].size()) continue;
+                const uint32_t n = std::min<uint32_t>(FREQS_PER_ENTRY,
+                                                      gPolicyFreqs[policy].size() - offset);
+                uint64_t *out = row + policyOffsets[policy] + offset;
+                for (const auto &cpu : gPolicyCpus[policy]) {
+                    for (uint32_t j = 0; j < n; ++j) out[j] += vals[cpu].ar[j];
+                }
+            }
+        } else {
+            const concurrent_val_t *vals = reinterpret_cast<const concurrent_val_t *>(value);
+            const uint32_t offset = key.bucket * CPUS_PER_ENTRY;
+            if (offset < gNCpus) {
+                const uint32_t n = std::min<uint32_t>(CPUS_PER_ENTRY, gNCpus - offset);
+                for (uint32_t cpu = 0; cpu < gNCpus; ++cpu) {
+                    for (uint32_t j = 0; j < n; ++j) row[offset + j] += vals[cpu].active[j];
+                }
+            }
+            for (uint32_t policy = 0; policy < gNPolicies; ++policy) {
+                if (offset >= gPolicyCpus[policy].size()) continue;
+                const uint32_t n = std::min<uint32_t>(CPUS_PER_ENTRY,
+                                                      gPolicyCpus[policy].size() - offset);
+                uint64_t *out = row + policyOffsets[policy] + offset;
+                for (const auto &cpu : gPolicyCpus[policy]) {
+                    for (uint32_t j = 0; j < n; ++j) out[j] += vals[cpu].policy[j];
+                }
+            }
+        }
+    }
+
+    deltas->stride = stride;
+    deltas->uids.clear();
+    deltas->deltas.clear();
+    // Rows of UIDs that are gone are dropped, and the remaining ones moved up to fill the gaps.
+    uint32_t kept = 0;
+    for (uint32_t row = 0; row < mUids.size(); ++row) {
+        if (!mSeen[row]) {
+            // The UID was cleared; it starts from zero if it shows up again.
+            mRows.erase(mUids[row]);
+            continue;
+        }
+        uint64_t *total = mTotals.data() + kept * stride;
+        const uint64_t *current = mCurrent.data() + row * stride;
+        if (kept != row) {
+            std::copy(mTotals.data() + row * stride, mTotals.data() + (row + 1) * stride, total);
+            mUids[kept] = mUids[row];
+            mRows[mUids[kept]] = kept;
+        }
+        ++kept;
+        if (std::equal(current, current + stride, total)) continue;
+
+        deltas->uids.push_back(mUids[kept - 1]);
+        for (uint32_t j = 0; j < stride; ++j) {
+            // Times only decrease when the UID was cleared between two polls.
+            deltas->deltas.push_back(current[j] >= total[j] ? current[j] - total[j] : current[j]);
+        }
+        std::copy(current, current + stride, total);
+    }
+    mUids.resize(kept);
+    mTotals.resize(kept * stride);
+    mCurrent.resize(kept * stride);
+    mSeen.resize(kept);
+    return true;
+}
+
 // Clear all time in state data for a given uid. Returns false on error, true otherwise.
 // This is only suitable for clearing data when an app is uninstalled; if called on a UID with
 // running tasks it will cause time in state vs. concurrent time totals to be inconsistent for that
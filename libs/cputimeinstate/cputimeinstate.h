@@ -41,5 +41,51 @@ std::optional<std::unordered_map<uint32_t, concurrent_time_t>>
     getUidsUpdatedConcurrentTimes(uint64_t *lastUpdate);
 bool clearUidTimes(unsigned int uid);
 
+// The times of the UIDs that ran since the previous poll of a UidTimesPoller, laid out flat: the
+// values of uids[i] are deltas[i * stride] to deltas[(i + 1) * stride - 1].
+struct uid_time_deltas_t {
+    uint32_t stride = 0;
+    std::vector<uint32_t> uids;
+    std::vector<uint64_t> deltas;
+};
+
+// Polls the times of all UIDs and reports how much they grew since the previous poll. This is
+// much cheaper than getUidsUpdatedCpuFreqTimes and getUidsUpdatedConcurrentTimes for collectors
+// that poll every UID: the maps are read in batches where the kernel supports it, and neither the
+// poller nor a reused uid_time_deltas_t allocate once they have seen every UID.
+// A UidTimesPoller is not thread-safe.
+class UidTimesPoller {
+public:
+    enum class Type {
+        // Values are the times at each frequency of each policy, in the order of getCpuFreqs().
+        CPU_FREQ,
+        // Values are the active times followed by the times of each policy, in the format of
+        // concurrent_time_t.
+        CONCURRENT,
+    };
+
+    explicit UidTimesPoller(Type type) : mType(type) {}
+
+    // Replaces the contents of deltas with the UIDs whose times grew since the previous call, or
+    // all the UIDs on the first call. Returns false on error.
+    bool poll(uid_time_deltas_t *deltas);
+
+private:
+    const Type mType;
+    // The number of values of a UID, and the offset of the values of each policy among them.
+    uint32_t mStride = 0;
+    std::vector<uint32_t> mPolicyOffsets;
+    // Row r of the flat arrays below holds the times of mUids[r]. The rows of UIDs that are no
+    // longer in the maps are dropped.
+    std::unordered_map<uint32_t, uint32_t> mRows;
+    std::vector<uint32_t> mUids;
+    std::vector<uint64_t> mTotals;
+    std::vector<uint64_t> mCurrent;
+    std::vector<bool> mSeen;
+    // Raw map entries, kept to reuse their memory.
+    std::vector<uint8_t> mKeys;
+    std::vector<uint8_t> mValues;
+};
+
 } // namespace bpf
 } // namespace android
@@ -19,7 +19,10 @@
 
 #include <sys/sysinfo.h>
 
+#include <algorithm>
+#include <chrono>
 #include <numeric>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
@@ -471,6 +474,174 @@ TEST(TimeInStateTest, RemoveUid) {
     ASSERT_EQ(allConcurrentTimes->find(uid), allConcurrentTimes->end());
 }
 
+TEST(TimeInStateTest, PolledCpuFreqTimesMatchAllUidTimeInState) {
+    UidTimesPoller poller(UidTimesPoller::Type::CPU_FREQ);
+    uid_time_deltas_t deltas;
+    ASSERT_TRUE(poller.poll(&deltas));
+    auto map = getUidsCpuFreqTimes();
+    ASSERT_TRUE(map.has_value());
+    ASSERT_FALSE(deltas.uids.empty());
+    ASSERT_EQ(deltas.uids.size() * deltas.stride, deltas.deltas.size());
+
+    // The first poll reports the totals of every UID, which were read slightly earlier.
+    for (size_t i = 0; i < deltas.uids.size(); ++i) {
+        ASSERT_NE(map->find(deltas.uids[i]), map->end());
+        const auto &times = (*map)[deltas.uids[i]];
+        uint32_t j = 0;
+        for (const auto &policyTimes : times) {
+            for (auto time : policyTimes) {
+                ASSERT_LT(j, deltas.stride);
+                ASSERT_LE(deltas.deltas[i * deltas.stride + j], time);
+                ASSERT_LE(time - deltas.deltas[i * deltas.stride + j], NSEC_PER_SEC);
+                ++j;
+            }
+        }
+        ASSERT_EQ(j, deltas.stride);
+    }
+
+    // Later polls only report what changed in between.
+    ASSERT_TRUE(poller.poll(&deltas));
+    for (size_t i = 0; i < deltas.uids.size(); ++i) {
+        uint64_t sum = std::accumulate(deltas.deltas.begin() + i * deltas.stride,
+                                       deltas.deltas.begin() + (i + 1) * deltas.stride,
+                                       (uint64_t)0);
+        ASSERT_GT(sum, (uint64_t)0);
+        ASSERT_LE(sum, NSEC_PER_SEC);
+    }
+}
+
+TEST(TimeInStateTest, PolledConcurrentTimesMatchAllUidConcurrentTimes) {
+    UidTimesPoller poller(UidTimesPoller::Type::CONCURRENT);
+    uid_time_deltas_t deltas;
+    ASSERT_TRUE(poller.poll(&deltas));
+    auto map = getUidsConcurrentTimes();
+    ASSERT_TRUE(map.has_value());
+    ASSERT_FALSE(deltas.uids.empty());
+    ASSERT_EQ(deltas.uids.size() * deltas.stride, deltas.deltas.size());
+
+    for (size_t i = 0; i < deltas.uids.size(); ++i) {
+        ASSERT_NE(map->find(deltas.uids[i]), map->end());
+        const auto &times = (*map)[deltas.uids[i]];
+        size_t policySize = 0;
+        for (const auto &policyTimes : times.policy) policySize += policyTimes.size();
+        ASSERT_EQ(times.active.size() + policySize, deltas.stride);
+
+        const uint64_t *values = deltas.deltas.data() + i * deltas.stride;
+        uint64_t activeSum = std::accumulate(values, values + times.active.size(), (uint64_t)0);
+        uint64_t policySum =
+                std::accumulate(values + times.active.size(), values + deltas.stride, (uint64_t)0);
+        // Same slight flakiness as TestConcurrentTimesConsistent.
+        ASSERT_EQ(activeSum, policySum);
+    }
+}
+
+// Adds fake UIDs to the time in state map by copying a real entry, and clears them again when it
+// goes out of scope, however the test exits.
+class FakeUids {
+public:
+    ~FakeUids() {
+        for (uint32_t uid : mUids) EXPECT_TRUE(clearUidTimes(uid));
+    }
+
+    void init() {
+        auto times = getUidsCpuFreqTimes();
+        ASSERT_TRUE(times.has_value());
+        for (const auto &kv : *times) mNextUid = std::max(mNextUid, kv.first);
+        ++mNextUid;
+
+        mFd.reset(bpf_obj_get(BPF_FS_PATH "map_time_in_state_uid_time_in_state_map"));
+        ASSERT_GE(mFd, 0);
+        ASSERT_FALSE(getFirstMapKey(mFd, &mKey));
+        mVals.resize(get_nprocs_conf());
+        ASSERT_FALSE(findMapEntry(mFd, &mKey, mVals.data()));
+    }
+
+    // Adds a new fake UID, or writes the entry of uid again. Returns false if the map is full.
+    bool add(std::optional<uint32_t> uid = {}) {
+        mKey.uid = uid.value_or(mNextUid);
+        if (writeToMapEntry(mFd, &mKey, mVals.data(), BPF_ANY)) return false;
+        if (!uid.has_value()) mUids.push_back(mNextUid++);
+        return true;
+    }
+
+    size_t size() const { return mUids.size(); }
+    uint32_t operator[](size_t i) const { return mUids[i]; }
+
+private:
+    uint32_t mNextUid = 0;
+    std::vector<uint32_t> mUids;
+    android::base::unique_fd mFd;
+    time_key_t mKey;
+    std::vector<tis_val_t> mVals;
+};
+
+static const uint64_t *findPolledTimes(const uid_time_deltas_t &deltas, uint32_t uid) {
+    auto it = std::find(deltas.uids.begin(), deltas.uids.end(), uid);
+    if (it == deltas.uids.end()) return nullptr;
+    return deltas.deltas.data() + (it - deltas.uids.begin()) * deltas.stride;
+}
+
+TEST(TimeInStateTest, PollerForgetsClearedUids) {
+    FakeUids fakeUids;
+    ASSERT_NO_FATAL_FAILURE(fakeUids.init());
+    ASSERT_TRUE(fakeUids.add());
+    ASSERT_TRUE(fakeUids.add());
+
+    UidTimesPoller poller(UidTimesPoller::Type::CPU_FREQ);
+    uid_time_deltas_t deltas;
+    ASSERT_TRUE(poller.poll(&deltas));
+    const uint64_t *times = findPolledTimes(deltas, fakeUids[0]);
+    ASSERT_NE(nullptr, times);
+    const std::vector<uint64_t> firstTimes(times, times + deltas.stride);
+    ASSERT_NE(nullptr, findPolledTimes(deltas, fakeUids[1]));
+
+    // The cleared UID is dropped, which moves the other one to another row.
+    ASSERT_TRUE(clearUidTimes(fakeUids[0]));
+    ASSERT_TRUE(poller.poll(&deltas));
+    ASSERT_EQ(nullptr, findPolledTimes(deltas, fakeUids[0]));
+    ASSERT_EQ(nullptr, findPolledTimes(deltas, fakeUids[1]));
+
+    // A UID that comes back is reported from zero, and the moved one still hasn't changed.
+    ASSERT_TRUE(fakeUids.add(fakeUids[0]));
+    ASSERT_TRUE(poller.poll(&deltas));
+    times = findPolledTimes(deltas, fakeUids[0]);
+    ASSERT_NE(nullptr, times);
+    ASSERT_EQ(firstTimes, std::vector<uint64_t>(times, times + deltas.stride));
+    ASSERT_EQ(nullptr, findPolledTimes(deltas, fakeUids[1]));
+}
+
+// Not a correctness test: reports how the cost of polling all UIDs grows with their number, for
+// the map based API and for UidTimesPoller.
+TEST(TimeInStateTest, PollCostByUidCount) {
+    FakeUids fakeUids;
+    ASSERT_NO_FATAL_FAILURE(fakeUids.init());
+
+    constexpr int kPolls = 20;
+    UidTimesPoller poller(UidTimesPoller::Type::CPU_FREQ);
+    uid_time_deltas_t deltas;
+    for (size_t target : {0, 100, 250, 500, 1000}) {
+        // Stop adding UIDs once the map is full.
+        while (fakeUids.size() < target && fakeUids.add()) {
+        }
+        if (fakeUids.size() < target) break;
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t lastUpdate = 0;
+        for (int i = 0; i < kPolls; ++i) ASSERT_TRUE(getUidsUpdatedCpuFreqTimes(&lastUpdate));
+        auto mapTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kPolls; ++i) ASSERT_TRUE(poller.poll(&deltas));
+        auto pollerTime = std::chrono::steady_clock::now() - start;
+
+        using std::chrono::microseconds;
+        printf("%zu fake UIDs: getUidsUpdatedCpuFreqTimes %lldus, UidTimesPoller %lldus\n",
+               fakeUids.size(),
+               (long long)std::chrono::duration_cast<microseconds>(mapTime).count() / kPolls,
+               (long long)std::chrono::duration_cast<microseconds>(pollerTime).count() / kPolls);
+    }
+}
+
 TEST(TimeInStateTest, GetCpuFreqs) {
     auto freqs = getCpuFreqs();
     ASSERT_TRUE(freqs.has_value());
@@ -24,78 +24,174 @@
 #include <gui/IGraphicBufferProducer.h>
 #include <gui/LayerState.h>
 
+#include <atomic>
 #include <cmath>
 
+#include <android-base/properties.h>
+
 namespace android {
 
-status_t layer_state_t::write(Parcel& output) const
+namespace {
+
+std::atomic<layer_state_t::ParcelFormat>& parcelFormat() {
+    static std::atomic<layer_state_t::ParcelFormat> format(
+            base::GetBoolProperty("debug.sf.layer_state_full_parcel", false)
+                    ? layer_state_t::ParcelFormat::FULL
+                    : layer_state_t::ParcelFormat::COMPACT);
+    return format;
+}
+
+} // namespace
+
+void layer_state_t::setParcelFormat(ParcelFormat format) {
+    parcelFormat() = format;
+}
+
+status_t layer_state_t::write(Parcel& output) const {
+    return write(output, parcelFormat());
+}
+
+status_t layer_state_t::write(Parcel& output, ParcelFormat format) const
 {
+    // Most transactions only change a couple of properties, so by default only the fields that
+    // what selects are written. The listeners are always written, SurfaceFlinger uses them even
+    // when eHasListenerCallbacksChanged is not set.
+    const uint64_t fields = format == ParcelFormat::FULL ? ~uint64_t(0) : what;
+
+    output.writeUint32(static_cast<uint32_t>(format));
     output.writeStrongBinder(surface);
     output.writeUint64(what);
-    output.writeFloat(x);
-    output.writeFloat(y);
-    output.writeInt32(z);
-    output.writeUint32(w);
-    output.writeUint32(h);
-    output.writeUint32(layerStack);
-    output.writeFloat(alpha);
-    output.writeUint32(flags);
-    output.writeUint32(mask);
-    *reinterpret_cast<layer_state_t::matrix22_t *>(
-            output.writeInplace(sizeof(layer_state_t::matrix22_t))) = matrix;
-    output.write(crop_legacy);
-    output.writeStrongBinder(barrierHandle_legacy);
-    output.writeStrongBinder(reparentHandle);
-    output.writeUint64(frameNumber_legacy);
-    output.writeInt32(overrideScalingMode);
-    output.writeStrongBinder(IInterface::asBinder(barrierGbp_legacy));
-    output.writeStrongBinder(relativeLayerHandle);
-    output.writeStrongBinder(parentHandleForChild);
-    output.writeFloat(color.r);
-    output.writeFloat(color.g);
-    output.writeFloat(color.b);
+    if (fields & ePositionChanged) {
+        output.writeFloat(x);
+        output.writeFloat(y);
+    }
+    if (fields & (eLayerChanged | eRelativeLayerChanged)) {
+        output.writeInt32(z);
+    }
+    if (fields & eSizeChanged) {
+        output.writeUint32(w);
+        output.writeUint32(h);
+    }
+    if (fields & eLayerStackChanged) {
+        output.writeUint32(layerStack);
+    }
+    if (fields & eAlphaChanged) {
+        output.writeFloat(alpha);
+    }
+    if (fields & eFlagsChanged) {
+        output.writeUint32(flags);
+        output.writeUint32(mask);
+    }
+    if (fields & eMatrixChanged) {
+        *reinterpret_cast<layer_state_t::matrix22_t *>(
+                output.writeInplace(sizeof(layer_state_t::matrix22_t))) = matrix;
+    }
+    if (fields & eCropChanged_legacy) {
+        output.write(crop_legacy);
+    }
+    if (fields & eDeferTransaction_legacy) {
+        output.writeStrongBinder(barrierHandle_legacy);
+        output.writeUint64(frameNumber_legacy);
+        output.writeStrongBinder(IInterface::asBinder(barrierGbp_legacy));
+    }
+    if (fields & eReparentChildren) {
+        output.writeStrongBinder(reparentHandle);
+    }
+    if (fields & eOverrideScalingModeChanged) {
+        output.writeInt32(overrideScalingMode);
+    }
+    if (fields & eRelativeLayerChanged) {
+        output.writeStrongBinder(relativeLayerHandle);
+    }
+    if (fields & eReparent) {
+        output.writeStrongBinder(parentHandleForChild);
+    }
+    if (fields & (eColorChanged | eBackgroundColorChanged)) {
+        output.writeFloat(color.r);
+        output.writeFloat(color.g);
+        output.writeFloat(color.b);
+    }
 #ifndef NO_INPUT
-    inputInfo.write(output);
+    if (fields & eInputInfoChanged) {
+        inputInfo.write(output);
+    }
 #endif
-    output.write(transparentRegion);
-    output.writeUint32(transform);
-    output.writeBool(transformToDisplayInverse);
-    output.write(crop);
-    output.write(frame);
-    if (buffer) {
-        output.writeBool(true);
-        output.write(*buffer);
-    } else {
-        output.writeBool(false);
-    }
-    if (acquireFence) {
-        output.writeBool(true);
-        output.write(*acquireFence);
-    } else {
-        output.writeBool(false);
-    }
-    output.writeUint32(static_cast<uint32_t>(dataspace));
-    output.write(hdrMetadata);
-    output.write(surfaceDamageRegion);
-    output.writeInt32(api);
-    if (sidebandStream) {
-        output.writeBool(true);
-        output.writeNativeHandle(sidebandStream->handle());
-    } else {
-        output.writeBool(false);
-    }
-
-    memcpy(output.writeInplace(16 * sizeof(float)),
-           colorTransform.asArray(), 16 * sizeof(float));
-    output.writeFloat(cornerRadius);
-    output.writeUint32(backgroundBlurRadius);
-    output.writeStrongBinder(cachedBuffer.token.promote());
-    output.writeUint64(cachedBuffer.id);
-    output.writeParcelable(metadata);
-
-    output.writeFloat(bgColorAlpha);
-    output.writeUint32(static_cast<uint32_t>(bgColorDataspace));
-    output.writeBool(colorSpaceAgnostic);
+    if (fields & eTransparentRegionChanged) {
+        output.write(transparentRegion);
+    }
+    if (fields & eTransformChanged) {
+        output.writeUint32(transform);
+    }
+    if (fields & eTransformToDisplayInverseChanged) {
+        output.writeBool(transformToDisplayInverse);
+    }
+    if (fields & eCropChanged) {
+        output.write(crop);
+    }
+    if (fields & eFrameChanged) {
+        output.write(frame);
+    }
+    if (fields & eBufferChanged) {
+        if (buffer) {
+            output.writeBool(true);
+            output.write(*buffer);
+        } else {
+            output.writeBool(false);
+        }
+    }
+    if (fields & eAcquireFenceChanged) {
+        if (acquireFence) {
+            output.writeBool(true);
+            output.write(*acquireFence);
+        } else {
+            output.writeBool(false);
+        }
+    }
+    if (fields & eDataspaceChanged) {
+        output.writeUint32(static_cast<uint32_t>(dataspace));
+    }
+    if (fields & eHdrMetadataChanged) {
+        output.write(hdrMetadata);
+    }
+    if (fields & eSurfaceDamageRegionChanged) {
+        output.write(surfaceDamageRegion);
+    }
+    if (fields & eApiChanged) {
+        output.writeInt32(api);
+    }
+    if (fields & eSidebandStreamChanged) {
+        if (sidebandStream) {
+            output.writeBool(true);
+            output.writeNativeHandle(sidebandStream->handle());
+        } else {
+            output.writeBool(false);
+        }
+    }
+    if (fields & eColorTransformChanged) {
+        memcpy(output.writeInplace(16 * sizeof(float)),
+               colorTransform.asArray(), 16 * sizeof(float));
+    }
+    if (fields & eCornerRadiusChanged) {
+        output.writeFloat(cornerRadius);
+    }
+    if (fields & eBackgroundBlurRadiusChanged) {
+        output.writeUint32(backgroundBlurRadius);
+    }
+    // SurfaceFlinger passes the cached buffer id along with a buffer that is not cached.
+    if (fields & (eBufferChanged | eCachedBufferChanged)) {
+        output.writeStrongBinder(cachedBuffer.token.promote());
+        output.writeUint64(cachedBuffer.id);
+    }
+    if (fields & eMetadataChanged) {
+        output.writeParcelable(metadata);
+    }
+    if (fields & eBackgroundColorChanged) {
+        output.writeFloat(bgColorAlpha);
+        output.writeUint32(static_cast<uint32_t>(bgColorDataspace));
+    }
+    if (fields & eColorSpaceAgnosticChanged) {
+        output.writeBool(colorSpaceAgnostic);
+    }
 
     auto err = output.writeVectorSize(listeners);
     if (err) {
@@ -112,82 +208,168 @@ status_t layer_state_t::write(Parcel& output) const
             return err;
         }
     }
-    output.writeFloat(shadowRadius);
-    output.writeInt32(frameRateSelectionPriority);
-    output.writeFloat(frameRate);
-    output.writeByte(frameRateCompatibility);
-    output.writeUint32(fixedTransformHint);
-    output.writeBool(isTrustedOverlay);
-    output.writeUint32(static_cast<uint32_t>(dropInputMode));
+    if (fields & eShadowRadiusChanged) {
+        output.writeFloat(shadowRadius);
+    }
+    if (fields & eFrameRateSelectionPriority) {
+        output.writeInt32(frameRateSelectionPriority);
+    }
+    if (fields & eFrameRateChanged) {
+        output.writeFloat(frameRate);
+        output.writeByte(frameRateCompatibility);
+    }
+    if (fields & eFixedTransformHintChanged) {
+        output.writeUint32(fixedTransformHint);
+    }
+    if (fields & eTrustedOverlayChanged) {
+        output.writeBool(isTrustedOverlay);
+    }
+    if (fields & eDropInputModeChanged) {
+        output.writeUint32(static_cast<uint32_t>(dropInputMode));
+    }
     return NO_ERROR;
 }
 
 status_t layer_state_t::read(const Parcel& input)
 {
+    const uint32_t format = input.readUint32();
+    if (format != static_cast<uint32_t>(ParcelFormat::FULL) &&
+        format != static_cast<uint32_t>(ParcelFormat::COMPACT)) {
+        ALOGE("Unknown layer_state_t parcel format %" PRIu32, format);
+        return BAD_VALUE;
+    }
     surface = input.readStrongBinder();
     what = input.readUint64();
-    x = input.readFloat();
-    y = input.readFloat();
-    z = input.readInt32();
-    w = input.readUint32();
-    h = input.readUint32();
-    layerStack = input.readUint32();
-    alpha = input.readFloat();
-    flags = static_cast<uint8_t>(input.readUint32());
-    mask = static_cast<uint8_t>(input.readUint32());
-    const void* matrix_data = input.readInplace(sizeof(layer_state_t::matrix22_t));
-    if (matrix_data) {
-        matrix = *reinterpret_cast<layer_state_t::matrix22_t const *>(matrix_data);
-    } else {
-        return BAD_VALUE;
+    const uint64_t fields =
+            format == static_cast<uint32_t>(ParcelFormat::FULL) ? ~uint64_t(0) : what;
+
+    if (fields & ePositionChanged) {
+        x = input.readFloat();
+        y = input.readFloat();
+    }
+    if (fields & (eLayerChanged | eRelativeLayerChanged)) {
+        z = input.readInt32();
+    }
+    if (fields & eSizeChanged) {
+        w = input.readUint32();
+        h = input.readUint32();
+    }
+    if (fields & eLayerStackChanged) {
+        layerStack = input.readUint32();
+    }
+    if (fields & eAlphaChanged) {
+        alpha = input.readFloat();
+    }
+    if (fields & eFlagsChanged) {
+        flags = static_cast<uint8_t>(input.readUint32());
+        mask = static_cast<uint8_t>(input.readUint32());
+    }
+    if (fields & eMatrixChanged) {
+        const void* matrix_data = input.readInplace(sizeof(layer_state_t::matrix22_t));
+        if (matrix_data) {
+            matrix = *reinterpret_cast<layer_state_t::matrix22_t const *>(matrix_data);
+        } else {
+            return BAD_VALUE;
+        }
+    }
+    if (fields & eCropChanged_legacy) {
+        input.read(crop_legacy);
+    }
+    if (fields & eDeferTransaction_legacy) {
+        barrierHandle_legacy = input.readStrongBinder();
+        frameNumber_legacy = input.readUint64();
+        barrierGbp_legacy = interface_cast<IGraphicBufferProducer>(input.readStrongBinder());
+    }
+    if (fields & eReparentChildren) {
+        reparentHandle = input.readStrongBinder();
+    }
+    if (fields & eOverrideScalingModeChanged) {
+        overrideScalingMode = input.readInt32();
+    }
+    if (fields & eRelativeLayerChanged) {
+        relativeLayerHandle = input.readStrongBinder();
+    }
+    if (fields & eReparent) {
+        parentHandleForChild = input.readStrongBinder();
+    }
+    if (fields & (eColorChanged | eBackgroundColorChanged)) {
+        color.r = input.readFloat();
+        color.g = input.readFloat();
+        color.b = input.readFloat();
     }
-    input.read(crop_legacy);
-    barrierHandle_legacy = input.readStrongBinder();
-    reparentHandle = input.readStrongBinder();
-    frameNumber_legacy = input.readUint64();
-    overrideScalingMode = input.readInt32();
-    barrierGbp_legacy = interface_cast<IGraphicBufferProducer>(input.readStrongBinder());
-    relativeLayerHandle = input.readStrongBinder();
-    parentHandleForChild = input.readStrongBinder();
-    color.r = input.readFloat();
-    color.g = input.readFloat();
-    color.b = input.readFloat();
 
 #ifndef NO_INPUT
-    inputInfo = InputWindowInfo::read(input);
+    if (fields & eInputInfoChanged) {
+        inputInfo = InputWindowInfo::read(input);
+    }
 #endif
 
-    input.read(transparentRegion);
-    transform = input.readUint32();
-    transformToDisplayInverse = input.readBool();
-    input.read(crop);
-    input.read(frame);
+    if (fields & eTransparentRegionChanged) {
+        input.read(transparentRegion);
+    }
+    if (fields & eTransformChanged) {
+        transform = input.readUint32();
+    }
+    if (fields & eTransformToDisplayInverseChanged) {
+        transformToDisplayInverse = input.readBool();
+    }
+    if (fields & eCropChanged) {
+        input.read(crop);
+    }
+    if (fields & eFrameChanged) {
+        input.read(frame);
+    }
+    // SurfaceFlinger expects a buffer and a fence even when they did not change.
     buffer = new GraphicBuffer();
-    if (input.readBool()) {
+    if ((fields & eBufferChanged) && input.readBool()) {
         input.read(*buffer);
     }
     acquireFence = new Fence();
-    if (input.readBool()) {
+    if ((fields & eAcquireFenceChanged) && input.readBool()) {
         input.read(*acquireFence);
     }
-    dataspace = static_cast<ui::Dataspace>(input.readUint32());
-    input.read(hdrMetadata);
-    input.read(surfaceDamageRegion);
-    api = input.readInt32();
-    if (input.readBool()) {
+    if (fields & eDataspaceChanged) {
+        dataspace = static_cast<ui::Dataspace>(input.readUint32());
+    }
+    if (fields & eHdrMetadataChanged) {
+        input.read(hdrMetadata);
+    }
+    if (fields & eSurfaceDamageRegionChanged) {
+        input.read(surfaceDamageRegion);
+    }
+    if (fields & eApiChanged) {
+        api = input.readInt32();
+    }
+    if ((fields & eSidebandStreamChanged) && input.readBool()) {
         sidebandStream = NativeHandle::create(input.readNativeHandle(), true);
     }
-
-    colorTransform = mat4(static_cast<const float*>(input.readInplace(16 * sizeof(float))));
-    cornerRadius = input.readFloat();
-    backgroundBlurRadius = input.readUint32();
-    cachedBuffer.token = input.readStrongBinder();
-    cachedBuffer.id = input.readUint64();
-    input.readParcelable(&metadata);
-
-    bgColorAlpha = input.readFloat();
-    bgColorDataspace = static_cast<ui::Dataspace>(input.readUint32());
-    colorSpaceAgnostic = input.readBool();
+    if (fields & eColorTransformChanged) {
+        const void* colorTransformData = input.readInplace(16 * sizeof(float));
+        if (!colorTransformData) {
+            return BAD_VALUE;
+        }
+        colorTransform = mat4(static_cast<const float*>(colorTransformData));
+    }
+    if (fields & eCornerRadiusChanged) {
+        cornerRadius = input.readFloat();
+    }
+    if (fields & eBackgroundBlurRadiusChanged) {
+        backgroundBlurRadius = input.readUint32();
+    }
+    if (fields & (eBufferChanged | eCachedBufferChanged)) {
+        cachedBuffer.token = input.readStrongBinder();
+        cachedBuffer.id = input.readUint64();
+    }
+    if (fields & eMetadataChanged) {
+        input.readParcelable(&metadata);
+    }
+    if (fields & eBackgroundColorChanged) {
+        bgColorAlpha = input.readFloat();
+        bgColorDataspace = static_cast<ui::Dataspace>(input.readUint32());
+    }
+    if (fields & eColorSpaceAgnosticChanged) {
+        colorSpaceAgnostic = input.readBool();
+    }
 
     int32_t numListeners = input.readInt32();
     listeners.clear();
@@ -197,16 +379,27 @@ status_t layer_state_t::read(const Parcel& input)
         input.readInt64Vector(&callbackIds);
         listeners.emplace_back(listener, callbackIds);
     }
-    shadowRadius = input.readFloat();
-    frameRateSelectionPriority = input.readInt32();
-    frameRate = input.readFloat();
-    frameRateCompatibility = input.readByte();
-    fixedTransformHint = static_cast<ui::Transform::RotationFlags>(input.readUint32());
-    isTrustedOverlay = input.readBool();
-
-    uint32_t mode;
-    mode = input.readUint32();
-    dropInputMode = static_cast<gui::DropInputMode>(mode);
+    if (fields & eShadowRadiusChanged) {
+        shadowRadius = input.readFloat();
+    }
+    if (fields & eFrameRateSelectionPriority) {
+        frameRateSelectionPriority = input.readInt32();
+    }
+    if (fields & eFrameRateChanged) {
+        frameRate = input.readFloat();
+        frameRateCompatibility = input.readByte();
+    }
+    if (fields & eFixedTransformHintChanged) {
+        fixedTransformHint = static_cast<ui::Transform::RotationFlags>(input.readUint32());
+    }
+    if (fields & eTrustedOverlayChanged) {
+        isTrustedOverlay = input.readBool();
+    }
+    if (fields & eDropInputModeChanged) {
+        uint32_t mode;
+        mode = input.readUint32();
+        dropInputMode = static_cast<gui::DropInputMode>(mode);
+    }
     return NO_ERROR;
 }
 
@@ -150,8 +150,22 @@ struct layer_state_t {
         hdrMetadata.validTypes = 0;
     }
 
+    // The layouts a layer_state_t can be written to a Parcel in. The layout is written first,
+    // so read accepts either.
+    enum class ParcelFormat : uint32_t {
+        // Every field, whatever what is set to.
+        FULL = 1,
+        // surface, what, listeners and only the fields that what selects.
+        COMPACT = 2,
+    };
+
+    // Sets the layout write uses in this process. It is COMPACT, unless the
+    // debug.sf.layer_state_full_parcel property is set.
+    static void setParcelFormat(ParcelFormat format);
+
     void merge(const layer_state_t& other);
     status_t write(Parcel& output) const;
+    status_t write(Parcel& output, ParcelFormat format) const;
     status_t read(const Parcel& input);
 
     struct matrix22_t {
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures what a typical small transaction, a position and alpha change on some layers, costs to
+// marshal with each layer_state_t parcel format. Needs SurfaceFlinger to create the layers.
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <gui/LayerState.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+
+namespace android {
+namespace {
+
+constexpr int kMaxLayers = 64;
+
+using Transaction = SurfaceComposerClient::Transaction;
+
+const std::vector<sp<SurfaceControl>>& getLayers() {
+    static const std::vector<sp<SurfaceControl>> layers = [] {
+        ProcessState::self()->startThreadPool();
+        sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+        std::vector<sp<SurfaceControl>> layers;
+        for (int i = 0; i < kMaxLayers; i++) {
+            layers.push_back(client->createSurface(String8("LayerState_benchmark"), 1, 1,
+                                                   PIXEL_FORMAT_RGBA_8888,
+                                                   ISurfaceComposerClient::eFXSurfaceEffect));
+        }
+        return layers;
+    }();
+    return layers;
+}
+
+void fillTransaction(Transaction* t, int layerCount, int frame) {
+    const auto& layers = getLayers();
+    for (int i = 0; i < layerCount; i++) {
+        t->setPosition(layers[i], frame % 100, i);
+        t->setAlpha(layers[i], (frame % 10) / 10.0f);
+    }
+}
+
+layer_state_t::ParcelFormat getFormat(const benchmark::State& state) {
+    return static_cast<layer_state_t::ParcelFormat>(state.range(0));
+}
+
+void setFormat(benchmark::State& state) {
+    layer_state_t::setParcelFormat(getFormat(state));
+    state.SetLabel(getFormat(state) == layer_state_t::ParcelFormat::FULL ? "full" : "compact");
+}
+
+// Writes the layer states the way apply() does, and reports the parcel size.
+void BM_WriteTransaction(benchmark::State& state) {
+    setFormat(state);
+    const int layerCount = state.range(1);
+    Transaction t;
+    fillTransaction(&t, layerCount, 0);
+    size_t bytes = 0;
+    for (auto _ : state) {
+        Parcel parcel;
+        t.writeToParcel(&parcel);
+        bytes = parcel.dataSize();
+    }
+    state.counters["bytes"] = bytes;
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+// What SurfaceFlinger pays to unmarshal the same transaction.
+void BM_ReadTransaction(benchmark::State& state) {
+    setFormat(state);
+    Transaction t;
+    fillTransaction(&t, state.range(1), 0);
+    Parcel parcel;
+    t.writeToParcel(&parcel);
+    for (auto _ : state) {
+        parcel.setDataPosition(0);
+        Transaction read;
+        benchmark::DoNotOptimize(read.readFromParcel(&parcel));
+    }
+    state.counters["bytes"] = parcel.dataSize();
+}
+
+// A whole apply(), including the binder call and SurfaceFlinger queueing the transaction.
+void BM_Apply(benchmark::State& state) {
+    setFormat(state);
+    int frame = 0;
+    for (auto _ : state) {
+        Transaction t;
+        fillTransaction(&t, state.range(1), frame++);
+        t.apply();
+    }
+}
+
+void formatsAndLayerCounts(benchmark::internal::Benchmark* b) {
+    for (auto format : {layer_state_t::ParcelFormat::FULL, layer_state_t::ParcelFormat::COMPACT}) {
+        for (int layers : {1, 4, 16, kMaxLayers}) {
+            b->Args({static_cast<int64_t>(format), layers});
+        }
+    }
+}
+
+BENCHMARK(BM_WriteTransaction)->Apply(formatsAndLayerCounts);
+BENCHMARK(BM_ReadTransaction)->Apply(formatsAndLayerCounts);
+BENCHMARK(BM_Apply)->Apply(formatsAndLayerCounts);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <binder/Binder.h>
+#include <binder/Parcel.h>
+#include <gui/LayerState.h>
+
+namespace android {
+
+namespace {
+
+layer_state_t makeState() {
+    layer_state_t state;
+    state.surface = new BBinder();
+    state.what = layer_state_t::ePositionChanged | layer_state_t::eAlphaChanged;
+    state.x = 10.0f;
+    state.y = 20.0f;
+    state.alpha = 0.5f;
+    // Not selected by what.
+    state.cornerRadius = 4.0f;
+    state.crop = Rect(1, 2, 3, 4);
+    return state;
+}
+
+layer_state_t roundTrip(const layer_state_t& state, layer_state_t::ParcelFormat format,
+                        size_t* size = nullptr) {
+    Parcel parcel;
+    EXPECT_EQ(NO_ERROR, state.write(parcel, format));
+    if (size) *size = parcel.dataSize();
+    parcel.setDataPosition(0);
+    layer_state_t result;
+    EXPECT_EQ(NO_ERROR, result.read(parcel));
+    EXPECT_EQ(parcel.dataSize(), parcel.dataPosition());
+    return result;
+}
+
+} // namespace
+
+TEST(LayerStateTest, CompactFormatWritesSelectedFields) {
+    const layer_state_t state = makeState();
+    const layer_state_t result = roundTrip(state, layer_state_t::ParcelFormat::COMPACT);
+    EXPECT_EQ(state.surface, result.surface);
+    EXPECT_EQ(state.what, result.what);
+    EXPECT_EQ(10.0f, result.x);
+    EXPECT_EQ(20.0f, result.y);
+    EXPECT_EQ(0.5f, result.alpha);
+    // Fields that are not selected keep their defaults.
+    EXPECT_EQ(0.0f, result.cornerRadius);
+    EXPECT_EQ(Rect::INVALID_RECT, result.crop);
+    EXPECT_NE(nullptr, result.buffer);
+    EXPECT_NE(nullptr, result.acquireFence);
+}
+
+TEST(LayerStateTest, FullFormatWritesEveryField) {
+    const layer_state_t state = makeState();
+    const layer_state_t result = roundTrip(state, layer_state_t::ParcelFormat::FULL);
+    EXPECT_EQ(state.what, result.what);
+    EXPECT_EQ(10.0f, result.x);
+    EXPECT_EQ(0.5f, result.alpha);
+    EXPECT_EQ(4.0f, result.cornerRadius);
+    EXPECT_EQ(Rect(1, 2, 3, 4), result.crop);
+}
+
+TEST(LayerStateTest, CompactFormatIsSmaller) {
+    const layer_state_t state = makeState();
+    size_t compactSize, fullSize;
+    roundTrip(state, layer_state_t::ParcelFormat::COMPACT, &compactSize);
+    roundTrip(state, layer_state_t::ParcelFormat::FULL, &fullSize);
+    EXPECT_LT(compactSize * 4, fullSize);
+}
+
+TEST(LayerStateTest, CompactFormatKeepsSharedFields) {
+    layer_state_t state;
+    state.what = layer_state_t::eRelativeLayerChanged | layer_state_t::eBackgroundColorChanged |
+            layer_state_t::eFrameRateChanged | layer_state_t::eHasListenerCallbacksChanged;
+    state.z = -3;
+    state.relativeLayerHandle = new BBinder();
+    state.color = half3(0.25f, 0.5f, 0.75f);
+    state.bgColorAlpha = 0.5f;
+    state.bgColorDataspace = ui::Dataspace::V0_SRGB;
+    state.frameRate = 60.0f;
+    state.frameRateCompatibility = ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE;
+    state.listeners.emplace_back(new BBinder(), std::vector<CallbackId>{1, 2});
+
+    const layer_state_t result = roundTrip(state, layer_state_t::ParcelFormat::COMPACT);
+    EXPECT_EQ(-3, result.z);
+    EXPECT_EQ(state.relativeLayerHandle, result.relativeLayerHandle);
+    EXPECT_EQ(state.color, result.color);
+    EXPECT_EQ(0.5f, result.bgColorAlpha);
+    EXPECT_EQ(ui::Dataspace::V0_SRGB, result.bgColorDataspace);
+    EXPECT_EQ(60.0f, result.frameRate);
+    EXPECT_EQ(ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE, result.frameRateCompatibility);
+    ASSERT_EQ(1u, result.listeners.size());
+    EXPECT_EQ(state.listeners[0], result.listeners[0]);
+}
+
+TEST(LayerStateTest, ReadRejectsUnknownFormat) {
+    Parcel parcel;
+    parcel.writeUint32(0);
+    parcel.setDataPosition(0);
+    layer_state_t state;
+    EXPECT_EQ(BAD_VALUE, state.read(parcel));
+}
+
+} // namespace android
@@ -23,11 +23,9 @@
 // Log debug messages about the progress of the algorithm itself.
 #define DEBUG_STRATEGY 0
 
-#include <array>
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
-#include <optional>
 
 #include <android-base/stringprintf.h>
 #include <cutils/properties.h>
@@ -571,67 +569,191 @@ static bool solveLeastSquares(const float* x, const float* y,
     return true;
 }
 
+/**
+ * Same as solveLeastSquares, for a polynomial with a compile-time number of coefficients N,
+ * fitting both axes at once.
+ *
+ * The QR decomposition of A only depends on the sample times and weights, so it is shared by
+ * X and Y.  The samples are passed as fixed-size arrays whose entries past m are zero, so every
+ * loop has a compile-time trip count; the padding has zero weight and does not change any of the
+ * sums.
+ */
+template <size_t N, size_t M>
+static bool solveLeastSquaresXY(const float (&t)[M], const float (&x)[M], const float (&y)[M],
+        const float (&w)[M], uint32_t m, float* outXB, float* outYB,
+        float* outXDet, float* outYDet) {
+    // Expand the T vector to a matrix A, pre-multiplied by the weights.
+    float a[N][M]; // column-major order
+    for (size_t h = 0; h < M; h++) {
+        a[0][h] = w[h];
+    }
+    for (size_t i = 1; i < N; i++) {
+        for (size_t h = 0; h < M; h++) {
+            a[i][h] = a[i - 1][h] * t[h];
+        }
+    }
+
+    // Apply the Gram-Schmidt process to A to obtain its QR decomposition.
+    float q[N][M]; // orthonormal basis, column-major order
+    float r[N][N]; // upper triangular matrix, row-major order
+    for (size_t j = 0; j < N; j++) {
+        for (size_t h = 0; h < M; h++) {
+            q[j][h] = a[j][h];
+        }
+        for (size_t i = 0; i < j; i++) {
+            const float dot = vectorDot(q[j], q[i], M);
+            for (size_t h = 0; h < M; h++) {
+                q[j][h] -= dot * q[i][h];
+            }
+        }
+
+        const float norm = vectorNorm(q[j], M);
+        if (norm < 0.000001f) {
+            // vectors are linearly dependent or zero so no solution
+            return false;
+        }
+
+        const float invNorm = 1.0f / norm;
+        for (size_t h = 0; h < M; h++) {
+            q[j][h] *= invNorm;
+        }
+        for (size_t i = 0; i < N; i++) {
+            r[j][i] = i < j ? 0 : vectorDot(q[j], a[i], M);
+        }
+    }
+
+    // Solve R B = Qt W Y to find B, for both axes.
+    float wx[M];
+    float wy[M];
+    for (size_t h = 0; h < M; h++) {
+        wx[h] = x[h] * w[h];
+        wy[h] = y[h] * w[h];
+    }
+    for (size_t i = N; i != 0; ) {
+        i--;
+        outXB[i] = vectorDot(q[i], wx, M);
+        outYB[i] = vectorDot(q[i], wy, M);
+        for (size_t j = N - 1; j > i; j--) {
+            outXB[i] -= r[i][j] * outXB[j];
+            outYB[i] -= r[i][j] * outYB[j];
+        }
+        outXB[i] /= r[i][i];
+        outYB[i] /= r[i][i];
+    }
+
+    // Calculate the coefficients of determination, as solveLeastSquares does.
+    float xmean = 0;
+    float ymean = 0;
+    for (size_t h = 0; h < M; h++) {
+        xmean += x[h];
+        ymean += y[h];
+    }
+    xmean /= m;
+    ymean /= m;
+
+    float xsserr = 0;
+    float xsstot = 0;
+    float ysserr = 0;
+    float ysstot = 0;
+    for (size_t h = 0; h < M; h++) {
+        float xerr = x[h] - outXB[0];
+        float yerr = y[h] - outYB[0];
+        float term = 1;
+        for (size_t i = 1; i < N; i++) {
+            term *= t[h];
+            xerr -= term * outXB[i];
+            yerr -= term * outYB[i];
+        }
+        const float w2 = w[h] * w[h];
+        xsserr += w2 * xerr * xerr;
+        ysserr += w2 * yerr * yerr;
+        const float xvar = x[h] - xmean;
+        const float yvar = y[h] - ymean;
+        xsstot += w2 * xvar * xvar;
+        ysstot += w2 * yvar * yvar;
+    }
+    *outXDet = xsstot > 0.000001f ? 1.0f - (xsserr / xsstot) : 1;
+    *outYDet = ysstot > 0.000001f ? 1.0f - (ysserr / ysstot) : 1;
+    return true;
+}
+
 /*
  * Optimized unweighted second-order least squares fit. About 2x speed improvement compared to
- * the default implementation
+ * the default implementation.
+ *
+ * The sums of the powers of time are shared, so both axes are fitted in one pass over the
+ * samples.  As for solveLeastSquaresXY, the entries past count must be zero.
  */
-static std::optional<std::array<float, 3>> solveUnweightedLeastSquaresDeg2(
-        const float* x, const float* y, size_t count) {
-    // Solving y = a*x^2 + b*x + c
-    float sxi = 0, sxiyi = 0, syi = 0, sxi2 = 0, sxi3 = 0, sxi2yi = 0, sxi4 = 0;
-
-    for (size_t i = 0; i < count; i++) {
-        float xi = x[i];
-        float yi = y[i];
-        float xi2 = xi*xi;
-        float xi3 = xi2*xi;
-        float xi4 = xi3*xi;
-        float xiyi = xi*yi;
-        float xi2yi = xi2*yi;
-
-        sxi += xi;
-        sxi2 += xi2;
-        sxiyi += xiyi;
-        sxi2yi += xi2yi;
-        syi += yi;
-        sxi3 += xi3;
-        sxi4 += xi4;
-    }
-
-    float Sxx = sxi2 - sxi*sxi / count;
-    float Sxy = sxiyi - sxi*syi / count;
-    float Sxx2 = sxi3 - sxi*sxi2 / count;
-    float Sx2y = sxi2yi - sxi2*syi / count;
-    float Sx2x2 = sxi4 - sxi2*sxi2 / count;
-
-    float denominator = Sxx*Sx2x2 - Sxx2*Sxx2;
+template <size_t M>
+static bool solveUnweightedLeastSquaresDeg2(const float (&t)[M], const float (&x)[M],
+        const float (&y)[M], size_t count, float* outXCoeff, float* outYCoeff) {
+    // Solving x = a*t^2 + b*t + c and y = a*t^2 + b*t + c
+    float sti = 0, sti2 = 0, sti3 = 0, sti4 = 0;
+    float sxi = 0, stixi = 0, sti2xi = 0;
+    float syi = 0, stiyi = 0, sti2yi = 0;
+
+    for (size_t i = 0; i < M; i++) {
+        float ti = t[i];
+        float ti2 = ti*ti;
+        float ti3 = ti2*ti;
+        float ti4 = ti3*ti;
+
+        sti += ti;
+        sti2 += ti2;
+        sti3 += ti3;
+        sti4 += ti4;
+        sxi += x[i];
+        stixi += ti*x[i];
+        sti2xi += ti2*x[i];
+        syi += y[i];
+        stiyi += ti*y[i];
+        sti2yi += ti2*y[i];
+    }
+
+    float Stt = sti2 - sti*sti / count;
+    float Stt2 = sti3 - sti*sti2 / count;
+    float St2t2 = sti4 - sti2*sti2 / count;
+
+    float denominator = Stt*St2t2 - Stt2*Stt2;
     if (denominator == 0) {
-        ALOGW("division by 0 when computing velocity, Sxx=%f, Sx2x2=%f, Sxx2=%f", Sxx, Sx2x2, Sxx2);
-        return std::nullopt;
+        ALOGW("division by 0 when computing velocity, Sxx=%f, Sx2x2=%f, Sxx2=%f", Stt, St2t2, Stt2);
+        return false;
     }
-    // Compute a
-    float numerator = Sx2y*Sxx - Sxy*Sxx2;
-    float a = numerator / denominator;
 
-    // Compute b
-    numerator = Sxy*Sx2x2 - Sx2y*Sxx2;
-    float b = numerator / denominator;
+    auto solve = [&](float svi, float stivi, float sti2vi, float* outCoeff) {
+        float Stv = stivi - sti*svi / count;
+        float St2v = sti2vi - sti2*svi / count;
+
+        // Compute a
+        float numerator = St2v*Stt - Stv*Stt2;
+        float a = numerator / denominator;
+
+        // Compute b
+        numerator = Stv*St2t2 - St2v*Stt2;
+        float b = numerator / denominator;
 
-    // Compute c
-    float c = syi/count - b * sxi/count - a * sxi2/count;
+        // Compute c
+        float c = svi/count - b * sti/count - a * sti2/count;
 
-    return std::make_optional(std::array<float, 3>({c, b, a}));
+        outCoeff[0] = c;
+        outCoeff[1] = b;
+        outCoeff[2] = a;
+    };
+    solve(sxi, stixi, sti2xi, outXCoeff);
+    solve(syi, stiyi, sti2yi, outYCoeff);
+    return true;
 }
 
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         VelocityTracker::Estimator* outEstimator) const {
     outEstimator->clear();
 
-    // Iterate over movement samples in reverse time order and collect samples.
-    float x[HISTORY_SIZE];
-    float y[HISTORY_SIZE];
-    float w[HISTORY_SIZE];
-    float time[HISTORY_SIZE];
+    // Iterate over movement samples in reverse time order and collect samples, as a structure
+    // of arrays padded with zeros.
+    float x[HISTORY_SIZE] = {};
+    float y[HISTORY_SIZE] = {};
+    float w[HISTORY_SIZE] = {};
+    float time[HISTORY_SIZE] = {};
     uint32_t m = 0;
     uint32_t index = mIndex;
     const Movement& newestMovement = mMovements[mIndex];
@@ -666,24 +788,34 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
 
     if (degree == 2 && mWeighting == WEIGHTING_NONE) {
         // Optimize unweighted, quadratic polynomial fit
-        std::optional<std::array<float, 3>> xCoeff = solveUnweightedLeastSquaresDeg2(time, x, m);
-        std::optional<std::array<float, 3>> yCoeff = solveUnweightedLeastSquaresDeg2(time, y, m);
-        if (xCoeff && yCoeff) {
+        if (solveUnweightedLeastSquaresDeg2(time, x, y, m, outEstimator->xCoeff,
+                outEstimator->yCoeff)) {
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = 2;
             outEstimator->confidence = 1;
-            for (size_t i = 0; i <= outEstimator->degree; i++) {
-                outEstimator->xCoeff[i] = (*xCoeff)[i];
-                outEstimator->yCoeff[i] = (*yCoeff)[i];
-            }
             return true;
         }
     } else if (degree >= 1) {
-        // General case for an Nth degree polynomial fit
+        // Linear and quadratic fits use fixed-size kernels, higher degrees the general case for
+        // an Nth degree polynomial fit.
         float xdet, ydet;
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        bool solved;
+        switch (n) {
+            case 2:
+                solved = solveLeastSquaresXY<2>(time, x, y, w, m, outEstimator->xCoeff,
+                        outEstimator->yCoeff, &xdet, &ydet);
+                break;
+            case 3:
+                solved = solveLeastSquaresXY<3>(time, x, y, w, m, outEstimator->xCoeff,
+                        outEstimator->yCoeff, &xdet, &ydet);
+                break;
+            default:
+                solved = solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
+                        && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet);
+                break;
+        }
+        if (solved) {
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = degree;
             outEstimator->confidence = xdet * ydet;
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <benchmark/benchmark.h>
+#include <input/VelocityTracker.h>
+
+namespace android {
+
+// A fling sampled at 120 Hz, long enough to fill the least squares history.
+constexpr size_t SAMPLE_COUNT = 24;
+constexpr nsecs_t SAMPLE_INTERVAL = 8333333;
+
+// Feeds pointerCount pointers moving along slightly different curves to tracker, so that
+// getVelocity has a full history to fit for each of them.
+static void fillTracker(VelocityTracker& tracker, uint32_t pointerCount) {
+    BitSet32 idBits;
+    for (uint32_t id = 0; id < pointerCount; id++) {
+        idBits.markBit(id);
+    }
+    VelocityTracker::Position positions[MAX_POINTERS];
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        const float t = i * 0.008f;
+        for (uint32_t id = 0; id < pointerCount; id++) {
+            positions[id].x = 100 + id * 50 + 1500 * t - 2000 * t * t;
+            positions[id].y = 800 - id * 30 - 900 * t + 40 * sinf(t * 20 + id);
+        }
+        tracker.addMovement(i * SAMPLE_INTERVAL, idBits, positions);
+    }
+}
+
+static void benchmarkGetVelocity(benchmark::State& state, const char* strategy) {
+    const uint32_t pointerCount = state.range(0);
+    VelocityTracker tracker(strategy);
+    fillTracker(tracker, pointerCount);
+    for (auto _ : state) {
+        for (uint32_t id = 0; id < pointerCount; id++) {
+            float vx, vy;
+            benchmark::DoNotOptimize(tracker.getVelocity(id, &vx, &vy));
+            benchmark::DoNotOptimize(vx);
+            benchmark::DoNotOptimize(vy);
+        }
+    }
+    // Items are getVelocity calls, so the reported rate is the cost per call.
+    state.SetItemsProcessed(state.iterations() * pointerCount);
+}
+
+// The default strategy, unweighted quadratic.
+BENCHMARK_CAPTURE(benchmarkGetVelocity, lsq2, "lsq2")->DenseRange(1, 10);
+// Linear and weighted quadratic fits.
+BENCHMARK_CAPTURE(benchmarkGetVelocity, lsq1, "lsq1")->DenseRange(1, 10);
+BENCHMARK_CAPTURE(benchmarkGetVelocity, wlsq2_delta, "wlsq2-delta")->DenseRange(1, 10);
+BENCHMARK_CAPTURE(benchmarkGetVelocity, wlsq2_central, "wlsq2-central")->DenseRange(1, 10);
+// The general case, for comparison.
+BENCHMARK_CAPTURE(benchmarkGetVelocity, lsq3, "lsq3")->DenseRange(1, 10);
+
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -48,6 +48,7 @@
 #include "GLImage.h"
 #include "GLShadowVertexGenerator.h"
 #include "Program.h"
+#include "ProgramBinaryCache.h"
 #include "ProgramCache.h"
 #include "filters/BlurFilter.h"
 
@@ -407,8 +408,22 @@ GLESRenderEngine::GLESRenderEngine(const RenderEngineCreationArgs& args, EGLDisp
         mFlushTracer = std::make_unique<FlushTracer>(this);
     }
 
+    if (!args.programBinaryCacheDir.empty()) {
+        const GLExtensions& extensions = GLExtensions::getInstance();
+        if (extensions.hasProgramBinary()) {
+            // Start loading the cached programs now, so it overlaps with the rest of the set-up.
+            ProgramCache::getInstance().setBinaryCache(
+                    std::make_unique<ProgramBinaryCache>(args.programBinaryCacheDir,
+                                                         ProgramBinaryCache::getDriverId(
+                                                                 extensions)));
+        } else {
+            ALOGI("GL_OES_get_program_binary is not supported, not caching programs");
+        }
+    }
+
     if (args.supportsBackgroundBlur) {
-        mBlurFilter = new BlurFilter(*this);
+        property_get("debug.renderengine.blur_region", value, "0");
+        mBlurFilter = new BlurFilter(*this, atoi(value));
         checkErrors("BlurFilter creation");
     }
 
@@ -448,6 +463,8 @@ GLESRenderEngine::~GLESRenderEngine() {
     }
     eglDestroyImageKHR(mEGLDisplay, mPlaceholderImage);
     mImageCache.clear();
+    ProgramCache::getInstance().purgeCache(mEGLContext);
+    ProgramCache::getInstance().purgeCache(mProtectedEGLContext);
     eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglTerminate(mEGLDisplay);
 }
@@ -1032,6 +1049,24 @@ EGLImageKHR GLESRenderEngine::createFramebufferImageIfNeeded(ANativeWindowBuffer
     return image;
 }
 
+// Returns the bounds of layer in normalized device coordinates, given the display projection.
+static FloatRect getBlurRegion(const LayerSettings& layer, const mat4& projectionMatrix) {
+    const mat4 transform = projectionMatrix * layer.geometry.positionTransform;
+    const FloatRect& bounds = layer.geometry.boundaries;
+    const vec4 corners[] = {transform * vec4(bounds.left, bounds.top, 0.0f, 1.0f),
+                            transform * vec4(bounds.right, bounds.top, 0.0f, 1.0f),
+                            transform * vec4(bounds.left, bounds.bottom, 0.0f, 1.0f),
+                            transform * vec4(bounds.right, bounds.bottom, 0.0f, 1.0f)};
+    FloatRect region(corners[0].x, corners[0].y, corners[0].x, corners[0].y);
+    for (const vec4& corner : corners) {
+        region.left = std::min(region.left, corner.x);
+        region.top = std::min(region.top, corner.y);
+        region.right = std::max(region.right, corner.x);
+        region.bottom = std::max(region.bottom, corner.y);
+    }
+    return region;
+}
+
 status_t GLESRenderEngine::drawLayers(const DisplaySettings& display,
                                       const std::vector<const LayerSettings*>& layers,
                                       ANativeWindowBuffer* const buffer,
@@ -1081,8 +1116,11 @@ status_t GLESRenderEngine::drawLayers(const DisplaySettings& display,
         setViewportAndProjection(display.physicalDisplay, display.clip);
     } else {
         setViewportAndProjection(display.physicalDisplay, display.clip);
+        const mat4 projectionMatrix =
+                ui::Transform(display.orientation).asMatrix4() * mState.projectionMatrix;
         auto status =
-                mBlurFilter->setAsDrawTarget(display, blurLayers.front()->backgroundBlurRadius);
+                mBlurFilter->setAsDrawTarget(display, blurLayers.front()->backgroundBlurRadius,
+                                             getBlurRegion(*blurLayers.front(), projectionMatrix));
         if (status != NO_ERROR) {
             ALOGE("Failed to prepare blur filter! Aborting GPU composition for buffer (%p).",
                   buffer->handle);
@@ -1136,7 +1174,9 @@ status_t GLESRenderEngine::drawLayers(const DisplaySettings& display,
                 // There's still something else to blur, so let's keep rendering to our FBO
                 // instead of to the display.
                 status = mBlurFilter->setAsDrawTarget(display,
-                                                      blurLayers.front()->backgroundBlurRadius);
+                                                      blurLayers.front()->backgroundBlurRadius,
+                                                      getBlurRegion(*blurLayers.front(),
+                                                                    projectionMatrix));
             }
             if (status != NO_ERROR) {
                 ALOGE("Failed to bind framebuffer! Aborting GPU composition for buffer (%p).",
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 
+#include <GLES2/gl2ext.h>
 #include <log/log.h>
 #include <math/mat4.h>
 #include <utils/String8.h>
@@ -34,11 +35,7 @@ Program::Program(const ProgramCache::Key& /*needs*/, const char* vertex, const c
     GLuint programId = glCreateProgram();
     glAttachShader(programId, vertexId);
     glAttachShader(programId, fragmentId);
-    glBindAttribLocation(programId, position, "position");
-    glBindAttribLocation(programId, texCoords, "texCoords");
-    glBindAttribLocation(programId, cropCoords, "cropCoords");
-    glBindAttribLocation(programId, shadowColor, "shadowColor");
-    glBindAttribLocation(programId, shadowParams, "shadowParams");
+    bindAttribLocations(programId);
     glLinkProgram(programId);
 
     GLint status;
@@ -58,29 +55,59 @@ Program::Program(const ProgramCache::Key& /*needs*/, const char* vertex, const c
         glDeleteShader(fragmentId);
         glDeleteProgram(programId);
     } else {
-        mProgram = programId;
         mVertexShader = vertexId;
         mFragmentShader = fragmentId;
-        mInitialized = true;
-        mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
-        mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
-        mSamplerLoc = glGetUniformLocation(programId, "sampler");
-        mColorLoc = glGetUniformLocation(programId, "color");
-        mDisplayMaxLuminanceLoc = glGetUniformLocation(programId, "displayMaxLuminance");
-        mMaxMasteringLuminanceLoc = glGetUniformLocation(programId, "maxMasteringLuminance");
-        mMaxContentLuminanceLoc = glGetUniformLocation(programId, "maxContentLuminance");
-        mInputTransformMatrixLoc = glGetUniformLocation(programId, "inputTransformMatrix");
-        mOutputTransformMatrixLoc = glGetUniformLocation(programId, "outputTransformMatrix");
-        mCornerRadiusLoc = glGetUniformLocation(programId, "cornerRadius");
-        mCropCenterLoc = glGetUniformLocation(programId, "cropCenter");
-
-        // set-up the default values for our uniforms
-        glUseProgram(programId);
-        glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, mat4().asArray());
-        glEnableVertexAttribArray(0);
+        initialize(programId);
+    }
+}
+
+Program::Program(const ProgramCache::Key& /*needs*/, GLenum binaryFormat,
+                 const std::vector<uint8_t>& binary)
+      : mInitialized(false) {
+    GLuint programId = glCreateProgram();
+    bindAttribLocations(programId);
+    glProgramBinaryOES(programId, binaryFormat, binary.data(), static_cast<GLint>(binary.size()));
+
+    GLint status;
+    glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // Not an error: drivers may reject binaries from other versions of themselves.
+        ALOGV("Program binary rejected by the driver");
+        glDeleteProgram(programId);
+    } else {
+        initialize(programId);
     }
 }
 
+void Program::bindAttribLocations(GLuint programId) {
+    glBindAttribLocation(programId, position, "position");
+    glBindAttribLocation(programId, texCoords, "texCoords");
+    glBindAttribLocation(programId, cropCoords, "cropCoords");
+    glBindAttribLocation(programId, shadowColor, "shadowColor");
+    glBindAttribLocation(programId, shadowParams, "shadowParams");
+}
+
+void Program::initialize(GLuint programId) {
+    mProgram = programId;
+    mInitialized = true;
+    mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
+    mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
+    mSamplerLoc = glGetUniformLocation(programId, "sampler");
+    mColorLoc = glGetUniformLocation(programId, "color");
+    mDisplayMaxLuminanceLoc = glGetUniformLocation(programId, "displayMaxLuminance");
+    mMaxMasteringLuminanceLoc = glGetUniformLocation(programId, "maxMasteringLuminance");
+    mMaxContentLuminanceLoc = glGetUniformLocation(programId, "maxContentLuminance");
+    mInputTransformMatrixLoc = glGetUniformLocation(programId, "inputTransformMatrix");
+    mOutputTransformMatrixLoc = glGetUniformLocation(programId, "outputTransformMatrix");
+    mCornerRadiusLoc = glGetUniformLocation(programId, "cornerRadius");
+    mCropCenterLoc = glGetUniformLocation(programId, "cropCenter");
+
+    // set-up the default values for our uniforms
+    glUseProgram(programId);
+    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, mat4().asArray());
+    glEnableVertexAttribArray(0);
+}
+
 bool Program::isValid() const {
     return mInitialized;
 }
@@ -99,6 +126,26 @@ GLint Program::getUniform(const char* name) const {
     return glGetUniformLocation(mProgram, name);
 }
 
+bool Program::getBinary(GLenum* outBinaryFormat, std::vector<uint8_t>* outBinary) const {
+    if (!mInitialized) {
+        return false;
+    }
+    GLint length = 0;
+    glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return false;
+    }
+    outBinary->resize(static_cast<size_t>(length));
+    GLsizei written = 0;
+    glGetProgramBinaryOES(mProgram, length, &written, outBinaryFormat, outBinary->data());
+    if (written <= 0) {
+        outBinary->clear();
+        return false;
+    }
+    outBinary->resize(static_cast<size_t>(written));
+    return true;
+}
+
 GLuint Program::buildShader(const char* source, GLenum type) {
     GLuint shader = glCreateShader(type);
     glShaderSource(shader, 1, &source, 0);
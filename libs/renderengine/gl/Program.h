@@ -18,6 +18,7 @@
 #define SF_RENDER_ENGINE_PROGRAM_H
 
 #include <stdint.h>
+#include <vector>
 
 #include <GLES2/gl2.h>
 #include <renderengine/private/Description.h>
@@ -54,6 +55,10 @@ public:
     };
 
     Program(const ProgramCache::Key& needs, const char* vertex, const char* fragment);
+    // Creates a program from a binary previously returned by getBinary(). The program is not
+    // valid if the driver rejects the binary.
+    Program(const ProgramCache::Key& needs, GLenum binaryFormat,
+            const std::vector<uint8_t>& binary);
     ~Program() = default;
 
     /* whether this object is usable */
@@ -71,16 +76,21 @@ public:
     /* set-up uniforms from the description */
     void setUniforms(const Description& desc);
 
+    /* Retrieves the linked program binary. Requires GL_OES_get_program_binary. */
+    bool getBinary(GLenum* outBinaryFormat, std::vector<uint8_t>* outBinary) const;
+
 private:
     GLuint buildShader(const char* source, GLenum type);
+    void bindAttribLocations(GLuint programId);
+    void initialize(GLuint programId);
 
     // whether the initialization succeeded
     bool mInitialized;
 
     // Name of the OpenGL program and shaders
     GLuint mProgram;
-    GLuint mVertexShader;
-    GLuint mFragmentShader;
+    GLuint mVertexShader = 0;
+    GLuint mFragmentShader = 0;
 
     /* location of the projection matrix uniform */
     GLint mProjectionMatrixLoc;
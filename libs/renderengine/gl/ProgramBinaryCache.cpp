@@ -0,0 +1,272 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "ProgramBinaryCache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+#include <utils/Trace.h>
+#include "GLExtensions.h"
+
+namespace android {
+namespace renderengine {
+namespace gl {
+
+namespace {
+
+constexpr uint32_t kFileMagic = 0x52455042; // 'REPB'
+// Bump whenever the file layout changes.
+constexpr uint32_t kFileVersion = 1;
+constexpr size_t kMaxBinarySize = 4 * 1024 * 1024;
+constexpr char kFileSuffix[] = ".bin";
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t driverHash;
+    uint64_t sourceHash;
+    uint64_t checksum;
+    uint32_t key;
+    uint32_t format;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+// FNV-1a
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t hashString(const std::string& string) {
+    return hashBytes(string.data(), string.size());
+}
+
+} // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(std::string directory, const std::string& driverId)
+      : mDirectory(std::move(directory)), mDriverHash(hashString(driverId)) {
+    ATRACE_CALL();
+    if (mkdir(mDirectory.c_str(), 0700) != 0 && errno != EEXIST) {
+        ALOGW("Unable to create program binary cache directory %s: %s", mDirectory.c_str(),
+              strerror(errno));
+    }
+
+    std::vector<uint32_t> keys;
+    if (DIR* dir = opendir(mDirectory.c_str())) {
+        while (const dirent* dirEntry = readdir(dir)) {
+            uint32_t key;
+            char suffix[sizeof(kFileSuffix) + 1] = {};
+            if (sscanf(dirEntry->d_name, "%08x%5s", &key, suffix) == 2 &&
+                strcmp(suffix, kFileSuffix) == 0) {
+                keys.push_back(key);
+            }
+        }
+        closedir(dir);
+    }
+
+    // Reading is I/O and checksum bound, so spread the files over a few threads. Each file gets
+    // its own promise, so a lookup only waits for the file it needs.
+    auto promises = std::make_shared<std::vector<std::promise<std::shared_ptr<const Entry>>>>(
+            keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        mEntries.emplace(keys[i], (*promises)[i].get_future().share());
+    }
+
+    const size_t threadCount = std::min(kMaxLoaderThreads, keys.size());
+    for (size_t thread = 0; thread < threadCount; thread++) {
+        mLoaderThreads.emplace_back([this, keys, promises, thread, threadCount] {
+            for (size_t i = thread; i < keys.size(); i += threadCount) {
+                (*promises)[i].set_value(readFile(keys[i]));
+            }
+        });
+    }
+
+    mWriterThread = std::thread(&ProgramBinaryCache::writerMain, this);
+}
+
+ProgramBinaryCache::~ProgramBinaryCache() {
+    for (auto& thread : mLoaderThreads) {
+        thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWriterCondition.notify_all();
+    mWriterThread.join();
+}
+
+std::string ProgramBinaryCache::getDriverId(const GLExtensions& extensions) {
+    return base::StringPrintf("%s|%s|%s|%s", extensions.getVendor(), extensions.getRenderer(),
+                              extensions.getVersion(),
+                              base::GetProperty("ro.build.fingerprint", "").c_str());
+}
+
+uint64_t ProgramBinaryCache::hashSources(const char* vertex, const char* fragment) {
+    return hashBytes(fragment, strlen(fragment), hashBytes(vertex, strlen(vertex)));
+}
+
+std::shared_ptr<const ProgramBinaryCache::Binary> ProgramBinaryCache::get(uint32_t key,
+                                                                          uint64_t sourceHash) {
+    std::shared_future<std::shared_ptr<const Entry>> future;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mEntries.find(key);
+        if (it == mEntries.end()) {
+            return nullptr;
+        }
+        future = it->second;
+    }
+
+    const std::shared_ptr<const Entry>& entry = future.get();
+    if (!entry || entry->sourceHash != sourceHash) {
+        return nullptr;
+    }
+    return entry->binary;
+}
+
+void ProgramBinaryCache::put(uint32_t key, uint64_t sourceHash, Binary binary) {
+    auto entry = std::make_shared<const Entry>(
+            Entry{sourceHash, std::make_shared<const Binary>(std::move(binary))});
+    std::promise<std::shared_ptr<const Entry>> promise;
+    promise.set_value(entry);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEntries[key] = promise.get_future().share();
+        mWriteQueue.push_back({key, std::move(entry)});
+    }
+    mWriterCondition.notify_one();
+}
+
+void ProgramBinaryCache::remove(uint32_t key) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEntries.erase(key);
+        mWriteQueue.push_back({key, nullptr});
+    }
+    mWriterCondition.notify_one();
+}
+
+std::string ProgramBinaryCache::getPath(uint32_t key) const {
+    return base::StringPrintf("%s/%08x%s", mDirectory.c_str(), key, kFileSuffix);
+}
+
+std::shared_ptr<const ProgramBinaryCache::Entry> ProgramBinaryCache::readFile(uint32_t key) const {
+    ATRACE_CALL();
+    std::string contents;
+    if (!base::ReadFileToString(getPath(key), &contents) || contents.size() < sizeof(FileHeader)) {
+        return nullptr;
+    }
+
+    FileHeader header;
+    memcpy(&header, contents.data(), sizeof(header));
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.data()) + sizeof(header);
+    const size_t size = contents.size() - sizeof(header);
+    if (header.magic != kFileMagic || header.version != kFileVersion ||
+        header.driverHash != mDriverHash || header.key != key || header.size != size ||
+        size > kMaxBinarySize || header.checksum != hashBytes(data, size)) {
+        ALOGV("Ignoring stale or corrupt program binary for key %08x", key);
+        return nullptr;
+    }
+
+    auto binary = std::make_shared<Binary>();
+    binary->format = header.format;
+    binary->data.assign(data, data + size);
+    return std::make_shared<const Entry>(Entry{header.sourceHash, std::move(binary)});
+}
+
+void ProgramBinaryCache::writeFile(uint32_t key, const Entry& entry) const {
+    ATRACE_CALL();
+    const std::vector<uint8_t>& data = entry.binary->data;
+    if (data.size() > kMaxBinarySize) {
+        return;
+    }
+
+    FileHeader header{};
+    header.magic = kFileMagic;
+    header.version = kFileVersion;
+    header.driverHash = mDriverHash;
+    header.sourceHash = entry.sourceHash;
+    header.checksum = hashBytes(data.data(), data.size());
+    header.key = key;
+    header.format = entry.binary->format;
+    header.size = static_cast<uint32_t>(data.size());
+
+    // Write to a temporary file and rename it, so a concurrent reader or a crash never sees a
+    // partially written binary.
+    const std::string path = getPath(key);
+    const std::string tmpPath = path + ".tmp";
+    base::unique_fd fd(open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd < 0) {
+        ALOGW("Unable to create %s: %s", tmpPath.c_str(), strerror(errno));
+        return;
+    }
+    if (!base::WriteFully(fd, &header, sizeof(header)) ||
+        !base::WriteFully(fd, data.data(), data.size())) {
+        ALOGW("Unable to write %s: %s", tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return;
+    }
+    fd.reset();
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ALOGW("Unable to rename %s: %s", tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+    }
+}
+
+void ProgramBinaryCache::writerMain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWriterCondition.wait(lock, [this] { return mStopping || !mWriteQueue.empty(); });
+        if (mWriteQueue.empty()) {
+            return;
+        }
+        WriteRequest request = std::move(mWriteQueue.front());
+        mWriteQueue.pop_front();
+        lock.unlock();
+
+        if (request.entry) {
+            writeFile(request.key, *request.entry);
+        } else {
+            unlink(getPath(request.key).c_str());
+        }
+
+        lock.lock();
+    }
+}
+
+} // namespace gl
+} // namespace renderengine
+} // namespace android
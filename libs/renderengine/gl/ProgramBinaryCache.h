@@ -0,0 +1,117 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SF_RENDER_ENGINE_PROGRAMBINARYCACHE_H
+#define SF_RENDER_ENGINE_PROGRAMBINARYCACHE_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <GLES2/gl2.h>
+
+namespace android {
+namespace renderengine {
+namespace gl {
+
+class GLExtensions;
+
+/*
+ * On-disk cache of linked program binaries, used by ProgramCache to skip shader compilation
+ * across restarts.
+ *
+ * Each program is stored in its own file, named after its ProgramCache::Key. A file also records
+ * the cache format version, a hash of the driver build that produced it and a hash of the shader
+ * sources, and is ignored if any of them doesn't match.
+ *
+ * The files are read in parallel on background threads as soon as the cache is created, so that
+ * the reads overlap with the rest of the start-up. get() only waits for the file it needs.
+ * Writes happen on a background thread too, so that storing a newly compiled program does not
+ * stall the frame that needed it.
+ */
+class ProgramBinaryCache {
+public:
+    struct Binary {
+        GLenum format = 0;
+        std::vector<uint8_t> data;
+    };
+
+    // Binaries are read from and written to directory, which is created if needed. driverId
+    // identifies the driver build that produces and consumes the binaries.
+    ProgramBinaryCache(std::string directory, const std::string& driverId);
+    // Waits for pending reads and writes.
+    ~ProgramBinaryCache();
+
+    ProgramBinaryCache(const ProgramBinaryCache&) = delete;
+    ProgramBinaryCache& operator=(const ProgramBinaryCache&) = delete;
+
+    // Returns a driver id made from the GL version strings and the build fingerprint, which
+    // covers driver updates that keep the same version strings.
+    static std::string getDriverId(const GLExtensions& extensions);
+
+    static uint64_t hashSources(const char* vertex, const char* fragment);
+
+    // Returns the binary for key, or nullptr if there isn't one for these sources.
+    std::shared_ptr<const Binary> get(uint32_t key, uint64_t sourceHash);
+    void put(uint32_t key, uint64_t sourceHash, Binary binary);
+    // Forgets the binary for key, e.g. because the driver rejected it.
+    void remove(uint32_t key);
+
+private:
+    struct Entry {
+        uint64_t sourceHash;
+        std::shared_ptr<const Binary> binary;
+    };
+
+    struct WriteRequest {
+        uint32_t key;
+        // nullptr to delete the file.
+        std::shared_ptr<const Entry> entry;
+    };
+
+    static constexpr size_t kMaxLoaderThreads = 4;
+
+    std::string getPath(uint32_t key) const;
+    std::shared_ptr<const Entry> readFile(uint32_t key) const;
+    void writeFile(uint32_t key, const Entry& entry) const;
+    void writerMain();
+
+    const std::string mDirectory;
+    const uint64_t mDriverHash;
+
+    std::mutex mMutex;
+    std::unordered_map<uint32_t, std::shared_future<std::shared_ptr<const Entry>>> mEntries;
+    std::vector<std::thread> mLoaderThreads;
+
+    std::condition_variable mWriterCondition;
+    std::deque<WriteRequest> mWriteQueue;
+    bool mStopping = false;
+    std::thread mWriterThread;
+};
+
+} // namespace gl
+} // namespace renderengine
+} // namespace android
+
+#endif /* SF_RENDER_ENGINE_PROGRAMBINARYCACHE_H */
@@ -25,6 +25,7 @@
 #include <utils/String8.h>
 #include <utils/Trace.h>
 #include "Program.h"
+#include "ProgramBinaryCache.h"
 
 ANDROID_SINGLETON_STATIC_INSTANCE(android::renderengine::gl::ProgramCache)
 
@@ -77,6 +78,13 @@ Formatter& dedent(Formatter& f) {
     return f;
 }
 
+ProgramCache::ProgramCache() = default;
+ProgramCache::~ProgramCache() = default;
+
+void ProgramCache::setBinaryCache(std::unique_ptr<ProgramBinaryCache> binaryCache) {
+    mBinaryCache = std::move(binaryCache);
+}
+
 void ProgramCache::primeCache(
         EGLContext context, bool useColorManagement, bool toneMapperShaderOnly) {
     auto& cache = mCaches[context];
@@ -102,7 +110,7 @@ void ProgramCache::primeCache(
             shaderKey.set(Key::Y410_BT2020_MASK, (i & 2) ?
                     Key::Y410_BT2020_ON : Key::Y410_BT2020_OFF);
             if (cache.count(shaderKey) == 0) {
-                cache.emplace(shaderKey, generateProgram(shaderKey));
+                cache.emplace(shaderKey, createProgram(shaderKey));
                 shaderCount++;
             }
         }
@@ -123,7 +131,7 @@ void ProgramCache::primeCache(
             continue;
         }
         if (cache.count(shaderKey) == 0) {
-            cache.emplace(shaderKey, generateProgram(shaderKey));
+            cache.emplace(shaderKey, createProgram(shaderKey));
             shaderCount++;
         }
     }
@@ -147,7 +155,7 @@ void ProgramCache::primeCache(
             // Cache texture off option for window transition
             shaderKey.set(Key::TEXTURE_MASK, (i & 8) ? Key::TEXTURE_EXT : Key::TEXTURE_OFF);
             if (cache.count(shaderKey) == 0) {
-                cache.emplace(shaderKey, generateProgram(shaderKey));
+                cache.emplace(shaderKey, createProgram(shaderKey));
                 shaderCount++;
             }
         }
@@ -770,6 +778,41 @@ std::unique_ptr<Program> ProgramCache::generateProgram(const Key& needs) {
     return std::make_unique<Program>(needs, vs.string(), fs.string());
 }
 
+std::unique_ptr<Program> ProgramCache::createProgram(const Key& needs) {
+    if (!mBinaryCache) {
+        return generateProgram(needs);
+    }
+
+    String8 vs = generateVertexShader(needs);
+    String8 fs = generateFragmentShader(needs);
+    const uint64_t sourceHash = ProgramBinaryCache::hashSources(vs.string(), fs.string());
+
+    if (auto binary = mBinaryCache->get(needs.mKey, sourceHash)) {
+        ATRACE_NAME("loadProgramBinary");
+        auto program = std::make_unique<Program>(needs, binary->format, binary->data);
+        if (program->isValid()) {
+            return program;
+        }
+        mBinaryCache->remove(needs.mKey);
+    }
+
+    std::unique_ptr<Program> program;
+    {
+        ATRACE_NAME("compileProgram");
+        program = std::make_unique<Program>(needs, vs.string(), fs.string());
+    }
+    ProgramBinaryCache::Binary binary;
+    if (program->getBinary(&binary.format, &binary.data)) {
+        mBinaryCache->put(needs.mKey, sourceHash, std::move(binary));
+    }
+    return program;
+}
+
+uint64_t ProgramCache::getSourceHash(const Key& needs) {
+    return ProgramBinaryCache::hashSources(generateVertexShader(needs).string(),
+                                           generateFragmentShader(needs).string());
+}
+
 void ProgramCache::useProgram(EGLContext context, const Description& description) {
     // generate the key for the shader based on the description
     Key needs(computeKey(description));
@@ -780,7 +823,7 @@ void ProgramCache::useProgram(EGLContext context, const Description& description
     if (it == cache.end()) {
         // we didn't find our program, so generate one...
         nsecs_t time = systemTime();
-        it = cache.emplace(needs, generateProgram(needs)).first;
+        it = cache.emplace(needs, createProgram(needs)).first;
         time = systemTime() - time;
 
         ALOGV(">>> generated new program for context %p: needs=%08X, time=%u ms (%zu programs)",
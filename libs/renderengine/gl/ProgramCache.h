@@ -38,6 +38,7 @@ namespace gl {
 
 class Formatter;
 class Program;
+class ProgramBinaryCache;
 
 /*
  * This class generates GLSL programs suitable to handle a given
@@ -182,18 +183,30 @@ public:
         };
     };
 
-    ProgramCache() = default;
-    ~ProgramCache() = default;
+    ProgramCache();
+    ~ProgramCache();
+
+    // Persist compiled programs to binaryCache, and use the programs it holds instead of
+    // compiling them.
+    void setBinaryCache(std::unique_ptr<ProgramBinaryCache> binaryCache);
 
     // Generate shaders to populate the cache
     void primeCache(const EGLContext context, bool useColorManagement, bool toneMapperShaderOnly);
 
     size_t getSize(const EGLContext context) { return mCaches[context].size(); }
 
+    // Forget the programs of a context that is being destroyed. The GL objects themselves go
+    // away with the context.
+    void purgeCache(const EGLContext context) { mCaches.erase(context); }
+
     // useProgram lookup a suitable program in the cache or generates one
     // if none can be found.
     void useProgram(const EGLContext context, const Description& description);
 
+    // Returns the hash of the shader sources generated for needs, which a binary must have been
+    // stored with to be used for them.
+    static uint64_t getSourceHash(const Key& needs);
+
 private:
     // compute a cache Key from a Description
     static Key computeKey(const Description& description);
@@ -207,6 +220,9 @@ private:
     static void generateOETF(Formatter& fs, const Key& needs);
     // generates a program from the Key
     static std::unique_ptr<Program> generateProgram(const Key& needs);
+    // loads the program for the Key from the binary cache if possible, otherwise generates it
+    // and stores it in the binary cache.
+    std::unique_ptr<Program> createProgram(const Key& needs);
     // generates the vertex shader from the Key
     static String8 generateVertexShader(const Key& needs);
     // generates the fragment shader from the Key
@@ -216,6 +232,8 @@ private:
     // is never shrunk (and the GL program objects are never deleted).
     std::unordered_map<EGLContext, std::unordered_map<Key, std::unique_ptr<Program>, Key::Hash>>
             mCaches;
+
+    std::unique_ptr<ProgramBinaryCache> mBinaryCache;
 };
 
 } // namespace gl
@@ -22,6 +22,7 @@
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 #include <ui/GraphicTypes.h>
+#include <algorithm>
 #include <cstdint>
 
 #include <utils/Trace.h>
@@ -30,19 +31,24 @@ namespace android {
 namespace renderengine {
 namespace gl {
 
-BlurFilter::BlurFilter(GLESRenderEngine& engine)
+BlurFilter::BlurFilter(GLESRenderEngine& engine, bool regionOnly)
       : mEngine(engine),
+        mRegionOnly(regionOnly),
         mCompositionFbo(engine),
         mPingFbo(engine),
         mPongFbo(engine),
         mMixProgram(engine),
-        mBlurProgram(engine) {
+        mBlurProgram(engine),
+        mDownsampleProgram(engine),
+        mUpsampleProgram(engine) {
     mMixProgram.compile(getVertexShader(), getMixFragShader());
     mMPosLoc = mMixProgram.getAttributeLocation("aPosition");
     mMUvLoc = mMixProgram.getAttributeLocation("aUV");
     mMTextureLoc = mMixProgram.getUniformLocation("uTexture");
     mMCompositionTextureLoc = mMixProgram.getUniformLocation("uCompositionTexture");
     mMMixLoc = mMixProgram.getUniformLocation("uMix");
+    mMUvScaleLoc = mMixProgram.getUniformLocation("uUvScale");
+    mMCompositionUvTransformLoc = mMixProgram.getUniformLocation("uCompositionUvTransform");
 
     mBlurProgram.compile(getVertexShader(), getFragmentShader());
     mBPosLoc = mBlurProgram.getAttributeLocation("aPosition");
@@ -50,6 +56,11 @@ BlurFilter::BlurFilter(GLESRenderEngine& engine)
     mBTextureLoc = mBlurProgram.getUniformLocation("uTexture");
     mBOffsetLoc = mBlurProgram.getUniformLocation("uOffset");
 
+    if (mRegionOnly) {
+        compileDualFilterProgram(mDownsampleProgram, getDownsampleFragShader());
+        compileDualFilterProgram(mUpsampleProgram, getUpsampleFragShader());
+    }
+
     static constexpr auto size = 2.0f;
     static constexpr auto translation = 1.0f;
     const GLfloat vboData[] = {
@@ -65,7 +76,19 @@ BlurFilter::BlurFilter(GLESRenderEngine& engine)
     mMeshBuffer.allocateBuffers(vboData, 12 /* size */);
 }
 
-status_t BlurFilter::setAsDrawTarget(const DisplaySettings& display, uint32_t radius) {
+void BlurFilter::compileDualFilterProgram(DualFilterProgram& program,
+                                          const string& fragmentShader) {
+    program.program.compile(getVertexShader(), fragmentShader);
+    program.posLoc = program.program.getAttributeLocation("aPosition");
+    program.uvLoc = program.program.getAttributeLocation("aUV");
+    program.textureLoc = program.program.getUniformLocation("uTexture");
+    program.halfPixelLoc = program.program.getUniformLocation("uHalfPixel");
+    program.uvTransformLoc = program.program.getUniformLocation("uUvTransform");
+    program.uvClampLoc = program.program.getUniformLocation("uUvClamp");
+}
+
+status_t BlurFilter::setAsDrawTarget(const DisplaySettings& display, uint32_t radius,
+                                     const FloatRect& blurRegion) {
     ATRACE_NAME("BlurFilter::setAsDrawTarget");
     mRadius = radius;
     mDisplayX = display.physicalDisplay.left;
@@ -79,34 +102,98 @@ status_t BlurFilter::setAsDrawTarget(const DisplaySettings& display, uint32_t ra
         mDisplayHeight = display.physicalDisplay.height();
         mCompositionFbo.allocateBuffers(mDisplayWidth, mDisplayHeight);
 
-        const uint32_t fboWidth = floorf(mDisplayWidth * kFboScale);
-        const uint32_t fboHeight = floorf(mDisplayHeight * kFboScale);
-        mPingFbo.allocateBuffers(fboWidth, fboHeight);
-        mPongFbo.allocateBuffers(fboWidth, fboHeight);
-
-        if (mPingFbo.getStatus() != GL_FRAMEBUFFER_COMPLETE) {
-            ALOGE("Invalid ping buffer");
-            return mPingFbo.getStatus();
-        }
-        if (mPongFbo.getStatus() != GL_FRAMEBUFFER_COMPLETE) {
-            ALOGE("Invalid pong buffer");
-            return mPongFbo.getStatus();
-        }
         if (mCompositionFbo.getStatus() != GL_FRAMEBUFFER_COMPLETE) {
             ALOGE("Invalid composition buffer");
             return mCompositionFbo.getStatus();
         }
-        if (!mBlurProgram.isValid()) {
-            ALOGE("Invalid shader");
-            return GL_INVALID_OPERATION;
+
+        if (mRegionOnly) {
+            // The dual filter textures depend on the region, they come from the pool.
+            if (!mDownsampleProgram.program.isValid() || !mUpsampleProgram.program.isValid()) {
+                ALOGE("Invalid shader");
+                return GL_INVALID_OPERATION;
+            }
+        } else {
+            const uint32_t fboWidth = floorf(mDisplayWidth * kFboScale);
+            const uint32_t fboHeight = floorf(mDisplayHeight * kFboScale);
+            mPingFbo.allocateBuffers(fboWidth, fboHeight);
+            mPongFbo.allocateBuffers(fboWidth, fboHeight);
+
+            if (mPingFbo.getStatus() != GL_FRAMEBUFFER_COMPLETE) {
+                ALOGE("Invalid ping buffer");
+                return mPingFbo.getStatus();
+            }
+            if (mPongFbo.getStatus() != GL_FRAMEBUFFER_COMPLETE) {
+                ALOGE("Invalid pong buffer");
+                return mPongFbo.getStatus();
+            }
+            if (!mBlurProgram.isValid()) {
+                ALOGE("Invalid shader");
+                return GL_INVALID_OPERATION;
+            }
+        }
+    }
+
+    if (mRegionOnly) {
+        // Map the region to pixels, and pad it with the area the blur samples from.
+        const int32_t width = mCompositionFbo.getBufferWidth();
+        const int32_t height = mCompositionFbo.getBufferHeight();
+        const Rect region(floorf((blurRegion.left + 1.0f) * 0.5f * width),
+                          floorf((blurRegion.top + 1.0f) * 0.5f * height),
+                          ceilf((blurRegion.right + 1.0f) * 0.5f * width),
+                          ceilf((blurRegion.bottom + 1.0f) * 0.5f * height));
+        const int32_t padding = radius;
+        const Rect padded(region.left - padding, region.top - padding, region.right + padding,
+                          region.bottom + padding);
+        if (!region.intersect(Rect(width, height), &mRegionBounds) ||
+            !padded.intersect(Rect(width, height), &mBlurBounds)) {
+            mRegionBounds = Rect::EMPTY_RECT;
+            mBlurBounds = Rect::EMPTY_RECT;
         }
     }
 
     mCompositionFbo.bind();
+    mCompositionIsDrawTarget = true;
     glViewport(0, 0, mCompositionFbo.getBufferWidth(), mCompositionFbo.getBufferHeight());
     return NO_ERROR;
 }
 
+GLFramebuffer* BlurFilter::acquireFbo(uint32_t width, uint32_t height) {
+    const uint32_t fboWidth = (width + kPoolGranularity - 1) / kPoolGranularity * kPoolGranularity;
+    const uint32_t fboHeight =
+            (height + kPoolGranularity - 1) / kPoolGranularity * kPoolGranularity;
+    for (auto& pooled : mFboPool) {
+        if (!pooled.inUse && uint32_t(pooled.fbo->getBufferWidth()) == fboWidth &&
+            uint32_t(pooled.fbo->getBufferHeight()) == fboHeight) {
+            pooled.inUse = true;
+            pooled.lastUsedFrame = mFrame;
+            return pooled.fbo.get();
+        }
+    }
+
+    ATRACE_NAME("BlurFilter::allocatingTextures");
+    auto fbo = std::make_unique<GLFramebuffer>(mEngine);
+    fbo->allocateBuffers(fboWidth, fboHeight);
+    GLFramebuffer* result = fbo.get();
+    mFboPool.push_back({std::move(fbo), mFrame, true});
+    return result;
+}
+
+void BlurFilter::releaseFbos() {
+    for (auto& pooled : mFboPool) {
+        pooled.inUse = false;
+    }
+}
+
+void BlurFilter::endFrame() {
+    mFrame++;
+    mFboPool.erase(std::remove_if(mFboPool.begin(), mFboPool.end(),
+                                  [this](const PooledFbo& pooled) {
+                                      return mFrame - pooled.lastUsedFrame > kMaxPoolIdleFrames;
+                                  }),
+                   mFboPool.end());
+}
+
 void BlurFilter::drawMesh(GLuint uv, GLuint position) {
 
     glEnableVertexAttribArray(uv);
@@ -125,6 +212,10 @@ void BlurFilter::drawMesh(GLuint uv, GLuint position) {
 status_t BlurFilter::prepare() {
     ATRACE_NAME("BlurFilter::prepare");
 
+    if (mRegionOnly) {
+        return prepareRegion();
+    }
+
     // Kawase is an approximation of Gaussian, but it behaves differently from it.
     // A radius transformation is required for approximating them, and also to introduce
     // non-integer steps, necessary to smoothly interpolate large radii.
@@ -174,6 +265,16 @@ status_t BlurFilter::prepare() {
 status_t BlurFilter::render(bool multiPass) {
     ATRACE_NAME("BlurFilter::render");
 
+    if (mRegionOnly) {
+        // Only the last blur layer of a frame is drawn somewhere else than the composition.
+        const bool lastLayer = !mCompositionIsDrawTarget;
+        const status_t status = renderRegion();
+        if (lastLayer) {
+            endFrame();
+        }
+        return status;
+    }
+
     // Now let's scale our blur up. It will be interpolated with the larger composited
     // texture for the first frames, to hide downscaling artifacts.
     GLfloat mix = fmin(1.0, mRadius / kMaxCrossFadeRadius);
@@ -197,6 +298,8 @@ status_t BlurFilter::render(bool multiPass) {
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, mCompositionFbo.getTextureName());
     glUniform1i(mMCompositionTextureLoc, 1);
+    glUniform2f(mMUvScaleLoc, 1.0f, 1.0f);
+    glUniform4f(mMCompositionUvTransformLoc, 1.0f, 1.0f, 0.0f, 0.0f);
 
     drawMesh(mMUvLoc, mMPosLoc);
 
@@ -206,6 +309,156 @@ status_t BlurFilter::render(bool multiPass) {
     return NO_ERROR;
 }
 
+void BlurFilter::drawDualFilterPass(const DualFilterProgram& program, GLuint texture,
+                                    uint32_t width, uint32_t height, const Rect& area,
+                                    float offset) {
+    const float w = width;
+    const float h = height;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(program.textureLoc, 0);
+    glUniform2f(program.halfPixelLoc, offset / w, offset / h);
+    glUniform4f(program.uvTransformLoc, area.getWidth() / w, area.getHeight() / h,
+                area.left / w, area.top / h);
+    // Keep the samples inside of area, the rest of the texture is stale.
+    glUniform4f(program.uvClampLoc, (area.left + 0.5f) / w, (area.top + 0.5f) / h,
+                (area.right - 0.5f) / w, (area.bottom - 0.5f) / h);
+    drawMesh(program.uvLoc, program.posLoc);
+}
+
+status_t BlurFilter::prepareRegion() {
+    ATRACE_NAME("BlurFilter::prepareRegion");
+    // The previous blur has been drawn by now, so its textures can be reused.
+    releaseFbos();
+    mLevels.clear();
+    mBlurredRegionBounds = mRegionBounds;
+    mBlurredBounds = mBlurBounds;
+    mBlurredRadius = mRadius;
+    if (mBlurredBounds.isEmpty()) {
+        return NO_ERROR;
+    }
+
+    // Each downsample and upsample pair doubles the distance the samples spread over, so
+    // pick the number of passes for which the spread reaches the radius with an offset of
+    // about a texel.
+    const auto passes = static_cast<uint32_t>(
+            std::clamp(ceilf(log2f(mRadius / 4.0f)), 1.0f, float(kMaxDualFilterPasses)));
+    const float offset = mRadius / static_cast<float>(1 << (passes + 1));
+
+    uint32_t width = mBlurredBounds.getWidth();
+    uint32_t height = mBlurredBounds.getHeight();
+    for (uint32_t i = 0; i < passes; i++) {
+        width = std::max(1u, (width + 1) / 2);
+        height = std::max(1u, (height + 1) / 2);
+        GLFramebuffer* fbo = acquireFbo(width, height);
+        if (fbo->getStatus() != GL_FRAMEBUFFER_COMPLETE) {
+            ALOGE("Invalid blur buffer");
+            mLevels.clear();
+            return fbo->getStatus();
+        }
+        mLevels.push_back({fbo, width, height});
+    }
+
+    // Downsample the padded region of the composited frame, level by level...
+    mDownsampleProgram.program.useProgram();
+    glActiveTexture(GL_TEXTURE0);
+    GLuint texture = mCompositionFbo.getTextureName();
+    uint32_t textureWidth = mCompositionFbo.getBufferWidth();
+    uint32_t textureHeight = mCompositionFbo.getBufferHeight();
+    Rect area = mBlurredBounds;
+    for (const Level& level : mLevels) {
+        ATRACE_NAME("BlurFilter::downsamplePass");
+        level.fbo->bind();
+        glViewport(0, 0, level.width, level.height);
+        drawDualFilterPass(mDownsampleProgram, texture, textureWidth, textureHeight, area, offset);
+
+        texture = level.fbo->getTextureName();
+        textureWidth = level.fbo->getBufferWidth();
+        textureHeight = level.fbo->getBufferHeight();
+        area = Rect(level.width, level.height);
+    }
+    mCompositionIsDrawTarget = false;
+
+    // ... and back up to the first level, which holds the result.
+    mUpsampleProgram.program.useProgram();
+    for (size_t i = mLevels.size() - 1; i > 0; i--) {
+        ATRACE_NAME("BlurFilter::upsamplePass");
+        const Level& source = mLevels[i];
+        const Level& target = mLevels[i - 1];
+        target.fbo->bind();
+        glViewport(0, 0, target.width, target.height);
+        drawDualFilterPass(mUpsampleProgram, source.fbo->getTextureName(),
+                           source.fbo->getBufferWidth(), source.fbo->getBufferHeight(),
+                           Rect(source.width, source.height), offset);
+    }
+
+    glUseProgram(0);
+    mEngine.checkErrors("Preparing blur region");
+    return NO_ERROR;
+}
+
+status_t BlurFilter::renderRegion() {
+    ATRACE_NAME("BlurFilter::renderRegion");
+    const int32_t compositionWidth = mCompositionFbo.getBufferWidth();
+    const int32_t compositionHeight = mCompositionFbo.getBufferHeight();
+
+    // Outside of the region, the output is the composited frame as is. When rendering into
+    // the composition buffer for the next blur layer it is already there.
+    if (!mCompositionIsDrawTarget) {
+        mCompositionFbo.bindAsReadBuffer();
+        glBlitFramebuffer(0, 0, compositionWidth, compositionHeight, mDisplayX, mDisplayY,
+                          mDisplayWidth, mDisplayHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    if (mLevels.empty()) {
+        return NO_ERROR;
+    }
+
+    // The padding is blurred too, so that the edges of the region sample their surroundings,
+    // but only the region itself is drawn.
+    const Level& blurred = mLevels.front();
+    const Point displayOffset(mDisplayX, mDisplayY);
+    const Rect target = mBlurredBounds + displayOffset;
+    const Rect region = mBlurredRegionBounds + displayOffset;
+    glScissor(region.left, region.top, region.getWidth(), region.getHeight());
+    glEnable(GL_SCISSOR_TEST);
+
+    // See render. The composition can't be sampled while it's the draw target.
+    GLfloat mix = fmin(1.0, mBlurredRadius / kMaxCrossFadeRadius);
+    if (mix >= 1 || mCompositionIsDrawTarget) {
+        blurred.fbo->bindAsReadBuffer();
+        glBlitFramebuffer(0, 0, blurred.width, blurred.height, target.left, target.top,
+                          target.right, target.bottom, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    } else {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(target.left, target.top, target.getWidth(), target.getHeight());
+
+        mMixProgram.useProgram();
+        glUniform1f(mMMixLoc, mix);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, blurred.fbo->getTextureName());
+        glUniform1i(mMTextureLoc, 0);
+        glUniform2f(mMUvScaleLoc, blurred.width / (float)blurred.fbo->getBufferWidth(),
+                    blurred.height / (float)blurred.fbo->getBufferHeight());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, mCompositionFbo.getTextureName());
+        glUniform1i(mMCompositionTextureLoc, 1);
+        glUniform4f(mMCompositionUvTransformLoc, mBlurredBounds.getWidth() / (float)compositionWidth,
+                    mBlurredBounds.getHeight() / (float)compositionHeight,
+                    mBlurredBounds.left / (float)compositionWidth,
+                    mBlurredBounds.top / (float)compositionHeight);
+
+        drawMesh(mMUvLoc, mMPosLoc);
+
+        glUseProgram(0);
+        glActiveTexture(GL_TEXTURE0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    mEngine.checkErrors("Drawing blur region");
+    return NO_ERROR;
+}
+
 string BlurFilter::getVertexShader() const {
     return R"SHADER(#version 310 es
         precision mediump float;
@@ -253,16 +506,81 @@ string BlurFilter::getMixFragShader() const {
         uniform sampler2D uCompositionTexture;
         uniform sampler2D uTexture;
         uniform float uMix;
+        // The parts of the textures to draw, which may be larger than the output.
+        uniform highp vec2 uUvScale;
+        uniform highp vec4 uCompositionUvTransform;
 
         void main() {
-            vec4 blurred = texture(uTexture, vUV);
-            vec4 composition = texture(uCompositionTexture, vUV);
+            vec4 blurred = texture(uTexture, vUV * uUvScale);
+            vec4 composition = texture(uCompositionTexture,
+                    vUV * uCompositionUvTransform.xy + uCompositionUvTransform.zw);
             fragColor = mix(composition, blurred, uMix);
         }
     )SHADER";
     return shader;
 }
 
+string BlurFilter::getDownsampleFragShader() const {
+    return R"SHADER(#version 310 es
+        precision mediump float;
+
+        uniform sampler2D uTexture;
+        uniform highp vec2 uHalfPixel;
+        uniform highp vec4 uUvTransform;
+        uniform highp vec4 uUvClamp;
+
+        in highp vec2 vUV;
+        out vec4 fragColor;
+
+        vec4 sampleAt(highp vec2 uv) {
+            return texture(uTexture, clamp(uv, uUvClamp.xy, uUvClamp.zw), 0.0);
+        }
+
+        void main() {
+            highp vec2 uv = vUV * uUvTransform.xy + uUvTransform.zw;
+            vec4 sum = sampleAt(uv) * 4.0;
+            sum += sampleAt(uv - uHalfPixel);
+            sum += sampleAt(uv + uHalfPixel);
+            sum += sampleAt(uv + vec2(uHalfPixel.x, -uHalfPixel.y));
+            sum += sampleAt(uv - vec2(uHalfPixel.x, -uHalfPixel.y));
+
+            fragColor = vec4(sum.rgb * 0.125, 1.0);
+        }
+    )SHADER";
+}
+
+string BlurFilter::getUpsampleFragShader() const {
+    return R"SHADER(#version 310 es
+        precision mediump float;
+
+        uniform sampler2D uTexture;
+        uniform highp vec2 uHalfPixel;
+        uniform highp vec4 uUvTransform;
+        uniform highp vec4 uUvClamp;
+
+        in highp vec2 vUV;
+        out vec4 fragColor;
+
+        vec4 sampleAt(highp vec2 uv) {
+            return texture(uTexture, clamp(uv, uUvClamp.xy, uUvClamp.zw), 0.0);
+        }
+
+        void main() {
+            highp vec2 uv = vUV * uUvTransform.xy + uUvTransform.zw;
+            vec4 sum = sampleAt(uv + vec2(-uHalfPixel.x * 2.0, 0.0));
+            sum += sampleAt(uv + vec2(-uHalfPixel.x, uHalfPixel.y)) * 2.0;
+            sum += sampleAt(uv + vec2(0.0, uHalfPixel.y * 2.0));
+            sum += sampleAt(uv + vec2(uHalfPixel.x, uHalfPixel.y)) * 2.0;
+            sum += sampleAt(uv + vec2(uHalfPixel.x * 2.0, 0.0));
+            sum += sampleAt(uv + vec2(uHalfPixel.x, -uHalfPixel.y)) * 2.0;
+            sum += sampleAt(uv + vec2(0.0, -uHalfPixel.y * 2.0));
+            sum += sampleAt(uv + vec2(-uHalfPixel.x, -uHalfPixel.y)) * 2.0;
+
+            fragColor = vec4(sum.rgb / 12.0, 1.0);
+        }
+    )SHADER";
+}
+
 } // namespace gl
 } // namespace renderengine
 } // namespace android
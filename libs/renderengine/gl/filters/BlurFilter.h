@@ -16,7 +16,11 @@
 
 #pragma once
 
+#include <ui/FloatRect.h>
 #include <ui/GraphicTypes.h>
+#include <ui/Rect.h>
+#include <memory>
+#include <vector>
 #include "../GLESRenderEngine.h"
 #include "../GLFramebuffer.h"
 #include "../GLVertexBuffer.h"
@@ -32,6 +36,12 @@ namespace gl {
  * This is an implementation of a Kawase blur, as described in here:
  * https://community.arm.com/cfs-file/__key/communityserver-blogs-components-weblogfiles/
  * 00-00-00-20-66/siggraph2015_2D00_mmg_2D00_marius_2D00_notes.pdf
+ *
+ * By default the whole composited frame is blurred at kFboScale. In region mode only the area
+ * behind the blur layer is blurred, padded by the blur radius, using the dual filter variant
+ * described in the same notes: a chain of half resolution downsample passes followed by the
+ * matching upsample passes. The textures of the chain come from a pool, so that regions of
+ * similar sizes don't reallocate them.
  */
 class BlurFilter {
 public:
@@ -42,25 +52,75 @@ public:
     // To avoid downscaling artifacts, we interpolate the blurred fbo with the full composited
     // image, up to this radius.
     static constexpr float kMaxCrossFadeRadius = 30.0f;
+    // Maximum number of downsample passes in region mode.
+    static constexpr uint32_t kMaxDualFilterPasses = 5;
+    // Pooled textures are rounded up to a multiple of this size, so that they can be shared by
+    // regions of similar sizes.
+    static constexpr uint32_t kPoolGranularity = 64;
+    // Pooled textures unused for this many frames are freed.
+    static constexpr uint32_t kMaxPoolIdleFrames = 120;
 
-    explicit BlurFilter(GLESRenderEngine& engine);
+    explicit BlurFilter(GLESRenderEngine& engine, bool regionOnly = false);
     virtual ~BlurFilter(){};
 
-    // Set up render targets, redirecting output to offscreen texture.
-    status_t setAsDrawTarget(const DisplaySettings&, uint32_t radius);
+    // Set up render targets, redirecting output to offscreen texture. blurRegion is the area
+    // covered by the blur layer, in normalized device coordinates. It is only used in region
+    // mode.
+    status_t setAsDrawTarget(const DisplaySettings&, uint32_t radius,
+                             const FloatRect& blurRegion = FloatRect(-1, -1, 1, 1));
     // Execute blur passes, rendering to offscreen texture.
     status_t prepare();
     // Render blur to the bound framebuffer (screen).
     status_t render(bool multiPass);
 
 private:
+    struct DualFilterProgram {
+        explicit DualFilterProgram(GLESRenderEngine& engine) : program(engine) {}
+
+        GenericProgram program;
+        GLuint posLoc;
+        GLuint uvLoc;
+        GLuint textureLoc;
+        GLuint halfPixelLoc;
+        GLuint uvTransformLoc;
+        GLuint uvClampLoc;
+    };
+
+    // A texture of the dual filter chain, and the size of its used part.
+    struct Level {
+        GLFramebuffer* fbo;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct PooledFbo {
+        std::unique_ptr<GLFramebuffer> fbo;
+        uint64_t lastUsedFrame;
+        bool inUse;
+    };
+
     uint32_t mRadius;
     void drawMesh(GLuint uv, GLuint position);
+    status_t prepareRegion();
+    status_t renderRegion();
+    void compileDualFilterProgram(DualFilterProgram& program, const string& fragmentShader);
+    // Draws the area part of texture, of the given size, to the whole viewport of the bound
+    // framebuffer. offset is the sampling distance in source texels.
+    void drawDualFilterPass(const DualFilterProgram& program, GLuint texture, uint32_t width,
+                            uint32_t height, const Rect& area, float offset);
+    GLFramebuffer* acquireFbo(uint32_t width, uint32_t height);
+    // Makes every pooled texture available again, once the previous blur layer is drawn.
+    void releaseFbos();
+    // Frees the pooled textures which haven't been used for kMaxPoolIdleFrames frames.
+    void endFrame();
     string getVertexShader() const;
     string getFragmentShader() const;
     string getMixFragShader() const;
+    string getDownsampleFragShader() const;
+    string getUpsampleFragShader() const;
 
     GLESRenderEngine& mEngine;
+    const bool mRegionOnly;
     // Frame buffer holding the composited background.
     GLFramebuffer mCompositionFbo;
     // Frame buffers holding the blur passes.
@@ -73,6 +133,24 @@ private:
     // Buffer holding the final blur pass.
     GLFramebuffer* mLastDrawTarget;
 
+    // Region mode: the part of mCompositionFbo behind the blur layer, and the same area padded
+    // by the blur radius, which is what gets blurred. Both are in GL window coordinates, so top
+    // is the lowest row, and mBlurBounds is empty when there is nothing to blur.
+    Rect mRegionBounds;
+    Rect mBlurBounds;
+    // The same, as of the last prepare. setAsDrawTarget is called for the next blur layer before
+    // render draws the previous one.
+    Rect mBlurredRegionBounds;
+    Rect mBlurredBounds;
+    uint32_t mBlurredRadius = 0;
+    // The levels of the dual filter chain, the first one being the half resolution result.
+    std::vector<Level> mLevels;
+    // Whether mCompositionFbo is the bound framebuffer, i.e. whether render draws into it.
+    bool mCompositionIsDrawTarget = false;
+    std::vector<PooledFbo> mFboPool;
+    // Number of frames drawn, each of which may blur several layers.
+    uint64_t mFrame = 0;
+
     // VBO containing vertex and uv data of a fullscreen triangle.
     GLVertexBuffer mMeshBuffer;
 
@@ -82,12 +160,17 @@ private:
     GLuint mMMixLoc;
     GLuint mMTextureLoc;
     GLuint mMCompositionTextureLoc;
+    GLuint mMUvScaleLoc;
+    GLuint mMCompositionUvTransformLoc;
 
     GenericProgram mBlurProgram;
     GLuint mBPosLoc;
     GLuint mBUvLoc;
     GLuint mBTextureLoc;
     GLuint mBOffsetLoc;
+
+    DualFilterProgram mDownsampleProgram;
+    DualFilterProgram mUpsampleProgram;
 };
 
 } // namespace gl
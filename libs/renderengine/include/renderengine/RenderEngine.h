@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <memory>
+#include <string>
 
 #include <android-base/unique_fd.h>
 #include <math/mat4.h>
@@ -195,6 +196,8 @@ struct RenderEngineCreationArgs {
     bool precacheToneMapperShaderOnly;
     bool supportsBackgroundBlur;
     RenderEngine::ContextPriority contextPriority;
+    // If not empty, compiled shader programs are persisted to and reloaded from this directory.
+    std::string programBinaryCacheDir;
 
     struct Builder;
 
@@ -207,14 +210,16 @@ private:
             bool _enableProtectedContext,
             bool _precacheToneMapperShaderOnly,
             bool _supportsBackgroundBlur,
-            RenderEngine::ContextPriority _contextPriority)
+            RenderEngine::ContextPriority _contextPriority,
+            std::string _programBinaryCacheDir)
         : pixelFormat(_pixelFormat)
         , imageCacheSize(_imageCacheSize)
         , useColorManagement(_useColorManagement)
         , enableProtectedContext(_enableProtectedContext)
         , precacheToneMapperShaderOnly(_precacheToneMapperShaderOnly)
         , supportsBackgroundBlur(_supportsBackgroundBlur)
-        , contextPriority(_contextPriority) {}
+        , contextPriority(_contextPriority)
+        , programBinaryCacheDir(std::move(_programBinaryCacheDir)) {}
     RenderEngineCreationArgs() = delete;
 };
 
@@ -249,10 +254,15 @@ struct RenderEngineCreationArgs::Builder {
         this->contextPriority = contextPriority;
         return *this;
     }
+    Builder& setProgramBinaryCacheDir(std::string programBinaryCacheDir) {
+        this->programBinaryCacheDir = std::move(programBinaryCacheDir);
+        return *this;
+    }
     RenderEngineCreationArgs build() const {
         return RenderEngineCreationArgs(pixelFormat, imageCacheSize, useColorManagement,
                                         enableProtectedContext, precacheToneMapperShaderOnly,
-                                        supportsBackgroundBlur, contextPriority);
+                                        supportsBackgroundBlur, contextPriority,
+                                        programBinaryCacheDir);
     }
 
 private:
@@ -264,6 +274,7 @@ private:
     bool precacheToneMapperShaderOnly = false;
     bool supportsBackgroundBlur = false;
     RenderEngine::ContextPriority contextPriority = RenderEngine::ContextPriority::MEDIUM;
+    std::string programBinaryCacheDir;
 };
 
 class BindNativeBufferAsFramebuffer {
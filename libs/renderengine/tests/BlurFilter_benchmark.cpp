@@ -0,0 +1,146 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the GPU time of a background blur per radius, from the composited frame to the blurred
+// output, for the full screen blur and for the region blur. Each iteration waits for the GPU to
+// finish, so the times include the rendering and not just the command submission.
+
+#include <GLES3/gl3.h>
+#include <benchmark/benchmark.h>
+#include <renderengine/DisplaySettings.h>
+#include <renderengine/RenderEngine.h>
+#include <ui/PixelFormat.h>
+
+#include "../gl/GLESRenderEngine.h"
+#include "../gl/GLFramebuffer.h"
+#include "../gl/filters/BlurFilter.h"
+
+namespace android {
+namespace {
+
+using renderengine::DisplaySettings;
+using renderengine::RenderEngineCreationArgs;
+using renderengine::gl::BlurFilter;
+using renderengine::gl::GLESRenderEngine;
+using renderengine::gl::GLFramebuffer;
+
+constexpr int32_t kDisplayWidth = 1080;
+constexpr int32_t kDisplayHeight = 2340;
+
+GLESRenderEngine& getRenderEngine() {
+    static std::unique_ptr<GLESRenderEngine> engine = GLESRenderEngine::create(
+            RenderEngineCreationArgs::Builder()
+                    .setPixelFormat(static_cast<int>(ui::PixelFormat::RGBA_8888))
+                    .setImageCacheSize(1)
+                    .setUseColorManagerment(false)
+                    .setEnableProtectedContext(false)
+                    .setPrecacheToneMapperShaderOnly(false)
+                    .setSupportsBackgroundBlur(true)
+                    .setContextPriority(renderengine::RenderEngine::ContextPriority::MEDIUM)
+                    .build());
+    return *engine;
+}
+
+// A blur layer spanning the width of the display and the given percentage of its height,
+// centered, in normalized device coordinates.
+FloatRect getBlurRegion(int64_t heightPercent) {
+    const float halfHeight = heightPercent / 100.0f;
+    return FloatRect(-1.0f, -halfHeight, 1.0f, halfHeight);
+}
+
+struct BlurRunner {
+    explicit BlurRunner(bool regionOnly)
+          : engine(getRenderEngine()), blur(engine, regionOnly), output(engine) {
+        display.physicalDisplay = Rect(kDisplayWidth, kDisplayHeight);
+        display.clip = display.physicalDisplay;
+        output.allocateBuffers(kDisplayWidth, kDisplayHeight);
+    }
+
+    bool blurFrame(uint32_t radius, const FloatRect& region) {
+        if (blur.setAsDrawTarget(display, radius, region) != NO_ERROR) {
+            return false;
+        }
+        // Stands in for the layers under the blur layer.
+        glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        if (blur.prepare() != NO_ERROR) {
+            return false;
+        }
+        output.bind();
+        glViewport(0, 0, kDisplayWidth, kDisplayHeight);
+        if (blur.render(false /* multiPass */) != NO_ERROR) {
+            return false;
+        }
+        glFinish();
+        return true;
+    }
+
+    GLESRenderEngine& engine;
+    BlurFilter blur;
+    GLFramebuffer output;
+    DisplaySettings display;
+};
+
+// Args: region mode, blur radius, blur layer height in percent of the display.
+void BM_Blur(benchmark::State& state) {
+    BlurRunner runner(state.range(0));
+    const uint32_t radius = state.range(1);
+    const FloatRect region = getBlurRegion(state.range(2));
+    for (auto _ : state) {
+        if (!runner.blurFrame(radius, region)) {
+            state.SkipWithError("Blur failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_Blur)
+        ->Apply([](benchmark::internal::Benchmark* b) {
+            for (int regionOnly : {0, 1}) {
+                for (int radius : {5, 15, 30, 60, 120}) {
+                    for (int heightPercent : {25, 100}) {
+                        b->Args({regionOnly, radius, heightPercent});
+                    }
+                }
+            }
+        })
+        ->ArgNames({"region", "radius", "height"})
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+// A blur layer which grows and shrinks every frame, as during an animation. In region mode the
+// textures come from the pool instead of being reallocated.
+void BM_BlurAnimatedRegion(benchmark::State& state) {
+    BlurRunner runner(state.range(0));
+    int64_t frame = 0;
+    for (auto _ : state) {
+        const int64_t heightPercent = 25 + (frame++ % 50);
+        if (!runner.blurFrame(60, getBlurRegion(heightPercent))) {
+            state.SkipWithError("Blur failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_BlurAnimatedRegion)
+        ->Arg(0)
+        ->Arg(1)
+        ->ArgName("region")
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
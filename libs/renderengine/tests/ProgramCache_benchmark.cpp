@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures RenderEngine start-up, i.e. creating the engine and priming the program cache, as
+// SurfaceFlinger does at boot. Compares no binary cache, a cold binary cache (every program is
+// compiled and written out) and a warm one (every program is loaded from disk).
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <renderengine/RenderEngine.h>
+#include <ui/PixelFormat.h>
+
+#include <string>
+
+#include "../gl/GLESRenderEngine.h"
+#include "../gl/ProgramCache.h"
+
+namespace android {
+namespace {
+
+using renderengine::RenderEngineCreationArgs;
+using renderengine::gl::GLESRenderEngine;
+using renderengine::gl::ProgramCache;
+
+void startRenderEngine(const std::string& cacheDir) {
+    std::unique_ptr<GLESRenderEngine> engine = GLESRenderEngine::create(
+            RenderEngineCreationArgs::Builder()
+                    .setPixelFormat(static_cast<int>(ui::PixelFormat::RGBA_8888))
+                    .setImageCacheSize(1)
+                    .setUseColorManagerment(true)
+                    .setEnableProtectedContext(false)
+                    .setPrecacheToneMapperShaderOnly(false)
+                    .setSupportsBackgroundBlur(false)
+                    .setContextPriority(renderengine::RenderEngine::ContextPriority::MEDIUM)
+                    .setProgramBinaryCacheDir(cacheDir)
+                    .build());
+    engine->primeCache();
+    benchmark::DoNotOptimize(engine.get());
+}
+
+// Drops the binary cache held by the ProgramCache singleton, which waits for its pending writes.
+void flushBinaryCache() {
+    ProgramCache::getInstance().setBinaryCache(nullptr);
+}
+
+void clearCacheDir(const std::string& cacheDir) {
+    if (DIR* dir = opendir(cacheDir.c_str())) {
+        while (const dirent* entry = readdir(dir)) {
+            if (entry->d_type == DT_REG) {
+                unlink((cacheDir + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(cacheDir.c_str());
+}
+
+void BM_StartupWithoutBinaryCache(benchmark::State& state) {
+    for (auto _ : state) {
+        startRenderEngine("");
+    }
+}
+BENCHMARK(BM_StartupWithoutBinaryCache)->Unit(benchmark::kMillisecond);
+
+void BM_StartupColdBinaryCache(benchmark::State& state) {
+    TemporaryDir dir;
+    const std::string cacheDir = std::string(dir.path) + "/programs";
+    for (auto _ : state) {
+        state.PauseTiming();
+        flushBinaryCache();
+        clearCacheDir(cacheDir);
+        state.ResumeTiming();
+
+        startRenderEngine(cacheDir);
+    }
+    flushBinaryCache();
+    clearCacheDir(cacheDir);
+}
+BENCHMARK(BM_StartupColdBinaryCache)->Unit(benchmark::kMillisecond);
+
+void BM_StartupWarmBinaryCache(benchmark::State& state) {
+    TemporaryDir dir;
+    const std::string cacheDir = std::string(dir.path) + "/programs";
+    startRenderEngine(cacheDir);
+    for (auto _ : state) {
+        state.PauseTiming();
+        flushBinaryCache();
+        state.ResumeTiming();
+
+        startRenderEngine(cacheDir);
+    }
+    flushBinaryCache();
+    clearCacheDir(cacheDir);
+}
+BENCHMARK(BM_StartupWarmBinaryCache)->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -22,12 +22,21 @@
 #include <condition_variable>
 #include <fstream>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <gtest/gtest.h>
 #include <cutils/properties.h>
 #include <renderengine/RenderEngine.h>
 #include <sync/sync.h>
 #include <ui/PixelFormat.h>
 #include "../gl/GLESRenderEngine.h"
+#include "../gl/GLExtensions.h"
+#include "../gl/ProgramBinaryCache.h"
+#include "../gl/ProgramCache.h"
+#include "../gl/filters/BlurFilter.h"
 
 constexpr int DEFAULT_DISPLAY_WIDTH = 128;
 constexpr int DEFAULT_DISPLAY_HEIGHT = 256;
@@ -334,6 +343,13 @@ struct RenderEngineTest : public ::testing::Test {
     template <typename SourceVariant>
     void fillBufferAndBlurBackground();
 
+    static bool supportsBackgroundBlur();
+
+    // Draws a frame through a region mode BlurFilter the way drawLayers does, with one blur
+    // layer per region over a composition whose left half is red and right half green.
+    void drawRegionBlur(renderengine::gl::BlurFilter& blur, const std::vector<FloatRect>& regions,
+                        uint32_t radius);
+
     template <typename SourceVariant>
     void overlayCorners();
 
@@ -754,6 +770,44 @@ void RenderEngineTest::fillBufferAndBlurBackground() {
                       50 /* tolerance */);
 }
 
+bool RenderEngineTest::supportsBackgroundBlur() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.surface_flinger.supports_background_blur", value, "0");
+    return atoi(value);
+}
+
+void RenderEngineTest::drawRegionBlur(renderengine::gl::BlurFilter& blur,
+                                      const std::vector<FloatRect>& regions, uint32_t radius) {
+    renderengine::DisplaySettings settings;
+    settings.physicalDisplay = fullscreenRect();
+    settings.clip = fullscreenRect();
+
+    ASSERT_EQ(NO_ERROR, blur.setAsDrawTarget(settings, radius, regions.front()));
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, DEFAULT_DISPLAY_WIDTH / 2, DEFAULT_DISPLAY_HEIGHT);
+    glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(DEFAULT_DISPLAY_WIDTH / 2, 0, DEFAULT_DISPLAY_WIDTH / 2, DEFAULT_DISPLAY_HEIGHT);
+    glClearColor(0.0f, 1.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+
+    for (size_t i = 0; i < regions.size(); i++) {
+        ASSERT_EQ(NO_ERROR, blur.prepare());
+        if (i + 1 < regions.size()) {
+            ASSERT_EQ(NO_ERROR, blur.setAsDrawTarget(settings, radius, regions[i + 1]));
+            ASSERT_EQ(NO_ERROR, blur.render(true /* multiPass */));
+        } else {
+            renderengine::BindNativeBufferAsFramebuffer fbo(*sRE, mBuffer->getNativeBuffer(),
+                                                            true /* useFramebufferCache */);
+            ASSERT_EQ(NO_ERROR, fbo.getStatus());
+            glViewport(0, 0, DEFAULT_DISPLAY_WIDTH, DEFAULT_DISPLAY_HEIGHT);
+            ASSERT_EQ(NO_ERROR, blur.render(regions.size() > 1));
+            glFinish();
+        }
+    }
+}
+
 template <typename SourceVariant>
 void RenderEngineTest::overlayCorners() {
     renderengine::DisplaySettings settings;
@@ -1196,6 +1250,68 @@ TEST_F(RenderEngineTest, drawLayers_fillBufferAndBlurBackground_bufferSource) {
     fillBufferAndBlurBackground<BufferSourceVariant<RelaxOpaqueBufferVariant>>();
 }
 
+// The regions below are bands across the display which are symmetric about its middle row, so
+// that the expected rows don't depend on which way up the buffer is.
+TEST_F(RenderEngineTest, regionBlur_blursOnlyTheRegion) {
+    if (!supportsBackgroundBlur()) {
+        return;
+    }
+    const int32_t center = DEFAULT_DISPLAY_WIDTH / 2;
+    renderengine::gl::BlurFilter blur(*sRE, true /* regionOnly */);
+
+    // Rows 96 to 160, blitted from the blur as the radius is over kMaxCrossFadeRadius.
+    drawRegionBlur(blur, {FloatRect(-1.0f, -0.25f, 1.0f, 0.25f)}, 50);
+
+    expectBufferColor(Rect(0, 0, center, 96), 255, 0, 0, 255);
+    expectBufferColor(Rect(center, 0, DEFAULT_DISPLAY_WIDTH, 96), 0, 255, 0, 255);
+    expectBufferColor(Rect(0, 160, center, DEFAULT_DISPLAY_HEIGHT), 255, 0, 0, 255);
+    expectBufferColor(Rect(center, 160, DEFAULT_DISPLAY_WIDTH, DEFAULT_DISPLAY_HEIGHT), 0, 255, 0,
+                      255);
+    expectBufferColor(Rect(center - 1, 120, center + 1, 136), 128, 128, 0, 255,
+                      50 /* tolerance */);
+}
+
+TEST_F(RenderEngineTest, regionBlur_crossfadesSmallRadius) {
+    if (!supportsBackgroundBlur()) {
+        return;
+    }
+    const int32_t center = DEFAULT_DISPLAY_WIDTH / 2;
+    renderengine::gl::BlurFilter blur(*sRE, true /* regionOnly */);
+
+    // Half the blur and half the composition, on either side of the edge between red and green.
+    drawRegionBlur(blur, {FloatRect(-1.0f, -0.25f, 1.0f, 0.25f)}, 15);
+
+    expectBufferColor(Rect(0, 0, center, 96), 255, 0, 0, 255);
+    expectBufferColor(Rect(center, 160, DEFAULT_DISPLAY_WIDTH, DEFAULT_DISPLAY_HEIGHT), 0, 255, 0,
+                      255);
+    expectBufferColor(Rect(center - 1, 120, center, 136), 191, 64, 0, 255, 50 /* tolerance */);
+    expectBufferColor(Rect(center, 120, center + 1, 136), 64, 191, 0, 255, 50 /* tolerance */);
+}
+
+TEST_F(RenderEngineTest, regionBlur_blursEachLayerRegion) {
+    if (!supportsBackgroundBlur()) {
+        return;
+    }
+    const int32_t center = DEFAULT_DISPLAY_WIDTH / 2;
+    renderengine::gl::BlurFilter blur(*sRE, true /* regionOnly */);
+
+    // Rows 32 to 64 and 192 to 224, with the second layer reusing the textures of the first.
+    drawRegionBlur(blur,
+                   {FloatRect(-1.0f, -0.75f, 1.0f, -0.5f), FloatRect(-1.0f, 0.5f, 1.0f, 0.75f)},
+                   50);
+
+    expectBufferColor(Rect(0, 0, center, 32), 255, 0, 0, 255);
+    expectBufferColor(Rect(center, 0, DEFAULT_DISPLAY_WIDTH, 32), 0, 255, 0, 255);
+    expectBufferColor(Rect(0, 64, center, 192), 255, 0, 0, 255);
+    expectBufferColor(Rect(center, 64, DEFAULT_DISPLAY_WIDTH, 192), 0, 255, 0, 255);
+    expectBufferColor(Rect(0, 224, center, DEFAULT_DISPLAY_HEIGHT), 255, 0, 0, 255);
+    expectBufferColor(Rect(center, 224, DEFAULT_DISPLAY_WIDTH, DEFAULT_DISPLAY_HEIGHT), 0, 255, 0,
+                      255);
+    expectBufferColor(Rect(center - 1, 40, center + 1, 56), 128, 128, 0, 255, 50 /* tolerance */);
+    expectBufferColor(Rect(center - 1, 200, center + 1, 216), 128, 128, 0, 255,
+                      50 /* tolerance */);
+}
+
 TEST_F(RenderEngineTest, drawLayers_overlayCorners_bufferSource) {
     overlayCorners<BufferSourceVariant<RelaxOpaqueBufferVariant>>();
 }
@@ -1465,6 +1581,135 @@ TEST_F(RenderEngineTest, cleanupPostRender_whenCleaningAll_replacesTextureMemory
     EXPECT_TRUE(sRE->isTextureNameKnownForTesting(texName));
 }
 
+TEST_F(RenderEngineTest, programBinaryCache_compilesProgramWhenDriverRejectsBinary) {
+    using renderengine::gl::ProgramBinaryCache;
+    using renderengine::gl::ProgramCache;
+
+    if (!renderengine::gl::GLExtensions::getInstance().hasProgramBinary()) {
+        GTEST_SKIP() << "GL_OES_get_program_binary is not supported";
+    }
+
+    // The first of the programs primed for tone mapping only.
+    const uint32_t keyValue = ProgramCache::Key::BLEND_NORMAL |
+            ProgramCache::Key::INPUT_TRANSFORM_MATRIX_ON |
+            ProgramCache::Key::OUTPUT_TRANSFORM_MATRIX_ON | ProgramCache::Key::OUTPUT_TF_SRGB |
+            ProgramCache::Key::OPACITY_OPAQUE | ProgramCache::Key::ALPHA_EQ_ONE |
+            ProgramCache::Key::ROUNDED_CORNERS_OFF | ProgramCache::Key::TEXTURE_EXT |
+            ProgramCache::Key::INPUT_TF_ST2084 | ProgramCache::Key::Y410_BT2020_OFF;
+    const uint64_t sourceHash =
+            ProgramCache::getSourceHash(ProgramCache::Key().set(~0u, keyValue));
+
+    // Store a binary for it that passes every check of the cache, but that no driver will take.
+    TemporaryDir dir;
+    const std::vector<uint8_t> garbage(64, 0xa5);
+    {
+        ProgramBinaryCache cache(dir.path, "driver");
+        cache.put(keyValue, sourceHash, ProgramBinaryCache::Binary{GL_NONE, garbage});
+    }
+
+    // Any context will do as a key for the programs, they are created in the current one.
+    const EGLContext context = reinterpret_cast<EGLContext>(this);
+    ProgramCache::getInstance().setBinaryCache(
+            std::make_unique<ProgramBinaryCache>(dir.path, "driver"));
+    ProgramCache::getInstance().primeCache(context, false, true);
+    // Waits for the compiled binary to be written back.
+    ProgramCache::getInstance().setBinaryCache(nullptr);
+    ProgramCache::getInstance().purgeCache(context);
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    ProgramBinaryCache cache(dir.path, "driver");
+    auto binary = cache.get(keyValue, sourceHash);
+    ASSERT_NE(nullptr, binary);
+    EXPECT_NE(garbage, binary->data);
+}
+
+/*
+ * ProgramBinaryCache files
+ */
+
+class ProgramBinaryCacheTest : public ::testing::Test {
+protected:
+    static constexpr uint32_t kKey = 0x1234;
+    static constexpr uint64_t kSourceHash = 0xabcdef;
+
+    using Cache = renderengine::gl::ProgramBinaryCache;
+
+    ProgramBinaryCacheTest() {
+        mBinary.format = 0x8fb0;
+        for (size_t i = 0; i < 1024; i++) {
+            mBinary.data.push_back(static_cast<uint8_t>(i * 7));
+        }
+        // Written out when the cache goes away.
+        Cache(mDir.path, "driver").put(kKey, kSourceHash, mBinary);
+    }
+
+    std::string getPath() const {
+        return base::StringPrintf("%s/%08x.bin", mDir.path, kKey);
+    }
+
+    off_t getFileSize() const {
+        struct stat st;
+        return stat(getPath().c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    TemporaryDir mDir;
+    Cache::Binary mBinary;
+};
+
+TEST_F(ProgramBinaryCacheTest, readsBackWrittenBinary) {
+    auto binary = Cache(mDir.path, "driver").get(kKey, kSourceHash);
+    ASSERT_NE(nullptr, binary);
+    EXPECT_EQ(mBinary.format, binary->format);
+    EXPECT_EQ(mBinary.data, binary->data);
+}
+
+TEST_F(ProgramBinaryCacheTest, ignoresTruncatedFile) {
+    ASSERT_EQ(0, truncate(getPath().c_str(), getFileSize() - 1));
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash));
+}
+
+TEST_F(ProgramBinaryCacheTest, ignoresFileShorterThanHeader) {
+    ASSERT_EQ(0, truncate(getPath().c_str(), 8));
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash));
+
+    ASSERT_EQ(0, truncate(getPath().c_str(), 0));
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash));
+}
+
+TEST_F(ProgramBinaryCacheTest, ignoresCorruptBinary) {
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(getPath(), &contents));
+    contents.back() ^= 0xff;
+    ASSERT_TRUE(base::WriteStringToFile(contents, getPath()));
+
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash));
+}
+
+TEST_F(ProgramBinaryCacheTest, ignoresCorruptHeader) {
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(getPath(), &contents));
+    contents[0] ^= 0xff;
+    ASSERT_TRUE(base::WriteStringToFile(contents, getPath()));
+
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash));
+}
+
+TEST_F(ProgramBinaryCacheTest, ignoresBinaryFromOtherDriver) {
+    // E.g. the build fingerprint changed with an OTA.
+    EXPECT_EQ(nullptr, Cache(mDir.path, "other driver").get(kKey, kSourceHash));
+}
+
+TEST_F(ProgramBinaryCacheTest, ignoresBinaryForOtherSources) {
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash + 1));
+}
+
+TEST_F(ProgramBinaryCacheTest, removeDeletesFile) {
+    Cache(mDir.path, "driver").remove(kKey);
+    EXPECT_EQ(-1, getFileSize());
+    EXPECT_EQ(nullptr, Cache(mDir.path, "driver").get(kKey, kSourceHash));
+}
+
 } // namespace android
 
 // TODO(b/129481165): remove the #pragma below and fix conversion issues
@@ -19,6 +19,12 @@
 #include <inttypes.h>
 #include <limits.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <android-base/stringprintf.h>
 
 #include <utils/Log.h>
@@ -62,6 +68,14 @@ enum {
     direction_RTL
 };
 
+// Result of an operation that can be computed from the bounds of its operands alone.
+enum {
+    trivial_none,   // the full region operator is needed
+    trivial_empty,  // the result is empty
+    trivial_lhs,    // the result is lhs
+    trivial_rhs     // the result is rhs
+};
+
 const Region Region::INVALID_REGION(Rect::INVALID_RECT);
 
 // ----------------------------------------------------------------------------
@@ -528,6 +542,40 @@ void Region::rasterizer::operator()(const Rect& rect)
     cur = span.data() + (span.size() - 1);
 }
 
+// Returns true if the rects of both spans have the same left and right edges. This is the test
+// for whether a new span can be merged vertically into the previous one, and runs for every span
+// that the rasterizer emits, so compare one whole Rect per vector instruction where possible.
+static inline bool haveSameHorizontalEdges(const Rect* p, const Rect* q, size_t count) {
+    static_assert(sizeof(Rect) == 4 * sizeof(int32_t), "Rect must be 4 packed int32_t");
+#if defined(__SSE2__)
+    // Byte mask of the left (lane 0) and right (lane 2) edges.
+    constexpr int kEdgesMask = 0x0F0F;
+    for (size_t i = 0; i < count; i++) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + i));
+        if ((_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)) & kEdgesMask) != kEdgesMask) {
+            return false;
+        }
+    }
+    return true;
+#elif defined(__ARM_NEON)
+    for (size_t i = 0; i < count; i++) {
+        const uint32x4_t eq = vceqq_s32(vld1q_s32(&p[i].left), vld1q_s32(&q[i].left));
+        if ((vgetq_lane_u32(eq, 0) & vgetq_lane_u32(eq, 2)) == 0) {
+            return false;
+        }
+    }
+    return true;
+#else
+    for (size_t i = 0; i < count; i++) {
+        if ((p[i].left != q[i].left) || (p[i].right != q[i].right)) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
 void Region::rasterizer::flushSpan()
 {
     bool merge = false;
@@ -535,15 +583,7 @@ void Region::rasterizer::flushSpan()
         Rect const* p = span.data();
         Rect const* q = head;
         if (p->top == q->bottom) {
-            merge = true;
-            while (q != tail) {
-                if ((p->left != q->left) || (p->right != q->right)) {
-                    merge = false;
-                    break;
-                }
-                p++;
-                q++;
-            }
+            merge = haveSameHorizontalEdges(p, q, span.size());
         }
     }
     if (merge) {
@@ -643,6 +683,29 @@ bool Region::validate(const Region& reg, const char* name, bool silent)
     return result;
 }
 
+// Visible region computation mostly combines regions that do not overlap at all, or that are
+// empty. In those cases the result is one of the operands, which is much cheaper to copy than to
+// rasterize.
+static int classifyBooleanOperation(uint32_t op, const Rect& lhsBounds, const Rect& rhsBounds)
+{
+    const bool lhsEmpty = lhsBounds.isEmpty();
+    const bool rhsEmpty = rhsBounds.isEmpty();
+    Rect unused;
+    const bool disjoint = lhsEmpty || rhsEmpty || !lhsBounds.intersect(rhsBounds, &unused);
+    switch (op) {
+        case op_and:
+            return disjoint ? trivial_empty : trivial_none;
+        case op_nand:
+            if (lhsEmpty) return trivial_empty;
+            return disjoint ? trivial_lhs : trivial_none;
+        case op_or:
+        case op_xor:
+            if (rhsEmpty) return lhsEmpty ? trivial_empty : trivial_lhs;
+            return lhsEmpty ? trivial_rhs : trivial_none;
+    }
+    return trivial_none;
+}
+
 void Region::boolean_operation(uint32_t op, Region& dst,
         const Region& lhs,
         const Region& rhs, int dx, int dy)
@@ -653,6 +716,21 @@ void Region::boolean_operation(uint32_t op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !VALIDATE_WITH_CORECG
+    switch (classifyBooleanOperation(op, lhs.getBounds(), rhs.getBounds() + Point(dx, dy))) {
+        case trivial_empty:
+            dst.clear();
+            return;
+        case trivial_lhs:
+            dst = lhs;
+            return;
+        case trivial_rhs:
+            dst = rhs;
+            dst.translateSelf(dx, dy);
+            return;
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -767,6 +845,18 @@ void Region::boolean_operation(uint32_t op, Region& dst,
 #if VALIDATE_WITH_CORECG || defined(VALIDATE_REGIONS)
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    switch (classifyBooleanOperation(op, lhs.getBounds(), rhs + Point(dx, dy))) {
+        case trivial_empty:
+            dst.clear();
+            return;
+        case trivial_lhs:
+            dst = lhs;
+            return;
+        case trivial_rhs:
+            dst.set(rhs + Point(dx, dy));
+            return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
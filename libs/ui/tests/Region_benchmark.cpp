@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+namespace android {
+
+// Builds a region out of rectCount rects laid out on a staggered grid, so that the spans of
+// neighbouring rows do not line up and the rasterizer cannot collapse them.
+static Region generateRegion(size_t rectCount, int32_t offset) {
+    constexpr int32_t kSize = 8;
+    constexpr int32_t kColumns = 100;
+    Region region;
+    for (size_t i = 0; i < rectCount; i++) {
+        const int32_t column = i % kColumns;
+        const int32_t row = i / kColumns;
+        const int32_t left = column * 2 * kSize + (row % 2) * kSize / 2 + offset;
+        const int32_t top = row * kSize + offset;
+        region.orSelf(Rect(left, top, left + kSize, top + kSize));
+    }
+    return region;
+}
+
+template <const Region (Region::*Operation)(const Region&) const>
+static void benchmarkRegionOperation(benchmark::State& state) {
+    const Region lhs = generateRegion(state.range(0), 0);
+    const Region rhs = generateRegion(state.range(0), 3);
+    for (auto _ : state) {
+        Region result = (lhs.*Operation)(rhs);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetComplexityN(state.range(0));
+}
+
+// The common visible region computation case: operands that do not overlap at all.
+static void benchmarkRegionSubtractDisjoint(benchmark::State& state) {
+    const Region lhs = generateRegion(state.range(0), 0);
+    const Region rhs(Rect(-100, -100, -10, -10));
+    for (auto _ : state) {
+        Region result = lhs.subtract(rhs);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetComplexityN(state.range(0));
+}
+
+#define REGION_BENCHMARK(benchmark_) \
+    BENCHMARK(benchmark_)->RangeMultiplier(10)->Range(1, 10000)->Complexity()
+
+REGION_BENCHMARK(benchmarkRegionOperation<&Region::merge>)->Name("benchmarkRegionOr");
+REGION_BENCHMARK(benchmarkRegionOperation<&Region::intersect>)->Name("benchmarkRegionAnd");
+REGION_BENCHMARK(benchmarkRegionOperation<&Region::subtract>)->Name("benchmarkRegionSubtract");
+REGION_BENCHMARK(benchmarkRegionSubtractDisjoint);
+
+} // namespace android
+
+BENCHMARK_MAIN();
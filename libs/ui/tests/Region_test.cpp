@@ -167,5 +167,45 @@ TEST_F(RegionTest, EqualsToSelf) {
     ASSERT_TRUE(touchableRegion.contains(50, 50));
 }
 
+TEST_F(RegionTest, DisjointOperands) {
+    Region lhs(Rect(0, 0, 100, 100));
+    lhs.orSelf(Rect(50, 100, 150, 200));
+    const Rect rhs(300, 300, 400, 400);
+
+    EXPECT_TRUE(lhs.intersect(rhs).isEmpty());
+    EXPECT_TRUE(lhs.subtract(rhs).hasSameRects(lhs));
+    EXPECT_TRUE(lhs.intersect(Region(rhs), -300, -300).hasSameRects(Region(Rect(0, 0, 100, 100))));
+    EXPECT_TRUE(lhs.subtract(Region(rhs), -350, -350).hasSameRects(
+            Region(Rect(50, 0, 100, 50)).merge(Rect(0, 50, 100, 100)).merge(
+                    Rect(50, 100, 150, 200))));
+}
+
+TEST_F(RegionTest, EmptyOperands) {
+    const Region empty;
+    Region region(Rect(10, 10, 20, 20));
+    region.orSelf(Rect(30, 30, 40, 40));
+
+    EXPECT_TRUE(empty.merge(region).hasSameRects(region));
+    EXPECT_TRUE(region.merge(empty).hasSameRects(region));
+    EXPECT_TRUE(empty.mergeExclusive(region).hasSameRects(region));
+    EXPECT_TRUE(empty.merge(region, 5, 5).hasSameRects(region.translate(5, 5)));
+    EXPECT_TRUE(region.intersect(empty).isEmpty());
+    EXPECT_TRUE(empty.subtract(region).isEmpty());
+    EXPECT_TRUE(region.subtract(empty).hasSameRects(region));
+    EXPECT_TRUE(empty.merge(Rect(1, 2, 3, 4)).hasSameRects(Region(Rect(1, 2, 3, 4))));
+}
+
+TEST_F(RegionTest, MergesVerticallyAdjacentSpans) {
+    Region region;
+    for (int i = 0; i < 10; i++) {
+        region.orSelf(Rect(0, i * 10, 10, i * 10 + 10));
+        region.orSelf(Rect(20, i * 10, 30, i * 10 + 10));
+    }
+
+    // Every row has the same two spans, so they collapse into two rects.
+    EXPECT_EQ(2, region.end() - region.begin());
+    EXPECT_EQ(Rect(0, 0, 30, 100), region.getBounds());
+}
+
 }; // namespace android
 
@@ -0,0 +1,186 @@
+/*
+ ** Copyright 2020, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+// Compares BlobCache, used behind the egl_cache_t mutex, with ShardedBlobCache
+// on the workloads of the unit tests, scaled to the limits egl_cache_t uses.
+
+#include <unistd.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include "BlobCache.h"
+#include "FileBlobCache.h"
+#include "ShardedBlobCache.h"
+
+namespace android {
+namespace {
+
+// Same as egl_cache.cpp.
+constexpr size_t kMaxKeySize = 12 * 1024;
+constexpr size_t kMaxValueSize = 64 * 1024;
+constexpr size_t kMaxTotalSize = 2 * 1024 * 1024;
+
+// Shader cache keys are hashes plus some driver state, and values are
+// compiled binaries of a few KB.
+constexpr size_t kKeySize = 64;
+constexpr size_t kValueSize = 8 * 1024;
+constexpr size_t kEntryCount = kMaxTotalSize / (kKeySize + kValueSize) / 2;
+
+std::vector<uint8_t> makeKey(size_t i) {
+    std::vector<uint8_t> key(kKeySize, 0);
+    memcpy(key.data(), &i, sizeof(i));
+    return key;
+}
+
+// BlobCache is not thread-safe, so egl_cache_t serializes it with a mutex.
+struct LockedBlobCache {
+    LockedBlobCache() : cache(kMaxKeySize, kMaxValueSize, kMaxTotalSize) {}
+
+    void set(const void* key, size_t keySize, const void* value, size_t valueSize) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cache.set(key, keySize, value, valueSize);
+    }
+    size_t get(const void* key, size_t keySize, void* value, size_t valueSize) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return cache.get(key, keySize, value, valueSize);
+    }
+
+    std::mutex mutex;
+    BlobCache cache;
+};
+
+struct ShardedCache : ShardedBlobCache {
+    ShardedCache() : ShardedBlobCache(kMaxKeySize, kMaxValueSize, kMaxTotalSize, "") {}
+};
+
+template <typename Cache>
+void fill(Cache& cache) {
+    std::vector<uint8_t> value(kValueSize, 0xee);
+    for (size_t i = 0; i < kEntryCount; i++) {
+        auto key = makeKey(i);
+        cache.set(key.data(), key.size(), value.data(), value.size());
+    }
+}
+
+template <typename Cache>
+void BM_Set(benchmark::State& state) {
+    Cache cache;
+    std::vector<uint8_t> value(kValueSize, 0xee);
+    size_t i = 0;
+    for (auto _ : state) {
+        // Cycles through more keys than fit, so steady state includes evictions.
+        auto key = makeKey(i++ % (kEntryCount * 4));
+        cache.set(key.data(), key.size(), value.data(), value.size());
+    }
+}
+BENCHMARK_TEMPLATE(BM_Set, LockedBlobCache);
+BENCHMARK_TEMPLATE(BM_Set, ShardedCache);
+
+template <typename Cache>
+void BM_GetHit(benchmark::State& state) {
+    static Cache* cache = nullptr;
+    if (state.thread_index == 0) {
+        cache = new Cache();
+        fill(*cache);
+    }
+    std::vector<uint8_t> value(kValueSize);
+    size_t i = state.thread_index;
+    for (auto _ : state) {
+        auto key = makeKey(i++ % kEntryCount);
+        benchmark::DoNotOptimize(cache->get(key.data(), key.size(), value.data(), value.size()));
+    }
+    if (state.thread_index == 0) {
+        delete cache;
+    }
+}
+BENCHMARK_TEMPLATE(BM_GetHit, LockedBlobCache)->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(BM_GetHit, ShardedCache)->ThreadRange(1, 8);
+
+template <typename Cache>
+void BM_GetMiss(benchmark::State& state) {
+    Cache cache;
+    fill(cache);
+    size_t i = kEntryCount;
+    for (auto _ : state) {
+        auto key = makeKey(i++);
+        benchmark::DoNotOptimize(cache.get(key.data(), key.size(), nullptr, 0));
+    }
+}
+BENCHMARK_TEMPLATE(BM_GetMiss, LockedBlobCache);
+BENCHMARK_TEMPLATE(BM_GetMiss, ShardedCache);
+
+// The cost of a save: FileBlobCache rewrites the whole cache, ShardedBlobCache
+// appends the entries that were added since the last save.
+void BM_SaveAfterOneSet_FileBlobCache(benchmark::State& state) {
+    TemporaryDir dir;
+    const std::string filename = std::string(dir.path) + "/cache";
+    FileBlobCache cache(kMaxKeySize, kMaxValueSize, kMaxTotalSize, filename);
+    fill(cache);
+    std::vector<uint8_t> value(kValueSize, 0xaa);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto key = makeKey(i++ % kEntryCount);
+        cache.set(key.data(), key.size(), value.data(), value.size());
+        cache.writeToFile();
+    }
+    unlink(filename.c_str());
+}
+BENCHMARK(BM_SaveAfterOneSet_FileBlobCache);
+
+void BM_SaveAfterOneSet_ShardedBlobCache(benchmark::State& state) {
+    TemporaryDir dir;
+    const std::string filename = std::string(dir.path) + "/cache";
+    ShardedBlobCache cache(kMaxKeySize, kMaxValueSize, kMaxTotalSize, filename);
+    fill(cache);
+    std::vector<uint8_t> value(kValueSize, 0xaa);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto key = makeKey(i++ % kEntryCount);
+        cache.set(key.data(), key.size(), value.data(), value.size());
+        cache.writeToFile();
+    }
+    unlink(filename.c_str());
+}
+BENCHMARK(BM_SaveAfterOneSet_ShardedBlobCache);
+
+// The cost of loading a full cache file at process start.
+template <typename Cache>
+void BM_Load(benchmark::State& state) {
+    TemporaryDir dir;
+    const std::string filename = std::string(dir.path) + "/cache";
+    {
+        Cache cache(kMaxKeySize, kMaxValueSize, kMaxTotalSize, filename);
+        fill(cache);
+        cache.writeToFile();
+    }
+    for (auto _ : state) {
+        Cache cache(kMaxKeySize, kMaxValueSize, kMaxTotalSize, filename);
+        benchmark::DoNotOptimize(&cache);
+    }
+    unlink(filename.c_str());
+}
+BENCHMARK_TEMPLATE(BM_Load, FileBlobCache);
+BENCHMARK_TEMPLATE(BM_Load, ShardedBlobCache);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
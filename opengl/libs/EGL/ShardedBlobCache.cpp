@@ -0,0 +1,439 @@
+/*
+ ** Copyright 2020, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+
+#include "ShardedBlobCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+// Backing file header
+static const uint32_t shardedCacheMagic = ('E' << 24) + ('G' << 16) + ('L' << 8) + '%';
+static const uint32_t shardedCacheVersion = 1;
+
+static const size_t maxShardCount = 16;
+
+namespace android {
+
+namespace {
+
+struct FileHeader {
+    uint32_t mMagicNumber;
+    uint32_t mVersion;
+    uint32_t mBuildIdLength;
+};
+
+struct RecordHeader {
+    uint32_t mKeySize;
+    uint32_t mValueSize;
+    uint64_t mChecksum;
+};
+
+inline size_t align4(size_t size) {
+    return (size + 3) & ~3;
+}
+
+// FNV-1a, processing a word at a time for speed, with an extra shift to mix
+// the high bits of each step back into the low ones.
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 32;
+    }
+    for (; size > 0; size--, bytes++) {
+        hash = (hash ^ *bytes) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t recordChecksum(const uint8_t* key, size_t keySize, const uint8_t* value,
+        size_t valueSize) {
+    return hashBytes(value, valueSize, hashBytes(key, keySize));
+}
+
+size_t getShardCount(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize) {
+    // Every shard must be able to hold an entry of the maximum size.
+    return std::clamp(maxTotalSize / std::max<size_t>(maxKeySize + maxValueSize, 1),
+            size_t(1), maxShardCount);
+}
+
+} // namespace
+
+ShardedBlobCache::Mapping::~Mapping() {
+    munmap(address, size);
+}
+
+ShardedBlobCache::ShardedBlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize,
+        const std::string& filename)
+        : mMaxKeySize(maxKeySize),
+          mMaxValueSize(maxValueSize),
+          mMaxTotalSize(maxTotalSize),
+          mFilename(filename),
+          mBuildId(base::GetProperty("ro.build.id", "")),
+          mShards(getShardCount(maxKeySize, maxValueSize, maxTotalSize)) {
+    mMaxShardSize = mMaxTotalSize / mShards.size();
+    if (!mFilename.empty()) {
+        loadFromFile();
+    }
+}
+
+ShardedBlobCache::~ShardedBlobCache() = default;
+
+uint64_t ShardedBlobCache::hashKey(const void* key, size_t keySize) {
+    return hashBytes(key, keySize);
+}
+
+void ShardedBlobCache::set(const void* key, size_t keySize, const void* value,
+        size_t valueSize) {
+    if (mMaxKeySize < keySize) {
+        ALOGV("set: not caching because the key is too large: %zu (limit: %zu)",
+                keySize, mMaxKeySize);
+        return;
+    }
+    if (mMaxValueSize < valueSize) {
+        ALOGV("set: not caching because the value is too large: %zu (limit: %zu)",
+                valueSize, mMaxValueSize);
+        return;
+    }
+    if (mMaxShardSize < keySize + valueSize) {
+        ALOGV("set: not caching because the combined key/value size is too "
+                "large: %zu (limit: %zu)", keySize + valueSize, mMaxShardSize);
+        return;
+    }
+    if (keySize == 0) {
+        ALOGW("set: not caching because keySize is 0");
+        return;
+    }
+    if (valueSize == 0) {
+        ALOGW("set: not caching because valueSize is 0");
+        return;
+    }
+
+    Entry entry;
+    entry.hash = hashKey(key, keySize);
+    entry.data.reset(new uint8_t[keySize + valueSize]);
+    memcpy(entry.data.get(), key, keySize);
+    memcpy(entry.data.get() + keySize, value, valueSize);
+    entry.key = entry.data.get();
+    entry.keySize = keySize;
+    entry.value = entry.data.get() + keySize;
+    entry.valueSize = valueSize;
+    entry.persisted = false;
+
+    Shard& shard = getShard(entry.hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = findLocked(shard, entry.hash, key, keySize);
+    if (it != shard.entries.end()) {
+        eraseLocked(shard, it);
+    }
+    insertLocked(shard, std::move(entry));
+}
+
+size_t ShardedBlobCache::get(const void* key, size_t keySize, void* value, size_t valueSize) {
+    if (mMaxKeySize < keySize) {
+        ALOGV("get: not searching because the key is too large: %zu (limit %zu)",
+                keySize, mMaxKeySize);
+        return 0;
+    }
+
+    const uint64_t hash = hashKey(key, keySize);
+    Shard& shard = getShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = findLocked(shard, hash, key, keySize);
+    if (it == shard.entries.end()) {
+        ALOGV("get: no cache entry found for key of size %zu", keySize);
+        return 0;
+    }
+
+    // Mark the entry as the most recently used one.
+    shard.entries.splice(shard.entries.begin(), shard.entries, it);
+
+    if (it->valueSize <= valueSize && value != nullptr) {
+        ALOGV("get: copying %zu bytes to caller's buffer", it->valueSize);
+        memcpy(value, it->value, it->valueSize);
+    } else {
+        ALOGV("get: caller's buffer is too small for value: %zu (needs %zu)",
+                valueSize, it->valueSize);
+    }
+    return it->valueSize;
+}
+
+size_t ShardedBlobCache::getTotalSize() const {
+    size_t totalSize = 0;
+    for (const Shard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        totalSize += shard.totalSize;
+    }
+    return totalSize;
+}
+
+std::list<ShardedBlobCache::Entry>::iterator ShardedBlobCache::findLocked(Shard& shard,
+        uint64_t hash, const void* key, size_t keySize) {
+    auto range = shard.index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& entry = *it->second;
+        if (entry.keySize == keySize && memcmp(entry.key, key, keySize) == 0) {
+            return it->second;
+        }
+    }
+    return shard.entries.end();
+}
+
+void ShardedBlobCache::insertLocked(Shard& shard, Entry entry) {
+    const size_t size = entry.getSize();
+    while (shard.totalSize + size > mMaxShardSize && !shard.entries.empty()) {
+        eraseLocked(shard, std::prev(shard.entries.end()));
+    }
+    const uint64_t hash = entry.hash;
+    shard.entries.push_front(std::move(entry));
+    shard.index.emplace(hash, shard.entries.begin());
+    shard.totalSize += size;
+}
+
+void ShardedBlobCache::eraseLocked(Shard& shard, std::list<Entry>::iterator it) {
+    auto range = shard.index.equal_range(it->hash);
+    for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+        if (indexIt->second == it) {
+            shard.index.erase(indexIt);
+            break;
+        }
+    }
+    shard.totalSize -= it->getSize();
+    shard.entries.erase(it);
+}
+
+std::vector<uint8_t> ShardedBlobCache::createFileHeader() const {
+    std::vector<uint8_t> buffer(align4(sizeof(FileHeader) + mBuildId.size()), 0);
+    FileHeader header{shardedCacheMagic, shardedCacheVersion,
+            static_cast<uint32_t>(mBuildId.size())};
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + sizeof(header), mBuildId.data(), mBuildId.size());
+    return buffer;
+}
+
+void ShardedBlobCache::appendRecord(const Entry& entry, std::vector<uint8_t>* buffer) {
+    RecordHeader header{static_cast<uint32_t>(entry.keySize),
+            static_cast<uint32_t>(entry.valueSize),
+            recordChecksum(entry.key, entry.keySize, entry.value, entry.valueSize)};
+    const size_t offset = buffer->size();
+    buffer->resize(offset + align4(sizeof(header) + entry.keySize + entry.valueSize), 0);
+    uint8_t* record = buffer->data() + offset;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), entry.key, entry.keySize);
+    memcpy(record + sizeof(header) + entry.keySize, entry.value, entry.valueSize);
+}
+
+void ShardedBlobCache::loadFromFile() {
+    base::unique_fd fd(open(mFilename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", mFilename.c_str(),
+                    strerror(errno), errno);
+        }
+        return;
+    }
+
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
+        return;
+    }
+
+    // Sanity check the size before trying to mmap it.  A file that is too
+    // large is rewritten by the next writeToFile.
+    const size_t fileSize = statBuf.st_size;
+    if (fileSize > mMaxTotalSize * 2) {
+        ALOGE("cache file is too large: %zu", fileSize);
+        return;
+    }
+    if (fileSize < sizeof(FileHeader)) {
+        return;
+    }
+
+    void* address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        ALOGE("error mmaping cache file: %s (%d)", strerror(errno), errno);
+        return;
+    }
+    auto mapping = std::make_shared<const Mapping>(address, fileSize);
+    const uint8_t* buffer = reinterpret_cast<const uint8_t*>(address);
+
+    FileHeader header;
+    memcpy(&header, buffer, sizeof(header));
+    if (header.mMagicNumber != shardedCacheMagic ||
+            header.mVersion != shardedCacheVersion ||
+            header.mBuildIdLength != mBuildId.size() ||
+            sizeof(header) + header.mBuildIdLength > fileSize ||
+            memcmp(buffer + sizeof(header), mBuildId.data(), mBuildId.size()) != 0) {
+        ALOGV("cache file was written by another version, ignoring it");
+        return;
+    }
+
+    // Records are appended, so later records for a key replace earlier ones,
+    // and the order of the file approximates the order of use.  A torn or
+    // corrupt record ends the valid part of the file.
+    size_t offset = align4(sizeof(header) + header.mBuildIdLength);
+    size_t entryCount = 0;
+    while (offset + sizeof(RecordHeader) <= fileSize) {
+        RecordHeader record;
+        memcpy(&record, buffer + offset, sizeof(record));
+        const size_t keySize = record.mKeySize;
+        const size_t valueSize = record.mValueSize;
+        const size_t recordSize = align4(sizeof(record) + keySize + valueSize);
+        if (keySize == 0 || keySize > mMaxKeySize || valueSize == 0 ||
+                valueSize > mMaxValueSize || recordSize > fileSize - offset) {
+            break;
+        }
+        const uint8_t* key = buffer + offset + sizeof(record);
+        const uint8_t* value = key + keySize;
+        if (recordChecksum(key, keySize, value, valueSize) != record.mChecksum) {
+            break;
+        }
+
+        Entry entry;
+        entry.hash = hashKey(key, keySize);
+        entry.key = key;
+        entry.keySize = keySize;
+        entry.value = value;
+        entry.valueSize = valueSize;
+        entry.mapping = mapping;
+        entry.persisted = true;
+
+        Shard& shard = getShard(entry.hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = findLocked(shard, entry.hash, key, keySize);
+        if (it != shard.entries.end()) {
+            eraseLocked(shard, it);
+        }
+        insertLocked(shard, std::move(entry));
+
+        offset += recordSize;
+        entryCount++;
+    }
+
+    std::lock_guard<std::mutex> lock(mFileMutex);
+    mFileSize = offset;
+    ALOGV("loaded %zu records (%zu bytes) from %s", entryCount, offset, mFilename.c_str());
+}
+
+bool ShardedBlobCache::rewriteFile() {
+    // Write the entries least recently used first, so loading the file
+    // restores their order.
+    std::vector<uint8_t> buffer = createFileHeader();
+    for (Shard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.rbegin(); it != shard.entries.rend(); ++it) {
+            appendRecord(*it, &buffer);
+            it->persisted = true;
+        }
+    }
+
+    // Write to a temporary file and rename it, so that the file is always
+    // complete.  Entries keep their mapping of the old file alive.
+    const std::string tmpFilename = mFilename + ".tmp";
+    base::unique_fd fd(open(tmpFilename.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC,
+            S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+        ALOGE("error creating cache file %s: %s (%d)", tmpFilename.c_str(),
+                strerror(errno), errno);
+        mFileSize = 0;
+        return false;
+    }
+    if (!base::WriteFully(fd, buffer.data(), buffer.size()) ||
+            rename(tmpFilename.c_str(), mFilename.c_str()) == -1) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno), errno);
+        unlink(tmpFilename.c_str());
+        mFileSize = 0;
+        return false;
+    }
+    mFileSize = buffer.size();
+    return true;
+}
+
+void ShardedBlobCache::writeToFile() {
+    if (mFilename.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> fileLock(mFileMutex);
+    if (mFileSize == 0) {
+        rewriteFile();
+        return;
+    }
+
+    std::vector<uint8_t> records;
+    for (Shard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.rbegin(); it != shard.entries.rend(); ++it) {
+            if (!it->persisted) {
+                appendRecord(*it, &records);
+                it->persisted = true;
+            }
+        }
+    }
+    if (records.empty()) {
+        return;
+    }
+
+    // Compact the file once the records of evicted and replaced entries make
+    // it larger than the loader accepts.
+    if (mFileSize + records.size() > mMaxTotalSize * 2) {
+        rewriteFile();
+        return;
+    }
+
+    // Other processes may have the file mapped, so it is never truncated: that
+    // would fault their accesses to the pages past the new end.  Records are
+    // only appended if the file still ends where it was last loaded or
+    // written.  Otherwise it ends with a torn record or with the records of
+    // another process, and is replaced instead.  The lock keeps the check and
+    // the append together against other processes doing the same.
+    base::unique_fd fd(open(mFilename.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+    struct stat statBuf;
+    if (fd == -1 || flock(fd, LOCK_EX) == -1 || fstat(fd, &statBuf) == -1 ||
+            static_cast<size_t>(statBuf.st_size) != mFileSize) {
+        ALOGV("cache file %s changed since it was last written, rewriting it",
+                mFilename.c_str());
+        rewriteFile();
+        return;
+    }
+    if (!base::WriteFully(fd, records.data(), records.size())) {
+        ALOGE("error appending to cache file %s: %s (%d)", mFilename.c_str(),
+                strerror(errno), errno);
+        // Rewrite everything next time.
+        mFileSize = 0;
+        return;
+    }
+    mFileSize += records.size();
+}
+
+} // namespace android
@@ -0,0 +1,139 @@
+/*
+ ** Copyright 2020, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#ifndef ANDROID_SHARDED_BLOB_CACHE_H
+#define ANDROID_SHARDED_BLOB_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+// A ShardedBlobCache is a thread-safe cache for binary key/value pairs, with
+// the same get/set contract as BlobCache.
+//
+// Entries are spread over independently locked shards by a hash of their key,
+// and each shard evicts its least recently used entries when it runs out of
+// room, so concurrent lookups of different keys don't contend and eviction
+// never throws away recently used entries.
+//
+// The cache can be backed by an append-only file.  On creation the file is
+// mmap'd and its entries are used in place, without copying them.
+// writeToFile only appends the entries that were inserted since the previous
+// call, and compacts the file when the stale records in it grow too large.
+// The file is never shrunk in place, since other processes may have it mapped;
+// it is replaced by renaming a new file over it instead.
+class ShardedBlobCache {
+public:
+    // Create a blob cache with the same limits as BlobCache.  If filename is
+    // not empty, the cache is initialized with the contents of that file.
+    ShardedBlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize,
+            const std::string& filename);
+    ~ShardedBlobCache();
+
+    ShardedBlobCache(const ShardedBlobCache&) = delete;
+    ShardedBlobCache& operator=(const ShardedBlobCache&) = delete;
+
+    // See BlobCache::set.
+    void set(const void* key, size_t keySize, const void* value, size_t valueSize);
+
+    // See BlobCache::get.
+    size_t get(const void* key, size_t keySize, void* value, size_t valueSize);
+
+    // writeToFile appends the entries inserted since the last call to the
+    // backing file, if there is one.
+    void writeToFile();
+
+    // getTotalSize returns the combined size of all the keys and values in the
+    // cache.
+    size_t getTotalSize() const;
+
+private:
+    // A read-only mapping of the backing file.  Entries loaded from the file
+    // point into it, and keep it alive.
+    struct Mapping {
+        Mapping(void* address, size_t size) : address(address), size(size) {}
+        ~Mapping();
+
+        void* const address;
+        const size_t size;
+    };
+
+    struct Entry {
+        uint64_t hash;
+        const uint8_t* key;
+        size_t keySize;
+        const uint8_t* value;
+        size_t valueSize;
+        // Owns the key and value, unless they point into mapping.
+        std::unique_ptr<uint8_t[]> data;
+        std::shared_ptr<const Mapping> mapping;
+        // Whether the entry is in the backing file already.
+        bool persisted;
+
+        size_t getSize() const { return keySize + valueSize; }
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // Most recently used first.
+        std::list<Entry> entries;
+        std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+        size_t totalSize = 0;
+    };
+
+    static uint64_t hashKey(const void* key, size_t keySize);
+
+    Shard& getShard(uint64_t hash) { return mShards[(hash >> 32) % mShards.size()]; }
+
+    std::list<Entry>::iterator findLocked(Shard& shard, uint64_t hash, const void* key,
+            size_t keySize);
+    void insertLocked(Shard& shard, Entry entry);
+    void eraseLocked(Shard& shard, std::list<Entry>::iterator it);
+
+    void loadFromFile();
+    // Serializes entry into buffer, as a file record.
+    static void appendRecord(const Entry& entry, std::vector<uint8_t>* buffer);
+    std::vector<uint8_t> createFileHeader() const;
+    bool rewriteFile();
+
+    const size_t mMaxKeySize;
+    const size_t mMaxValueSize;
+    const size_t mMaxTotalSize;
+    // The size budget of each shard.  It is at least one maximum size entry.
+    size_t mMaxShardSize;
+    const std::string mFilename;
+    const std::string mBuildId;
+
+    std::vector<Shard> mShards;
+
+    // Serializes the writes to the backing file.
+    std::mutex mFileMutex;
+    // The size of the valid part of the backing file, or 0 if it must be
+    // rewritten from scratch.
+    size_t mFileSize = 0;
+};
+
+} // namespace android
+
+#endif // ANDROID_SHARDED_BLOB_CACHE_H
@@ -0,0 +1,331 @@
+/*
+ ** Copyright 2020, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+
+#include "ShardedBlobCache.h"
+
+namespace android {
+
+class ShardedBlobCacheTest : public ::testing::Test {
+protected:
+    enum {
+        MAX_KEY_SIZE = 6,
+        MAX_VALUE_SIZE = 8,
+        MAX_TOTAL_SIZE = 13,
+    };
+
+    virtual void SetUp() {
+        mBC.reset(new ShardedBlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE, ""));
+    }
+
+    virtual void TearDown() {
+        mBC.reset();
+    }
+
+    std::unique_ptr<ShardedBlobCache> mBC;
+};
+
+TEST_F(ShardedBlobCacheTest, CacheSingleValueSucceeds) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('f', buf[1]);
+    ASSERT_EQ('g', buf[2]);
+    ASSERT_EQ('h', buf[3]);
+}
+
+TEST_F(ShardedBlobCacheTest, GetOnlyWritesIfBufferIsLargeEnough) {
+    unsigned char buf[3] = { 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 3));
+    ASSERT_EQ(0xee, buf[0]);
+    ASSERT_EQ(0xee, buf[1]);
+    ASSERT_EQ(0xee, buf[2]);
+}
+
+TEST_F(ShardedBlobCacheTest, GetDoesntAccessNullBuffer) {
+    mBC->set("abcd", 4, "efgh", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, nullptr, 0));
+}
+
+TEST_F(ShardedBlobCacheTest, MultipleSetsCacheLatestValue) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    mBC->set("abcd", 4, "ijkl", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 4));
+    ASSERT_EQ('i', buf[0]);
+    ASSERT_EQ('l', buf[3]);
+    ASSERT_EQ(size_t(8), mBC->getTotalSize());
+}
+
+TEST_F(ShardedBlobCacheTest, SecondSetKeepsFirstValueIfTooLarge) {
+    unsigned char buf[MAX_VALUE_SIZE+1] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    mBC->set("abcd", 4, buf, MAX_VALUE_SIZE+1);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+}
+
+TEST_F(ShardedBlobCacheTest, DoesntCacheIfKeyOrValueIsTooBig) {
+    char key[MAX_KEY_SIZE+1] = {};
+    char value[MAX_VALUE_SIZE+1] = {};
+    mBC->set(key, MAX_KEY_SIZE+1, "x", 1);
+    mBC->set("x", 1, value, MAX_VALUE_SIZE+1);
+    ASSERT_EQ(size_t(0), mBC->get(key, MAX_KEY_SIZE+1, nullptr, 0));
+    ASSERT_EQ(size_t(0), mBC->get("x", 1, nullptr, 0));
+    ASSERT_EQ(size_t(0), mBC->getTotalSize());
+}
+
+TEST_F(ShardedBlobCacheTest, CacheSizeDoesntExceedTotalLimit) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+        ASSERT_GE(size_t(MAX_TOTAL_SIZE), mBC->getTotalSize());
+    }
+}
+
+TEST_F(ShardedBlobCacheTest, EvictsLeastRecentlyUsedEntries) {
+    // Fill up the entire cache with 1 char key/value pairs.
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // Use the first entry, so that the second one is the least recently used.
+    uint8_t first = 0;
+    ASSERT_EQ(size_t(1), mBC->get(&first, 1, nullptr, 0));
+
+    uint8_t k = maxEntries;
+    mBC->set(&k, 1, "x", 1);
+
+    uint8_t second = 1;
+    ASSERT_EQ(size_t(0), mBC->get(&second, 1, nullptr, 0));
+    ASSERT_EQ(size_t(1), mBC->get(&first, 1, nullptr, 0));
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, nullptr, 0));
+}
+
+TEST_F(ShardedBlobCacheTest, ConcurrentAccessKeepsValuesIntact) {
+    ShardedBlobCache cache(16, 64, 64 * 1024, "");
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; t++) {
+        threads.emplace_back([&cache, t] {
+            for (uint32_t i = 0; i < 1000; i++) {
+                const uint32_t key[2] = {t, i % 64};
+                uint32_t value[8];
+                std::fill(std::begin(value), std::end(value), key[0] * 1000 + key[1]);
+                cache.set(key, sizeof(key), value, sizeof(value));
+
+                uint32_t result[8] = {};
+                if (cache.get(key, sizeof(key), result, sizeof(result)) == sizeof(result)) {
+                    EXPECT_EQ(value[0], result[7]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+class ShardedBlobCacheFileTest : public ::testing::Test {
+protected:
+    enum {
+        MAX_KEY_SIZE = 16,
+        MAX_VALUE_SIZE = 64,
+        MAX_TOTAL_SIZE = 1024,
+    };
+
+    std::unique_ptr<ShardedBlobCache> createCache() {
+        return std::make_unique<ShardedBlobCache>(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE,
+                mFilename);
+    }
+
+    off_t getFileSize() {
+        struct stat statBuf;
+        return stat(mFilename.c_str(), &statBuf) == 0 ? statBuf.st_size : -1;
+    }
+
+    TemporaryDir mDir;
+    const std::string mFilename = std::string(mDir.path) + "/cache";
+
+    virtual void TearDown() {
+        unlink(mFilename.c_str());
+    }
+};
+
+TEST_F(ShardedBlobCacheFileTest, ReloadsWrittenEntries) {
+    {
+        auto cache = createCache();
+        cache->set("abcd", 4, "efgh", 4);
+        cache->set("ijkl", 4, "mnopqr", 6);
+        cache->writeToFile();
+    }
+
+    auto cache = createCache();
+    char buf[6] = {};
+    ASSERT_EQ(size_t(4), cache->get("abcd", 4, buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(buf, "efgh", 4));
+    ASSERT_EQ(size_t(6), cache->get("ijkl", 4, buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(buf, "mnopqr", 6));
+}
+
+TEST_F(ShardedBlobCacheFileTest, WriteOnlyAppendsNewEntries) {
+    auto cache = createCache();
+    cache->set("abcd", 4, "efgh", 4);
+    cache->writeToFile();
+    const off_t initialSize = getFileSize();
+    ASSERT_GT(initialSize, 0);
+
+    // Nothing new to write.
+    cache->writeToFile();
+    ASSERT_EQ(initialSize, getFileSize());
+
+    cache->set("ijkl", 4, "mnop", 4);
+    cache->writeToFile();
+    const off_t appendedSize = getFileSize();
+    ASSERT_GT(appendedSize, initialSize);
+
+    // The later record for a key wins.
+    cache->set("abcd", 4, "wxyz", 4);
+    cache->writeToFile();
+    cache = createCache();
+    char buf[4] = {};
+    ASSERT_EQ(size_t(4), cache->get("abcd", 4, buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(buf, "wxyz", 4));
+    ASSERT_EQ(size_t(4), cache->get("ijkl", 4, buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(buf, "mnop", 4));
+}
+
+TEST_F(ShardedBlobCacheFileTest, CompactsFileWhenItGrowsTooLarge) {
+    auto cache = createCache();
+    char value[MAX_VALUE_SIZE] = {};
+    for (int i = 0; i < 200; i++) {
+        value[0] = i;
+        cache->set("abcd", 4, value, sizeof(value));
+        cache->writeToFile();
+        ASSERT_GE(off_t(MAX_TOTAL_SIZE * 2), getFileSize());
+    }
+
+    cache = createCache();
+    char buf[MAX_VALUE_SIZE] = {};
+    ASSERT_EQ(size_t(MAX_VALUE_SIZE), cache->get("abcd", 4, buf, sizeof(buf)));
+    ASSERT_EQ(char(199), buf[0]);
+}
+
+TEST_F(ShardedBlobCacheFileTest, IgnoresTornRecordAtEndOfFile) {
+    {
+        auto cache = createCache();
+        cache->set("abcd", 4, "efgh", 4);
+        cache->writeToFile();
+        cache->set("ijkl", 4, "mnop", 4);
+        cache->writeToFile();
+    }
+    // Cut the last record short, as an interrupted write would.
+    ASSERT_EQ(0, truncate(mFilename.c_str(), getFileSize() - 2));
+
+    auto cache = createCache();
+    ASSERT_EQ(size_t(4), cache->get("abcd", 4, nullptr, 0));
+    ASSERT_EQ(size_t(0), cache->get("ijkl", 4, nullptr, 0));
+
+    // The next write replaces the torn record.
+    cache->set("qrst", 4, "uvwx", 4);
+    cache->writeToFile();
+    cache = createCache();
+    ASSERT_EQ(size_t(4), cache->get("abcd", 4, nullptr, 0));
+    ASSERT_EQ(size_t(4), cache->get("qrst", 4, nullptr, 0));
+}
+
+TEST_F(ShardedBlobCacheFileTest, ReplacesFileWithTornRecordInsteadOfTruncatingIt) {
+    {
+        auto cache = createCache();
+        cache->set("abcd", 4, "efgh", 4);
+        cache->writeToFile();
+    }
+    ASSERT_EQ(0, truncate(mFilename.c_str(), getFileSize() - 2));
+    const off_t tornSize = getFileSize();
+
+    // Stands in for another process that has the file mapped.
+    base::unique_fd otherFd(open(mFilename.c_str(), O_RDONLY | O_CLOEXEC));
+    ASSERT_NE(-1, otherFd.get());
+
+    auto cache = createCache();
+    cache->set("ijkl", 4, "mnop", 4);
+    cache->writeToFile();
+
+    struct stat statBuf;
+    ASSERT_EQ(0, fstat(otherFd, &statBuf));
+    ASSERT_EQ(tornSize, statBuf.st_size);
+
+    cache = createCache();
+    ASSERT_EQ(size_t(4), cache->get("ijkl", 4, nullptr, 0));
+}
+
+TEST_F(ShardedBlobCacheFileTest, RewritesFileAppendedToByAnotherCache) {
+    {
+        auto cache = createCache();
+        cache->set("abcd", 4, "efgh", 4);
+        cache->writeToFile();
+    }
+    auto cache = createCache();
+    auto otherCache = createCache();
+
+    otherCache->set("ijkl", 4, "mnop", 4);
+    otherCache->writeToFile();
+    const off_t otherSize = getFileSize();
+    base::unique_fd otherFd(open(mFilename.c_str(), O_RDONLY | O_CLOEXEC));
+    ASSERT_NE(-1, otherFd.get());
+
+    // The file no longer ends where this cache left it, so appending to it
+    // would be unsafe.
+    cache->set("qrst", 4, "uvwx", 4);
+    cache->writeToFile();
+
+    struct stat statBuf;
+    ASSERT_EQ(0, fstat(otherFd, &statBuf));
+    ASSERT_EQ(otherSize, statBuf.st_size);
+
+    cache = createCache();
+    ASSERT_EQ(size_t(4), cache->get("abcd", 4, nullptr, 0));
+    ASSERT_EQ(size_t(4), cache->get("qrst", 4, nullptr, 0));
+}
+
+TEST_F(ShardedBlobCacheFileTest, IgnoresFileWithBadMagic) {
+    ASSERT_TRUE(base::WriteStringToFile("not a cache file", mFilename));
+    auto cache = createCache();
+    ASSERT_EQ(size_t(0), cache->getTotalSize());
+
+    // The next write replaces the file.
+    cache->set("abcd", 4, "efgh", 4);
+    cache->writeToFile();
+    cache = createCache();
+    ASSERT_EQ(size_t(4), cache->get("abcd", 4, nullptr, 0));
+}
+
+} // namespace android
@@ -26,6 +26,7 @@
 
 #include <thread>
 
+#include <android-base/properties.h>
 #include <log/log.h>
 
 // Cache size limits.
@@ -64,7 +65,9 @@ static EGLsizeiANDROID getBlob(const void* key, EGLsizeiANDROID keySize,
 // egl_cache_t definition
 //
 egl_cache_t::egl_cache_t() :
-        mInitialized(false) {
+        mInitialized(false),
+        mUseShardedBlobCache(false),
+        mSavePending(false) {
 }
 
 egl_cache_t::~egl_cache_t() {
@@ -111,6 +114,7 @@ void egl_cache_t::initialize(egl_display_t *display) {
         }
     }
 
+    mUseShardedBlobCache = base::GetBoolProperty("debug.egl.blobcache.sharded", false);
     mInitialized = true;
 }
 
@@ -120,50 +124,83 @@ void egl_cache_t::terminate() {
         mBlobCache->writeToFile();
     }
     mBlobCache = nullptr;
+    if (mShardedBlobCache) {
+        mShardedBlobCache->writeToFile();
+    }
+    mShardedBlobCache = nullptr;
 }
 
 void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
         const void* value, EGLsizeiANDROID valueSize) {
-    std::lock_guard<std::mutex> lock(mMutex);
-
     if (keySize < 0 || valueSize < 0) {
         ALOGW("EGL_ANDROID_blob_cache set: negative sizes are not allowed");
         return;
     }
 
-    if (mInitialized) {
-        BlobCache* bc = getBlobCacheLocked();
-        bc->set(key, keySize, value, valueSize);
+    std::shared_ptr<ShardedBlobCache> shardedBlobCache;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mInitialized) {
+            return;
+        }
+        if (!mUseShardedBlobCache) {
+            BlobCache* bc = getBlobCacheLocked();
+            bc->set(key, keySize, value, valueSize);
+            scheduleDeferredSaveLocked();
+            return;
+        }
+        shardedBlobCache = getShardedBlobCacheLocked();
+        scheduleDeferredSaveLocked();
+    }
+    shardedBlobCache->set(key, keySize, value, valueSize);
+}
 
-        if (!mSavePending) {
-            mSavePending = true;
-            std::thread deferredSaveThread([this]() {
-                sleep(deferredSaveDelay);
+void egl_cache_t::scheduleDeferredSaveLocked() {
+    if (!mSavePending) {
+        mSavePending = true;
+        std::thread deferredSaveThread([this]() {
+            sleep(deferredSaveDelay);
+            std::shared_ptr<ShardedBlobCache> shardedBlobCache;
+            {
                 std::lock_guard<std::mutex> lock(mMutex);
                 if (mInitialized && mBlobCache) {
                     mBlobCache->writeToFile();
                 }
+                if (mInitialized) {
+                    shardedBlobCache = mShardedBlobCache;
+                }
                 mSavePending = false;
-            });
-            deferredSaveThread.detach();
-        }
+            }
+            // Appending to the file only holds the locks of the shards briefly
+            // while collecting the new entries.
+            if (shardedBlobCache) {
+                shardedBlobCache->writeToFile();
+            }
+        });
+        deferredSaveThread.detach();
     }
 }
 
 EGLsizeiANDROID egl_cache_t::getBlob(const void* key, EGLsizeiANDROID keySize,
         void* value, EGLsizeiANDROID valueSize) {
-    std::lock_guard<std::mutex> lock(mMutex);
-
     if (keySize < 0 || valueSize < 0) {
         ALOGW("EGL_ANDROID_blob_cache set: negative sizes are not allowed");
         return 0;
     }
 
-    if (mInitialized) {
-        BlobCache* bc = getBlobCacheLocked();
-        return bc->get(key, keySize, value, valueSize);
+    std::shared_ptr<ShardedBlobCache> shardedBlobCache;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mInitialized) {
+            return 0;
+        }
+        if (!mUseShardedBlobCache) {
+            BlobCache* bc = getBlobCacheLocked();
+            return bc->get(key, keySize, value, valueSize);
+        }
+        shardedBlobCache = getShardedBlobCacheLocked();
     }
-    return 0;
+    return shardedBlobCache->get(key, keySize, value, valueSize);
 }
 
 void egl_cache_t::setCacheFilename(const char* filename) {
@@ -178,6 +215,17 @@ BlobCache* egl_cache_t::getBlobCacheLocked() {
     return mBlobCache.get();
 }
 
+std::shared_ptr<ShardedBlobCache> egl_cache_t::getShardedBlobCacheLocked() {
+    if (mShardedBlobCache == nullptr) {
+        // The backing file has a different format, so it must not be shared
+        // with FileBlobCache.
+        const std::string filename = mFilename.empty() ? mFilename : mFilename + ".sharded";
+        mShardedBlobCache = std::make_shared<ShardedBlobCache>(maxKeySize, maxValueSize,
+                maxTotalSize, filename);
+    }
+    return mShardedBlobCache;
+}
+
 // ----------------------------------------------------------------------------
 }; // namespace android
 // ----------------------------------------------------------------------------
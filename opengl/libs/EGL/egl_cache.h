@@ -21,6 +21,7 @@
 #include <EGL/eglext.h>
 
 #include "FileBlobCache.h"
+#include "ShardedBlobCache.h"
 
 #include <memory>
 #include <mutex>
@@ -82,6 +83,15 @@ private:
     // possible.
     BlobCache* getBlobCacheLocked();
 
+    // getShardedBlobCacheLocked is the equivalent of getBlobCacheLocked for
+    // the ShardedBlobCache backend, which is used instead of BlobCache when
+    // mUseShardedBlobCache is set.
+    std::shared_ptr<ShardedBlobCache> getShardedBlobCacheLocked();
+
+    // scheduleDeferredSaveLocked starts a deferred save of the cache contents
+    // if one is not already pending.
+    void scheduleDeferredSaveLocked();
+
     // mInitialized indicates whether the egl_cache_t is in the initialized
     // state.  It is initialized to false at construction time, and gets set to
     // true when initialize is called.  It is set back to false when terminate
@@ -95,6 +105,16 @@ private:
     // first time it's needed.
     std::unique_ptr<FileBlobCache> mBlobCache;
 
+    // mUseShardedBlobCache selects the ShardedBlobCache backend.  It is read
+    // from the debug.egl.blobcache.sharded property when the cache is
+    // initialized.
+    bool mUseShardedBlobCache;
+
+    // mShardedBlobCache is the cache used when mUseShardedBlobCache is set.
+    // It is internally synchronized, so mMutex is only held to access the
+    // pointer and not for the cache operations themselves.
+    std::shared_ptr<ShardedBlobCache> mShardedBlobCache;
+
     // mFilename is the name of the file for storing cache contents in between
     // program invocations.  It is initialized to an empty string at
     // construction time, and can be set with the setCacheFilename method.  An
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "EventHub.h"
+
+namespace android {
+
+// Number of pointers down in each injected motion event.
+static constexpr size_t POINTER_COUNT = 2;
+// Historical samples in each injected motion event, in addition to the current one.
+static constexpr size_t HISTORY_SIZE = 3;
+
+static constexpr int RAW_EVENT_BUFFER_SIZE = 256;
+
+static nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+static MotionEvent generateMoveEvent() {
+    PointerProperties pointerProperties[POINTER_COUNT];
+    PointerCoords pointerCoords[POINTER_COUNT];
+    for (size_t i = 0; i < POINTER_COUNT; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerProperties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+        pointerCoords[i].clear();
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 100 + 50 * i);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 100 + 50 * i);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 0.5f);
+    }
+
+    const nsecs_t currentTime = now();
+    MotionEvent event;
+    event.initialize(InputEvent::nextId(), 1 /*deviceId*/, AINPUT_SOURCE_TOUCHSCREEN,
+                     ADISPLAY_ID_DEFAULT, INVALID_HMAC, AMOTION_EVENT_ACTION_MOVE,
+                     /* actionButton */ 0, /* flags */ 0,
+                     /* edgeFlags */ 0, AMETA_NONE, /* buttonState */ 0, MotionClassification::NONE,
+                     1 /* xScale */, 1 /* yScale */,
+                     /* xOffset */ 0, /* yOffset */ 0, /* xPrecision */ 0,
+                     /* yPrecision */ 0, AMOTION_EVENT_INVALID_CURSOR_POSITION,
+                     AMOTION_EVENT_INVALID_CURSOR_POSITION, currentTime, currentTime,
+                     POINTER_COUNT, pointerProperties, pointerCoords);
+    for (size_t h = 0; h < HISTORY_SIZE; h++) {
+        event.addSample(currentTime + h + 1, pointerCoords);
+    }
+    return event;
+}
+
+/**
+ * Drain the device scan, and return true if the wayland touch device that injected events are
+ * written to is present.
+ */
+static bool waitForTouchDevice(EventHub& eventHub) {
+    RawEvent buffer[RAW_EVENT_BUFFER_SIZE];
+    bool found = false;
+    for (;;) {
+        const size_t count = eventHub.getEvents(1000 /*timeoutMillis*/, buffer,
+                                                RAW_EVENT_BUFFER_SIZE);
+        if (count == 0) {
+            return found;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (buffer[i].type == EventHubInterface::DEVICE_ADDED &&
+                eventHub.getDeviceIdentifier(buffer[i].deviceId).name == "wayland_touch") {
+                found = true;
+            }
+            if (buffer[i].type == EventHubInterface::FINISHED_DEVICE_SCAN) {
+                return found;
+            }
+        }
+    }
+}
+
+/**
+ * Inject batches of multi-pointer motion events, and read them back through getEvents().
+ * Reports the injected motion events per second, and the time from injection until the last
+ * event of the batch has been read.
+ */
+static void benchmarkInjectMotionEvents(benchmark::State& state) {
+    EventHub eventHub;
+    if (!waitForTouchDevice(eventHub)) {
+        state.SkipWithError("wayland touch device is not available");
+        return;
+    }
+
+    const size_t batchSize = state.range(0);
+    std::vector<MotionEvent> motions(batchSize, generateMoveEvent());
+    std::vector<const MotionEvent*> batch;
+    for (const MotionEvent& motion : motions) {
+        batch.push_back(&motion);
+    }
+
+    std::vector<input_event> encoded;
+    std::vector<size_t> frameEnds;
+    for (const MotionEvent* motion : batch) {
+        EventHub::appendMotionEventFrames(*motion, &encoded, &frameEnds);
+    }
+    const size_t expectedRawEvents = encoded.size();
+
+    RawEvent buffer[RAW_EVENT_BUFFER_SIZE];
+    nsecs_t totalLatency = 0;
+    for (auto _ : state) {
+        const nsecs_t injectTime = now();
+        eventHub.injectMotionEvents(batch);
+
+        size_t received = 0;
+        while (received < expectedRawEvents) {
+            const size_t count = eventHub.getEvents(100 /*timeoutMillis*/, buffer,
+                                                    RAW_EVENT_BUFFER_SIZE);
+            if (count == 0) {
+                state.SkipWithError("Timed out waiting for injected events");
+                return;
+            }
+            received += count;
+        }
+        totalLatency += now() - injectTime;
+    }
+
+    state.SetItemsProcessed(state.iterations() * batchSize);
+    state.counters["latency_us"] =
+            benchmark::Counter(ns2us(totalLatency) / double(state.iterations()));
+}
+
+BENCHMARK(benchmarkInjectMotionEvents)->RangeMultiplier(4)->Range(1, 64);
+
+} // namespace android
+
+BENCHMARK_MAIN();
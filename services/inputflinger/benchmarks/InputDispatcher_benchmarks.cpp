@@ -161,7 +161,7 @@ public:
     virtual bool updateInfo() override {
         mInfo.token = mServerChannel->getConnectionToken();
         mInfo.name = "FakeWindowHandle";
-        mInfo.layoutParamsFlags = 0;
+        mInfo.layoutParamsFlags = mLayoutParamsFlags;
         mInfo.layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
         mInfo.dispatchingTimeout = DISPATCHING_TIMEOUT.count();
         mInfo.frameLeft = mFrame.left;
@@ -184,8 +184,13 @@ public:
         return true;
     }
 
+    void setFrame(const Rect& frame) { mFrame = frame; }
+
+    void setLayoutParamsFlags(int32_t flags) { mLayoutParamsFlags = flags; }
+
 protected:
     Rect mFrame;
+    int32_t mLayoutParamsFlags = 0;
 };
 
 static MotionEvent generateMotionEvent() {
@@ -310,8 +315,64 @@ static void benchmarkInjectMotion(benchmark::State& state) {
     dispatcher->stop();
 }
 
+/**
+ * Measure touch dispatch when the display has many windows. The touched window is at the bottom of
+ * the stack, and the windows above it are tiled across the rest of the display.
+ */
+static void benchmarkNotifyMotionManyWindows(benchmark::State& state) {
+    // Create dispatcher
+    sp<FakeInputDispatcherPolicy> fakePolicy = new FakeInputDispatcherPolicy();
+    sp<InputDispatcher> dispatcher = new InputDispatcher(fakePolicy);
+    dispatcher->setInputDispatchMode(/*enabled*/ true, /*frozen*/ false);
+    dispatcher->start();
+
+    sp<FakeApplicationHandle> application = new FakeApplicationHandle();
+    std::vector<sp<InputWindowHandle>> windows;
+    const int32_t windowCount = state.range(0);
+    for (int32_t i = 0; i < windowCount - 1; i++) {
+        sp<FakeWindowHandle> window =
+                new FakeWindowHandle(application, dispatcher, "Fake Window " + std::to_string(i));
+        const int32_t left = FakeWindowHandle::WIDTH + (i % 16) * FakeWindowHandle::WIDTH;
+        const int32_t top = (i / 16) * FakeWindowHandle::HEIGHT;
+        window->setFrame(Rect(left, top, left + FakeWindowHandle::WIDTH,
+                              top + FakeWindowHandle::HEIGHT));
+        window->setLayoutParamsFlags(InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+        windows.push_back(window);
+    }
+    // The window that receives the motion events
+    sp<FakeWindowHandle> window = new FakeWindowHandle(application, dispatcher, "Touched Window");
+    window->setLayoutParamsFlags(InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+    windows.push_back(window);
+
+    dispatcher->setInputWindows({{ADISPLAY_ID_DEFAULT, windows}});
+
+    NotifyMotionArgs motionArgs = generateMotionArgs();
+
+    for (auto _ : state) {
+        // Send ACTION_DOWN
+        motionArgs.action = AMOTION_EVENT_ACTION_DOWN;
+        motionArgs.id = 0;
+        motionArgs.downTime = now();
+        motionArgs.eventTime = motionArgs.downTime;
+        dispatcher->notifyMotion(&motionArgs);
+
+        // Send ACTION_UP
+        motionArgs.action = AMOTION_EVENT_ACTION_UP;
+        motionArgs.id = 1;
+        motionArgs.eventTime = now();
+        dispatcher->notifyMotion(&motionArgs);
+
+        window->consumeEvent();
+        window->consumeEvent();
+    }
+    state.SetComplexityN(windowCount);
+
+    dispatcher->stop();
+}
+
 BENCHMARK(benchmarkNotifyMotion);
 BENCHMARK(benchmarkInjectMotion);
+BENCHMARK(benchmarkNotifyMotionManyWindows)->RangeMultiplier(4)->Range(1, 1024)->Complexity();
 
 } // namespace android::inputdispatcher
 
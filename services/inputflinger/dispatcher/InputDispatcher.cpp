@@ -807,43 +807,43 @@ sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t display
         LOG_ALWAYS_FATAL(
                 "Must provide a valid touch state if adding portal windows or outside targets");
     }
-    // Traverse windows from front to back to find touched window.
-    const std::vector<sp<InputWindowHandle>> windowHandles = getWindowHandlesLocked(displayId);
-    for (const sp<InputWindowHandle>& windowHandle : windowHandles) {
-        const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        if (windowInfo->displayId == displayId) {
-            int32_t flags = windowInfo->layoutParamsFlags;
-
-            if (windowInfo->visible) {
-                if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    bool isTouchModal = (flags &
-                                         (InputWindowInfo::FLAG_NOT_FOCUSABLE |
-                                          InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        int32_t portalToDisplayId = windowInfo->portalToDisplayId;
-                        if (portalToDisplayId != ADISPLAY_ID_NONE &&
-                            portalToDisplayId != displayId) {
-                            if (addPortalWindows) {
-                                // For the monitoring channels of the display.
-                                touchState->addPortalWindow(windowHandle);
-                            }
-                            return findTouchedWindowAtLocked(portalToDisplayId, x, y, touchState,
-                                                             addOutsideTargets, addPortalWindows);
-                        }
-                        // Found window.
-                        return windowHandle;
-                    }
-                }
+    auto it = mTouchableWindowIndexByDisplay.find(displayId);
+    if (it == mTouchableWindowIndexByDisplay.end()) {
+        return nullptr;
+    }
+    const TouchableWindowIndex& index = it->second;
 
-                if (addOutsideTargets && (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)) {
-                    touchState->addOrUpdateWindow(windowHandle,
-                                                  InputTarget::FLAG_DISPATCH_AS_OUTSIDE,
-                                                  BitSet32(0));
-                }
+    // Find the front-most window that accepts the touch. The index keeps the windows in the same
+    // front to back order as mWindowHandlesByDisplay.
+    const size_t touchedWindow = index.findTopmostTouchableWindow(x, y);
+
+    if (addOutsideTargets) {
+        // Every window above the touched one was passed over, so it is touched outside.
+        for (size_t zOrder : index.getWatchOutsideWindows()) {
+            if (zOrder >= touchedWindow) {
+                break;
             }
+            touchState->addOrUpdateWindow(index.getWindowHandle(zOrder),
+                                          InputTarget::FLAG_DISPATCH_AS_OUTSIDE, BitSet32(0));
         }
     }
-    return nullptr;
+
+    if (touchedWindow == TouchableWindowIndex::NO_WINDOW) {
+        return nullptr;
+    }
+
+    const sp<InputWindowHandle>& windowHandle = index.getWindowHandle(touchedWindow);
+    int32_t portalToDisplayId = windowHandle->getInfo()->portalToDisplayId;
+    if (portalToDisplayId != ADISPLAY_ID_NONE && portalToDisplayId != displayId) {
+        if (addPortalWindows) {
+            // For the monitoring channels of the display.
+            touchState->addPortalWindow(windowHandle);
+        }
+        return findTouchedWindowAtLocked(portalToDisplayId, x, y, touchState, addOutsideTargets,
+                                         addPortalWindows);
+    }
+    // Found window.
+    return windowHandle;
 }
 
 std::vector<TouchedMonitor> InputDispatcher::findTouchedGestureMonitorsLocked(
@@ -3586,9 +3586,11 @@ void InputDispatcher::decrementPendingForegroundDispatches(EventEntry* entry) {
     }
 }
 
-std::vector<sp<InputWindowHandle>> InputDispatcher::getWindowHandlesLocked(
+const std::vector<sp<InputWindowHandle>>& InputDispatcher::getWindowHandlesLocked(
         int32_t displayId) const {
-    return getValueByKey(mWindowHandlesByDisplay, displayId);
+    static const std::vector<sp<InputWindowHandle>> EMPTY_WINDOW_HANDLES;
+    auto it = mWindowHandlesByDisplay.find(displayId);
+    return it != mWindowHandlesByDisplay.end() ? it->second : EMPTY_WINDOW_HANDLES;
 }
 
 sp<InputWindowHandle> InputDispatcher::getWindowHandleLocked(
@@ -3640,6 +3642,7 @@ void InputDispatcher::updateWindowHandlesForDisplayLocked(
     if (inputWindowHandles.empty()) {
         // Remove all handles on a display if there are no windows left.
         mWindowHandlesByDisplay.erase(displayId);
+        mTouchableWindowIndexByDisplay.erase(displayId);
         return;
     }
 
@@ -3691,6 +3694,7 @@ void InputDispatcher::updateWindowHandlesForDisplayLocked(
 
     // Insert or replace
     mWindowHandlesByDisplay[displayId] = newHandles;
+    mTouchableWindowIndexByDisplay[displayId].rebuild(newHandles, displayId);
 }
 
 void InputDispatcher::setInputWindows(
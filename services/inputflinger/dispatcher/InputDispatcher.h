@@ -29,6 +29,7 @@
 #include "InputThread.h"
 #include "Monitor.h"
 #include "TouchState.h"
+#include "TouchableWindowIndex.h"
 #include "TouchedWindow.h"
 
 #include <input/Input.h>
@@ -295,8 +296,11 @@ private:
             GUARDED_BY(mLock);
     void setInputWindowsLocked(const std::vector<sp<InputWindowHandle>>& inputWindowHandles,
                                int32_t displayId) REQUIRES(mLock);
+    // Spatial index used for touch hit-testing, kept in sync with mWindowHandlesByDisplay.
+    std::unordered_map<int32_t, TouchableWindowIndex> mTouchableWindowIndexByDisplay
+            GUARDED_BY(mLock);
     // Get window handles by display, return an empty vector if not found.
-    std::vector<sp<InputWindowHandle>> getWindowHandlesLocked(int32_t displayId) const
+    const std::vector<sp<InputWindowHandle>>& getWindowHandlesLocked(int32_t displayId) const
             REQUIRES(mLock);
     sp<InputWindowHandle> getWindowHandleLocked(const sp<IBinder>& windowHandleToken) const
             REQUIRES(mLock);
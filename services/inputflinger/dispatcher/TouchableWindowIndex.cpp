@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TouchableWindowIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace android::inputdispatcher {
+
+static bool isTouchModal(int32_t flags) {
+    return (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) ==
+            0;
+}
+
+void TouchableWindowIndex::clear() {
+    mWindowHandles.clear();
+    mKeys.clear();
+    mTouchModalWindows.clear();
+    mWatchOutsideWindows.clear();
+    mGridBounds = Rect::EMPTY_RECT;
+    mColumns = 0;
+    mRows = 0;
+    mCellStarts.clear();
+    mCellEntries.clear();
+}
+
+void TouchableWindowIndex::rebuild(const std::vector<sp<InputWindowHandle>>& windowHandles,
+                                   int32_t displayId) {
+    std::vector<WindowKey> keys;
+    keys.reserve(windowHandles.size());
+    for (const sp<InputWindowHandle>& windowHandle : windowHandles) {
+        const InputWindowInfo* info = windowHandle->getInfo();
+        keys.push_back({windowHandle->getId(), info->layoutParamsFlags,
+                        info->visible && info->displayId == displayId,
+                        info->touchableRegion.getBounds()});
+    }
+    if (keys == mKeys && windowHandles == mWindowHandles) {
+        return;
+    }
+
+    clear();
+    mWindowHandles = windowHandles;
+    mKeys = std::move(keys);
+
+    // Collect the windows that have to be looked at when hit-testing, and the grid bounds.
+    std::vector<size_t> boundedWindows;
+    for (size_t i = 0; i < mKeys.size(); i++) {
+        const WindowKey& key = mKeys[i];
+        if (!key.visible) {
+            continue;
+        }
+        if (key.layoutParamsFlags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+            mWatchOutsideWindows.push_back(i);
+        }
+        if (key.layoutParamsFlags & InputWindowInfo::FLAG_NOT_TOUCHABLE) {
+            continue;
+        }
+        if (isTouchModal(key.layoutParamsFlags)) {
+            mTouchModalWindows.push_back(i);
+            continue;
+        }
+        if (key.bounds.isEmpty()) {
+            continue;
+        }
+        boundedWindows.push_back(i);
+        if (mGridBounds.isEmpty()) {
+            mGridBounds = key.bounds;
+        } else {
+            mGridBounds.left = std::min(mGridBounds.left, key.bounds.left);
+            mGridBounds.top = std::min(mGridBounds.top, key.bounds.top);
+            mGridBounds.right = std::max(mGridBounds.right, key.bounds.right);
+            mGridBounds.bottom = std::max(mGridBounds.bottom, key.bounds.bottom);
+        }
+    }
+
+    if (boundedWindows.empty()) {
+        return;
+    }
+
+    // Aim for roughly one window per cell along each axis.
+    const int32_t windowsPerAxis = static_cast<int32_t>(
+            std::ceil(std::sqrt(static_cast<float>(boundedWindows.size()))));
+    const int32_t dimension = std::clamp(windowsPerAxis, 1, MAX_GRID_DIMENSION);
+    mColumns = std::min(dimension, mGridBounds.getWidth());
+    mRows = std::min(dimension, mGridBounds.getHeight());
+    mCellWidth = (mGridBounds.getWidth() + mColumns - 1) / mColumns;
+    mCellHeight = (mGridBounds.getHeight() + mRows - 1) / mRows;
+
+    // Lay out the cell lists. Touch-modal windows are present in every cell, so that walking a
+    // single cell list visits all of the candidates for a point in z-order.
+    const size_t cellCount = static_cast<size_t>(mColumns) * mRows;
+    std::vector<size_t> cellCounts(cellCount, 0);
+    auto forEachCell = [this](const Rect& bounds, auto&& visitor) {
+        const int32_t firstColumn = (bounds.left - mGridBounds.left) / mCellWidth;
+        const int32_t lastColumn = (bounds.right - 1 - mGridBounds.left) / mCellWidth;
+        const int32_t firstRow = (bounds.top - mGridBounds.top) / mCellHeight;
+        const int32_t lastRow = (bounds.bottom - 1 - mGridBounds.top) / mCellHeight;
+        for (int32_t row = firstRow; row <= lastRow; row++) {
+            for (int32_t column = firstColumn; column <= lastColumn; column++) {
+                visitor(static_cast<size_t>(row) * mColumns + column);
+            }
+        }
+    };
+
+    auto forEachCandidate = [&](auto&& visitor) {
+        // Merge the bounded and touch-modal windows back into a single z-ordered sequence.
+        size_t nextBounded = 0;
+        size_t nextModal = 0;
+        while (nextBounded < boundedWindows.size() || nextModal < mTouchModalWindows.size()) {
+            if (nextModal == mTouchModalWindows.size() ||
+                (nextBounded < boundedWindows.size() &&
+                 boundedWindows[nextBounded] < mTouchModalWindows[nextModal])) {
+                visitor(boundedWindows[nextBounded++], false /*modal*/);
+            } else {
+                visitor(mTouchModalWindows[nextModal++], true /*modal*/);
+            }
+        }
+    };
+
+    forEachCandidate([&](size_t zOrder, bool modal) {
+        if (modal) {
+            for (size_t& count : cellCounts) {
+                count++;
+            }
+        } else {
+            forEachCell(mKeys[zOrder].bounds, [&](size_t cell) { cellCounts[cell]++; });
+        }
+    });
+
+    mCellStarts.resize(cellCount + 1);
+    mCellStarts[0] = 0;
+    for (size_t cell = 0; cell < cellCount; cell++) {
+        mCellStarts[cell + 1] = mCellStarts[cell] + cellCounts[cell];
+    }
+    mCellEntries.resize(mCellStarts[cellCount]);
+
+    std::vector<size_t> cellFill(mCellStarts.begin(), mCellStarts.end() - 1);
+    forEachCandidate([&](size_t zOrder, bool modal) {
+        if (modal) {
+            for (size_t cell = 0; cell < cellCount; cell++) {
+                mCellEntries[cellFill[cell]++] = zOrder;
+            }
+        } else {
+            forEachCell(mKeys[zOrder].bounds,
+                        [&](size_t cell) { mCellEntries[cellFill[cell]++] = zOrder; });
+        }
+    });
+}
+
+bool TouchableWindowIndex::acceptsTouch(size_t zOrder, int32_t x, int32_t y) const {
+    return isTouchModal(mKeys[zOrder].layoutParamsFlags) ||
+            mWindowHandles[zOrder]->getInfo()->touchableRegionContainsPoint(x, y);
+}
+
+size_t TouchableWindowIndex::cellForPoint(int32_t x, int32_t y) const {
+    if (mColumns == 0 || x < mGridBounds.left || x >= mGridBounds.right || y < mGridBounds.top ||
+        y >= mGridBounds.bottom) {
+        return NO_WINDOW;
+    }
+    const int32_t column = (x - mGridBounds.left) / mCellWidth;
+    const int32_t row = (y - mGridBounds.top) / mCellHeight;
+    return static_cast<size_t>(row) * mColumns + column;
+}
+
+size_t TouchableWindowIndex::findTopmostTouchableWindow(int32_t x, int32_t y) const {
+    const size_t cell = cellForPoint(x, y);
+    if (cell == NO_WINDOW) {
+        // Only touch-modal windows can be hit outside of the grid.
+        return mTouchModalWindows.empty() ? NO_WINDOW : mTouchModalWindows.front();
+    }
+    for (size_t i = mCellStarts[cell]; i < mCellStarts[cell + 1]; i++) {
+        const size_t zOrder = mCellEntries[i];
+        if (acceptsTouch(zOrder, x, y)) {
+            return zOrder;
+        }
+    }
+    return NO_WINDOW;
+}
+
+} // namespace android::inputdispatcher
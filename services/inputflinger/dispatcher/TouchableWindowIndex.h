@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_INPUTDISPATCHER_TOUCHABLEWINDOWINDEX_H
+#define _UI_INPUT_INPUTDISPATCHER_TOUCHABLEWINDOWINDEX_H
+
+#include <input/InputWindow.h>
+#include <ui/Rect.h>
+#include <utils/StrongPointer.h>
+
+#include <vector>
+
+namespace android::inputdispatcher {
+
+/*
+ * Spatial index over the touchable windows of a single display, used to speed up touch
+ * hit-testing when a display has many windows.
+ *
+ * The touchable region bounds of each visible, touchable window are bucketed into a uniform grid
+ * that covers the union of all bounds. Each grid cell stores the z-ordered (front to back) list of
+ * windows that may contain a point in that cell. Touch-modal windows accept touches anywhere on
+ * the display, so they are stored in every cell and also in a separate list used for points that
+ * fall outside of the grid.
+ *
+ * The cell lists are packed into a single flat array, so a lookup does not allocate.
+ *
+ * The index holds a snapshot of the window handles that it was built from and must be rebuilt
+ * whenever the set of windows of the display, or their info, changes.
+ */
+class TouchableWindowIndex {
+public:
+    static constexpr size_t NO_WINDOW = static_cast<size_t>(-1);
+
+    TouchableWindowIndex() = default;
+
+    // Rebuild the index for the given z-ordered (front to back) window handles. If none of the
+    // properties that affect hit-testing changed since the last rebuild, this is a no-op.
+    void rebuild(const std::vector<sp<InputWindowHandle>>& windowHandles, int32_t displayId);
+    void clear();
+
+    // Returns the z-order position of the front-most window that accepts a touch at (x, y), or
+    // NO_WINDOW if no window does.
+    size_t findTopmostTouchableWindow(int32_t x, int32_t y) const;
+
+    const sp<InputWindowHandle>& getWindowHandle(size_t zOrder) const {
+        return mWindowHandles[zOrder];
+    }
+
+    // Z-ordered positions of the visible windows that requested FLAG_WATCH_OUTSIDE_TOUCH.
+    const std::vector<size_t>& getWatchOutsideWindows() const { return mWatchOutsideWindows; }
+
+    size_t size() const { return mWindowHandles.size(); }
+
+private:
+    // The subset of window state that determines the contents of the index.
+    struct WindowKey {
+        int32_t id;
+        int32_t layoutParamsFlags;
+        bool visible;
+        Rect bounds;
+
+        bool operator==(const WindowKey& other) const {
+            return id == other.id && layoutParamsFlags == other.layoutParamsFlags &&
+                    visible == other.visible && bounds == other.bounds;
+        }
+    };
+
+    static constexpr int32_t MAX_GRID_DIMENSION = 64;
+
+    bool acceptsTouch(size_t zOrder, int32_t x, int32_t y) const;
+    size_t cellForPoint(int32_t x, int32_t y) const;
+
+    std::vector<sp<InputWindowHandle>> mWindowHandles;
+    std::vector<WindowKey> mKeys;
+
+    // Z-ordered positions of windows that accept touches anywhere on the display.
+    std::vector<size_t> mTouchModalWindows;
+    std::vector<size_t> mWatchOutsideWindows;
+
+    // Grid covering mGridBounds, with mColumns x mRows cells of mCellWidth x mCellHeight pixels.
+    // The candidate windows of cell i are mCellEntries[mCellStarts[i]..mCellStarts[i + 1]).
+    Rect mGridBounds;
+    int32_t mColumns = 0;
+    int32_t mRows = 0;
+    int32_t mCellWidth = 1;
+    int32_t mCellHeight = 1;
+    std::vector<size_t> mCellStarts;
+    std::vector<size_t> mCellEntries;
+};
+
+} // namespace android::inputdispatcher
+
+#endif // _UI_INPUT_INPUTDISPATCHER_TOUCHABLEWINDOWINDEX_H
@@ -14,12 +14,14 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <memory.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +31,7 @@
 #include <sys/inotify.h>
 #include <sys/ioctl.h>
 #include <sys/limits.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define LOG_TAG "EventHub"
@@ -38,6 +41,7 @@
 #include "EventHub.h"
 
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <cutils/properties.h>
 #include <openssl/sha.h>
 #include <utils/Errors.h>
@@ -69,14 +73,6 @@ using android::base::StringPrintf;
 namespace android {
 
 
-#define ADD_EVENT(type_, code_, value_)            \
-    event[n].time.tv_sec = rt.tv_sec;              \
-    event[n].time.tv_usec = rt.tv_nsec / 1000;     \
-    event[n].type = type_;                         \
-    event[n].code = code_;                         \
-    event[n].value = value_;                       \
-    n++;
-
 static constexpr bool DEBUG = true;
 
 static const char* DEVICE_PATH = "/dev/input";
@@ -415,55 +411,201 @@ void EventHub::getConfiguration(int32_t deviceId, PropertyMap* outConfiguration)
     }
 }
 
+// The wayland touch device reports ABS_MT_SLOT in [0, 9] and ABS_MT_PRESSURE in [0, 255], see
+// getAbsoluteAxisInfo().
+static constexpr int32_t WL_TOUCH_SLOT_COUNT = 10;
+static constexpr int32_t WL_TOUCH_MAX_PRESSURE = 255;
+// Pressure used for injected pointers that do not report one.
+static constexpr int32_t WL_TOUCH_DEFAULT_PRESSURE = 50;
+// How long injection waits for the touch device pipe to drain before dropping the rest of a batch.
+static constexpr int WL_TOUCH_INJECT_TIMEOUT_MILLIS = 1000;
+
+// A frame holds at most a slot, tracking id, position and pressure per slot, and a SYN_REPORT.
+// Writes to a pipe of up to PIPE_BUF bytes are atomic, so frames written in groups that fit
+// never reach the reader halfway, even when the pipe is full.
+static_assert((WL_TOUCH_SLOT_COUNT * 5 + 1) * sizeof(input_event) <= PIPE_BUF,
+              "A touch frame must fit in an atomic pipe write");
+
+static void appendEvent(std::vector<input_event>* outEvents, nsecs_t when, uint16_t type,
+                        uint16_t code, int32_t value) {
+    struct input_event event;
+    event.time.tv_sec = when / 1000000000LL;
+    event.time.tv_usec = (when % 1000000000LL) / 1000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    outEvents->push_back(event);
+}
+
+static int32_t toSlotPressure(float pressure) {
+    if (pressure <= 0) {
+        return WL_TOUCH_DEFAULT_PRESSURE;
+    }
+    return std::clamp(static_cast<int32_t>(pressure * WL_TOUCH_MAX_PRESSURE + 0.5f), 1,
+                      WL_TOUCH_MAX_PRESSURE);
+}
+
+/**
+ * Append one SYN frame that reports the given sample of every pointer of the motion event.
+ * The pointer at liftedPointerIndex, if any, is released instead. A negative sampleIndex
+ * refers to the current sample, otherwise to a historical one.
+ */
+static void appendMotionFrame(const MotionEvent& motion, ssize_t sampleIndex,
+                              ssize_t liftedPointerIndex, bool liftAll,
+                              std::vector<input_event>* outEvents) {
+    const nsecs_t when = sampleIndex < 0 ? motion.getEventTime()
+                                         : motion.getHistoricalEventTime(sampleIndex);
+    const size_t pointerCount = motion.getPointerCount();
+    for (size_t i = 0; i < pointerCount; i++) {
+        const int32_t id = motion.getPointerId(i);
+        if (id >= WL_TOUCH_SLOT_COUNT) {
+            ALOGW("Dropping injected pointer %d, the touch device only has %d slots", id,
+                  WL_TOUCH_SLOT_COUNT);
+            continue;
+        }
+        appendEvent(outEvents, when, EV_ABS, ABS_MT_SLOT, id);
+        if (liftAll || ssize_t(i) == liftedPointerIndex) {
+            appendEvent(outEvents, when, EV_ABS, ABS_MT_TRACKING_ID, -1);
+            continue;
+        }
+        const float x = sampleIndex < 0 ? motion.getX(i) : motion.getHistoricalX(i, sampleIndex);
+        const float y = sampleIndex < 0 ? motion.getY(i) : motion.getHistoricalY(i, sampleIndex);
+        const float pressure = sampleIndex < 0 ? motion.getPressure(i)
+                                               : motion.getHistoricalPressure(i, sampleIndex);
+        appendEvent(outEvents, when, EV_ABS, ABS_MT_TRACKING_ID, id);
+        appendEvent(outEvents, when, EV_ABS, ABS_MT_POSITION_X, static_cast<int32_t>(x));
+        appendEvent(outEvents, when, EV_ABS, ABS_MT_POSITION_Y, static_cast<int32_t>(y));
+        appendEvent(outEvents, when, EV_ABS, ABS_MT_PRESSURE, toSlotPressure(pressure));
+    }
+    appendEvent(outEvents, when, EV_SYN, SYN_REPORT, 0);
+}
+
+void EventHub::appendMotionEventFrames(const MotionEvent& motion,
+                                       std::vector<input_event>* outEvents,
+                                       std::vector<size_t>* outFrameEnds) {
+    const int32_t maskedAction = motion.getActionMasked();
+    switch (maskedAction) {
+        case AMOTION_EVENT_ACTION_DOWN:
+        case AMOTION_EVENT_ACTION_POINTER_DOWN:
+        case AMOTION_EVENT_ACTION_MOVE:
+        case AMOTION_EVENT_ACTION_POINTER_UP:
+        case AMOTION_EVENT_ACTION_UP:
+        case AMOTION_EVENT_ACTION_CANCEL:
+            break;
+        default:
+            // Hover, scroll and button actions have no multitouch protocol equivalent.
+            return;
+    }
+
+    // Historical samples are always movements of the pointers that are down.
+    for (size_t h = 0; h < motion.getHistorySize(); h++) {
+        appendMotionFrame(motion, h, -1 /*liftedPointerIndex*/, false /*liftAll*/, outEvents);
+        outFrameEnds->push_back(outEvents->size());
+    }
+
+    ssize_t liftedPointerIndex = -1;
+    if (maskedAction == AMOTION_EVENT_ACTION_POINTER_UP) {
+        liftedPointerIndex = motion.getActionIndex();
+    }
+    const bool liftAll = maskedAction == AMOTION_EVENT_ACTION_UP ||
+            maskedAction == AMOTION_EVENT_ACTION_CANCEL;
+    appendMotionFrame(motion, -1 /*sampleIndex*/, liftedPointerIndex, liftAll, outEvents);
+    outFrameEnds->push_back(outEvents->size());
+}
+
 void EventHub::injectMotionEvent(MotionEvent * motion, int32_t syncMode, int32_t timeoutMillis,
     int32_t policyFlags) const{
-    switch (motion->getAction())
+    injectMotionEvents({motion});
+}
+
+void EventHub::injectMotionEvents(const std::vector<const MotionEvent*>& motions) const {
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    for (const MotionEvent* motion : motions) {
+        appendMotionEventFrames(*motion, &events, &frameEnds);
+    }
+    if (frameEnds.empty()) {
+        return;
+    }
+
+    // The pipe is drained by getEvents() under mLock, so wait for it with a duplicate of the
+    // device fd instead of holding the lock. mInjectLock keeps batches from interleaving.
+    std::scoped_lock injectLock(mInjectLock);
+    base::unique_fd fd;
     {
-        case AMOTION_EVENT_ACTION_DOWN:
-        {
-            struct input_event event[6];
-            struct timespec rt;
-            unsigned n = 0;
-            ADD_EVENT(EV_ABS, ABS_MT_SLOT, 1);
-            ADD_EVENT(EV_ABS, ABS_MT_TRACKING_ID, 1);
-            ADD_EVENT(EV_ABS, ABS_MT_POSITION_X, (int)motion->getX(0));
-            ADD_EVENT(EV_ABS, ABS_MT_POSITION_Y, (int)motion->getY(0));
-            ADD_EVENT(EV_ABS, ABS_MT_PRESSURE, 50);
-            ADD_EVENT(EV_SYN, SYN_REPORT, 0);
-            Device* device = getDeviceByPathLocked(INPUT_PIPE_NAME[0]);
-            write(device->fd, &event, sizeof(event));
-        }
-            break;    
-        case AMOTION_EVENT_ACTION_UP:
-        {
-            struct input_event event[3];
-            struct timespec rt;
-            unsigned int n = 0;
-            ADD_EVENT(EV_ABS, ABS_MT_SLOT, 1);
-            ADD_EVENT(EV_ABS, ABS_MT_TRACKING_ID, -1);
-            ADD_EVENT(EV_SYN, SYN_REPORT, 0);
-            Device* device = getDeviceByPathLocked(INPUT_PIPE_NAME[0]);
-            write(device->fd, &event, sizeof(event));
+        AutoMutex _l(mLock);
+        Device* device = getDeviceByPathLocked(INPUT_PIPE_NAME[WL_INPUT_TOUCH]);
+        if (device == nullptr || !device->hasValidFd()) {
+            ALOGW("Dropping %zu injected motion events, %s is not open", motions.size(),
+                  INPUT_PIPE_NAME[WL_INPUT_TOUCH]);
+            return;
         }
-            break;
-        case AMOTION_EVENT_ACTION_MOVE:
-        {
-            struct input_event event[6];
-            struct timespec rt;
-            unsigned n = 0;
-            ADD_EVENT(EV_ABS, ABS_MT_SLOT, 1);
-            ADD_EVENT(EV_ABS, ABS_MT_TRACKING_ID, 1);
-            ADD_EVENT(EV_ABS, ABS_MT_POSITION_X, (int)motion->getX(0));
-            ADD_EVENT(EV_ABS, ABS_MT_POSITION_Y, (int)motion->getY(0));
-            ADD_EVENT(EV_ABS, ABS_MT_PRESSURE, 50);
-            ADD_EVENT(EV_SYN, SYN_REPORT, 0);
-            Device* device = getDeviceByPathLocked(INPUT_PIPE_NAME[0]);
-            write(device->fd, &event, sizeof(event));
+        fd.reset(fcntl(device->fd, F_DUPFD_CLOEXEC, 0));
+        if (fd < 0) {
+            ALOGE("Could not inject motion events into %s: %s", device->path.c_str(),
+                  strerror(errno));
+            return;
+        }
+    }
+
+    if (!writeMotionFrames(fd, events, frameEnds, WL_TOUCH_INJECT_TIMEOUT_MILLIS)) {
+        ALOGE("Could not inject all motion events into %s: %s", INPUT_PIPE_NAME[WL_INPUT_TOUCH],
+              strerror(errno));
+    }
+}
+
+bool EventHub::writeMotionFrames(int fd, const std::vector<input_event>& events,
+                                 const std::vector<size_t>& frameEnds, int timeoutMillis) {
+    // One iovec per SYN frame, and as many frames per writev() as fit in one atomic write.
+    std::vector<struct iovec> iovs;
+    iovs.reserve(frameEnds.size());
+    size_t frameStart = 0;
+    for (size_t frameEnd : frameEnds) {
+        iovs.push_back({const_cast<input_event*>(&events[frameStart]),
+                        (frameEnd - frameStart) * sizeof(input_event)});
+        frameStart = frameEnd;
+    }
+
+    size_t next = 0;
+    while (next < iovs.size()) {
+        size_t count = 0;
+        size_t bytes = 0;
+        while (next + count < iovs.size() && count < IOV_MAX &&
+               (count == 0 || bytes + iovs[next + count].iov_len <= PIPE_BUF)) {
+            bytes += iovs[next + count].iov_len;
+            count++;
+        }
+        ssize_t nWrite = writev(fd, &iovs[next], count);
+        if (nWrite < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return false;
+            }
+            // The pipe is full. Nothing of this group was written, so wait and resume at next.
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            int result = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeoutMillis));
+            if (result == 0) {
+                errno = ETIMEDOUT;
+            }
+            if (result <= 0 || (pfd.revents & POLLOUT) == 0) {
+                return false;
+            }
+            continue;
+        }
+        // Skip the frames that were fully written, and resume inside a partially written one,
+        // which can only happen for fds that are not pipes.
+        while (next < iovs.size() && size_t(nWrite) >= iovs[next].iov_len) {
+            nWrite -= iovs[next].iov_len;
+            next++;
+        }
+        if (nWrite > 0) {
+            iovs[next].iov_base = static_cast<uint8_t*>(iovs[next].iov_base) + nWrite;
+            iovs[next].iov_len -= nWrite;
         }
-            break;
-        default:
-            break;
     }
+    return true;
 }
 
 status_t EventHub::getAbsoluteAxisInfo(int32_t deviceId, int axis,
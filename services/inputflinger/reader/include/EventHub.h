@@ -17,6 +17,7 @@
 #ifndef _RUNTIME_EVENT_HUB_H
 #define _RUNTIME_EVENT_HUB_H
 
+#include <mutex>
 #include <vector>
 
 #include <input/Input.h>
@@ -174,6 +175,13 @@ public:
     virtual void injectMotionEvent(MotionEvent * event, int32_t syncMode, int32_t timeoutMillis,
         int32_t policyFlags) const = 0;
 
+    /*
+     * Inject a batch of touch motion events into the wayland touch device. All pointers and
+     * historical samples are converted to multitouch protocol frames, and the whole batch is
+     * written with a single writev().
+     */
+    virtual void injectMotionEvents(const std::vector<const MotionEvent*>& events) const = 0;
+
     virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
                                          RawAbsoluteAxisInfo* outAxisInfo) const = 0;
 
@@ -274,6 +282,25 @@ public:
     virtual void injectMotionEvent(MotionEvent * event, int32_t syncMode, int32_t timeoutMillis,
         int32_t policyFlags) const override;
 
+    virtual void injectMotionEvents(const std::vector<const MotionEvent*>& events) const override;
+
+    /*
+     * Convert a motion event to multitouch protocol (type B) frames, one per sample, each
+     * terminated by a SYN_REPORT. The index one past the end of each frame in outEvents is
+     * appended to outFrameEnds.
+     */
+    static void appendMotionEventFrames(const MotionEvent& motion,
+                                        std::vector<input_event>* outEvents,
+                                        std::vector<size_t>* outFrameEnds);
+
+    /*
+     * Write the frames built by appendMotionEventFrames() to a non-blocking pipe, never leaving
+     * a partial frame in it. Waits up to timeoutMillis whenever the pipe is full, and returns
+     * false with errno set if it stays full or the write fails.
+     */
+    static bool writeMotionFrames(int fd, const std::vector<input_event>& events,
+                                  const std::vector<size_t>& frameEnds, int timeoutMillis);
+
     virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
                                          RawAbsoluteAxisInfo* outAxisInfo) const override;
 
@@ -435,6 +462,9 @@ private:
     // Protect all internal state.
     mutable Mutex mLock;
 
+    // Serializes injected motion batches, which are written without holding mLock.
+    mutable std::mutex mInjectLock;
+
     // The actual id of the built-in keyboard, or NO_BUILT_IN_KEYBOARD if none.
     // EventHub remaps the built-in keyboard to id 0 externally as required by the API.
     enum {
@@ -18,11 +18,15 @@
 
 #include "UinputDevice.h"
 
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
 #include <gtest/gtest.h>
 #include <inttypes.h>
 #include <linux/uinput.h>
 #include <log/log.h>
+#include <algorithm>
 #include <chrono>
+#include <thread>
 
 #define TAG "EventHub_test"
 
@@ -199,3 +203,180 @@ TEST_F(EventHubTest, InputEvent_TimestampIsMonotonic) {
         lastEventTime = event.when; // Ensure all returned events are monotonic
     }
 }
+
+// --- EventHubMotionInjectionTest ---
+
+static android::MotionEvent createTouchMotionEvent(int32_t action, size_t pointerCount,
+                                                   float pressure = 0.5f) {
+    android::PointerProperties pointerProperties[pointerCount];
+    android::PointerCoords pointerCoords[pointerCount];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerProperties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+        pointerCoords[i].clear();
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 100 + 10 * i);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 200 + 10 * i);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, pressure);
+    }
+    const nsecs_t eventTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    android::MotionEvent event;
+    event.initialize(android::InputEvent::nextId(), 1 /*deviceId*/, AINPUT_SOURCE_TOUCHSCREEN,
+                     0 /*displayId*/, android::INVALID_HMAC, action, 0 /*actionButton*/,
+                     0 /*flags*/, AMOTION_EVENT_EDGE_FLAG_NONE, AMETA_NONE, 0 /*buttonState*/,
+                     android::MotionClassification::NONE, 1 /*xScale*/, 1 /*yScale*/,
+                     0 /*xOffset*/, 0 /*yOffset*/, 0 /*xPrecision*/, 0 /*yPrecision*/,
+                     AMOTION_EVENT_INVALID_CURSOR_POSITION, AMOTION_EVENT_INVALID_CURSOR_POSITION,
+                     eventTime, eventTime, pointerCount, pointerProperties, pointerCoords);
+    return event;
+}
+
+static int32_t findSlotValue(const std::vector<input_event>& events, size_t frameStart,
+                             size_t frameEnd, int32_t slot, uint16_t code) {
+    int32_t currentSlot = -1;
+    for (size_t i = frameStart; i < frameEnd; i++) {
+        if (events[i].type != EV_ABS) continue;
+        if (events[i].code == ABS_MT_SLOT) {
+            currentSlot = events[i].value;
+        } else if (currentSlot == slot && events[i].code == code) {
+            return events[i].value;
+        }
+    }
+    return INT32_MIN;
+}
+
+TEST(EventHubMotionInjectionTest, Down_OneFrameEndingWithSyn) {
+    android::MotionEvent motion = createTouchMotionEvent(AMOTION_EVENT_ACTION_DOWN, 1);
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    EventHub::appendMotionEventFrames(motion, &events, &frameEnds);
+
+    ASSERT_EQ(1U, frameEnds.size());
+    ASSERT_EQ(events.size(), frameEnds[0]);
+    ASSERT_EQ(EV_SYN, events.back().type);
+    ASSERT_EQ(SYN_REPORT, events.back().code);
+    ASSERT_EQ(0, findSlotValue(events, 0, frameEnds[0], 0, ABS_MT_TRACKING_ID));
+    ASSERT_EQ(100, findSlotValue(events, 0, frameEnds[0], 0, ABS_MT_POSITION_X));
+    ASSERT_EQ(200, findSlotValue(events, 0, frameEnds[0], 0, ABS_MT_POSITION_Y));
+    ASSERT_EQ(128, findSlotValue(events, 0, frameEnds[0], 0, ABS_MT_PRESSURE));
+}
+
+TEST(EventHubMotionInjectionTest, PointerUp_ReleasesOnlyActionPointer) {
+    android::MotionEvent motion =
+            createTouchMotionEvent(AMOTION_EVENT_ACTION_POINTER_UP |
+                                           (1 << AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT),
+                                   2);
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    EventHub::appendMotionEventFrames(motion, &events, &frameEnds);
+
+    ASSERT_EQ(1U, frameEnds.size());
+    ASSERT_EQ(0, findSlotValue(events, 0, frameEnds[0], 0, ABS_MT_TRACKING_ID));
+    ASSERT_EQ(-1, findSlotValue(events, 0, frameEnds[0], 1, ABS_MT_TRACKING_ID));
+}
+
+TEST(EventHubMotionInjectionTest, Move_OneFramePerHistoricalSample) {
+    android::MotionEvent motion = createTouchMotionEvent(AMOTION_EVENT_ACTION_MOVE, 2);
+    android::PointerCoords coords[2];
+    for (size_t i = 0; i < 2; i++) {
+        coords[i].clear();
+        coords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 300 + i);
+        coords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 400 + i);
+    }
+    motion.addSample(motion.getEventTime() + 1000000, coords);
+
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    EventHub::appendMotionEventFrames(motion, &events, &frameEnds);
+
+    ASSERT_EQ(2U, frameEnds.size());
+    ASSERT_EQ(100, findSlotValue(events, 0, frameEnds[0], 0, ABS_MT_POSITION_X));
+    ASSERT_EQ(301, findSlotValue(events, frameEnds[0], frameEnds[1], 1, ABS_MT_POSITION_X));
+    // Pointers without a pressure get the default one.
+    ASSERT_EQ(50, findSlotValue(events, frameEnds[0], frameEnds[1], 1, ABS_MT_PRESSURE));
+}
+
+TEST(EventHubMotionInjectionTest, HoverMove_NoFrames) {
+    android::MotionEvent motion = createTouchMotionEvent(AMOTION_EVENT_ACTION_HOVER_MOVE, 1);
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    EventHub::appendMotionEventFrames(motion, &events, &frameEnds);
+
+    ASSERT_TRUE(events.empty());
+    ASSERT_TRUE(frameEnds.empty());
+}
+
+static android::MotionEvent createMoveWithHistory(size_t historySize) {
+    android::MotionEvent motion = createTouchMotionEvent(AMOTION_EVENT_ACTION_MOVE, 2);
+    android::PointerCoords coords[2];
+    for (size_t h = 0; h < historySize; h++) {
+        for (size_t i = 0; i < 2; i++) {
+            coords[i].clear();
+            coords[i].setAxisValue(AMOTION_EVENT_AXIS_X, h + i);
+            coords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, h + 2 * i);
+        }
+        motion.addSample(motion.getEventTime() + 1000, coords);
+    }
+    return motion;
+}
+
+TEST(EventHubMotionInjectionTest, WriteMotionFrames_FullPipe_ResumesWithWholeFrames) {
+    android::MotionEvent motion = createMoveWithHistory(200);
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    EventHub::appendMotionEventFrames(motion, &events, &frameEnds);
+    const size_t totalBytes = events.size() * sizeof(input_event);
+
+    int fds[2];
+    ASSERT_EQ(0, pipe2(fds, O_NONBLOCK | O_CLOEXEC));
+    android::base::unique_fd readFd(fds[0]), writeFd(fds[1]);
+    // The smallest pipe there is, so that the batch has to wait for the reader many times.
+    fcntl(writeFd, F_SETPIPE_SZ, PIPE_BUF);
+    ASSERT_GT(totalBytes, size_t(fcntl(writeFd, F_GETPIPE_SZ)));
+
+    std::string received;
+    std::thread reader([&]() {
+        char buf[100];
+        while (received.size() < totalBytes) {
+            ssize_t n = read(readFd, buf, sizeof(buf));
+            if (n > 0) {
+                received.append(buf, n);
+            } else {
+                std::this_thread::sleep_for(1ms);
+            }
+        }
+    });
+    const bool written = EventHub::writeMotionFrames(writeFd, events, frameEnds, 5000);
+    reader.join();
+
+    ASSERT_TRUE(written);
+    ASSERT_EQ(totalBytes, received.size());
+    ASSERT_EQ(0, memcmp(events.data(), received.data(), totalBytes));
+}
+
+TEST(EventHubMotionInjectionTest, WriteMotionFrames_NoReader_LeavesWholeFrames) {
+    android::MotionEvent motion = createMoveWithHistory(200);
+    std::vector<input_event> events;
+    std::vector<size_t> frameEnds;
+    EventHub::appendMotionEventFrames(motion, &events, &frameEnds);
+
+    int fds[2];
+    ASSERT_EQ(0, pipe2(fds, O_NONBLOCK | O_CLOEXEC));
+    android::base::unique_fd readFd(fds[0]), writeFd(fds[1]);
+    fcntl(writeFd, F_SETPIPE_SZ, PIPE_BUF);
+
+    ASSERT_FALSE(EventHub::writeMotionFrames(writeFd, events, frameEnds, 10));
+    ASSERT_EQ(ETIMEDOUT, errno);
+
+    std::string received;
+    char buf[PIPE_BUF];
+    ssize_t n;
+    while ((n = read(readFd, buf, sizeof(buf))) > 0) {
+        received.append(buf, n);
+    }
+    ASSERT_FALSE(received.empty());
+    ASSERT_EQ(0U, received.size() % sizeof(input_event));
+    const size_t eventCount = received.size() / sizeof(input_event);
+    ASSERT_NE(frameEnds.end(), std::find(frameEnds.begin(), frameEnds.end(), eventCount))
+            << "The pipe holds a partial frame";
+}
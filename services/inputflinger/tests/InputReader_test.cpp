@@ -603,6 +603,10 @@ private:
         }
     }
 
+    virtual void injectMotionEvent(MotionEvent*, int32_t, int32_t, int32_t) const {}
+
+    virtual void injectMotionEvents(const std::vector<const MotionEvent*>&) const {}
+
     virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
             RawAbsoluteAxisInfo* outAxisInfo) const {
         Device* device = getDevice(deviceId);
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../dispatcher/TouchableWindowIndex.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+namespace inputdispatcher {
+
+static constexpr int32_t DISPLAY_ID = 0;
+
+class IndexedWindowHandle : public InputWindowHandle {
+public:
+    IndexedWindowHandle(int32_t id, const Rect& frame, int32_t flags) {
+        mInfo.id = id;
+        mInfo.displayId = DISPLAY_ID;
+        mInfo.visible = true;
+        mInfo.layoutParamsFlags = flags;
+        mInfo.addTouchableRegion(frame);
+    }
+
+    bool updateInfo() override { return true; }
+    InputWindowInfo* editInfo() { return &mInfo; }
+};
+
+static constexpr int32_t NOT_MODAL = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+
+// --- TouchableWindowIndexTest ---
+
+TEST(TouchableWindowIndexTest, Empty_NoWindow) {
+    TouchableWindowIndex index;
+    index.rebuild({}, DISPLAY_ID);
+
+    ASSERT_EQ(TouchableWindowIndex::NO_WINDOW, index.findTopmostTouchableWindow(10, 10));
+}
+
+TEST(TouchableWindowIndexTest, OverlappingWindows_ReturnsFrontMost) {
+    sp<IndexedWindowHandle> top = new IndexedWindowHandle(1, Rect(50, 50, 150, 150), NOT_MODAL);
+    sp<IndexedWindowHandle> bottom = new IndexedWindowHandle(2, Rect(0, 0, 200, 200), NOT_MODAL);
+    TouchableWindowIndex index;
+    index.rebuild({top, bottom}, DISPLAY_ID);
+
+    ASSERT_EQ(0u, index.findTopmostTouchableWindow(100, 100));
+    ASSERT_EQ(1u, index.findTopmostTouchableWindow(10, 10));
+    ASSERT_EQ(TouchableWindowIndex::NO_WINDOW, index.findTopmostTouchableWindow(300, 300));
+}
+
+TEST(TouchableWindowIndexTest, TouchModalWindow_HitOutsideOfItsBounds) {
+    sp<IndexedWindowHandle> small = new IndexedWindowHandle(1, Rect(0, 0, 10, 10), NOT_MODAL);
+    sp<IndexedWindowHandle> modal = new IndexedWindowHandle(2, Rect(0, 0, 10, 10), 0);
+    sp<IndexedWindowHandle> bottom = new IndexedWindowHandle(3, Rect(0, 0, 200, 200), NOT_MODAL);
+    TouchableWindowIndex index;
+    index.rebuild({small, modal, bottom}, DISPLAY_ID);
+
+    ASSERT_EQ(0u, index.findTopmostTouchableWindow(5, 5));
+    ASSERT_EQ(1u, index.findTopmostTouchableWindow(100, 100));
+    ASSERT_EQ(1u, index.findTopmostTouchableWindow(1000, 1000));
+}
+
+TEST(TouchableWindowIndexTest, InvisibleAndNotTouchableWindows_Skipped) {
+    sp<IndexedWindowHandle> invisible = new IndexedWindowHandle(1, Rect(0, 0, 100, 100), NOT_MODAL);
+    invisible->editInfo()->visible = false;
+    sp<IndexedWindowHandle> notTouchable =
+            new IndexedWindowHandle(2, Rect(0, 0, 100, 100),
+                                 NOT_MODAL | InputWindowInfo::FLAG_NOT_TOUCHABLE |
+                                         InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    sp<IndexedWindowHandle> bottom = new IndexedWindowHandle(3, Rect(0, 0, 100, 100), NOT_MODAL);
+    TouchableWindowIndex index;
+    index.rebuild({invisible, notTouchable, bottom}, DISPLAY_ID);
+
+    ASSERT_EQ(2u, index.findTopmostTouchableWindow(50, 50));
+    ASSERT_EQ(std::vector<size_t>{1u}, index.getWatchOutsideWindows());
+}
+
+TEST(TouchableWindowIndexTest, ManyWindows_MatchesLinearScan) {
+    std::vector<sp<InputWindowHandle>> windowHandles;
+    for (int32_t i = 0; i < 200; i++) {
+        const int32_t left = (i * 37) % 900;
+        const int32_t top = (i * 53) % 1800;
+        windowHandles.push_back(new IndexedWindowHandle(i, Rect(left, top, left + 120, top + 90),
+                                                     NOT_MODAL));
+    }
+    TouchableWindowIndex index;
+    index.rebuild(windowHandles, DISPLAY_ID);
+
+    for (int32_t y = 0; y < 2000; y += 17) {
+        for (int32_t x = 0; x < 1100; x += 13) {
+            size_t expected = TouchableWindowIndex::NO_WINDOW;
+            for (size_t i = 0; i < windowHandles.size(); i++) {
+                if (windowHandles[i]->getInfo()->touchableRegionContainsPoint(x, y)) {
+                    expected = i;
+                    break;
+                }
+            }
+            ASSERT_EQ(expected, index.findTopmostTouchableWindow(x, y)) << x << "," << y;
+        }
+    }
+}
+
+TEST(TouchableWindowIndexTest, Rebuild_PicksUpMovedWindow) {
+    sp<IndexedWindowHandle> window = new IndexedWindowHandle(1, Rect(0, 0, 100, 100), NOT_MODAL);
+    TouchableWindowIndex index;
+    index.rebuild({window}, DISPLAY_ID);
+    ASSERT_EQ(0u, index.findTopmostTouchableWindow(50, 50));
+
+    window->editInfo()->touchableRegion.clear();
+    window->editInfo()->addTouchableRegion(Rect(500, 500, 600, 600));
+    index.rebuild({window}, DISPLAY_ID);
+
+    ASSERT_EQ(TouchableWindowIndex::NO_WINDOW, index.findTopmostTouchableWindow(50, 50));
+    ASSERT_EQ(0u, index.findTopmostTouchableWindow(550, 550));
+}
+
+} // namespace inputdispatcher
+
+} // namespace android
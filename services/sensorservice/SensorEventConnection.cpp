@@ -186,6 +186,16 @@ std::vector<int32_t> SensorService::SensorEventConnection::getActiveSensorHandle
     return list;
 }
 
+void SensorService::SensorEventConnection::getRoutingInfo(std::vector<int32_t>* handles,
+                                                          bool* hasPendingFlushEvents) const {
+    Mutex::Autolock _l(mConnectionLock);
+    *hasPendingFlushEvents = false;
+    for (auto& it : mSensorInfo) {
+        handles->push_back(it.first);
+        *hasPendingFlushEvents |= it.second.mPendingFlushEventsToSend > 0;
+    }
+}
+
 bool SensorService::SensorEventConnection::hasSensor(int32_t handle) const {
     Mutex::Autolock _l(mConnectionLock);
     return mSensorInfo.count(handle) > 0;
@@ -288,7 +298,8 @@ bool SensorService::SensorEventConnection::incrementPendingFlushCountIfHasAccess
 status_t SensorService::SensorEventConnection::sendEvents(
         sensors_event_t const* buffer, size_t numEvents,
         sensors_event_t* scratch,
-        wp<const SensorEventConnection> const * mapFlushEventsToConnections) {
+        wp<const SensorEventConnection> const * mapFlushEventsToConnections,
+        uint32_t const* runEnds) {
     // filter out events not for this connection
 
     std::unique_ptr<sensors_event_t[]> sanitizedBuffer;
@@ -309,9 +320,9 @@ status_t SensorService::SensorEventConnection::sendEvents(
             }
 
             // Check if this connection has registered for this sensor. If not continue to the
-            // next sensor_event.
+            // next sensor_event, or past all the events for this sensor if we know where they end.
             if (mSensorInfo.count(sensor_handle) == 0) {
-                ++i;
+                i = runEnds ? runEnds[i] : i + 1;
                 continue;
             }
 
@@ -52,14 +52,20 @@ public:
     SensorEventConnection(const sp<SensorService>& service, uid_t uid, String8 packageName,
                           bool isDataInjectionMode, const String16& opPackageName);
 
+    // If runEnds is not null, runEnds[i] is the index just past the run of events that are for the
+    // same sensor as buffer[i], see SensorEventRouter::getRunEnds.
     status_t sendEvents(sensors_event_t const* buffer, size_t count, sensors_event_t* scratch,
-                        wp<const SensorEventConnection> const * mapFlushEventsToConnections = nullptr);
+                        wp<const SensorEventConnection> const * mapFlushEventsToConnections = nullptr,
+                        uint32_t const* runEnds = nullptr);
     bool hasSensor(int32_t handle) const;
     bool hasAnySensor() const;
     bool hasOneShotSensors() const;
     bool addSensor(int32_t handle);
     bool removeSensor(int32_t handle);
     std::vector<int32_t> getActiveSensorHandles() const;
+    // Appends the handles of the registered sensors to handles, and sets hasPendingFlushEvents to
+    // whether there are flush complete events waiting to be sent.
+    void getRoutingInfo(std::vector<int32_t>* handles, bool* hasPendingFlushEvents) const;
     void setFirstFlushPending(int32_t handle, bool value);
     void dump(String8& result);
     void dump(util::ProtoOutputStream* proto) const;
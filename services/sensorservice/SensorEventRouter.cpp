@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventRouter.h"
+
+namespace android {
+namespace SensorServiceUtil {
+
+void SensorEventRouter::clearSubscribers() {
+    for (auto& it : mSubscribersByHandle) {
+        it.second.clear();
+    }
+    mAlwaysRoute.clear();
+}
+
+void SensorEventRouter::addSubscriber(const std::vector<int32_t>& handles, bool alwaysRoute) {
+    const uint32_t subscriber = mAlwaysRoute.size();
+    mAlwaysRoute.push_back(alwaysRoute);
+    for (int32_t handle : handles) {
+        mSubscribersByHandle[handle].push_back(subscriber);
+    }
+}
+
+void SensorEventRouter::route(const sensors_event_t* events, size_t count,
+                              std::vector<size_t>* targets) {
+    mRunEnds.resize(count);
+    for (size_t i = count; i-- > 0;) {
+        if (i + 1 < count &&
+            getRoutingHandle(events[i]) == getRoutingHandle(events[i + 1])) {
+            mRunEnds[i] = mRunEnds[i + 1];
+        } else {
+            mRunEnds[i] = i + 1;
+        }
+    }
+
+    mRouted.assign(mAlwaysRoute.begin(), mAlwaysRoute.end());
+    for (size_t i = 0; i < count; i = mRunEnds[i]) {
+        auto it = mSubscribersByHandle.find(getRoutingHandle(events[i]));
+        if (it != mSubscribersByHandle.end()) {
+            for (uint32_t subscriber : it->second) {
+                mRouted[subscriber] = true;
+            }
+        }
+    }
+
+    targets->clear();
+    for (size_t subscriber = 0; subscriber < mRouted.size(); subscriber++) {
+        if (mRouted[subscriber]) {
+            targets->push_back(subscriber);
+        }
+    }
+}
+
+} // namespace SensorServiceUtil
+} // namespace android
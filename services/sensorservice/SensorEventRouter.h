@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_ROUTER_H
+#define ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_ROUTER_H
+
+#include <hardware/sensors.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace SensorServiceUtil {
+
+// Works out which subscribers the events of one poll have to be sent to, so that each event buffer
+// is only scanned by the connections that registered for one of its sensors.
+//
+// The index is rebuilt for every poll: clearSubscribers, addSubscriber for every active connection,
+// then route. Not thread safe.
+class SensorEventRouter {
+public:
+    // The handle an event is routed by. Flush complete events are routed by the flushed sensor.
+    static int32_t getRoutingHandle(const sensors_event_t& event) {
+        return event.type == SENSOR_TYPE_META_DATA ? event.meta_data.sensor : event.sensor;
+    }
+
+    void clearSubscribers();
+
+    // Adds the next subscriber, registered for the sensors in handles. Subscribers are numbered
+    // from 0 in the order they are added. If alwaysRoute is set, for instance because the
+    // subscriber has flush complete events to send, it is routed to even without events.
+    void addSubscriber(const std::vector<int32_t>& handles, bool alwaysRoute);
+
+    // Sets targets to the subscribers, in increasing order, that events has to be sent to.
+    void route(const sensors_event_t* events, size_t count, std::vector<size_t>* targets);
+
+    // After route, getRunEnds()[i] is the index just past the run of consecutive events with the
+    // same routing handle as events[i], so a subscriber can skip the run with one lookup.
+    const std::vector<uint32_t>& getRunEnds() const { return mRunEnds; }
+
+private:
+    // Vectors are cleared rather than erased between polls, to keep their storage.
+    std::unordered_map<int32_t, std::vector<uint32_t>> mSubscribersByHandle;
+    std::vector<bool> mAlwaysRoute;
+    std::vector<bool> mRouted;
+    std::vector<uint32_t> mRunEnds;
+};
+
+} // namespace SensorServiceUtil
+} // namespace android
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_ROUTER_H
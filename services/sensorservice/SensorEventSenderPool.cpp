@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventSenderPool.h"
+
+#include <log/log.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace android {
+namespace SensorServiceUtil {
+
+SensorEventSenderPool::SensorEventSenderPool(size_t threadCount, size_t scratchSize,
+                                             int fifoPriority)
+      : mScratchSize(scratchSize), mFifoPriority(fifoPriority) {
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        mScratch.emplace_back(new sensors_event_t[mScratchSize]);
+    }
+    for (size_t i = 1; i < threadCount; i++) {
+        mThreads.emplace_back(&SensorEventSenderPool::threadMain, this, i);
+    }
+}
+
+SensorEventSenderPool::~SensorEventSenderPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkCondition.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void SensorEventSenderPool::run(size_t count, const SendFunction& send) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSend = &send;
+        mCount = count;
+        mNextIndex = 0;
+        mBusyThreads = mThreads.size();
+        mGeneration++;
+    }
+    mWorkCondition.notify_all();
+
+    sendAll(mScratch[0].get());
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [this] { return mBusyThreads == 0; });
+    mSend = nullptr;
+}
+
+void SensorEventSenderPool::sendAll(sensors_event_t* scratch) {
+    const SendFunction& send = *mSend;
+    for (size_t index = mNextIndex++; index < mCount; index = mNextIndex++) {
+        send(index, scratch);
+    }
+}
+
+void SensorEventSenderPool::threadMain(size_t sender) {
+    pthread_setname_np(pthread_self(), "SensorSender");
+    if (mFifoPriority != 0) {
+        struct sched_param param = {0};
+        param.sched_priority = mFifoPriority;
+        if (sched_setscheduler(0 /* current thread */, SCHED_FIFO | SCHED_RESET_ON_FORK,
+                               &param) != 0) {
+            ALOGE("Couldn't set SCHED_FIFO for sensor sender thread");
+        }
+    }
+
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWorkCondition.wait(lock, [&] { return mStopping || mGeneration != generation; });
+        if (mStopping) {
+            return;
+        }
+        generation = mGeneration;
+        lock.unlock();
+
+        sendAll(mScratch[sender].get());
+
+        lock.lock();
+        if (--mBusyThreads == 0) {
+            mDoneCondition.notify_one();
+        }
+    }
+}
+
+} // namespace SensorServiceUtil
+} // namespace android
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_SENDER_POOL_H
+#define ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_SENDER_POOL_H
+
+#include <hardware/sensors.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace SensorServiceUtil {
+
+// A fixed set of threads that send the events of one poll to several connections at once, so that
+// a slow or busy connection socket doesn't hold up the others.
+class SensorEventSenderPool {
+public:
+    using SendFunction = std::function<void(size_t index, sensors_event_t* scratch)>;
+
+    // Starts threadCount - 1 threads, the thread calling run is the last sender. Every sender has
+    // its own scratch buffer of scratchSize events. If fifoPriority is not 0, the threads run with
+    // SCHED_FIFO at that priority, like the thread polling the HAL.
+    SensorEventSenderPool(size_t threadCount, size_t scratchSize, int fifoPriority);
+    ~SensorEventSenderPool();
+
+    SensorEventSenderPool(const SensorEventSenderPool&) = delete;
+    SensorEventSenderPool& operator=(const SensorEventSenderPool&) = delete;
+
+    // Calls send for every index in [0, count), concurrently from all the senders, and returns once
+    // all the calls returned. Not reentrant.
+    void run(size_t count, const SendFunction& send);
+
+private:
+    void threadMain(size_t sender);
+    void sendAll(sensors_event_t* scratch);
+
+    const size_t mScratchSize;
+    const int mFifoPriority;
+    std::vector<std::unique_ptr<sensors_event_t[]>> mScratch;
+    std::vector<std::thread> mThreads;
+
+    std::mutex mMutex;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mDoneCondition;
+    // The following are protected by mMutex.
+    uint64_t mGeneration = 0;
+    size_t mBusyThreads = 0;
+    bool mStopping = false;
+    const SendFunction* mSend = nullptr;
+    size_t mCount = 0;
+
+    // The next index to send, claimed by the senders as they go.
+    std::atomic<size_t> mNextIndex{0};
+};
+
+} // namespace SensorServiceUtil
+} // namespace android
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_SENDER_POOL_H
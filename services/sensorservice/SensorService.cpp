@@ -277,6 +277,11 @@ void SensorService::onFirstRef() {
             mSensorEventBuffer = new sensors_event_t[minBufferSize];
             mSensorEventScratch = new sensors_event_t[minBufferSize];
             mMapFlushEventsToConnections = new wp<const SensorEventConnection> [minBufferSize];
+            const int senderThreads = property_get_int32("ro.sensorservice.sender_threads", 0);
+            if (senderThreads > 1) {
+                mSenderPool = std::make_unique<SensorServiceUtil::SensorEventSenderPool>(
+                        senderThreads, minBufferSize, SENSOR_SERVICE_SCHED_FIFO_PRIORITY);
+            }
             mCurrentOperatingMode = NORMAL;
 
             mNextSensorRegIndex = 0;
@@ -1007,12 +1012,36 @@ bool SensorService::threadLoop() {
             }
         }
 
-        // Send our events to clients. Check the state of wake lock for each client and release the
-        // lock if none of the clients need it.
+        // Only the connections registered for one of the sensors in the buffer, or with flush
+        // complete events to send, need to look at it.
+        mEventRouter.clearSubscribers();
+        std::vector<int32_t> handles;
+        for (const sp<SensorEventConnection>& connection : activeConnections) {
+            bool hasPendingFlushEvents;
+            handles.clear();
+            connection->getRoutingInfo(&handles, &hasPendingFlushEvents);
+            mEventRouter.addSubscriber(handles, hasPendingFlushEvents);
+        }
+        mEventRouter.route(mSensorEventBuffer, count, &mEventTargets);
+        const uint32_t* runEnds = mEventRouter.getRunEnds().data();
+
+        // Send our events to clients.
+        if (mSenderPool != nullptr && mEventTargets.size() > 1) {
+            mSenderPool->run(mEventTargets.size(), [&](size_t i, sensors_event_t* scratch) {
+                activeConnections[mEventTargets[i]]->sendEvents(mSensorEventBuffer, count, scratch,
+                        mMapFlushEventsToConnections, runEnds);
+            });
+        } else {
+            for (size_t target : mEventTargets) {
+                activeConnections[target]->sendEvents(mSensorEventBuffer, count,
+                        mSensorEventScratch, mMapFlushEventsToConnections, runEnds);
+            }
+        }
+
+        // Check the state of wake lock for each client and release the lock if none of the
+        // clients need it.
         bool needsWakeLock = false;
         for (const sp<SensorEventConnection>& connection : activeConnections) {
-            connection->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
-                    mMapFlushEventsToConnections);
             needsWakeLock |= connection->needsWakeLock();
             // If the connection has one-shot sensors, it may be cleaned up after first trigger.
             // Early check for one-shot sensors.
@@ -18,6 +18,8 @@
 #define ANDROID_SENSOR_SERVICE_H
 
 #include "SensorList.h"
+#include "SensorEventRouter.h"
+#include "SensorEventSenderPool.h"
 #include "RecentEventLogger.h"
 
 #include <android-base/macros.h>
@@ -41,6 +43,7 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -406,6 +409,11 @@ private:
     // WARNING: these SensorEventConnection instances must not be promoted to sp, except via
     // modification to add support for them in ConnectionSafeAutolock
     wp<const SensorEventConnection> * mMapFlushEventsToConnections;
+    // Used by threadLoop to only send each poll's events to the connections that need them.
+    SensorServiceUtil::SensorEventRouter mEventRouter;
+    std::vector<size_t> mEventTargets;
+    // Sends events to several connections in parallel, if ro.sensorservice.sender_threads > 1.
+    std::unique_ptr<SensorServiceUtil::SensorEventSenderPool> mSenderPool;
     std::unordered_map<int, SensorServiceUtil::RecentEventLogger*> mRecentEvent;
     Mode mCurrentOperatingMode;
 
@@ -386,6 +386,83 @@ typedef mat<float, 2, 2> mat22_t;
 typedef mat<float, 3, 3> mat33_t;
 typedef mat<float, 4, 4> mat44_t;
 
+// -----------------------------------------------------------------------
+// float specializations of the 3x3 and 4x4 products, which are the bulk of
+// the work done by Fusion::predict and Fusion::update. Each column of the
+// result is accumulated in a single 4-lane register, which maps to NEON or
+// SSE. The sums are formed in the same order as the generic versions, but may
+// differ from them in the last bits where the compiler fuses the multiply-adds.
+
+namespace helpers {
+
+typedef float float4_t __attribute__((vector_size(16)));
+
+inline float4_t load(const vec<float, 3>& v) {
+    return float4_t{ v[0], v[1], v[2], 0 };
+}
+
+inline float4_t load(const vec<float, 4>& v) {
+    return float4_t{ v[0], v[1], v[2], v[3] };
+}
+
+inline void store(vec<float, 3>& v, float4_t r) {
+    v[0] = r[0]; v[1] = r[1]; v[2] = r[2];
+}
+
+inline void store(vec<float, 4>& v, float4_t r) {
+    v[0] = r[0]; v[1] = r[1]; v[2] = r[2]; v[3] = r[3];
+}
+
+template <>
+inline mat33_t PURE doMul<float, 3, 3, 3>(
+        const mat33_t& lhs,
+        const mat33_t& rhs)
+{
+    const float4_t l0(load(lhs[0])), l1(load(lhs[1])), l2(load(lhs[2]));
+    mat33_t res;
+    for (size_t c=0 ; c<3 ; c++) {
+        store(res[c], l0*rhs[c][0] + l1*rhs[c][1] + l2*rhs[c][2]);
+    }
+    return res;
+}
+
+template <>
+inline mat44_t PURE doMul<float, 4, 4, 4>(
+        const mat44_t& lhs,
+        const mat44_t& rhs)
+{
+    const float4_t l0(load(lhs[0])), l1(load(lhs[1])),
+                   l2(load(lhs[2])), l3(load(lhs[3]));
+    mat44_t res;
+    for (size_t c=0 ; c<4 ; c++) {
+        store(res[c], l0*rhs[c][0] + l1*rhs[c][1] + l2*rhs[c][2] + l3*rhs[c][3]);
+    }
+    return res;
+}
+
+template <>
+inline vec<float, 3> PURE doMul<float, 3, 3>(
+        const mat33_t& lhs,
+        const vec<float, 3>& rhs)
+{
+    vec<float, 3> res;
+    store(res, load(lhs[0])*rhs[0] + load(lhs[1])*rhs[1] + load(lhs[2])*rhs[2]);
+    return res;
+}
+
+template <>
+inline vec<float, 4> PURE doMul<float, 4, 4>(
+        const mat44_t& lhs,
+        const vec<float, 4>& rhs)
+{
+    vec<float, 4> res;
+    store(res, load(lhs[0])*rhs[0] + load(lhs[1])*rhs[1] +
+               load(lhs[2])*rhs[2] + load(lhs[3])*rhs[3]);
+    return res;
+}
+
+}; // namespace helpers
+
 // -----------------------------------------------------------------------
 
 }; // namespace android
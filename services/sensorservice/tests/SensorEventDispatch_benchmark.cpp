@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how long the events of one HAL poll take to reach the subscribers' sockets, from the
+// poll returning to the last subscriber reading its events, as the number of subscribers grows.
+// The HAL is faked, and subscribers filter and write events the way SensorEventConnection does,
+// serially or with a SensorEventSenderPool.
+
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <sensor/BitTube.h>
+#include <sensor/SensorEventQueue.h>
+#include <utils/Timers.h>
+
+#include "../SensorEventRouter.h"
+#include "../SensorEventSenderPool.h"
+
+namespace android {
+namespace {
+
+using SensorServiceUtil::SensorEventRouter;
+using SensorServiceUtil::SensorEventSenderPool;
+
+constexpr int32_t kSensorCount = 8;
+constexpr size_t kEventsPerSensor = 8;
+constexpr size_t kBufferSize = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
+constexpr size_t kSocketBufferSize = 100 * 1024;
+
+// Returns one batch of events from every sensor, interleaved, time stamped with the poll time.
+size_t fakeHalPoll(sensors_event_t* buffer) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t count = 0;
+    for (size_t i = 0; i < kEventsPerSensor; i++) {
+        for (int32_t handle = 1; handle <= kSensorCount; handle++) {
+            sensors_event_t& event = buffer[count++];
+            memset(&event, 0, sizeof(event));
+            event.version = sizeof(event);
+            event.sensor = handle;
+            event.type = SENSOR_TYPE_ACCELEROMETER;
+            event.timestamp = now;
+        }
+    }
+    return count;
+}
+
+class Subscriber {
+public:
+    explicit Subscriber(int32_t firstHandle)
+          : mHandles{firstHandle, firstHandle % kSensorCount + 1},
+            mChannel(new BitTube(kSocketBufferSize)),
+            mReader(&Subscriber::readerMain, this) {}
+
+    ~Subscriber() {
+        mStopping = true;
+        mReader.join();
+    }
+
+    const std::vector<int32_t>& getHandles() const { return mHandles; }
+
+    // Filters and writes the events like SensorEventConnection::sendEvents.
+    void sendEvents(const sensors_event_t* buffer, size_t count, sensors_event_t* scratch,
+                    const uint32_t* runEnds) {
+        size_t scratchCount = 0;
+        for (size_t i = 0; i < count;) {
+            const int32_t handle = SensorEventRouter::getRoutingHandle(buffer[i]);
+            if (std::find(mHandles.begin(), mHandles.end(), handle) == mHandles.end()) {
+                i = runEnds[i];
+                continue;
+            }
+            for (const size_t end = runEnds[i]; i < end; i++) {
+                scratch[scratchCount++] = buffer[i];
+            }
+        }
+        mExpected += scratchCount;
+        while (SensorEventQueue::write(mChannel, reinterpret_cast<ASensorEvent*>(scratch),
+                                       scratchCount) < 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    bool receivedAll() const { return mReceived.load() == mExpected.load(); }
+
+    nsecs_t takeMaxLatency() { return mMaxLatency.exchange(0); }
+
+private:
+    void readerMain() {
+        std::vector<ASensorEvent> events(kBufferSize);
+        struct pollfd fd = {.fd = mChannel->getFd(), .events = POLLIN};
+        while (!mStopping) {
+            if (poll(&fd, 1, 10) <= 0) {
+                continue;
+            }
+            ssize_t count = BitTube::recvObjects(mChannel, events.data(), events.size());
+            const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (ssize_t i = 0; i < count; i++) {
+                const nsecs_t latency = now - events[i].timestamp;
+                nsecs_t max = mMaxLatency.load();
+                while (latency > max && !mMaxLatency.compare_exchange_weak(max, latency)) {
+                }
+            }
+            if (count > 0) {
+                mReceived += count;
+            }
+        }
+    }
+
+    const std::vector<int32_t> mHandles;
+    const sp<BitTube> mChannel;
+    std::atomic<bool> mStopping{false};
+    std::atomic<size_t> mExpected{0};
+    std::atomic<size_t> mReceived{0};
+    std::atomic<nsecs_t> mMaxLatency{0};
+    std::thread mReader;
+};
+
+// Args: subscriber count, sender thread count (1 sends serially from the polling thread).
+void BM_DeliverPoll(benchmark::State& state) {
+    const size_t subscriberCount = state.range(0);
+    const size_t senderThreads = state.range(1);
+
+    std::vector<std::unique_ptr<Subscriber>> subscribers;
+    for (size_t i = 0; i < subscriberCount; i++) {
+        subscribers.push_back(std::make_unique<Subscriber>(i % kSensorCount + 1));
+    }
+    std::unique_ptr<SensorEventSenderPool> pool;
+    if (senderThreads > 1) {
+        pool = std::make_unique<SensorEventSenderPool>(senderThreads, kBufferSize, 0);
+    }
+    std::vector<sensors_event_t> buffer(kBufferSize);
+    std::vector<sensors_event_t> scratch(kBufferSize);
+    SensorEventRouter router;
+    std::vector<size_t> targets;
+
+    nsecs_t totalLatency = 0;
+    for (auto _ : state) {
+        const size_t count = fakeHalPoll(buffer.data());
+
+        router.clearSubscribers();
+        for (const auto& subscriber : subscribers) {
+            router.addSubscriber(subscriber->getHandles(), false);
+        }
+        router.route(buffer.data(), count, &targets);
+        const uint32_t* runEnds = router.getRunEnds().data();
+
+        if (pool) {
+            pool->run(targets.size(), [&](size_t i, sensors_event_t* senderScratch) {
+                subscribers[targets[i]]->sendEvents(buffer.data(), count, senderScratch, runEnds);
+            });
+        } else {
+            for (size_t target : targets) {
+                subscribers[target]->sendEvents(buffer.data(), count, scratch.data(), runEnds);
+            }
+        }
+
+        for (const auto& subscriber : subscribers) {
+            while (!subscriber->receivedAll()) {
+                std::this_thread::yield();
+            }
+        }
+        nsecs_t maxLatency = 0;
+        for (const auto& subscriber : subscribers) {
+            maxLatency = std::max(maxLatency, subscriber->takeMaxLatency());
+        }
+        totalLatency += maxLatency;
+    }
+    state.counters["delivery_us"] = benchmark::Counter(
+            ns2us(totalLatency) / static_cast<double>(state.iterations()));
+}
+
+void subscribersAndThreads(benchmark::internal::Benchmark* b) {
+    for (int senderThreads : {1, 2, 4}) {
+        for (int subscribers : {1, 4, 16, 64}) {
+            b->Args({subscribers, senderThreads});
+        }
+    }
+}
+
+BENCHMARK(BM_DeliverPoll)->Apply(subscribersAndThreads)->UseRealTime();
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
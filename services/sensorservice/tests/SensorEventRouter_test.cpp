@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../SensorEventRouter.h"
+#include "../SensorEventSenderPool.h"
+
+namespace android {
+namespace {
+
+using SensorServiceUtil::SensorEventRouter;
+using SensorServiceUtil::SensorEventSenderPool;
+
+constexpr size_t kScratchSize = 256;
+
+sensors_event_t makeEvent(int32_t handle, int64_t timestamp) {
+    sensors_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(event);
+    event.sensor = handle;
+    event.type = SENSOR_TYPE_ACCELEROMETER;
+    event.timestamp = timestamp;
+    return event;
+}
+
+sensors_event_t makeFlushCompleteEvent(int32_t handle) {
+    sensors_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.version = META_DATA_VERSION;
+    event.type = SENSOR_TYPE_META_DATA;
+    event.meta_data.what = META_DATA_FLUSH_COMPLETE;
+    event.meta_data.sensor = handle;
+    return event;
+}
+
+// Stands in for a SensorEventConnection: keeps the events of its sensors, filtered the way
+// SensorEventConnection::sendEvents does.
+class FakeConnection {
+public:
+    explicit FakeConnection(std::vector<int32_t> handles) : mHandles(std::move(handles)) {}
+
+    const std::vector<int32_t>& getHandles() const { return mHandles; }
+
+    void sendEvents(const sensors_event_t* buffer, size_t count, sensors_event_t* scratch,
+                    const uint32_t* runEnds) {
+        size_t scratchCount = 0;
+        for (size_t i = 0; i < count;) {
+            const int32_t handle = SensorEventRouter::getRoutingHandle(buffer[i]);
+            if (std::find(mHandles.begin(), mHandles.end(), handle) == mHandles.end()) {
+                i = runEnds[i];
+                continue;
+            }
+            for (const size_t end = runEnds[i]; i < end; i++) {
+                scratch[scratchCount++] = buffer[i];
+            }
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReceived.insert(mReceived.end(), scratch, scratch + scratchCount);
+    }
+
+    std::vector<sensors_event_t> getReceived() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mReceived;
+    }
+
+private:
+    const std::vector<int32_t> mHandles;
+    mutable std::mutex mMutex;
+    std::vector<sensors_event_t> mReceived;
+};
+
+using Connections = std::vector<std::shared_ptr<FakeConnection>>;
+
+// The events of buffer that connection has to get, in order.
+std::vector<sensors_event_t> filterEvents(const std::vector<sensors_event_t>& buffer,
+                                          const FakeConnection& connection) {
+    std::vector<sensors_event_t> events;
+    for (const sensors_event_t& event : buffer) {
+        const auto& handles = connection.getHandles();
+        if (std::find(handles.begin(), handles.end(), SensorEventRouter::getRoutingHandle(event)) !=
+            handles.end()) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+void expectSameEvents(const std::vector<sensors_event_t>& expected,
+                      const std::vector<sensors_event_t>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(0, memcmp(&expected[i], &actual[i], sizeof(sensors_event_t))) << "event " << i;
+    }
+}
+
+class SensorEventRouterTest : public ::testing::Test {
+protected:
+    std::vector<size_t> route(const Connections& connections,
+                              const std::vector<sensors_event_t>& events,
+                              const std::vector<bool>& alwaysRoute = {}) {
+        mRouter.clearSubscribers();
+        for (size_t i = 0; i < connections.size(); i++) {
+            mRouter.addSubscriber(connections[i]->getHandles(),
+                                  i < alwaysRoute.size() && alwaysRoute[i]);
+        }
+        std::vector<size_t> targets;
+        mRouter.route(events.data(), events.size(), &targets);
+        return targets;
+    }
+
+    SensorEventRouter mRouter;
+};
+
+TEST_F(SensorEventRouterTest, RoutesOnlyToConnectionsOfSensorsWithEvents) {
+    Connections connections = {
+            std::make_shared<FakeConnection>(std::vector<int32_t>{1}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{2}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{3}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{1, 3}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{}),
+    };
+    std::vector<sensors_event_t> events = {makeEvent(1, 1), makeEvent(1, 2), makeEvent(2, 3),
+                                           makeEvent(1, 4)};
+
+    EXPECT_EQ((std::vector<size_t>{0, 1, 3}), route(connections, events));
+    EXPECT_EQ((std::vector<uint32_t>{2, 2, 3, 4}), mRouter.getRunEnds());
+}
+
+TEST_F(SensorEventRouterTest, RoutesFlushCompleteEventsByFlushedSensor) {
+    Connections connections = {
+            std::make_shared<FakeConnection>(std::vector<int32_t>{1}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{2}),
+    };
+    EXPECT_EQ((std::vector<size_t>{1}), route(connections, {makeFlushCompleteEvent(2)}));
+}
+
+TEST_F(SensorEventRouterTest, AlwaysRoutesConnectionsWithPendingFlushEvents) {
+    Connections connections = {
+            std::make_shared<FakeConnection>(std::vector<int32_t>{1}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{2}),
+    };
+    EXPECT_EQ((std::vector<size_t>{1}), route(connections, {}, {false, true}));
+    EXPECT_EQ((std::vector<size_t>{0, 1}), route(connections, {makeEvent(1, 1)}, {false, true}));
+}
+
+TEST_F(SensorEventRouterTest, ForgetsSubscribersOfPreviousPoll) {
+    Connections connections = {
+            std::make_shared<FakeConnection>(std::vector<int32_t>{1}),
+            std::make_shared<FakeConnection>(std::vector<int32_t>{2}),
+    };
+    std::vector<sensors_event_t> events = {makeEvent(1, 1), makeEvent(2, 2)};
+    EXPECT_EQ((std::vector<size_t>{0, 1}), route(connections, events));
+
+    // The first connection went away, so the other one is now subscriber 0.
+    connections.erase(connections.begin());
+    EXPECT_EQ((std::vector<size_t>{0}), route(connections, events));
+}
+
+// Drives the router and a sender pool the way SensorService::threadLoop does, against a set of
+// connections that can change between and during polls.
+class SensorEventDispatchTest : public ::testing::Test {
+protected:
+    static constexpr int32_t kSensorCount = 4;
+
+    SensorEventDispatchTest() : mPool(3, kScratchSize, 0) {}
+
+    void addConnection(std::vector<int32_t> handles) {
+        std::lock_guard<std::mutex> lock(mConnectionsLock);
+        mConnections.push_back(std::make_shared<FakeConnection>(std::move(handles)));
+    }
+
+    void removeConnection(const std::shared_ptr<FakeConnection>& connection) {
+        std::lock_guard<std::mutex> lock(mConnectionsLock);
+        mConnections.erase(std::find(mConnections.begin(), mConnections.end(), connection));
+    }
+
+    Connections getActiveConnections() {
+        std::lock_guard<std::mutex> lock(mConnectionsLock);
+        return mConnections;
+    }
+
+    // Interleaved events of every sensor, several in a row for each.
+    std::vector<sensors_event_t> poll() {
+        std::vector<sensors_event_t> events;
+        for (int i = 0; i < 4; i++) {
+            for (int32_t handle = 1; handle <= kSensorCount; handle++) {
+                for (int j = 0; j < 3; j++) {
+                    events.push_back(makeEvent(handle, mNextTimestamp++));
+                }
+            }
+        }
+        return events;
+    }
+
+    // onSend is called on the sender thread before each connection gets the events.
+    void dispatch(const std::vector<sensors_event_t>& events,
+                  const std::function<void(size_t target)>& onSend = nullptr) {
+        // The snapshot keeps every connection in it alive until the events have been sent, even
+        // if it is removed meanwhile.
+        const Connections activeConnections = getActiveConnections();
+        mRouter.clearSubscribers();
+        for (const auto& connection : activeConnections) {
+            mRouter.addSubscriber(connection->getHandles(), false);
+        }
+        std::vector<size_t> targets;
+        mRouter.route(events.data(), events.size(), &targets);
+        const uint32_t* runEnds = mRouter.getRunEnds().data();
+
+        mPool.run(targets.size(), [&](size_t i, sensors_event_t* scratch) {
+            if (onSend) {
+                onSend(targets[i]);
+            }
+            activeConnections[targets[i]]->sendEvents(events.data(), events.size(), scratch,
+                                                      runEnds);
+        });
+    }
+
+    std::mutex mConnectionsLock;
+    Connections mConnections;
+    SensorEventRouter mRouter;
+    SensorEventSenderPool mPool;
+    int64_t mNextTimestamp = 1;
+};
+
+TEST_F(SensorEventDispatchTest, FansOutEachEventToEveryConnectionOfItsSensor) {
+    for (int32_t i = 0; i < 16; i++) {
+        addConnection({i % kSensorCount + 1, (i + 1) % kSensorCount + 1});
+    }
+    addConnection({kSensorCount + 1});
+
+    std::vector<sensors_event_t> sent;
+    for (int i = 0; i < 10; i++) {
+        std::vector<sensors_event_t> events = poll();
+        dispatch(events);
+        sent.insert(sent.end(), events.begin(), events.end());
+    }
+
+    for (const auto& connection : getActiveConnections()) {
+        expectSameEvents(filterEvents(sent, *connection), connection->getReceived());
+    }
+    EXPECT_TRUE(getActiveConnections().back()->getReceived().empty());
+}
+
+TEST_F(SensorEventDispatchTest, RemovingConnectionWhileEventsAreInFlight) {
+    for (int32_t i = 0; i < 8; i++) {
+        addConnection({i % kSensorCount + 1});
+    }
+    const Connections connections = getActiveConnections();
+
+    // The connection goes away while the events of the poll are being sent. It still gets them,
+    // since the poll holds on to it.
+    std::vector<sensors_event_t> first = poll();
+    std::atomic<bool> removedDuringSend = false;
+    dispatch(first, [&](size_t target) {
+        if (target == 0) {
+            removeConnection(connections[5]);
+            removedDuringSend = true;
+        }
+    });
+    ASSERT_TRUE(removedDuringSend);
+    expectSameEvents(filterEvents(first, *connections[5]), connections[5]->getReceived());
+
+    // The next poll routes around it, and the connections after it still get their own events.
+    std::vector<sensors_event_t> second = poll();
+    dispatch(second);
+    std::vector<sensors_event_t> sent = first;
+    sent.insert(sent.end(), second.begin(), second.end());
+    for (size_t i = 0; i < connections.size(); i++) {
+        if (i == 5) {
+            expectSameEvents(filterEvents(first, *connections[i]), connections[i]->getReceived());
+        } else {
+            expectSameEvents(filterEvents(sent, *connections[i]), connections[i]->getReceived());
+        }
+    }
+}
+
+TEST_F(SensorEventDispatchTest, RemovingConnectionsConcurrentlyWithPolls) {
+    for (int32_t i = 0; i < 12; i++) {
+        addConnection({i % kSensorCount + 1});
+    }
+    const Connections connections = getActiveConnections();
+
+    // Remove every other connection from another thread, as binder threads do when clients go
+    // away, while events keep being dispatched.
+    std::atomic<bool> done = false;
+    std::thread remover([&] {
+        for (size_t i = 0; i < connections.size(); i += 2) {
+            removeConnection(connections[i]);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        done = true;
+    });
+
+    std::vector<sensors_event_t> sent;
+    while (!done) {
+        std::vector<sensors_event_t> events = poll();
+        dispatch(events);
+        sent.insert(sent.end(), events.begin(), events.end());
+    }
+    remover.join();
+    std::vector<sensors_event_t> last = poll();
+    dispatch(last);
+    sent.insert(sent.end(), last.begin(), last.end());
+
+    for (size_t i = 0; i < connections.size(); i++) {
+        std::vector<sensors_event_t> expected = filterEvents(sent, *connections[i]);
+        std::vector<sensors_event_t> received = connections[i]->getReceived();
+        if (i % 2 == 1) {
+            expectSameEvents(expected, received);
+        } else {
+            // A removed connection got the events of every poll up to its removal, and none after.
+            ASSERT_LT(received.size(), expected.size());
+            expected.resize(received.size());
+            expectSameEvents(expected, received);
+        }
+    }
+}
+
+} // namespace
+} // namespace android
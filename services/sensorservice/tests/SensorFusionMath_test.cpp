@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <float.h>
+#include <math.h>
+
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "../mat.h"
+#include "../vec.h"
+
+namespace android {
+namespace {
+
+// The float products may be contracted into fused multiply-adds, which the
+// generic loops are not guaranteed to be, so results are checked against a
+// product in double with a bound on the rounding error of a sum of N terms
+// rather than for an exact match.
+constexpr int kIterations = 1000;
+
+class SensorFusionMathTest : public testing::Test {
+  protected:
+    template <size_t C, size_t R>
+    mat<float, C, R> randomMat() {
+        mat<float, C, R> m;
+        for (size_t c = 0; c < C; c++) {
+            for (size_t r = 0; r < R; r++) {
+                m[c][r] = mDist(mRng);
+            }
+        }
+        return m;
+    }
+
+    template <size_t N>
+    vec<float, N> randomVec() {
+        vec<float, N> v;
+        for (size_t i = 0; i < N; i++) {
+            v[i] = mDist(mRng);
+        }
+        return v;
+    }
+
+    // Checks that actual is lhs*rhs to within the rounding error of float.
+    template <size_t N, size_t C>
+    static void expectProduct(const mat<float, N, N>& lhs, const mat<float, C, N>& rhs,
+            const mat<float, C, N>& actual) {
+        for (size_t c = 0; c < C; c++) {
+            for (size_t r = 0; r < N; r++) {
+                double expected = 0;
+                double magnitude = 0;
+                for (size_t k = 0; k < N; k++) {
+                    expected += double(lhs[k][r]) * double(rhs[c][k]);
+                    magnitude += fabs(double(lhs[k][r]) * double(rhs[c][k]));
+                }
+                EXPECT_NEAR(expected, actual[c][r], N * FLT_EPSILON * magnitude)
+                        << "column " << c << " row " << r;
+            }
+        }
+    }
+
+    std::mt19937 mRng{42};
+    std::uniform_real_distribution<float> mDist{-2.0f, 2.0f};
+};
+
+TEST_F(SensorFusionMathTest, mat33TimesMat33) {
+    for (int i = 0; i < kIterations; i++) {
+        const mat33_t lhs(randomMat<3, 3>()), rhs(randomMat<3, 3>());
+        expectProduct<3, 3>(lhs, rhs, lhs * rhs);
+    }
+}
+
+TEST_F(SensorFusionMathTest, mat44TimesMat44) {
+    for (int i = 0; i < kIterations; i++) {
+        const mat44_t lhs(randomMat<4, 4>()), rhs(randomMat<4, 4>());
+        expectProduct<4, 4>(lhs, rhs, lhs * rhs);
+    }
+}
+
+TEST_F(SensorFusionMathTest, mat33TimesVec3) {
+    for (int i = 0; i < kIterations; i++) {
+        const mat33_t lhs(randomMat<3, 3>());
+        const vec3_t v(randomVec<3>());
+        // As the first column of a matrix whose other columns are zero
+        mat<float, 3, 3> rhs(0.0f), actual(0.0f);
+        rhs[0] = v;
+        actual[0] = lhs * v;
+        expectProduct<3, 3>(lhs, rhs, actual);
+    }
+}
+
+TEST_F(SensorFusionMathTest, mat44TimesVec4) {
+    for (int i = 0; i < kIterations; i++) {
+        const mat44_t lhs(randomMat<4, 4>());
+        const vec4_t v(randomVec<4>());
+        // As the first column of a matrix whose other columns are zero
+        mat<float, 4, 4> rhs(0.0f), actual(0.0f);
+        rhs[0] = v;
+        actual[0] = lhs * v;
+        expectProduct<4, 4>(lhs, rhs, actual);
+    }
+}
+
+// Fusion's covariance is a 2x2 matrix of 3x3 blocks, whose product is made of
+// the mat33 products above.
+TEST_F(SensorFusionMathTest, blockMatTimesBlockMat) {
+    for (int i = 0; i < kIterations; i++) {
+        mat<mat33_t, 2, 2> lhs, rhs;
+        for (size_t c = 0; c < 2; c++) {
+            for (size_t r = 0; r < 2; r++) {
+                lhs[c][r] = randomMat<3, 3>();
+                rhs[c][r] = randomMat<3, 3>();
+            }
+        }
+        const mat<mat33_t, 2, 2> product = lhs * rhs;
+
+        // The same product as a flat 6x6 matrix
+        mat<float, 6, 6> flatLhs, flatRhs, flatProduct;
+        for (size_t c = 0; c < 6; c++) {
+            for (size_t r = 0; r < 6; r++) {
+                flatLhs[c][r] = lhs[c / 3][r / 3][c % 3][r % 3];
+                flatRhs[c][r] = rhs[c / 3][r / 3][c % 3][r % 3];
+                flatProduct[c][r] = product[c / 3][r / 3][c % 3][r % 3];
+            }
+        }
+        expectProduct<6, 6>(flatLhs, flatRhs, flatProduct);
+    }
+}
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a sensor recording through Fusion, the way SensorFusion::process feeds it, and reports
+// the cost per fused sample for each fusion mode.
+//
+// The recording is read from the file named by $SENSOR_FUSION_RECORDING, with one sample per line:
+//     <type> <timestamp ns> <x> <y> <z>
+// where type is the SENSOR_TYPE_* of a gyroscope, accelerometer or magnetometer. Without it, a
+// deterministic synthetic recording of a slowly tumbling device is generated.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hardware/sensors.h>
+
+#include "../Fusion.h"
+
+namespace android {
+namespace {
+
+struct Sample {
+    int type;
+    int64_t timestamp;
+    vec3_t value;
+};
+
+constexpr int64_t kDurationNs = 60'000'000'000;
+constexpr int64_t kGyroPeriodNs = 2'500'000;  // 400 Hz
+constexpr int64_t kAccPeriodNs = 5'000'000;   // 200 Hz
+constexpr int64_t kMagPeriodNs = 20'000'000;  // 50 Hz
+
+// Deterministic on every platform, unlike the <random> distributions.
+class Noise {
+public:
+    float next(float amplitude) {
+        mState = mState * 6364136223846793005ull + 1442695040888963407ull;
+        return amplitude * (static_cast<float>(mState >> 40) / (1 << 24) * 2 - 1);
+    }
+    vec3_t next3(float amplitude) {
+        vec3_t v;
+        v.x = next(amplitude);
+        v.y = next(amplitude);
+        v.z = next(amplitude);
+        return v;
+    }
+
+private:
+    uint64_t mState = 1;
+};
+
+std::vector<Sample> generateRecording() {
+    std::vector<Sample> samples;
+    Noise noise;
+    vec3_t gravity, field, bias;
+    gravity.x = 0; gravity.y = 0; gravity.z = 9.81f;
+    field.x = 0; field.y = 22; field.z = -40;
+    bias.x = 0.01f; bias.y = -0.005f; bias.z = 0.002f;
+
+    quat_t q;
+    q.x = 0; q.y = 0; q.z = 0; q.w = 1;
+    for (int64_t t = 0; t < kDurationNs; t += kGyroPeriodNs) {
+        const float s = t / 1e9f;
+        vec3_t w;
+        w.x = 0.3f * sinf(0.5f * s);
+        w.y = 0.2f * cosf(0.3f * s);
+        w.z = 0.1f;
+        samples.push_back({SENSOR_TYPE_GYROSCOPE, t, w + bias + noise.next3(0.002f)});
+
+        // q += 0.5 * q * (0, w) * dT
+        const float dT = kGyroPeriodNs / 1e9f;
+        quat_t dq;
+        dq.w = -q.x * w.x - q.y * w.y - q.z * w.z;
+        dq.x = q.w * w.x + q.y * w.z - q.z * w.y;
+        dq.y = q.w * w.y - q.x * w.z + q.z * w.x;
+        dq.z = q.w * w.z + q.x * w.y - q.y * w.x;
+        q = normalize(q + dq * (0.5f * dT));
+
+        const mat33_t worldToDevice(transpose(quatToMatrix(q)));
+        if (t % kAccPeriodNs == 0) {
+            samples.push_back({SENSOR_TYPE_ACCELEROMETER, t,
+                               worldToDevice * gravity + noise.next3(0.05f)});
+        }
+        if (t % kMagPeriodNs == 0) {
+            samples.push_back({SENSOR_TYPE_MAGNETIC_FIELD, t,
+                               worldToDevice * field + noise.next3(0.5f)});
+        }
+    }
+    return samples;
+}
+
+std::vector<Sample> readRecording(const char* path) {
+    std::vector<Sample> samples;
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        return samples;
+    }
+    Sample sample;
+    long long timestamp;
+    while (fscanf(file, "%d %lld %f %f %f", &sample.type, &timestamp, &sample.value.x,
+                  &sample.value.y, &sample.value.z) == 5) {
+        sample.timestamp = timestamp;
+        samples.push_back(sample);
+    }
+    fclose(file);
+    return samples;
+}
+
+const std::vector<Sample>& getRecording() {
+    static const std::vector<Sample> samples = [] {
+        const char* path = getenv("SENSOR_FUSION_RECORDING");
+        std::vector<Sample> recording;
+        if (path != nullptr) {
+            recording = readRecording(path);
+            if (recording.empty()) {
+                fprintf(stderr, "Unable to read %s, using a synthetic recording\n", path);
+            }
+        }
+        return recording.empty() ? generateRecording() : recording;
+    }();
+    return samples;
+}
+
+// Same as SensorFusion::process, for a single fusion.
+class Replayer {
+public:
+    explicit Replayer(int mode) { mFusion.init(mode); }
+
+    void process(const Sample& sample) {
+        if (sample.type == SENSOR_TYPE_GYROSCOPE) {
+            const int64_t dT = sample.timestamp - mGyroTime;
+            if (dT > 0 && dT < 50'000'000) {
+                mFusion.handleGyro(sample.value, dT / 1e9f);
+            }
+            mGyroTime = sample.timestamp;
+        } else if (sample.type == SENSOR_TYPE_MAGNETIC_FIELD) {
+            mFusion.handleMag(sample.value);
+        } else if (sample.type == SENSOR_TYPE_ACCELEROMETER) {
+            const int64_t dT = sample.timestamp - mAccTime;
+            if (dT > 0 && dT < 100'000'000) {
+                mFusion.handleAcc(sample.value, dT / 1e9f);
+            }
+            mAccTime = sample.timestamp;
+        }
+    }
+
+    // Restarts the timestamps, when the recording loops.
+    void rewind() {
+        mGyroTime = 0;
+        mAccTime = 0;
+    }
+
+    vec4_t getAttitude() const { return mFusion.getAttitude(); }
+
+private:
+    Fusion mFusion;
+    int64_t mGyroTime = 0;
+    int64_t mAccTime = 0;
+};
+
+void BM_Replay(benchmark::State& state) {
+    const std::vector<Sample>& samples = getRecording();
+    Replayer replayer(state.range(0));
+    size_t i = 0;
+    for (auto _ : state) {
+        replayer.process(samples[i]);
+        if (++i == samples.size()) {
+            i = 0;
+            replayer.rewind();
+        }
+    }
+    benchmark::DoNotOptimize(replayer.getAttitude());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Replay)->Arg(FUSION_9AXIS)->Arg(FUSION_NOMAG)->Arg(FUSION_NOGYRO);
+
+// The whole recording at once, which also checks that the result is reproducible: the final
+// attitude is reported as counters so that runs and implementations can be compared.
+void BM_ReplayAll(benchmark::State& state) {
+    const std::vector<Sample>& samples = getRecording();
+    vec4_t attitude;
+    for (auto _ : state) {
+        Replayer replayer(state.range(0));
+        for (const Sample& sample : samples) {
+            replayer.process(sample);
+        }
+        attitude = replayer.getAttitude();
+    }
+    state.SetItemsProcessed(state.iterations() * samples.size());
+    state.counters["qx"] = attitude.x;
+    state.counters["qy"] = attitude.y;
+    state.counters["qz"] = attitude.z;
+    state.counters["qw"] = attitude.w;
+}
+BENCHMARK(BM_ReplayAll)->Arg(FUSION_9AXIS)->Arg(FUSION_NOMAG)->Arg(FUSION_NOGYRO)
+        ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -70,6 +70,14 @@ struct CompositionRefreshArgs {
     // If true, there was a geometry update this frame
     bool updatingGeometryThisFrame{false};
 
+    // If true, outputs only recompute the visible regions of the layers at or
+    // below the topmost layer whose geometry changed since the last update.
+    bool useIncrementalVisibleRegions{false};
+
+    // If true, the outputs are presented concurrently on a worker pool. Calls into HWC stay
+    // serialized, but GPU composition for one output overlaps with HWC work for another.
+    bool presentOutputsInParallel{false};
+
     // The color matrix to use for this
     // frame. Only set if the color transform is changing this frame.
     std::optional<mat4> colorTransformMatrix;
@@ -118,6 +118,10 @@ struct LayerFECompositionState {
     // length of the shadow in screen space
     float shadowRadius;
 
+    // Incremented by the front-end whenever any of the visibility state above changes, so that
+    // outputs can tell when the coverage they computed for this layer is still valid.
+    uint64_t geometryGeneration{0};
+
     /*
      * Geometry state
      */
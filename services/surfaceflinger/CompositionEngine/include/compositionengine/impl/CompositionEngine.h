@@ -17,6 +17,11 @@
 #pragma once
 
 #include <compositionengine/CompositionEngine.h>
+#include <compositionengine/impl/ParallelOutputPresenter.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace android::compositionengine::impl {
 
@@ -57,11 +62,30 @@ public:
     void setNeedsAnotherUpdateForTest(bool);
 
 private:
+    // The time taken by the last present of an output. In parallel mode this includes the time
+    // spent waiting for HWC and RenderEngine.
+    struct OutputPresentTime {
+        std::string name;
+        nsecs_t duration;
+    };
+
+    static constexpr size_t kMaxParallelPresentThreads = 3;
+
+    void presentOutputs(CompositionRefreshArgs&);
+
     std::unique_ptr<HWComposer> mHwComposer;
     std::unique_ptr<renderengine::RenderEngine> mRenderEngine;
     std::shared_ptr<TimeStats> mTimeStats;
     bool mNeedsAnotherUpdate = false;
     nsecs_t mRefreshStartTime = 0;
+
+    std::unique_ptr<ParallelOutputPresenter> mParallelOutputPresenter;
+
+    // Written by the presenting threads and read by dump(), so guarded by mPresentTimesMutex.
+    mutable std::mutex mPresentTimesMutex;
+    std::vector<OutputPresentTime> mOutputPresentTimes;
+    nsecs_t mAllOutputsPresentTime = 0;
+    bool mLastPresentWasParallel = false;
 };
 
 std::unique_ptr<compositionengine::CompositionEngine> createCompositionEngine();
@@ -116,6 +116,27 @@ protected:
     virtual void dumpState(std::string& out) const = 0;
 
 private:
+    // The coverage state after a layer was processed by collectVisibleLayers,
+    // used to skip the unchanged layers at the top of the stack on the next
+    // geometry update.
+    struct VisibleRegionCacheEntry {
+        wp<compositionengine::LayerFE> layerFE;
+        uint64_t geometryGeneration{0};
+        Region aboveCoveredLayers;
+        Region aboveOpaqueLayers;
+    };
+
+    // The output state that the visible region cache was computed with.
+    struct VisibleRegionCacheKey {
+        uint32_t layerStackId{~0u};
+        bool layerStackInternal{false};
+        Rect bounds;
+        Rect viewport;
+        ui::Transform transform;
+    };
+
+    size_t reuseUnchangedVisibleLayers(const compositionengine::CompositionRefreshArgs&,
+                                       compositionengine::Output::CoverageState&);
     void dirtyEntireOutput();
     compositionengine::OutputLayer* findLayerRequestingBackgroundComposition() const;
     ui::Dataspace getBestDataspace(ui::Dataspace*, bool*) const;
@@ -130,6 +151,10 @@ private:
     ReleasedLayers mReleasedLayers;
     OutputLayer* mLayerRequestingBackgroundBlur = nullptr;
     std::unique_ptr<ClientCompositionRequestCache> mClientCompositionRequestCache;
+
+    // Visible region cache, in front to back order
+    std::vector<VisibleRegionCacheEntry> mVisibleRegionCache;
+    VisibleRegionCacheKey mVisibleRegionCacheKey;
 };
 
 // This template factory function standardizes the implementation details of the
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android::compositionengine {
+
+class Output;
+
+namespace impl {
+
+// Runs Output::present for several outputs concurrently on a small pool of worker threads.
+//
+// Neither the HWC command stream, the RenderEngine context nor the front-end layers can be used
+// from several threads at once, so the workers are not fully independent:
+//
+//  - Each worker holds the frame's HWC lock while it runs an output's present, so the calls an
+//    output makes into HWComposer and the rest of the back-end stay serialized.
+//  - GPU composition and LayerFE callbacks are handed to the thread that called present(), which
+//    owns the RenderEngine context and the layers, through a serialized submission queue. A
+//    layer shown on several outputs is therefore only ever called back from that one thread.
+//    The worker drops the HWC lock while its work is pending, so another output can validate and
+//    present while one is rendering.
+//
+// Code that needs the RenderEngine context or calls into a LayerFE calls runOnMainThread().
+// Outside of a parallel present it simply runs the work inline.
+class ParallelOutputPresenter {
+public:
+    using OutputPresenter = std::function<void(const std::shared_ptr<Output>&)>;
+
+    explicit ParallelOutputPresenter(size_t threadCount);
+    ~ParallelOutputPresenter();
+
+    ParallelOutputPresenter(const ParallelOutputPresenter&) = delete;
+    ParallelOutputPresenter& operator=(const ParallelOutputPresenter&) = delete;
+
+    // Calls presentOutput for each output, and returns once all of them have completed. The
+    // calling thread services the main thread submission queue until then.
+    void present(const std::vector<std::shared_ptr<Output>>& outputs,
+                 const OutputPresenter& presentOutput);
+
+    // Runs work on the thread that called present(), blocking until it completes.
+    static void runOnMainThread(const std::function<void()>& work);
+
+    size_t getThreadCount() const { return mThreads.size(); }
+
+    // The per-frame state shared between the workers and the main thread.
+    struct Frame;
+
+private:
+    void threadMain();
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<std::function<void()>> mJobs;
+    bool mStopping = false;
+    std::vector<std::thread> mThreads;
+};
+
+} // namespace impl
+} // namespace android::compositionengine
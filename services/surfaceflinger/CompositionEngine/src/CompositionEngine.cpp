@@ -21,6 +21,7 @@
 #include <compositionengine/impl/CompositionEngine.h>
 #include <compositionengine/impl/Display.h>
 
+#include <android-base/stringprintf.h>
 #include <renderengine/RenderEngine.h>
 #include <utils/Trace.h>
 
@@ -107,9 +108,42 @@ void CompositionEngine::present(CompositionRefreshArgs& args) {
 
     updateLayerStateFromFE(args);
 
-    for (const auto& output : args.outputs) {
+    presentOutputs(args);
+}
+
+void CompositionEngine::presentOutputs(CompositionRefreshArgs& args) {
+    const bool parallel = args.presentOutputsInParallel && args.outputs.size() > 1;
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    {
+        std::lock_guard<std::mutex> lock(mPresentTimesMutex);
+        mOutputPresentTimes.clear();
+    }
+
+    auto presentOutput = [this, &args](const std::shared_ptr<compositionengine::Output>& output) {
+        const nsecs_t outputStart = systemTime(SYSTEM_TIME_MONOTONIC);
         output->present(args);
+        const nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - outputStart;
+
+        std::lock_guard<std::mutex> lock(mPresentTimesMutex);
+        mOutputPresentTimes.push_back({output->getName(), duration});
+    };
+
+    if (parallel) {
+        if (!mParallelOutputPresenter) {
+            mParallelOutputPresenter =
+                    std::make_unique<ParallelOutputPresenter>(kMaxParallelPresentThreads);
+        }
+        mParallelOutputPresenter->present(args.outputs, presentOutput);
+    } else {
+        for (const auto& output : args.outputs) {
+            presentOutput(output);
+        }
     }
+
+    std::lock_guard<std::mutex> lock(mPresentTimesMutex);
+    mAllOutputsPresentTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    mLastPresentWasParallel = parallel;
 }
 
 void CompositionEngine::updateCursorAsync(CompositionRefreshArgs& args) {
@@ -144,8 +178,14 @@ void CompositionEngine::preComposition(CompositionRefreshArgs& args) {
     mNeedsAnotherUpdate = needsAnotherUpdate;
 }
 
-void CompositionEngine::dump(std::string&) const {
-    // The base class has no state to dump, but derived classes might.
+void CompositionEngine::dump(std::string& out) const {
+    std::lock_guard<std::mutex> lock(mPresentTimesMutex);
+    base::StringAppendF(&out, "Output present times (last frame, %s): total %.3fms\n",
+                        mLastPresentWasParallel ? "parallel" : "serial",
+                        mAllOutputsPresentTime / 1e6);
+    for (const auto& time : mOutputPresentTimes) {
+        base::StringAppendF(&out, "    %s: %.3fms\n", time.name.c_str(), time.duration / 1e6);
+    }
 }
 
 void CompositionEngine::setNeedsAnotherUpdateForTest(bool value) {
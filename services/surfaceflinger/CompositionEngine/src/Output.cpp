@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <thread>
 
 #include <android-base/stringprintf.h>
@@ -27,6 +28,7 @@
 #include <compositionengine/impl/OutputCompositionState.h>
 #include <compositionengine/impl/OutputLayer.h>
 #include <compositionengine/impl/OutputLayerCompositionState.h>
+#include <compositionengine/impl/ParallelOutputPresenter.h>
 
 // TODO(b/129481165): remove the #pragma below and fix conversion issues
 #pragma clang diagnostic push
@@ -345,13 +347,31 @@ void Output::rebuildLayerStacks(const compositionengine::CompositionRefreshArgs&
 
 void Output::collectVisibleLayers(const compositionengine::CompositionRefreshArgs& refreshArgs,
                                   compositionengine::Output::CoverageState& coverage) {
+    // In incremental mode, pick up the coverage of the unchanged layers at the
+    // top of the stack from the last geometry update.
+    size_t reusedLayerCount = 0;
+    if (refreshArgs.useIncrementalVisibleRegions) {
+        reusedLayerCount = reuseUnchangedVisibleLayers(refreshArgs, coverage);
+    }
+    mVisibleRegionCache.resize(reusedLayerCount);
+
     // Evaluate the layers from front to back to determine what is visible. This
     // also incrementally calculates the coverage information for each layer as
     // well as the entire output.
-    for (auto layer : reversed(refreshArgs.layers)) {
+    for (auto it = refreshArgs.layers.rbegin() + reusedLayerCount; it != refreshArgs.layers.rend();
+         ++it) {
+        auto layer = *it;
         // Incrementally process the coverage for each layer
         ensureOutputLayerIfVisible(layer, coverage);
 
+        if (refreshArgs.useIncrementalVisibleRegions) {
+            const auto* layerFEState = layer->getCompositionState();
+            mVisibleRegionCache.push_back({layer,
+                                           layerFEState ? layerFEState->geometryGeneration : 0,
+                                           coverage.aboveCoveredLayers,
+                                           coverage.aboveOpaqueLayers});
+        }
+
         // TODO(b/121291683): Stop early if the output is completely covered and
         // no more layers could even be visible underneath the ones on top.
     }
@@ -367,6 +387,68 @@ void Output::collectVisibleLayers(const compositionengine::CompositionRefreshArg
     }
 }
 
+size_t Output::reuseUnchangedVisibleLayers(
+        const compositionengine::CompositionRefreshArgs& refreshArgs,
+        compositionengine::Output::CoverageState& coverage) {
+    // The cached coverage is only valid if the output projection and layer
+    // stack filtering are unchanged.
+    const auto& outputState = getState();
+    const VisibleRegionCacheKey key{outputState.layerStackId, outputState.layerStackInternal,
+                                    outputState.bounds, outputState.viewport,
+                                    outputState.transform};
+    if (key.layerStackId != mVisibleRegionCacheKey.layerStackId ||
+        key.layerStackInternal != mVisibleRegionCacheKey.layerStackInternal ||
+        key.bounds != mVisibleRegionCacheKey.bounds ||
+        key.viewport != mVisibleRegionCacheKey.viewport ||
+        !(key.transform == mVisibleRegionCacheKey.transform)) {
+        mVisibleRegionCacheKey = key;
+        return 0;
+    }
+
+    const size_t layerCount = refreshArgs.layers.size();
+    const size_t maxReused = std::min(layerCount, mVisibleRegionCache.size());
+    size_t reused = 0;
+    for (; reused < maxReused; reused++) {
+        const VisibleRegionCacheEntry& entry = mVisibleRegionCache[reused];
+        const sp<compositionengine::LayerFE>& layerFE = refreshArgs.layers[layerCount - 1 - reused];
+        if (entry.layerFE.promote() != layerFE) {
+            break;
+        }
+
+        if (!coverage.latchedLayers.count(layerFE)) {
+            coverage.latchedLayers.insert(layerFE);
+            layerFE->prepareCompositionState(
+                    compositionengine::LayerFE::StateSubset::BasicGeometry);
+        }
+
+        const auto* layerFEState = layerFE->getCompositionState();
+        if (!layerFEState || layerFEState->geometryGeneration != entry.geometryGeneration ||
+            layerFEState->contentDirty) {
+            break;
+        }
+
+        if (belongsInOutput(layerFE) && layerFEState->isVisible) {
+            // A layer that contributed to the coverage without being visible on
+            // this output has no cached regions to reuse.
+            auto outputLayerIndex = findCurrentOutputLayerForLayer(layerFE);
+            if (!outputLayerIndex) {
+                break;
+            }
+
+            // Nothing above changed, so this is the dirty region that a full
+            // recomputation would produce for the layer.
+            auto* outputLayer = ensureOutputLayer(outputLayerIndex, layerFE);
+            const auto& outputLayerState = outputLayer->getState();
+            coverage.dirtyRegion.orSelf(
+                    outputLayerState.visibleRegion.intersect(outputLayerState.coveredRegion));
+        }
+
+        coverage.aboveCoveredLayers = entry.aboveCoveredLayers;
+        coverage.aboveOpaqueLayers = entry.aboveOpaqueLayers;
+    }
+    return reused;
+}
+
 void Output::ensureOutputLayerIfVisible(sp<compositionengine::LayerFE>& layerFE,
                                         compositionengine::Output::CoverageState& coverage) {
     // Ensure we have a snapshot of the basic geometry layer state. Limit the
@@ -775,7 +857,9 @@ void Output::devOptRepaintFlash(const compositionengine::CompositionRefreshArgs&
         if (!dirtyRegion.isEmpty()) {
             base::unique_fd readyFence;
             // redraw the whole screen
-            static_cast<void>(composeSurfaces(dirtyRegion, refreshArgs));
+            ParallelOutputPresenter::runOnMainThread([&] {
+                static_cast<void>(composeSurfaces(dirtyRegion, refreshArgs));
+            });
 
             mRenderSurface->queueBuffer(std::move(readyFence));
         }
@@ -798,7 +882,10 @@ void Output::finishFrame(const compositionengine::CompositionRefreshArgs& refres
 
     // Repaint the framebuffer (if needed), getting the optional fence for when
     // the composition completes.
-    auto optReadyFence = composeSurfaces(Region::INVALID_REGION, refreshArgs);
+    std::optional<base::unique_fd> optReadyFence;
+    ParallelOutputPresenter::runOnMainThread([&] {
+        optReadyFence = composeSurfaces(Region::INVALID_REGION, refreshArgs);
+    });
     if (!optReadyFence) {
         return;
     }
@@ -1054,6 +1141,7 @@ void Output::postFramebuffer() {
 
     mRenderSurface->onPresentDisplayCompleted();
 
+    std::vector<std::pair<LayerFE*, sp<Fence>>> releaseFences;
     for (auto* layer : getOutputLayersOrderedByZ()) {
         // The layer buffer from the previous frame (if any) is released
         // by HWC only when the release fence from this frame (if any) is
@@ -1077,17 +1165,25 @@ void Output::postFramebuffer() {
                     Fence::merge("LayerRelease", releaseFence, frame.clientTargetAcquireFence);
         }
 
-        layer->getLayerFE().onLayerDisplayed(releaseFence);
+        releaseFences.emplace_back(&layer->getLayerFE(), std::move(releaseFence));
     }
 
-    // We've got a list of layers needing fences, that are disjoint with
-    // OutputLayersOrderedByZ.  The best we can do is to
-    // supply them with the present fence.
-    for (auto& weakLayer : mReleasedLayers) {
-        if (auto layer = weakLayer.promote(); layer != nullptr) {
-            layer->onLayerDisplayed(frame.presentFence);
+    // Layers may be shown on other outputs being presented at the same time, so they are only
+    // called back from the main thread.
+    ParallelOutputPresenter::runOnMainThread([&] {
+        for (auto& [layerFE, releaseFence] : releaseFences) {
+            layerFE->onLayerDisplayed(releaseFence);
         }
-    }
+
+        // We've got a list of layers needing fences, that are disjoint with
+        // OutputLayersOrderedByZ.  The best we can do is to
+        // supply them with the present fence.
+        for (auto& weakLayer : mReleasedLayers) {
+            if (auto layer = weakLayer.promote(); layer != nullptr) {
+                layer->onLayerDisplayed(frame.presentFence);
+            }
+        }
+    });
 
     // Clear out the released layers now that we're done with them.
     mReleasedLayers.clear();
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <compositionengine/Output.h>
+#include <compositionengine/impl/ParallelOutputPresenter.h>
+#include <utils/Trace.h>
+
+namespace android::compositionengine::impl {
+
+// State shared by the workers presenting the outputs of a single frame.
+struct ParallelOutputPresenter::Frame {
+    struct MainThreadWork {
+        const std::function<void()>* work;
+        bool done = false;
+    };
+
+    // Held by a worker for the whole of an output's present, except while it waits for its
+    // main thread work.
+    std::mutex hwcMutex;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<MainThreadWork*> mainThreadQueue;
+    size_t remainingOutputs = 0;
+};
+
+namespace {
+
+struct WorkerFrameState {
+    ParallelOutputPresenter::Frame* frame = nullptr;
+    std::unique_lock<std::mutex>* hwcLock = nullptr;
+};
+
+thread_local WorkerFrameState tWorkerFrameState;
+
+} // namespace
+
+ParallelOutputPresenter::ParallelOutputPresenter(size_t threadCount) {
+    // The workers stand in for the main thread, so they run with its scheduling policy.
+    int policy = SCHED_OTHER;
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &policy, &param);
+
+    mThreads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back([this, policy, param] {
+            pthread_setname_np(pthread_self(), "OutputPresent");
+            pthread_setschedparam(pthread_self(), policy, &param);
+            threadMain();
+        });
+    }
+}
+
+ParallelOutputPresenter::~ParallelOutputPresenter() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void ParallelOutputPresenter::threadMain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+        if (mJobs.empty()) {
+            return;
+        }
+        auto job = std::move(mJobs.front());
+        mJobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+void ParallelOutputPresenter::present(const std::vector<std::shared_ptr<Output>>& outputs,
+                                      const OutputPresenter& presentOutput) {
+    ATRACE_CALL();
+
+    Frame frame;
+    frame.remainingOutputs = outputs.size();
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& output : outputs) {
+            mJobs.emplace_back([&frame, &presentOutput, output] {
+                {
+                    std::unique_lock<std::mutex> hwcLock(frame.hwcMutex);
+                    tWorkerFrameState = {&frame, &hwcLock};
+                    presentOutput(output);
+                    tWorkerFrameState = {};
+                }
+
+                std::lock_guard<std::mutex> frameLock(frame.mutex);
+                frame.remainingOutputs--;
+                frame.condition.notify_all();
+            });
+        }
+    }
+    mCondition.notify_all();
+
+    // Service the main thread queue until every output has been presented.
+    std::unique_lock<std::mutex> frameLock(frame.mutex);
+    while (true) {
+        frame.condition.wait(frameLock, [&frame] {
+            return frame.remainingOutputs == 0 || !frame.mainThreadQueue.empty();
+        });
+        if (frame.mainThreadQueue.empty()) {
+            break;
+        }
+        Frame::MainThreadWork* item = frame.mainThreadQueue.front();
+        frame.mainThreadQueue.pop_front();
+
+        frameLock.unlock();
+        (*item->work)();
+        frameLock.lock();
+
+        item->done = true;
+        frame.condition.notify_all();
+    }
+}
+
+void ParallelOutputPresenter::runOnMainThread(const std::function<void()>& work) {
+    const WorkerFrameState state = tWorkerFrameState;
+    if (state.frame == nullptr) {
+        work();
+        return;
+    }
+
+    ATRACE_NAME("waitForMainThread");
+    Frame& frame = *state.frame;
+    Frame::MainThreadWork item{&work};
+
+    // Let the other outputs use HWC while the work for this one is queued and running.
+    state.hwcLock->unlock();
+    {
+        std::unique_lock<std::mutex> frameLock(frame.mutex);
+        frame.mainThreadQueue.push_back(&item);
+        frame.condition.notify_all();
+        frame.condition.wait(frameLock, [&item] { return item.done; });
+    }
+    state.hwcLock->lock();
+}
+
+} // namespace android::compositionengine::impl
@@ -23,6 +23,9 @@
 #include <gtest/gtest.h>
 #include <renderengine/mock/RenderEngine.h>
 
+#include <atomic>
+#include <thread>
+
 #include "MockHWComposer.h"
 #include "TimeStats/TimeStats.h"
 
@@ -31,6 +34,7 @@ namespace {
 
 using ::testing::_;
 using ::testing::InSequence;
+using ::testing::InvokeWithoutArgs;
 using ::testing::Ref;
 using ::testing::Return;
 using ::testing::ReturnRef;
@@ -49,6 +53,10 @@ struct CompositionEngineTest : public testing::Test {
     std::shared_ptr<mock::Output> mOutput1{std::make_shared<StrictMock<mock::Output>>()};
     std::shared_ptr<mock::Output> mOutput2{std::make_shared<StrictMock<mock::Output>>()};
     std::shared_ptr<mock::Output> mOutput3{std::make_shared<StrictMock<mock::Output>>()};
+
+    const std::string mOutput1Name{"Output1"};
+    const std::string mOutput2Name{"Output2"};
+    const std::string mOutput3Name{"Output3"};
 };
 
 TEST_F(CompositionEngineTest, canInstantiateCompositionEngine) {
@@ -115,11 +123,69 @@ TEST_F(CompositionEnginePresentTest, worksAsExpected) {
 
     // The last step is to actually present each output.
     EXPECT_CALL(*mOutput1, present(Ref(mRefreshArgs)));
+    EXPECT_CALL(*mOutput1, getName()).WillOnce(ReturnRef(mOutput1Name));
     EXPECT_CALL(*mOutput2, present(Ref(mRefreshArgs)));
+    EXPECT_CALL(*mOutput2, getName()).WillOnce(ReturnRef(mOutput2Name));
     EXPECT_CALL(*mOutput3, present(Ref(mRefreshArgs)));
+    EXPECT_CALL(*mOutput3, getName()).WillOnce(ReturnRef(mOutput3Name));
 
     mRefreshArgs.outputs = {mOutput1, mOutput2, mOutput3};
     mEngine.present(mRefreshArgs);
+
+    std::string dump;
+    mEngine.dump(dump);
+    EXPECT_NE(std::string::npos, dump.find("serial"));
+    EXPECT_NE(std::string::npos, dump.find(mOutput2Name));
+}
+
+TEST_F(CompositionEnginePresentTest, presentsOutputsInParallelWhenRequested) {
+    mRefreshArgs.presentOutputsInParallel = true;
+    mRefreshArgs.outputs = {mOutput1, mOutput2, mOutput3};
+
+    EXPECT_CALL(mEngine, preComposition(Ref(mRefreshArgs)));
+
+    // Preparing and latching front-end state still happens serially on the calling thread.
+    for (const auto& output : mRefreshArgs.outputs) {
+        EXPECT_CALL(*output, prepare(Ref(mRefreshArgs), _));
+        EXPECT_CALL(*output, updateLayerStateFromFE(Ref(mRefreshArgs)));
+    }
+
+    // Each output composes with RenderEngine from its worker. That work must run on the thread
+    // that called present().
+    const auto callingThread = std::this_thread::get_id();
+    std::atomic<int> renderEngineWorkOnCallingThread = 0;
+    auto composeOnRenderEngineThread = [&] {
+        impl::ParallelOutputPresenter::runOnMainThread([&] {
+            if (std::this_thread::get_id() == callingThread) {
+                renderEngineWorkOnCallingThread++;
+            }
+        });
+    };
+    EXPECT_CALL(*mOutput1, present(Ref(mRefreshArgs)))
+            .WillOnce(InvokeWithoutArgs(composeOnRenderEngineThread));
+    EXPECT_CALL(*mOutput1, getName()).WillOnce(ReturnRef(mOutput1Name));
+    EXPECT_CALL(*mOutput2, present(Ref(mRefreshArgs)))
+            .WillOnce(InvokeWithoutArgs(composeOnRenderEngineThread));
+    EXPECT_CALL(*mOutput2, getName()).WillOnce(ReturnRef(mOutput2Name));
+    EXPECT_CALL(*mOutput3, present(Ref(mRefreshArgs)))
+            .WillOnce(InvokeWithoutArgs(composeOnRenderEngineThread));
+    EXPECT_CALL(*mOutput3, getName()).WillOnce(ReturnRef(mOutput3Name));
+
+    mEngine.present(mRefreshArgs);
+
+    EXPECT_EQ(3, renderEngineWorkOnCallingThread);
+
+    std::string dump;
+    mEngine.dump(dump);
+    EXPECT_NE(std::string::npos, dump.find("parallel"));
+    EXPECT_NE(std::string::npos, dump.find(mOutput1Name));
+    EXPECT_NE(std::string::npos, dump.find(mOutput3Name));
+}
+
+TEST_F(CompositionEnginePresentTest, runsMainThreadWorkInlineOutsideParallelPresent) {
+    bool ran = false;
+    impl::ParallelOutputPresenter::runOnMainThread([&] { ran = true; });
+    EXPECT_TRUE(ran);
 }
 
 /*
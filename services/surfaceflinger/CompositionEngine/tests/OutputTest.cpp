@@ -15,12 +15,14 @@
  */
 
 #include <cmath>
+#include <thread>
 
 #include <android-base/stringprintf.h>
 #include <compositionengine/LayerFECompositionState.h>
 #include <compositionengine/impl/Output.h>
 #include <compositionengine/impl/OutputCompositionState.h>
 #include <compositionengine/impl/OutputLayerCompositionState.h>
+#include <compositionengine/impl/ParallelOutputPresenter.h>
 #include <compositionengine/mock/CompositionEngine.h>
 #include <compositionengine/mock/DisplayColorProfile.h>
 #include <compositionengine/mock/LayerFE.h>
@@ -47,6 +49,7 @@ using testing::ElementsAreArray;
 using testing::Eq;
 using testing::InSequence;
 using testing::Invoke;
+using testing::InvokeWithoutArgs;
 using testing::IsEmpty;
 using testing::Mock;
 using testing::Pointee;
@@ -1046,6 +1049,54 @@ TEST_F(OutputCollectVisibleLayersTest, processesCandidateLayersReversedAndSetsOu
     EXPECT_EQ(2u, mLayer3.outputLayerState.z);
 }
 
+TEST_F(OutputCollectVisibleLayersTest, incrementalModeReusesUnchangedTopLayers) {
+    constexpr uint32_t kLayerStack = 1u;
+    mOutput.mState.layerStackId = kLayerStack;
+    mRefreshArgs.useIncrementalVisibleRegions = true;
+
+    LayerFECompositionState layerFEStates[3];
+    Layer* layers[] = {&mLayer1, &mLayer2, &mLayer3};
+    for (size_t i = 0; i < 3; i++) {
+        layerFEStates[i].layerStackId = kLayerStack;
+        EXPECT_CALL(*layers[i]->layerFE, getCompositionState())
+                .WillRepeatedly(Return(&layerFEStates[i]));
+        EXPECT_CALL(layers[i]->outputLayer, getLayerFE())
+                .WillRepeatedly(ReturnRef(*layers[i]->layerFE));
+    }
+
+    // The first update evaluates every layer, and records the coverage after each one.
+    const Region kLayer3Opaque{Rect(0, 0, 10, 10)};
+    EXPECT_CALL(mOutput, ensureOutputLayerIfVisible(Eq(mLayer3.layerFE), Ref(mCoverageState)))
+            .WillOnce(Invoke([&](sp<LayerFE>&, Output::CoverageState& coverage) {
+                coverage.aboveOpaqueLayers = kLayer3Opaque;
+            }));
+    EXPECT_CALL(mOutput, ensureOutputLayerIfVisible(Eq(mLayer2.layerFE), Ref(mCoverageState)));
+    EXPECT_CALL(mOutput, ensureOutputLayerIfVisible(Eq(mLayer1.layerFE), Ref(mCoverageState)));
+    EXPECT_CALL(mOutput, setReleasedLayers(Ref(mRefreshArgs))).Times(2);
+    EXPECT_CALL(mOutput, finalizePendingOutputLayers()).Times(2);
+
+    mOutput.collectVisibleLayers(mRefreshArgs, mCoverageState);
+
+    // Only the middle layer changes. The top layer is reused as is.
+    layerFEStates[1].geometryGeneration++;
+    mLayer3.outputLayerState.visibleRegion = Region(Rect(0, 0, 100, 100));
+    mLayer3.outputLayerState.coveredRegion = Region(Rect(0, 0, 50, 50));
+
+    LayerFESet geomSnapshots;
+    Output::CoverageState coverageState{geomSnapshots};
+    EXPECT_CALL(*mLayer3.layerFE, prepareCompositionState(LayerFE::StateSubset::BasicGeometry));
+    EXPECT_CALL(*mLayer2.layerFE, prepareCompositionState(LayerFE::StateSubset::BasicGeometry));
+    EXPECT_CALL(mOutput, ensureOutputLayer(Eq(std::optional<size_t>(2u)), Eq(mLayer3.layerFE)))
+            .WillOnce(Return(&mLayer3.outputLayer));
+    EXPECT_CALL(mOutput, ensureOutputLayerIfVisible(Eq(mLayer2.layerFE), Ref(coverageState)));
+    EXPECT_CALL(mOutput, ensureOutputLayerIfVisible(Eq(mLayer1.layerFE), Ref(coverageState)));
+
+    mOutput.collectVisibleLayers(mRefreshArgs, coverageState);
+
+    EXPECT_THAT(coverageState.aboveOpaqueLayers, RegionEq(kLayer3Opaque));
+    EXPECT_THAT(coverageState.dirtyRegion, RegionEq(Region(Rect(0, 0, 50, 50))));
+}
+
 /*
  * Output::ensureOutputLayerIfVisible()
  */
@@ -2761,6 +2812,45 @@ TEST_F(OutputPostFramebufferTest, releasedLayersSentPresentFence) {
     EXPECT_TRUE(mOutput.getReleasedLayersForTest().empty());
 }
 
+TEST_F(OutputPostFramebufferTest, layerFECallbacksRunOnMainThreadDuringParallelPresent) {
+    // A layer can be on several outputs presented at once, so it must only be called back from
+    // the thread that started the parallel present, never from the worker presenting an output.
+    mOutput.mState.isEnabled = true;
+
+    sp<StrictMock<mock::LayerFE>> releasedLayer{new StrictMock<mock::LayerFE>()};
+    Output::ReleasedLayers layers;
+    layers.push_back(releasedLayer);
+    mOutput.setReleasedLayers(std::move(layers));
+
+    EXPECT_CALL(*mRenderSurface, flip());
+    EXPECT_CALL(mOutput, presentAndGetFrameFences()).WillOnce(Return(Output::FrameFences()));
+    EXPECT_CALL(*mRenderSurface, onPresentDisplayCompleted());
+
+    const auto mainThread = std::this_thread::get_id();
+    int callbacksOnMainThread = 0;
+    auto onLayerDisplayed = [&] {
+        if (std::this_thread::get_id() == mainThread) {
+            callbacksOnMainThread++;
+        }
+    };
+    EXPECT_CALL(mLayer1.layerFE, onLayerDisplayed(_))
+            .WillOnce(InvokeWithoutArgs(onLayerDisplayed));
+    EXPECT_CALL(mLayer2.layerFE, onLayerDisplayed(_))
+            .WillOnce(InvokeWithoutArgs(onLayerDisplayed));
+    EXPECT_CALL(mLayer3.layerFE, onLayerDisplayed(_))
+            .WillOnce(InvokeWithoutArgs(onLayerDisplayed));
+    EXPECT_CALL(*releasedLayer, onLayerDisplayed(_))
+            .WillOnce(InvokeWithoutArgs(onLayerDisplayed));
+
+    impl::ParallelOutputPresenter presenter(1);
+    std::shared_ptr<compositionengine::Output> unowned(&mOutput, [](auto*) {});
+    presenter.present({unowned}, [](const std::shared_ptr<compositionengine::Output>& output) {
+        output->postFramebuffer();
+    });
+
+    EXPECT_EQ(4, callbacksOnMainThread);
+}
+
 /*
  * Output::composeSurfaces()
  */
@@ -448,20 +448,35 @@ void Layer::prepareBasicGeometryCompositionState() {
     }
 
     auto* compositionState = editCompositionState();
-    compositionState->layerStackId =
-            (layerStack != ~0u) ? std::make_optional(layerStack) : std::nullopt;
-    compositionState->internalOnly = getPrimaryDisplayOnly();
-    compositionState->isVisible = isVisible();
-    compositionState->isOpaque = opaque && !usesRoundedCorners && alpha == 1.f;
+    const auto layerStackId = (layerStack != ~0u) ? std::make_optional(layerStack) : std::nullopt;
+    const bool internalOnly = getPrimaryDisplayOnly();
+    const bool visible = isVisible();
+    const bool isOpaque = opaque && !usesRoundedCorners && alpha == 1.f;
+    const ui::Transform& transform = getTransform();
+    const Region& transparentRegionHint = getActiveTransparentRegion(drawingState);
+    if (contentDirty || compositionState->layerStackId != layerStackId ||
+        compositionState->internalOnly != internalOnly ||
+        compositionState->isVisible != visible || compositionState->isOpaque != isOpaque ||
+        compositionState->shadowRadius != mEffectiveShadowRadius ||
+        !(compositionState->geomLayerBounds == mBounds) ||
+        !(compositionState->geomLayerTransform == transform) ||
+        !compositionState->transparentRegionHint.hasSameRects(transparentRegionHint)) {
+        compositionState->geometryGeneration++;
+    }
+
+    compositionState->layerStackId = layerStackId;
+    compositionState->internalOnly = internalOnly;
+    compositionState->isVisible = visible;
+    compositionState->isOpaque = isOpaque;
     compositionState->shadowRadius = mEffectiveShadowRadius;
 
     compositionState->contentDirty = contentDirty;
     contentDirty = false;
 
     compositionState->geomLayerBounds = mBounds;
-    compositionState->geomLayerTransform = getTransform();
+    compositionState->geomLayerTransform = transform;
     compositionState->geomInverseLayerTransform = compositionState->geomLayerTransform.inverse();
-    compositionState->transparentRegionHint = getActiveTransparentRegion(drawingState);
+    compositionState->transparentRegionHint = transparentRegionHint;
 
     compositionState->blendMode = static_cast<Hwc2::IComposerClient::BlendMode>(blendMode);
     compositionState->alpha = alpha;
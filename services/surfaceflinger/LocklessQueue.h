@@ -0,0 +1,80 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace android {
+
+// A multiple producer, single consumer queue, which never blocks its producers.
+//
+// Producers push onto a lock-free stack. The consumer takes the whole stack at once, and drains
+// it in the order it was pushed, so the elements pushed by each producer come out in the order
+// that producer pushed them. Only one thread may call drain at a time.
+template <typename T>
+class LocklessQueue {
+public:
+    LocklessQueue() = default;
+    LocklessQueue(const LocklessQueue&) = delete;
+    LocklessQueue& operator=(const LocklessQueue&) = delete;
+
+    ~LocklessQueue() {
+        drain([](T&&) {});
+    }
+
+    void push(T value) {
+        Node* node = new Node{std::move(value), mHead.load(std::memory_order_relaxed)};
+        while (!mHead.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    bool empty() const { return mHead.load(std::memory_order_acquire) == nullptr; }
+
+    // Calls consume with each element, oldest first.
+    template <typename Consumer>
+    void drain(Consumer&& consume) {
+        Node* node = mHead.exchange(nullptr, std::memory_order_acquire);
+
+        // The stack is newest first.
+        Node* oldest = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = oldest;
+            oldest = node;
+            node = next;
+        }
+
+        while (oldest) {
+            Node* next = oldest->next;
+            consume(std::move(oldest->value));
+            delete oldest;
+            oldest = next;
+        }
+    }
+
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> mHead = nullptr;
+};
+
+} // namespace android
@@ -55,14 +55,46 @@ void LayerInfoV2::setLastPresentTime(nsecs_t lastPresentTime, nsecs_t now,
             FrameTimeData frameTime = {.presetTime = lastPresentTime,
                                        .queueTime = mLastUpdatedTime,
                                        .pendingConfigChange = pendingConfigChange};
+            addFrameTimeTotals(frameTime, mFrameTimes.empty() ? nullptr : &mFrameTimes.back());
             mFrameTimes.push_back(frameTime);
             if (mFrameTimes.size() > HISTORY_SIZE) {
+                removeFrameTimeTotals(mFrameTimes.front(), &mFrameTimes[1]);
                 mFrameTimes.pop_front();
             }
             break;
     }
 }
 
+void LayerInfoV2::addFrameTimeTotals(const FrameTimeData& frame, const FrameTimeData* previous) {
+    mFrameTimeTotals.missingPresentTimes += frame.presetTime == 0;
+    mFrameTimeTotals.pendingConfigChanges += frame.pendingConfigChange;
+    if (!previous) {
+        return;
+    }
+
+    mFrameTimeTotals.queueTimeDeltas +=
+            std::max(frame.queueTime - previous->queueTime, mHighRefreshRatePeriod);
+    if (previous->presetTime != 0 && frame.presetTime != 0) {
+        mFrameTimeTotals.presentTimeDeltas +=
+                std::max(frame.presetTime - previous->presetTime, mHighRefreshRatePeriod);
+    }
+}
+
+void LayerInfoV2::removeFrameTimeTotals(const FrameTimeData& frame, const FrameTimeData* next) {
+    mFrameTimeTotals.missingPresentTimes -= frame.presetTime == 0;
+    mFrameTimeTotals.pendingConfigChanges -= frame.pendingConfigChange;
+    if (!next) {
+        return;
+    }
+
+    mFrameTimeTotals.queueTimeDeltas -=
+            std::max(next->queueTime - frame.queueTime, mHighRefreshRatePeriod);
+    if (frame.presetTime != 0 && next->presetTime != 0) {
+        mFrameTimeTotals.presentTimeDeltas -=
+                std::max(next->presetTime - frame.presetTime, mHighRefreshRatePeriod);
+    }
+}
+
 bool LayerInfoV2::isFrameTimeValid(const FrameTimeData& frameTime) const {
     return frameTime.queueTime >= std::chrono::duration_cast<std::chrono::nanoseconds>(
                                           mFrameTimeValidSince.time_since_epoch())
@@ -121,33 +153,18 @@ bool LayerInfoV2::hasEnoughDataForHeuristic() const {
 }
 
 std::optional<nsecs_t> LayerInfoV2::calculateAverageFrameTime() const {
-    nsecs_t totalPresentTimeDeltas = 0;
-    nsecs_t totalQueueTimeDeltas = 0;
-    bool missingPresentTime = false;
-    int numFrames = 0;
-    for (auto it = mFrameTimes.begin(); it != mFrameTimes.end() - 1; ++it) {
-        // Ignore frames captured during a config change
-        if (it->pendingConfigChange || (it + 1)->pendingConfigChange) {
-            return std::nullopt;
-        }
-
-        totalQueueTimeDeltas +=
-                std::max(((it + 1)->queueTime - it->queueTime), mHighRefreshRatePeriod);
-        numFrames++;
-
-        if (!missingPresentTime && (it->presetTime == 0 || (it + 1)->presetTime == 0)) {
-            missingPresentTime = true;
-            // If there are no presentation timestamps and we haven't calculated
-            // one in the past then we can't calculate the refresh rate
-            if (mLastRefreshRate.reported == 0) {
-                return std::nullopt;
-            }
-            continue;
-        }
+    // Ignore frames captured during a config change
+    if (mFrameTimeTotals.pendingConfigChanges > 0) {
+        return std::nullopt;
+    }
 
-        totalPresentTimeDeltas +=
-                std::max(((it + 1)->presetTime - it->presetTime), mHighRefreshRatePeriod);
+    const bool missingPresentTime = mFrameTimeTotals.missingPresentTimes > 0;
+    // If there are no presentation timestamps and we haven't calculated
+    // one in the past then we can't calculate the refresh rate
+    if (missingPresentTime && mLastRefreshRate.reported == 0) {
+        return std::nullopt;
     }
+    const int numFrames = static_cast<int>(mFrameTimes.size()) - 1;
 
     // Calculate the average frame time based on presentation timestamps. If those
     // doesn't exist, we look at the time the buffer was queued only. We can do that only if
@@ -158,7 +175,8 @@ std::optional<nsecs_t> LayerInfoV2::calculateAverageFrameTime() const {
     // matches the content.
 
     const auto averageFrameTime =
-            static_cast<float>(missingPresentTime ? totalQueueTimeDeltas : totalPresentTimeDeltas) /
+            static_cast<float>(missingPresentTime ? mFrameTimeTotals.queueTimeDeltas
+                                                  : mFrameTimeTotals.presentTimeDeltas) /
             numFrames;
     return static_cast<nsecs_t>(averageFrameTime);
 }
@@ -254,13 +272,38 @@ LayerInfoV2::RefreshRateHistory::makeHeuristicTraceTagData() const {
 
 void LayerInfoV2::RefreshRateHistory::clear() {
     mRefreshRates.clear();
+    mMaxima.clear();
+    mMinima.clear();
+}
+
+void LayerInfoV2::RefreshRateHistory::popFront() {
+    // An equal refresh rate at the front of mMaxima or mMinima is the same entry, since entries
+    // are only dropped from them for a later one that is strictly larger or smaller.
+    const auto refreshRate = mRefreshRates.front().refreshRate;
+    if (mMaxima.front().refreshRate == refreshRate) {
+        mMaxima.pop_front();
+    }
+    if (mMinima.front().refreshRate == refreshRate) {
+        mMinima.pop_front();
+    }
+    mRefreshRates.pop_front();
 }
 
 bool LayerInfoV2::RefreshRateHistory::add(float refreshRate, nsecs_t now) {
-    mRefreshRates.push_back({refreshRate, now});
+    const RefreshRateData data = {refreshRate, now};
+    mRefreshRates.push_back(data);
+    while (!mMaxima.empty() && mMaxima.back() < data) {
+        mMaxima.pop_back();
+    }
+    mMaxima.push_back(data);
+    while (!mMinima.empty() && data < mMinima.back()) {
+        mMinima.pop_back();
+    }
+    mMinima.push_back(data);
+
     while (mRefreshRates.size() >= HISTORY_SIZE ||
            now - mRefreshRates.front().timestamp > HISTORY_DURATION.count()) {
-        mRefreshRates.pop_front();
+        popFront();
     }
 
     if (CC_UNLIKELY(sTraceEnabled)) {
@@ -277,8 +320,8 @@ bool LayerInfoV2::RefreshRateHistory::add(float refreshRate, nsecs_t now) {
 bool LayerInfoV2::RefreshRateHistory::isConsistent() const {
     if (mRefreshRates.empty()) return true;
 
-    const auto max = std::max_element(mRefreshRates.begin(), mRefreshRates.end());
-    const auto min = std::min_element(mRefreshRates.begin(), mRefreshRates.end());
+    const auto max = mMaxima.begin();
+    const auto min = mMinima.begin();
     const auto consistent = max->refreshRate - min->refreshRate <= MARGIN_FPS;
 
     if (CC_UNLIKELY(sTraceEnabled)) {
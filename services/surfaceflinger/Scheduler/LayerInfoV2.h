@@ -109,6 +109,7 @@ public:
     void clearHistory(nsecs_t now) {
         onLayerInactive(now);
         mFrameTimes.clear();
+        mFrameTimeTotals = {};
     }
 
 private:
@@ -175,18 +176,38 @@ private:
         bool isConsistent() const;
         HeuristicTraceTagData makeHeuristicTraceTagData() const;
 
+        void popFront();
+
         const std::string mName;
         mutable std::optional<HeuristicTraceTagData> mHeuristicTraceTagData;
         std::deque<RefreshRateData> mRefreshRates;
+        // The refresh rates in mRefreshRates that are not smaller (mMaxima) or not larger
+        // (mMinima) than any added after them, so that the max and min are at the front.
+        std::deque<RefreshRateData> mMaxima;
+        std::deque<RefreshRateData> mMinima;
         static constexpr float MARGIN_FPS = 1.0;
     };
 
+    // Totals over the pairs of consecutive frames in mFrameTimes, kept as frames come and go
+    // for calculateAverageFrameTime().
+    struct FrameTimeTotals {
+        nsecs_t queueTimeDeltas = 0;
+        // Only over the pairs where both frames have a present time.
+        nsecs_t presentTimeDeltas = 0;
+        // Frames without a present time, and frames captured during a config change.
+        size_t missingPresentTimes = 0;
+        size_t pendingConfigChanges = 0;
+    };
+
     bool isFrequent(nsecs_t now) const;
     bool isAnimating(nsecs_t now) const;
     bool hasEnoughDataForHeuristic() const;
     std::optional<float> calculateRefreshRateIfPossible(nsecs_t now);
     std::optional<nsecs_t> calculateAverageFrameTime() const;
     bool isFrameTimeValid(const FrameTimeData&) const;
+    // Adds or removes a frame to the totals, along with its pair with the neighbouring frame.
+    void addFrameTimeTotals(const FrameTimeData&, const FrameTimeData* previous);
+    void removeFrameTimeTotals(const FrameTimeData&, const FrameTimeData* next);
 
     const std::string mName;
 
@@ -203,6 +224,7 @@ private:
     RefreshRateHeuristicData mLastRefreshRate;
 
     std::deque<FrameTimeData> mFrameTimes;
+    FrameTimeTotals mFrameTimeTotals;
     std::chrono::time_point<std::chrono::steady_clock> mFrameTimeValidSince =
             std::chrono::steady_clock::now();
     static constexpr size_t HISTORY_SIZE = RefreshRateHistory::HISTORY_SIZE;
@@ -118,6 +118,30 @@ const RefreshRate& RefreshRateConfigs::getBestRefreshRate(
         const std::vector<LayerRequirement>& layers, const GlobalSignals& globalSignals,
         GlobalSignals* outSignalsConsidered) const {
     ATRACE_CALL();
+    std::lock_guard lock(mLock);
+
+    if (mLastBestRefreshRateInvocation && mLastBestRefreshRateInvocation->layers == layers &&
+        mLastBestRefreshRateInvocation->globalSignals == globalSignals) {
+        if (outSignalsConsidered) {
+            *outSignalsConsidered = mLastBestRefreshRateInvocation->outSignalsConsidered;
+        }
+        return *mLastBestRefreshRateInvocation->refreshRate;
+    }
+
+    GlobalSignals signalsConsidered;
+    const RefreshRate& refreshRate =
+            getBestRefreshRateLocked(layers, globalSignals, &signalsConsidered);
+    mLastBestRefreshRateInvocation.emplace(
+            GetBestRefreshRateInvocation{layers, globalSignals, signalsConsidered, &refreshRate});
+    if (outSignalsConsidered) {
+        *outSignalsConsidered = signalsConsidered;
+    }
+    return refreshRate;
+}
+
+const RefreshRate& RefreshRateConfigs::getBestRefreshRateLocked(
+        const std::vector<LayerRequirement>& layers, const GlobalSignals& globalSignals,
+        GlobalSignals* outSignalsConsidered) const {
     ALOGV("getRefreshRateForContent %zu layers", layers.size());
 
     if (outSignalsConsidered) *outSignalsConsidered = {};
@@ -133,8 +157,6 @@ const RefreshRate& RefreshRateConfigs::getBestRefreshRate(
         }
     };
 
-    std::lock_guard lock(mLock);
-
     int noVoteLayers = 0;
     int minVoteLayers = 0;
     int maxVoteLayers = 0;
@@ -515,6 +537,8 @@ void RefreshRateConfigs::getSortedRefreshRateList(
 }
 
 void RefreshRateConfigs::constructAvailableRefreshRates() {
+    mLastBestRefreshRateInvocation.reset();
+
     // Filter configs based on current policy and sort based on vsync period
     const Policy* policy = getCurrentPolicyLocked();
     const auto& defaultConfig = mRefreshRates.at(policy->defaultConfig)->hwcConfig;
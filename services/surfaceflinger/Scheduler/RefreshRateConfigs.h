@@ -226,9 +226,14 @@ public:
         bool touch = false;
         // True if the system hasn't seen any buffers posted to layers recently.
         bool idle = false;
+
+        bool operator==(const GlobalSignals& other) const {
+            return touch == other.touch && idle == other.idle;
+        }
     };
 
-    // Returns the refresh rate that fits best to the given layers.
+    // Returns the refresh rate that fits best to the given layers. The result of the last call is
+    // kept, and returned as is if the arguments and the policy are the same.
     //   layers - The layer requirements to consider.
     //   globalSignals - global state of touch and idle
     //   outSignalsConsidered - An output param that tells the caller whether the refresh rate was
@@ -308,6 +313,11 @@ private:
     template <typename Iter>
     const RefreshRate* getBestRefreshRate(Iter begin, Iter end) const;
 
+    const RefreshRate& getBestRefreshRateLocked(const std::vector<LayerRequirement>& layers,
+                                                const GlobalSignals& globalSignals,
+                                                GlobalSignals* outSignalsConsidered) const
+            REQUIRES(mLock);
+
     // Returns number of display frames and remainder when dividing the layer refresh period by
     // display refresh period.
     std::pair<nsecs_t, nsecs_t> getDisplayFrames(nsecs_t layerPeriod, nsecs_t displayPeriod) const;
@@ -355,6 +365,17 @@ private:
 
     mutable std::mutex mLock;
 
+    // The arguments and result of the last getBestRefreshRate() call. Cleared when the policy
+    // changes.
+    struct GetBestRefreshRateInvocation {
+        std::vector<LayerRequirement> layers;
+        GlobalSignals globalSignals;
+        GlobalSignals outSignalsConsidered;
+        const RefreshRate* refreshRate;
+    };
+    mutable std::optional<GetBestRefreshRateInvocation> mLastBestRefreshRateInvocation
+            GUARDED_BY(mLock);
+
     // A sorted list of known frame rates that a Heuristic layer will choose
     // from based on the closest value.
     const std::vector<float> mKnownFrameRates;
@@ -72,20 +72,27 @@ std::unique_ptr<DispSync> createDispSync(bool supportKernelTimer) {
         static constexpr size_t vsyncTimestampHistorySize = 20;
         static constexpr size_t minimumSamplesForPrediction = 6;
         static constexpr uint32_t discardOutlierPercent = 20;
+        const auto model = property_get_bool("debug.sf.vsp_robust_model", false)
+                ? scheduler::VSyncPredictor::Model::RobustKalman
+                : scheduler::VSyncPredictor::Model::LeastSquares;
         auto tracker = std::make_unique<
                 scheduler::VSyncPredictor>(std::chrono::duration_cast<std::chrono::nanoseconds>(
                                                    initialPeriod)
                                                    .count(),
                                            vsyncTimestampHistorySize, minimumSamplesForPrediction,
-                                           discardOutlierPercent);
+                                           discardOutlierPercent, model);
 
         static constexpr auto vsyncMoveThreshold =
                 std::chrono::duration_cast<std::chrono::nanoseconds>(3ms);
         static constexpr auto timerSlack =
                 std::chrono::duration_cast<std::chrono::nanoseconds>(500us);
+        const auto backend = property_get_bool("debug.sf.vsync_dispatch_ordered", false)
+                ? scheduler::VSyncDispatchTimerQueue::Backend::Ordered
+                : scheduler::VSyncDispatchTimerQueue::Backend::Linear;
         auto dispatch = std::make_unique<
                 scheduler::VSyncDispatchTimerQueue>(std::make_unique<scheduler::Timer>(), *tracker,
-                                                    timerSlack.count(), vsyncMoveThreshold.count());
+                                                    timerSlack.count(), vsyncMoveThreshold.count(),
+                                                    backend);
 
         static constexpr size_t pendingFenceLimit = 20;
         return std::make_unique<scheduler::VSyncReactor>(std::make_unique<scheduler::SystemClock>(),
@@ -16,6 +16,7 @@
 
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 #include <android-base/stringprintf.h>
+#include <log/log.h>
 #include <utils/Trace.h>
 #include <vector>
 
@@ -164,11 +165,12 @@ void VSyncDispatchTimerQueueEntry::dump(std::string& result) const {
 
 VSyncDispatchTimerQueue::VSyncDispatchTimerQueue(std::unique_ptr<TimeKeeper> tk,
                                                  VSyncTracker& tracker, nsecs_t timerSlack,
-                                                 nsecs_t minVsyncDistance)
+                                                 nsecs_t minVsyncDistance, Backend backend)
       : mTimeKeeper(std::move(tk)),
         mTracker(tracker),
         mTimerSlack(timerSlack),
-        mMinVsyncDistance(minVsyncDistance) {}
+        mMinVsyncDistance(minVsyncDistance),
+        mBackend(backend) {}
 
 VSyncDispatchTimerQueue::~VSyncDispatchTimerQueue() {
     std::lock_guard<decltype(mMutex)> lk(mMutex);
@@ -201,25 +203,115 @@ void VSyncDispatchTimerQueue::TraceBuffer::note(std::string_view name, nsecs_t a
     ATRACE_NAME(str_buffer.data());
 }
 
-void VSyncDispatchTimerQueue::rearmTimerSkippingUpdateFor(
+void VSyncDispatchTimerQueue::dequeue(CallbackMap::const_iterator const& it) {
+    if (mBackend != Backend::Ordered) {
+        return;
+    }
+    if (auto const wakeupTime = it->second->wakeupTime()) {
+        mArmedQueue.erase({*wakeupTime, it->first});
+    }
+}
+
+void VSyncDispatchTimerQueue::enqueue(CallbackMap::const_iterator const& it) {
+    if (mBackend != Backend::Ordered) {
+        return;
+    }
+    if (auto const wakeupTime = it->second->wakeupTime()) {
+        mArmedQueue.emplace(*wakeupTime, it->first);
+    }
+}
+
+void VSyncDispatchTimerQueue::revalidateArmedQueueSkippingUpdateFor(
         nsecs_t now, CallbackMap::iterator const& skipUpdateIt) {
-    std::optional<nsecs_t> min;
-    std::optional<nsecs_t> targetVsync;
-    std::optional<std::string_view> nextWakeupName;
+    auto const period = mTracker.currentPeriod();
+    if (period == mArmedQueuePeriod) {
+        return;
+    }
+    mArmedQueuePeriod = period;
+
+    mArmedQueue.clear();
     for (auto it = mCallbacks.begin(); it != mCallbacks.end(); it++) {
         auto& callback = it->second;
-        if (!callback->wakeupTime() && !callback->hasPendingWorkloadUpdate()) {
+        if (it != skipUpdateIt && (callback->wakeupTime() || callback->hasPendingWorkloadUpdate())) {
+            callback->update(mTracker, now);
+        }
+        enqueue(it);
+    }
+}
+
+VSyncDispatchTimerQueue::CallbackMap::iterator
+VSyncDispatchTimerQueue::updateArmedQueueSkippingUpdateFor(
+        nsecs_t now, CallbackMap::iterator const& skipUpdateIt) {
+    revalidateArmedQueueSkippingUpdateFor(now, skipUpdateIt);
+
+    size_t stillPending = 0;
+    for (auto const& token : mPendingWorkloadUpdates) {
+        auto it = mCallbacks.find(token);
+        if (it == mCallbacks.end() || !it->second->hasPendingWorkloadUpdate()) {
             continue;
         }
+        if (it == skipUpdateIt) {
+            mPendingWorkloadUpdates[stillPending++] = token;
+            continue;
+        }
+        dequeue(it);
+        it->second->update(mTracker, now);
+        enqueue(it);
+    }
+    mPendingWorkloadUpdates.resize(stillPending);
+
+    // Updating a callback from the same tracker twice gives the same wakeup, so this stops once
+    // the earliest callback is one that has been updated. The bound only guards against a tracker
+    // that keeps changing under us.
+    for (size_t i = 0; i <= mArmedQueue.size(); i++) {
+        if (mArmedQueue.empty()) {
+            return mCallbacks.end();
+        }
+        auto const [wakeupTime, token] = *mArmedQueue.begin();
+        auto it = mCallbacks.find(token);
+        LOG_ALWAYS_FATAL_IF(it == mCallbacks.end(), "armed callback %zu not registered",
+                            token.value());
+        if (it == skipUpdateIt) {
+            return it;
+        }
+        dequeue(it);
+        it->second->update(mTracker, now);
+        enqueue(it);
+        if (*it->second->wakeupTime() == wakeupTime) {
+            return it;
+        }
+    }
+    return mArmedQueue.empty() ? mCallbacks.end() : mCallbacks.find(mArmedQueue.begin()->second);
+}
 
-        if (it != skipUpdateIt) {
-            callback->update(mTracker, now);
+void VSyncDispatchTimerQueue::rearmTimerSkippingUpdateFor(
+        nsecs_t now, CallbackMap::iterator const& skipUpdateIt) {
+    std::optional<nsecs_t> min;
+    std::optional<nsecs_t> targetVsync;
+    std::optional<std::string_view> nextWakeupName;
+    if (mBackend == Backend::Ordered) {
+        auto const it = updateArmedQueueSkippingUpdateFor(now, skipUpdateIt);
+        if (it != mCallbacks.end()) {
+            nextWakeupName = it->second->name();
+            min = it->second->wakeupTime();
+            targetVsync = it->second->targetVsync();
         }
-        auto const wakeupTime = *callback->wakeupTime();
-        if (!min || (min && *min > wakeupTime)) {
-            nextWakeupName = callback->name();
-            min = wakeupTime;
-            targetVsync = callback->targetVsync();
+    } else {
+        for (auto it = mCallbacks.begin(); it != mCallbacks.end(); it++) {
+            auto& callback = it->second;
+            if (!callback->wakeupTime() && !callback->hasPendingWorkloadUpdate()) {
+                continue;
+            }
+
+            if (it != skipUpdateIt) {
+                callback->update(mTracker, now);
+            }
+            auto const wakeupTime = *callback->wakeupTime();
+            if (!min || (min && *min > wakeupTime)) {
+                nextWakeupName = callback->name();
+                min = wakeupTime;
+                targetVsync = callback->targetVsync();
+            }
         }
     }
 
@@ -245,18 +337,37 @@ void VSyncDispatchTimerQueue::timerCallback() {
         std::lock_guard<decltype(mMutex)> lk(mMutex);
         auto const now = mTimeKeeper->now();
         mLastTimerCallback = now;
-        for (auto it = mCallbacks.begin(); it != mCallbacks.end(); it++) {
-            auto& callback = it->second;
-            auto const wakeupTime = callback->wakeupTime();
-            if (!wakeupTime) {
-                continue;
-            }
-
-            auto const lagAllowance = std::max(now - mIntendedWakeupTime, static_cast<nsecs_t>(0));
-            if (*wakeupTime < mIntendedWakeupTime + mTimerSlack + lagAllowance) {
+        auto const lagAllowance = std::max(now - mIntendedWakeupTime, static_cast<nsecs_t>(0));
+        if (mBackend == Backend::Ordered) {
+            // The callbacks behind the earliest were armed from the tracker as it was when they
+            // were scheduled, so don't run any of them for a vsync it no longer predicts.
+            revalidateArmedQueueSkippingUpdateFor(now, mCallbacks.end());
+            while (!mArmedQueue.empty() &&
+                   mArmedQueue.begin()->first < mIntendedWakeupTime + mTimerSlack + lagAllowance) {
+                auto const [wakeupTime, token] = *mArmedQueue.begin();
+                mArmedQueue.erase(mArmedQueue.begin());
+                auto const it = mCallbacks.find(token);
+                LOG_ALWAYS_FATAL_IF(it == mCallbacks.end(), "armed callback %zu not registered",
+                                    token.value());
+                auto& callback = it->second;
                 callback->executing();
                 invocations.emplace_back(
-                        Invocation{callback, *callback->lastExecutedVsyncTarget(), *wakeupTime});
+                        Invocation{callback, *callback->lastExecutedVsyncTarget(), wakeupTime});
+            }
+        } else {
+            for (auto it = mCallbacks.begin(); it != mCallbacks.end(); it++) {
+                auto& callback = it->second;
+                auto const wakeupTime = callback->wakeupTime();
+                if (!wakeupTime) {
+                    continue;
+                }
+
+                if (*wakeupTime < mIntendedWakeupTime + mTimerSlack + lagAllowance) {
+                    callback->executing();
+                    invocations.emplace_back(Invocation{callback,
+                                                        *callback->lastExecutedVsyncTarget(),
+                                                        *wakeupTime});
+                }
             }
         }
 
@@ -288,6 +399,7 @@ void VSyncDispatchTimerQueue::unregisterCallback(CallbackToken token) {
         auto it = mCallbacks.find(token);
         if (it != mCallbacks.end()) {
             entry = it->second;
+            dequeue(it);
             mCallbacks.erase(it);
         }
     }
@@ -314,11 +426,16 @@ ScheduleResult VSyncDispatchTimerQueue::schedule(CallbackToken token, nsecs_t wo
          * timer recalculation to avoid cancelling a callback that is about to fire. */
         auto const rearmImminent = now > mIntendedWakeupTime;
         if (CC_UNLIKELY(rearmImminent)) {
+            if (mBackend == Backend::Ordered && !callback->hasPendingWorkloadUpdate()) {
+                mPendingWorkloadUpdates.push_back(token);
+            }
             callback->addPendingWorkloadUpdate(workDuration, earliestVsync);
             return ScheduleResult::Scheduled;
         }
 
+        dequeue(it);
         result = callback->schedule(workDuration, earliestVsync, mTracker, now);
+        enqueue(it);
         if (result == ScheduleResult::CannotSchedule) {
             return result;
         }
@@ -342,6 +459,7 @@ CancelResult VSyncDispatchTimerQueue::cancel(CallbackToken token) {
 
     auto const wakeupTime = callback->wakeupTime();
     if (wakeupTime) {
+        dequeue(it);
         callback->disarm();
 
         if (*wakeupTime == mIntendedWakeupTime) {
@@ -359,6 +477,8 @@ void VSyncDispatchTimerQueue::dump(std::string& result) const {
     mTimeKeeper->dump(result);
     StringAppendF(&result, "\tmTimerSlack: %.2fms mMinVsyncDistance: %.2fms\n", mTimerSlack / 1e6f,
                   mMinVsyncDistance / 1e6f);
+    StringAppendF(&result, "\tmBackend: %s\n",
+                  mBackend == Backend::Ordered ? "Ordered" : "Linear");
     StringAppendF(&result, "\tmIntendedWakeupTime: %.2fms from now\n",
                   (mIntendedWakeupTime - mTimeKeeper->now()) / 1e6f);
     StringAppendF(&result, "\tmLastTimerCallback: %.2fms ago mLastTimerSchedule: %.2fms ago\n",
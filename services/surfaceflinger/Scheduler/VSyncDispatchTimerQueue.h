@@ -21,9 +21,12 @@
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "SchedulerUtils.h"
 #include "VSyncDispatch.h"
@@ -112,6 +115,22 @@ private:
  */
 class VSyncDispatchTimerQueue : public VSyncDispatch {
 public:
+    // How the armed callbacks are searched for the next wakeup.
+    enum class Backend {
+        // Every rearm updates all armed callbacks from the tracker and takes the earliest, and
+        // every timer fire walks all of them.
+        Linear,
+        // Armed callbacks are kept ordered by wakeup time. A rearm only updates the earliest ones
+        // from the tracker, until the earliest is up to date, and a timer fire visits only the
+        // callbacks it runs, so both are O(log n) in the number of callbacks. While the tracker
+        // and the work duration of a callback stay the same, updating it can only move its wakeup
+        // later, so the two backends agree. When the tracker's period changes, every armed
+        // callback is updated on the next rearm or timer fire. Other changes, like a callback's
+        // work duration or a phase correction of the tracker, leave the callbacks behind the
+        // earliest with their wakeup from before until they become the earliest.
+        Ordered,
+    };
+
     // Constructs a VSyncDispatchTimerQueue.
     // \param[in] tk                    A timekeeper.
     // \param[in] tracker               A tracker.
@@ -119,8 +138,10 @@ public:
     //                                  should be grouped into one wakeup.
     // \param[in] minVsyncDistance      The minimum distance between two vsync estimates before the
     //                                  vsyncs are considered the same vsync event.
+    // \param[in] backend               How the next wakeup is found among the callbacks.
     explicit VSyncDispatchTimerQueue(std::unique_ptr<TimeKeeper> tk, VSyncTracker& tracker,
-                                     nsecs_t timerSlack, nsecs_t minVsyncDistance);
+                                     nsecs_t timerSlack, nsecs_t minVsyncDistance,
+                                     Backend backend = Backend::Linear);
     ~VSyncDispatchTimerQueue();
 
     CallbackToken registerCallback(Callback const& callbackFn, std::string callbackName) final;
@@ -143,11 +164,27 @@ private:
             REQUIRES(mMutex);
     void cancelTimer() REQUIRES(mMutex);
 
+    // With the Ordered backend, these remove an entry from mArmedQueue before its wakeup time
+    // changes and put it back after, if it is armed. They do nothing with the Linear backend.
+    void dequeue(CallbackMap::const_iterator const& it) REQUIRES(mMutex);
+    void enqueue(CallbackMap::const_iterator const& it) REQUIRES(mMutex);
+    // Updates every armed callback and rebuilds mArmedQueue if the tracker's period changed
+    // since it was last built.
+    void revalidateArmedQueueSkippingUpdateFor(nsecs_t now,
+                                               CallbackMap::iterator const& skipUpdate)
+            REQUIRES(mMutex);
+    // Applies the deferred workload updates and updates the earliest armed callbacks until the
+    // earliest is up to date, returning it, or mCallbacks.end() if none is armed.
+    CallbackMap::iterator updateArmedQueueSkippingUpdateFor(nsecs_t now,
+                                                            CallbackMap::iterator const& skipUpdate)
+            REQUIRES(mMutex);
+
     static constexpr nsecs_t kInvalidTime = std::numeric_limits<int64_t>::max();
     std::unique_ptr<TimeKeeper> const mTimeKeeper;
     VSyncTracker& mTracker;
     nsecs_t const mTimerSlack;
     nsecs_t const mMinVsyncDistance;
+    Backend const mBackend;
 
     std::mutex mutable mMutex;
     size_t mCallbackToken GUARDED_BY(mMutex) = 0;
@@ -155,6 +192,13 @@ private:
     CallbackMap mCallbacks GUARDED_BY(mMutex);
     nsecs_t mIntendedWakeupTime GUARDED_BY(mMutex) = kInvalidTime;
 
+    // With the Ordered backend, the armed callbacks by wakeup time, and the callbacks with a
+    // workload update deferred to the next rearm.
+    std::set<std::pair<nsecs_t, CallbackToken>> mArmedQueue GUARDED_BY(mMutex);
+    std::vector<CallbackToken> mPendingWorkloadUpdates GUARDED_BY(mMutex);
+    // The tracker's period when mArmedQueue was last revalidated.
+    nsecs_t mArmedQueuePeriod GUARDED_BY(mMutex) = 0;
+
     struct TraceBuffer {
         static constexpr char const kTraceNamePrefix[] = "-alarm in:";
         static constexpr char const kTraceNameSeparator[] = " for vs:";
@@ -29,6 +29,7 @@
 #include <utils/Trace.h>
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <sstream>
 
 namespace android::scheduler {
@@ -36,14 +37,30 @@ using base::StringAppendF;
 
 static auto constexpr kMaxPercent = 100u;
 
+// Tunables of the RobustKalman model, as fractions of the period.
+// Standard deviation of the timestamps around the vsync they are a sample of, which the filter
+// starts from and then estimates from the samples, down to the minimum.
+static constexpr double kKalmanJitter = 1.0 / 32;
+static constexpr double kKalmanMinJitter = 1.0 / 2000;
+// Weight of each sample in the estimate of the jitter.
+static constexpr double kKalmanJitterWeight = 1.0 / 8;
+// Standard deviation of the change of the period from one vsync to the next.
+static constexpr double kKalmanPeriodDrift = 1.0 / 100000;
+// Standard deviation of the period the filter is seeded with.
+static constexpr double kKalmanSeedPeriodError = 1.0 / 200;
+// Innovations beyond this many standard deviations are clamped.
+static constexpr double kKalmanInnovationLimit = 3;
+
 VSyncPredictor::~VSyncPredictor() = default;
 
 VSyncPredictor::VSyncPredictor(nsecs_t idealPeriod, size_t historySize,
-                               size_t minimumSamplesForPrediction, uint32_t outlierTolerancePercent)
+                               size_t minimumSamplesForPrediction, uint32_t outlierTolerancePercent,
+                               Model model)
       : mTraceOn(property_get_bool("debug.sf.vsp_trace", true)),
         kHistorySize(historySize),
         kMinimumSamplesForPrediction(minimumSamplesForPrediction),
         kOutlierTolerancePercent(std::min(outlierTolerancePercent, kMaxPercent)),
+        mModel(model),
         mIdealPeriod(idealPeriod) {
     resetModel();
 }
@@ -96,6 +113,10 @@ bool VSyncPredictor::addVsyncTimestamp(nsecs_t timestamp) {
         mTimestamps[mLastTimestampIndex] = timestamp;
     }
 
+    if (mModel == Model::RobustKalman) {
+        return updateKalmanModel(timestamp);
+    }
+
     if (mTimestamps.size() < kMinimumSamplesForPrediction) {
         mRateMap[mIdealPeriod] = {mIdealPeriod, 0};
         return true;
@@ -176,6 +197,106 @@ bool VSyncPredictor::addVsyncTimestamp(nsecs_t timestamp) {
     return true;
 }
 
+void VSyncPredictor::KalmanFilter::seed(nsecs_t timestamp, double initialPeriod) {
+    origin = timestamp;
+    phase = 0;
+    period = initialPeriod;
+    const double jitter = initialPeriod * kKalmanJitter;
+    const double periodError = initialPeriod * kKalmanSeedPeriodError;
+    jitterVariance = jitter * jitter;
+    p00 = jitterVariance;
+    p01 = 0;
+    p11 = periodError * periodError;
+    valid = true;
+}
+
+void VSyncPredictor::KalmanFilter::update(nsecs_t timestamp) {
+    const double sample = static_cast<double>(timestamp - origin);
+    const double vsyncs = std::round((sample - phase) / period);
+
+    // The sample is measured against the vsync it is closest to. Samples of a later vsync move
+    // the state forward to it, and those of an earlier one, which come in when present fences
+    // signal out of order, are measured against the current state.
+    double h1 = 0;
+    if (vsyncs > 0) {
+        const double drift = period * kKalmanPeriodDrift;
+        phase += vsyncs * period;
+        p00 += vsyncs * (2 * p01 + vsyncs * p11);
+        p01 += vsyncs * p11;
+        p11 += vsyncs * drift * drift;
+    } else {
+        h1 = vsyncs;
+    }
+
+    const double ph0 = p00 + h1 * p01;
+    const double ph1 = p01 + h1 * p11;
+    const double stateVariance = ph0 + h1 * ph1;
+    const double innovationVariance = stateVariance + jitterVariance;
+    const double limit = kKalmanInnovationLimit * std::sqrt(innovationVariance);
+    const double innovation = std::clamp(sample - (phase + h1 * period), -limit, limit);
+
+    // The part of the innovation that the uncertainty of the state does not account for is the
+    // jitter. The clamped innovation keeps outliers from inflating it.
+    const double minJitter = period * kKalmanMinJitter;
+    jitterVariance += kKalmanJitterWeight *
+            (std::max(innovation * innovation - stateVariance, minJitter * minJitter) -
+             jitterVariance);
+
+    const double k0 = ph0 / innovationVariance;
+    const double k1 = ph1 / innovationVariance;
+    phase += k0 * innovation;
+    period += k1 * innovation;
+    p00 -= k0 * ph0;
+    p01 -= k0 * ph1;
+    p11 -= k1 * ph1;
+
+    const nsecs_t shift = std::llround(phase);
+    origin += shift;
+    phase -= shift;
+}
+
+bool VSyncPredictor::updateKalmanModel(nsecs_t timestamp) {
+    auto it = mRateMap.find(mIdealPeriod);
+    if (!mKalman.valid) {
+        // The period last learned for this ideal period is the best guess until samples come in.
+        mKalman.seed(timestamp, std::get<0>(it->second));
+    } else {
+        mKalman.update(timestamp);
+    }
+
+    if (mTimestamps.size() < kMinimumSamplesForPrediction) {
+        it->second = {mIdealPeriod, 0};
+        return true;
+    }
+
+    nsecs_t const anticipatedPeriod = std::llround(mKalman.period);
+    auto const percent = std::abs(anticipatedPeriod - mIdealPeriod) * kMaxPercent / mIdealPeriod;
+    if (percent >= kOutlierTolerancePercent) {
+        it->second = {mIdealPeriod, 0};
+        clearTimestamps();
+        return false;
+    }
+
+    // Express the model like the least-squares one, relative to the oldest timestamp, with the
+    // intercept being the offset of the nearest modelled vsync.
+    auto const oldest_ts = *std::min_element(mTimestamps.begin(), mTimestamps.end());
+    nsecs_t intercept = (mKalman.origin - oldest_ts) % anticipatedPeriod;
+    if (intercept > anticipatedPeriod / 2) {
+        intercept -= anticipatedPeriod;
+    } else if (intercept < -anticipatedPeriod / 2) {
+        intercept += anticipatedPeriod;
+    }
+
+    traceInt64If("VSP-period", anticipatedPeriod);
+    traceInt64If("VSP-intercept", intercept);
+
+    it->second = {anticipatedPeriod, intercept};
+
+    ALOGV("kalman model update ts: %" PRId64 " slope: %" PRId64 " intercept: %" PRId64, timestamp,
+          anticipatedPeriod, intercept);
+    return true;
+}
+
 nsecs_t VSyncPredictor::nextAnticipatedVSyncTimeFrom(nsecs_t timePoint) const {
     std::lock_guard<std::mutex> lk(mMutex);
 
@@ -253,6 +374,7 @@ void VSyncPredictor::clearTimestamps() {
         mTimestamps.clear();
         mLastTimestampIndex = 0;
     }
+    mKalman.valid = false;
 }
 
 bool VSyncPredictor::needsMoreSamples() const {
@@ -269,6 +391,8 @@ void VSyncPredictor::resetModel() {
 void VSyncPredictor::dump(std::string& result) const {
     std::lock_guard<std::mutex> lk(mMutex);
     StringAppendF(&result, "\tmIdealPeriod=%.2f\n", mIdealPeriod / 1e6f);
+    StringAppendF(&result, "\tmModel=%s\n",
+                  mModel == Model::RobustKalman ? "RobustKalman" : "LeastSquares");
     StringAppendF(&result, "\tRefresh Rate Map:\n");
     for (const auto& [idealPeriod, periodInterceptTuple] : mRateMap) {
         StringAppendF(&result,
@@ -27,15 +27,26 @@ namespace android::scheduler {
 
 class VSyncPredictor : public VSyncTracker {
 public:
+    enum class Model {
+        // Least-squares fit over the timestamps in the history, recomputed for each sample.
+        LeastSquares,
+        // Kalman filter over the vsync phase and period, updated in constant time for each
+        // sample. The jitter of the samples is estimated as they come in, innovations are clamped
+        // so that outliers move the model less, and the filter is seeded with the last period
+        // learned for the ideal period after a period change.
+        RobustKalman,
+    };
+
     /*
      * \param [in] idealPeriod  The initial ideal period to use.
      * \param [in] historySize  The internal amount of entries to store in the model.
      * \param [in] minimumSamplesForPrediction The minimum number of samples to collect before
      * predicting. \param [in] outlierTolerancePercent a number 0 to 100 that will be used to filter
      * samples that fall outlierTolerancePercent from an anticipated vsync event.
+     * \param [in] model        The estimator used to fit the samples.
      */
     VSyncPredictor(nsecs_t idealPeriod, size_t historySize, size_t minimumSamplesForPrediction,
-                   uint32_t outlierTolerancePercent);
+                   uint32_t outlierTolerancePercent, Model model = Model::LeastSquares);
     ~VSyncPredictor();
 
     bool addVsyncTimestamp(nsecs_t timestamp) final;
@@ -66,12 +77,32 @@ private:
     VSyncPredictor& operator=(VSyncPredictor const&) = delete;
     void clearTimestamps() REQUIRES(mMutex);
 
+    // State of the RobustKalman model. The phase is kept relative to an integral origin, which
+    // follows the last vsync, so that the doubles keep their precision for any uptime.
+    struct KalmanFilter {
+        nsecs_t origin = 0;
+        double phase = 0;
+        double period = 0;
+        // Covariance of the (phase, period) estimate.
+        double p00 = 0;
+        double p01 = 0;
+        double p11 = 0;
+        // Estimate of the variance of the timestamps around the vsync they are a sample of.
+        double jitterVariance = 0;
+        bool valid = false;
+
+        void seed(nsecs_t timestamp, double initialPeriod);
+        void update(nsecs_t timestamp);
+    };
+    bool updateKalmanModel(nsecs_t timestamp) REQUIRES(mMutex);
+
     inline void traceInt64If(const char* name, int64_t value) const;
     bool const mTraceOn;
 
     size_t const kHistorySize;
     size_t const kMinimumSamplesForPrediction;
     size_t const kOutlierTolerancePercent;
+    Model const mModel;
 
     std::mutex mutable mMutex;
     size_t next(int i) const REQUIRES(mMutex);
@@ -86,6 +117,8 @@ private:
 
     int mLastTimestampIndex GUARDED_BY(mMutex) = 0;
     std::vector<nsecs_t> mTimestamps GUARDED_BY(mMutex);
+
+    KalmanFilter mKalman GUARDED_BY(mMutex);
 };
 
 } // namespace android::scheduler
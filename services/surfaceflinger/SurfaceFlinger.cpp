@@ -438,6 +438,12 @@ SurfaceFlinger::SurfaceFlinger(Factory& factory) : SurfaceFlinger(factory, SkipI
     property_get("debug.sf.disable_client_composition_cache", value, "0");
     mDisableClientCompositionCache = atoi(value);
 
+    property_get("debug.sf.incremental_visible_regions", value, "0");
+    mUseIncrementalVisibleRegions = atoi(value);
+
+    property_get("debug.sf.parallel_output_present", value, "0");
+    mPresentOutputsInParallel = atoi(value);
+
     // We should be reading 'persist.sys.sf.color_saturation' here
     // but since /data may be encrypted, we need to wait until after vold
     // comes online to attempt to read the property. The property is
@@ -694,6 +700,8 @@ void SurfaceFlinger::init() {
                 .setContextPriority(useContextPriority
                         ? renderengine::RenderEngine::ContextPriority::HIGH
                         : renderengine::RenderEngine::ContextPriority::MEDIUM)
+                .setProgramBinaryCacheDir(
+                        base::GetProperty("debug.sf.program_binary_cache_dir", ""))
                 .build()));
     mCompositionEngine->setTimeStats(mTimeStats);
 
@@ -2085,6 +2093,8 @@ void SurfaceFlinger::onMessageRefresh() {
     refreshArgs.updatingOutputGeometryThisFrame = mVisibleRegionsDirty;
     refreshArgs.updatingGeometryThisFrame = mGeometryInvalid || mVisibleRegionsDirty;
     refreshArgs.blursAreExpensive = mBlursAreExpensive;
+    refreshArgs.useIncrementalVisibleRegions = mUseIncrementalVisibleRegions;
+    refreshArgs.presentOutputsInParallel = mPresentOutputsInParallel;
     refreshArgs.internalDisplayRotationFlags = DisplayDevice::getPrimaryDisplayRotationFlags();
 
     if (CC_UNLIKELY(mDrawingState.colorMatrixChanged)) {
@@ -3306,6 +3316,7 @@ bool SurfaceFlinger::flushTransactionQueues() {
     bool flushedATransaction = false;
     {
         Mutex::Autolock _l(mStateLock);
+        dequeueIngressTransactionsLocked();
 
         auto it = mTransactionQueues.begin();
         while (it != mTransactionQueues.end()) {
@@ -3340,7 +3351,13 @@ bool SurfaceFlinger::flushTransactionQueues() {
 }
 
 bool SurfaceFlinger::transactionFlushNeeded() {
-    return !mTransactionQueues.empty();
+    return !mTransactionQueues.empty() || !mTransactionIngress.empty();
+}
+
+void SurfaceFlinger::dequeueIngressTransactionsLocked() {
+    mTransactionIngress.drain([this](std::pair<sp<IBinder>, TransactionState>&& transaction) {
+        mTransactionQueues[transaction.first].push(std::move(transaction.second));
+    });
 }
 
 
@@ -3378,7 +3395,24 @@ void SurfaceFlinger::setTransactionState(
 
     bool privileged = callingThreadHasUnscopedSurfaceFlingerAccess();
 
+    // Unless the caller waits for the transaction, or it changes the vsync offsets, leave it to
+    // the main thread to apply, after the transactions queued before it with the same applyToken.
+    // This doesn't take mStateLock, which the main thread holds for most of a frame.
+    constexpr uint32_t kApplyNowFlags = eSynchronous | eAnimation | eEarlyWakeup |
+            eExplicitEarlyWakeupStart | eExplicitEarlyWakeupEnd;
+    if (!(flags & kApplyNowFlags) && !inputWindowCommands.syncInputWindows) {
+        // The main thread checks whether it is ready to be applied against the expected present
+        // time it computes on invalidate, before flushing.
+        mTransactionIngress.push({applyToken,
+                                  TransactionState(states, displays, flags, desiredPresentTime,
+                                                   uncacheBuffer, postTime, privileged,
+                                                   hasListenerCallbacks, listenerCallbacks)});
+        setTransactionFlags(eTransactionFlushNeeded);
+        return;
+    }
+
     Mutex::Autolock _l(mStateLock);
+    dequeueIngressTransactionsLocked();
 
     // If its TransactionQueue already has a pending TransactionState or if it is pending
     auto itr = mTransactionQueues.find(applyToken);
@@ -3393,6 +3427,7 @@ void SurfaceFlinger::setTransactionState(
                          "waiting for animation frame to apply");
                 break;
             }
+            dequeueIngressTransactionsLocked();
             itr = mTransactionQueues.find(applyToken);
         }
     }
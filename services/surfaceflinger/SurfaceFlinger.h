@@ -56,6 +56,7 @@
 #include "Effects/Daltonizer.h"
 #include "FrameTracker.h"
 #include "LayerVector.h"
+#include "LocklessQueue.h"
 #include "Scheduler/RefreshRateConfigs.h"
 #include "Scheduler/RefreshRateStats.h"
 #include "Scheduler/Scheduler.h"
@@ -336,6 +337,13 @@ public:
     // debug.sf.disable_client_composition_cache
     bool mDisableClientCompositionCache = false;
 
+    // If true, only recompute the visible regions of layers at or below the topmost layer whose
+    // geometry changed.
+    bool mUseIncrementalVisibleRegions = false;
+
+    // debug.sf.parallel_output_present
+    bool mPresentOutputsInParallel = false;
+
 private:
     friend class BufferLayer;
     friend class BufferQueueLayer;
@@ -625,6 +633,8 @@ private:
                                bool privileged, bool hasListenerCallbacks,
                                const std::vector<ListenerCallbacks>& listenerCallbacks,
                                bool isMainThread = false) REQUIRES(mStateLock);
+    // Moves the transactions pushed to mTransactionIngress to mTransactionQueues
+    void dequeueIngressTransactionsLocked() REQUIRES(mStateLock);
     // Returns true if at least one transaction was flushed
     bool flushTransactionQueues();
     // Returns true if there is at least one transaction that needs to be flushed
@@ -1155,6 +1165,9 @@ private:
         std::vector<ListenerCallbacks> listenerCallbacks;
     };
     std::unordered_map<sp<IBinder>, std::queue<TransactionState>, IListenerHash> mTransactionQueues;
+    // Transactions that don't need to wait for being applied are pushed here by the binder threads,
+    // without taking mStateLock, and moved to mTransactionQueues by whoever holds it next.
+    LocklessQueue<std::pair<sp<IBinder>, TransactionState>> mTransactionIngress;
 
     /* ------------------------------------------------------------------------
      * Feature prototyping
@@ -25,11 +25,18 @@
 #include <SurfaceFlinger.h>
 
 #include <android-base/file.h>
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <log/log.h>
+#include <sys/mman.h>
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
+
 namespace android {
 
 SurfaceTracing::SurfaceTracing(SurfaceFlinger& flinger)
@@ -65,7 +72,11 @@ LayersTraceProto SurfaceTracing::traceWhenNotified() {
 
 bool SurfaceTracing::addTraceToBuffer(LayersTraceProto& entry) {
     std::scoped_lock lock(mTraceLock);
-    mBuffer.emplace(std::move(entry));
+    if (mIncremental) {
+        addIncrementalTraceLocked(entry);
+    } else {
+        mBuffer.emplace(std::move(entry));
+    }
     if (mWriteToFile) {
         writeProtoFileLocked();
         mWriteToFile = false;
@@ -73,6 +84,21 @@ bool SurfaceTracing::addTraceToBuffer(LayersTraceProto& entry) {
     return mEnabled;
 }
 
+void SurfaceTracing::addIncrementalTraceLocked(LayersTraceProto& entry) {
+    ATRACE_CALL();
+
+    // The diff is computed here rather than in traceLayersLocked, so that it does not hold up
+    // the main thread.
+    const bool forceKeyframe =
+            !mRingBuffer.hasKeyframe() || mEntriesSinceKeyframe >= kKeyframeInterval;
+    const bool keyframe = mDiff.encode(&entry, forceKeyframe);
+    mEntriesSinceKeyframe = keyframe ? 0 : mEntriesSinceKeyframe + 1;
+    if (!mRingBuffer.emplace(entry, keyframe)) {
+        // The next entry cannot be a diff against one that was dropped.
+        mDiff.reset();
+    }
+}
+
 void SurfaceTracing::notify(const char* where) {
     std::scoped_lock lock(mSfLock);
     notifyLocked(where);
@@ -124,6 +150,104 @@ void SurfaceTracing::LayersTraceBuffer::flush(LayersTraceFileProto* fileProto) {
     }
 }
 
+bool SurfaceTracing::LayersTraceRingBuffer::reset(size_t newSize) {
+    release();
+    void* data = mmap(nullptr, newSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (data == MAP_FAILED) {
+        ALOGE("Could not map a %zu byte trace buffer: %s", newSize, strerror(errno));
+        return false;
+    }
+    mData = static_cast<uint8_t*>(data);
+    mSizeInBytes = newSize;
+    return true;
+}
+
+void SurfaceTracing::LayersTraceRingBuffer::clear() {
+    mRecords.clear();
+    mUsedInBytes = 0U;
+    mTail = 0U;
+    mKeyframeCount = 0U;
+}
+
+void SurfaceTracing::LayersTraceRingBuffer::release() {
+    clear();
+    if (mData) {
+        munmap(mData, mSizeInBytes);
+        mData = nullptr;
+    }
+    mSizeInBytes = 0U;
+}
+
+bool SurfaceTracing::LayersTraceRingBuffer::emplace(const LayersTraceProto& proto,
+                                                   bool keyframe) {
+    const size_t protoSize = proto.ByteSizeLong();
+    if (protoSize > mSizeInBytes) {
+        return false;
+    }
+
+    // Entries are kept contiguous, so one that does not fit before the end starts over at 0,
+    // and the end of the buffer is left unused.
+    const bool wrap = mTail + protoSize > mSizeInBytes;
+    const size_t offset = wrap ? 0U : mTail;
+    const auto inTheWay = [&](const Record& record) {
+        const size_t end = record.offset + record.size;
+        return (record.offset < offset + protoSize && offset < end) || (wrap && end > mTail);
+    };
+    // Entries follow each other from the oldest one on, so that is the first one in the way.
+    while (!mRecords.empty() && inTheWay(mRecords.front())) {
+        mUsedInBytes -= mRecords.front().size;
+        mKeyframeCount -= mRecords.front().keyframe ? 1 : 0;
+        mRecords.pop_front();
+    }
+
+    proto.SerializeWithCachedSizesToArray(mData + offset);
+    mRecords.push_back({offset, protoSize, keyframe});
+    mUsedInBytes += protoSize;
+    mKeyframeCount += keyframe ? 1 : 0;
+    mTail = offset + protoSize;
+    return true;
+}
+
+status_t SurfaceTracing::LayersTraceRingBuffer::writeToFile(const char* filename) const {
+    using google::protobuf::io::CodedOutputStream;
+    // Tags of LayersTraceFileProto.magic_number (fixed64) and LayersTraceFileProto.entry.
+    constexpr uint8_t kMagicNumberTag = (1 << 3) | 1;
+    constexpr uint8_t kEntryTag = (2 << 3) | 2;
+
+    // -rw-r--r--
+    const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    base::unique_fd fd(open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode));
+    if (fd < 0 || fchmod(fd, mode) != 0) {
+        ALOGE("Could not open %s: %s", filename, strerror(errno));
+        return PERMISSION_DENIED;
+    }
+
+    uint8_t header[1 + sizeof(uint64_t)] = {kMagicNumberTag};
+    CodedOutputStream::WriteLittleEndian64ToArray(
+            uint64_t(LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_H) << 32 |
+                    LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_L,
+            header + 1);
+    bool ok = base::WriteFully(fd, header, sizeof(header));
+
+    // Entries before the oldest keyframe are diffs against entries that were evicted.
+    auto record = std::find_if(mRecords.begin(), mRecords.end(),
+                               [](const Record& r) { return r.keyframe; });
+    for (; ok && record != mRecords.end(); ++record) {
+        // The tag, followed by the size as a varint of at most 5 bytes.
+        uint8_t entryHeader[1 + 5] = {kEntryTag};
+        const uint8_t* end = CodedOutputStream::WriteVarint32ToArray(record->size, entryHeader + 1);
+        ok = base::WriteFully(fd, entryHeader, end - entryHeader) &&
+                base::WriteFully(fd, mData + record->offset, record->size);
+    }
+
+    if (!ok) {
+        ALOGE("Could not write %s: %s", filename, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
 bool SurfaceTracing::enable() {
     std::scoped_lock lock(mTraceLock);
 
@@ -131,7 +255,13 @@ bool SurfaceTracing::enable() {
         return false;
     }
 
-    mBuffer.reset(mBufferSize);
+    mIncremental = base::GetBoolProperty("debug.sf.layer_trace_incremental", false);
+    if (mIncremental) {
+        mIncremental = mRingBuffer.reset(mBufferSize);
+        mDiff.reset();
+        mEntriesSinceKeyframe = 0;
+    }
+    mBuffer.reset(mIncremental ? 0 : mBufferSize);
     mEnabled = true;
     mThread = std::thread(&SurfaceTracing::mainLoop, this);
     return true;
@@ -168,6 +298,7 @@ bool SurfaceTracing::isEnabled() const {
 void SurfaceTracing::setBufferSize(size_t bufferSizeInByte) {
     std::scoped_lock lock(mTraceLock);
     mBufferSize = bufferSizeInByte;
+    // The ring buffer of incremental mode is resized the next time tracing is enabled.
     mBuffer.setSize(bufferSizeInByte);
 }
 
@@ -205,6 +336,17 @@ LayersTraceProto SurfaceTracing::traceLayersLocked(const char* where) {
 void SurfaceTracing::writeProtoFileLocked() {
     ATRACE_CALL();
 
+    if (mIncremental) {
+        mLastErr = mRingBuffer.writeToFile(kDefaultFileName);
+        if (mEnabled) {
+            mRingBuffer.clear();
+        } else {
+            mRingBuffer.release();
+        }
+        mDiff.reset();
+        return;
+    }
+
     LayersTraceFileProto fileProto;
     std::string output;
 
@@ -231,7 +373,14 @@ void SurfaceTracing::writeProtoFileLocked() {
 
 void SurfaceTracing::dump(std::string& result) const {
     std::scoped_lock lock(mTraceLock);
-    base::StringAppendF(&result, "Tracing state: %s\n", mEnabled ? "enabled" : "disabled");
+    base::StringAppendF(&result, "Tracing state: %s%s\n", mEnabled ? "enabled" : "disabled",
+                        mIncremental ? " (incremental)" : "");
+    if (mIncremental) {
+        base::StringAppendF(&result, "  number of entries: %zu (%.2fMB / %.2fMB)\n",
+                            mRingBuffer.frameCount(), float(mRingBuffer.used()) / float(1_MB),
+                            float(mRingBuffer.size()) / float(1_MB));
+        return;
+    }
     base::StringAppendF(&result, "  number of entries: %zu (%.2fMB / %.2fMB)\n",
                         mBuffer.frameCount(), float(mBuffer.used()) / float(1_MB),
                         float(mBuffer.size()) / float(1_MB));
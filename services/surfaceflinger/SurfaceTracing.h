@@ -18,10 +18,12 @@
 
 #include <android-base/thread_annotations.h>
 #include <layerproto/LayerProtoHeader.h>
+#include <layerproto/LayersTraceDiff.h>
 #include <utils/Errors.h>
 #include <utils/StrongPointer.h>
 
 #include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -38,6 +40,10 @@ constexpr auto operator""_MB(unsigned long long const num) {
 }
 /*
  * SurfaceTracing records layer states during surface flinging.
+ *
+ * When debug.sf.layer_trace_incremental is set as tracing is enabled, each entry only holds the
+ * layers that changed since the previous one, and is serialized straight into a preallocated
+ * ring buffer. Such traces are expanded back into full snapshots by layers_trace_expand.
  */
 class SurfaceTracing {
 public:
@@ -67,8 +73,13 @@ public:
     }
 
 private:
+    friend class LayersTraceRingBufferTest;
+
     static constexpr auto kDefaultBufferCapInByte = 5_MB;
     static constexpr auto kDefaultFileName = "/data/misc/wmtrace/layers_trace.pb";
+    // In incremental mode, the maximum number of entries between two full snapshots. This bounds
+    // the number of entries lost at the start of the trace when the ring buffer wraps.
+    static constexpr uint32_t kKeyframeInterval = 64;
 
     class LayersTraceBuffer { // ring buffer
     public:
@@ -87,6 +98,43 @@ private:
         std::queue<LayersTraceProto> mStorage;
     };
 
+    // Ring buffer of serialized entries in a shared memory mapping, which is populated up front
+    // so that tracing does not allocate or fault pages in.
+    class LayersTraceRingBuffer {
+    public:
+        ~LayersTraceRingBuffer() { release(); }
+
+        size_t size() const { return mSizeInBytes; }
+        size_t used() const { return mUsedInBytes; }
+        size_t frameCount() const { return mRecords.size(); }
+        bool hasKeyframe() const { return mKeyframeCount > 0; }
+
+        // Maps a new buffer of newSize bytes. Returns false if it could not be mapped.
+        bool reset(size_t newSize);
+        void clear();
+        void release();
+        // Serializes proto in place, evicting the oldest entries to make room. Returns false if
+        // proto is larger than the buffer.
+        bool emplace(const LayersTraceProto& proto, bool keyframe);
+        // Writes a LayersTraceFileProto with the entries from the oldest keyframe on.
+        status_t writeToFile(const char* filename) const;
+
+    private:
+        struct Record {
+            size_t offset;
+            size_t size;
+            bool keyframe;
+        };
+
+        uint8_t* mData = nullptr;
+        size_t mSizeInBytes = 0U;
+        size_t mUsedInBytes = 0U;
+        // Where the next entry is written, unless it does not fit before the end of the buffer.
+        size_t mTail = 0U;
+        size_t mKeyframeCount = 0U;
+        std::deque<Record> mRecords;
+    };
+
     void mainLoop();
     bool addFirstEntry();
     LayersTraceProto traceWhenNotified();
@@ -94,6 +142,7 @@ private:
 
     // Returns true if trace is enabled.
     bool addTraceToBuffer(LayersTraceProto& entry);
+    void addIncrementalTraceLocked(LayersTraceProto& entry) REQUIRES(mTraceLock);
     void writeProtoFileLocked() REQUIRES(mTraceLock);
 
     SurfaceFlinger& mFlinger;
@@ -111,6 +160,10 @@ private:
     LayersTraceBuffer mBuffer GUARDED_BY(mTraceLock);
     size_t mBufferSize GUARDED_BY(mTraceLock) = kDefaultBufferCapInByte;
     bool mEnabled GUARDED_BY(mTraceLock) = false;
+    bool mIncremental GUARDED_BY(mTraceLock) = false;
+    LayersTraceRingBuffer mRingBuffer GUARDED_BY(mTraceLock);
+    LayersTraceDiff mDiff GUARDED_BY(mTraceLock);
+    uint32_t mEntriesSinceKeyframe GUARDED_BY(mTraceLock) = 0;
     bool mWriteToFile GUARDED_BY(mTraceLock) = false;
 };
 
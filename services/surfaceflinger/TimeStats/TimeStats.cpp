@@ -123,6 +123,7 @@ AStatsManager_PullAtomCallbackReturn TimeStats::populateGlobalAtom(AStatsEventLi
 
 AStatsManager_PullAtomCallbackReturn TimeStats::populateLayerAtom(AStatsEventList* data) {
     std::lock_guard<std::mutex> lock(mMutex);
+    drainAllLayerEventsLocked();
 
     std::vector<TimeStatsHelper::TimeStatsLayer const*> dumpStats;
     for (const auto& ele : mTimeStats.stats) {
@@ -238,6 +239,7 @@ std::string TimeStats::miniDump() {
 
     std::string result = "TimeStats miniDump:\n";
     std::lock_guard<std::mutex> lock(mMutex);
+    drainAllLayerEventsLocked();
     android::base::StringAppendF(&result, "Number of layers currently being tracked is %zu\n",
                                  mTimeStatsTracker.size());
     android::base::StringAppendF(&result, "Number of layers in the stats pool is %zu\n",
@@ -385,10 +387,9 @@ bool TimeStats::recordReadyLocked(int32_t layerId, TimeRecord* timeRecord) {
     return true;
 }
 
-void TimeStats::flushAvailableRecordsToStatsLocked(int32_t layerId) {
+void TimeStats::flushAvailableRecordsToStatsLocked(int32_t layerId, LayerRecord& layerRecord) {
     ATRACE_CALL();
 
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
     TimeRecord& prevTimeRecord = layerRecord.prevTimeRecord;
     std::deque<TimeRecord>& timeRecords = layerRecord.timeRecords;
     while (!timeRecords.empty()) {
@@ -397,11 +398,21 @@ void TimeStats::flushAvailableRecordsToStatsLocked(int32_t layerId) {
               timeRecords[0].frameTime.frameNumber, timeRecords[0].frameTime.presentTime);
 
         if (prevTimeRecord.ready) {
-            const std::string& layerName = layerRecord.layerName;
-            if (!mTimeStats.stats.count(layerName)) {
-                mTimeStats.stats[layerName].layerName = layerName;
+            if (layerRecord.timeStatsLayer == nullptr) {
+                const std::string& layerName = layerRecord.layerName;
+                TimeStatsHelper::TimeStatsLayer& timeStatsLayer = mTimeStats.stats[layerName];
+                timeStatsLayer.layerName = layerName;
+                layerRecord.timeStatsLayer = &timeStatsLayer;
+                layerRecord.histograms = {
+                        .post2acquire = &timeStatsLayer.deltas["post2acquire"],
+                        .post2present = &timeStatsLayer.deltas["post2present"],
+                        .acquire2present = &timeStatsLayer.deltas["acquire2present"],
+                        .latch2present = &timeStatsLayer.deltas["latch2present"],
+                        .desired2present = &timeStatsLayer.deltas["desired2present"],
+                        .present2present = &timeStatsLayer.deltas["present2present"],
+                };
             }
-            TimeStatsHelper::TimeStatsLayer& timeStatsLayer = mTimeStats.stats[layerName];
+            TimeStatsHelper::TimeStatsLayer& timeStatsLayer = *layerRecord.timeStatsLayer;
             timeStatsLayer.totalFrames++;
             timeStatsLayer.droppedFrames += layerRecord.droppedFrames;
             timeStatsLayer.lateAcquireFrames += layerRecord.lateAcquireFrames;
@@ -415,37 +426,37 @@ void TimeStats::flushAvailableRecordsToStatsLocked(int32_t layerId) {
                                                       timeRecords[0].frameTime.acquireTime);
             ALOGV("[%d]-[%" PRIu64 "]-post2acquire[%d]", layerId,
                   timeRecords[0].frameTime.frameNumber, postToAcquireMs);
-            timeStatsLayer.deltas["post2acquire"].insert(postToAcquireMs);
+            layerRecord.histograms.post2acquire->insert(postToAcquireMs);
 
             const int32_t postToPresentMs = msBetween(timeRecords[0].frameTime.postTime,
                                                       timeRecords[0].frameTime.presentTime);
             ALOGV("[%d]-[%" PRIu64 "]-post2present[%d]", layerId,
                   timeRecords[0].frameTime.frameNumber, postToPresentMs);
-            timeStatsLayer.deltas["post2present"].insert(postToPresentMs);
+            layerRecord.histograms.post2present->insert(postToPresentMs);
 
             const int32_t acquireToPresentMs = msBetween(timeRecords[0].frameTime.acquireTime,
                                                          timeRecords[0].frameTime.presentTime);
             ALOGV("[%d]-[%" PRIu64 "]-acquire2present[%d]", layerId,
                   timeRecords[0].frameTime.frameNumber, acquireToPresentMs);
-            timeStatsLayer.deltas["acquire2present"].insert(acquireToPresentMs);
+            layerRecord.histograms.acquire2present->insert(acquireToPresentMs);
 
             const int32_t latchToPresentMs = msBetween(timeRecords[0].frameTime.latchTime,
                                                        timeRecords[0].frameTime.presentTime);
             ALOGV("[%d]-[%" PRIu64 "]-latch2present[%d]", layerId,
                   timeRecords[0].frameTime.frameNumber, latchToPresentMs);
-            timeStatsLayer.deltas["latch2present"].insert(latchToPresentMs);
+            layerRecord.histograms.latch2present->insert(latchToPresentMs);
 
             const int32_t desiredToPresentMs = msBetween(timeRecords[0].frameTime.desiredTime,
                                                          timeRecords[0].frameTime.presentTime);
             ALOGV("[%d]-[%" PRIu64 "]-desired2present[%d]", layerId,
                   timeRecords[0].frameTime.frameNumber, desiredToPresentMs);
-            timeStatsLayer.deltas["desired2present"].insert(desiredToPresentMs);
+            layerRecord.histograms.desired2present->insert(desiredToPresentMs);
 
             const int32_t presentToPresentMs = msBetween(prevTimeRecord.frameTime.presentTime,
                                                          timeRecords[0].frameTime.presentTime);
             ALOGV("[%d]-[%" PRIu64 "]-present2present[%d]", layerId,
                   timeRecords[0].frameTime.frameNumber, presentToPresentMs);
-            timeStatsLayer.deltas["present2present"].insert(presentToPresentMs);
+            layerRecord.histograms.present2present->insert(presentToPresentMs);
         }
         prevTimeRecord = timeRecords[0];
         timeRecords.pop_front();
@@ -462,6 +473,165 @@ static bool layerNameIsValid(const std::string& layerName) {
             layerName.compare(0, kMinLenLayerName, kPopupWindowPrefix) != 0;
 }
 
+TimeStats::LayerEventRing::LayerEventRing() {
+    for (uint32_t i = 0; i < kSize; i++) {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool TimeStats::LayerEventRing::push(LayerEvent& event) {
+    uint32_t position = mTail.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &mCells[position % kSize];
+        const uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const int32_t lag = static_cast<int32_t>(sequence - position);
+        if (lag == 0) {
+            if (mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // The cell still holds the event pushed kSize positions ago.
+            return false;
+        } else {
+            position = mTail.load(std::memory_order_relaxed);
+        }
+    }
+    cell->event = std::move(event);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool TimeStats::LayerEventRing::pop(LayerEvent* event) {
+    Cell& cell = mCells[mHead % kSize];
+    if (cell.sequence.load(std::memory_order_acquire) != mHead + 1) {
+        return false;
+    }
+    *event = std::move(cell.event);
+    cell.sequence.store(mHead + kSize, std::memory_order_release);
+    mHead++;
+    return true;
+}
+
+TimeStats::LayerSlot* TimeStats::findLayerSlot(int32_t layerId) {
+    if (layerId < 0) return nullptr;
+    LayerSlot& slot = mLayerSlots[layerId % kNumLayerSlots];
+    return slot.layerId.load(std::memory_order_acquire) == layerId ? &slot : nullptr;
+}
+
+void TimeStats::claimLayerSlotLocked(int32_t layerId, const std::string& layerName) {
+    if (layerId < 0 || !mTimeStatsTracker.count(layerId)) return;
+    LayerSlot& slot = mLayerSlots[layerId % kNumLayerSlots];
+    if (slot.layerId.load(std::memory_order_relaxed) != LayerSlot::kFree) return;
+
+    if (slot.events == nullptr) {
+        slot.events = std::make_unique<LayerEventRing>();
+    }
+    // Events pushed by a previous owner after it was destroyed.
+    drainLayerEventsLocked(slot);
+    slot.layerName = layerName;
+    slot.layerId.store(layerId, std::memory_order_release);
+}
+
+void TimeStats::drainLayerEventsLocked(LayerSlot& slot) {
+    if (slot.events == nullptr) return;
+
+    // The record of the layer that the last event was for, to look it up once for all the
+    // events of a frame rather than once per event.
+    int32_t layerId = LayerSlot::kFree;
+    LayerRecord* layerRecord = nullptr;
+    LayerEvent event;
+    while (slot.events->pop(&event)) {
+        if (event.type == LayerEvent::Type::Post) {
+            if (event.layerId == slot.layerId.load(std::memory_order_relaxed)) {
+                setPostTimeLocked(event.layerId, event.frameNumber, slot.layerName, event.time);
+            }
+            // Otherwise the layer was destroyed as it posted, and its name is gone with it.
+
+            // Posts add and remove records.
+            layerId = LayerSlot::kFree;
+            continue;
+        }
+        if (event.layerId != layerId) {
+            layerId = event.layerId;
+            const auto it = mTimeStatsTracker.find(layerId);
+            layerRecord = it != mTimeStatsTracker.end() ? &it->second : nullptr;
+        }
+        if (layerRecord != nullptr) {
+            applyLayerEventLocked(*layerRecord, event);
+        }
+    }
+}
+
+void TimeStats::drainAllLayerEventsLocked() {
+    ATRACE_CALL();
+
+    for (LayerSlot& slot : mLayerSlots) {
+        drainLayerEventsLocked(slot);
+    }
+}
+
+void TimeStats::recordLayerEvent(LayerEvent& event) {
+    LayerSlot* slot = findLayerSlot(event.layerId);
+    if (slot != nullptr && slot->events->push(event)) return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (slot != nullptr) {
+        // The ring is full. Apply the events in it first, to keep them in order.
+        drainLayerEventsLocked(*slot);
+    }
+    const auto it = mTimeStatsTracker.find(event.layerId);
+    if (it != mTimeStatsTracker.end()) {
+        applyLayerEventLocked(it->second, event);
+    }
+}
+
+void TimeStats::applyLayerEventLocked(LayerRecord& layerRecord, const LayerEvent& event) {
+    switch (event.type) {
+        case LayerEvent::Type::Post:
+            // Posts need the layer name, see setPostTime and drainLayerEventsLocked.
+            break;
+        case LayerEvent::Type::LatchSkipped:
+            switch (event.latchSkipReason) {
+                case LatchSkipReason::LateAcquire:
+                    layerRecord.lateAcquireFrames++;
+                    break;
+            }
+            break;
+        case LayerEvent::Type::BadDesiredPresent:
+            layerRecord.badDesiredPresentFrames++;
+            break;
+        case LayerEvent::Type::Latch:
+            if (TimeRecord* timeRecord = getWaitingTimeRecord(layerRecord, event.frameNumber)) {
+                timeRecord->frameTime.latchTime = event.time;
+            }
+            break;
+        case LayerEvent::Type::Desired:
+            if (TimeRecord* timeRecord = getWaitingTimeRecord(layerRecord, event.frameNumber)) {
+                timeRecord->frameTime.desiredTime = event.time;
+            }
+            break;
+        case LayerEvent::Type::Acquire:
+            if (TimeRecord* timeRecord = getWaitingTimeRecord(layerRecord, event.frameNumber)) {
+                timeRecord->frameTime.acquireTime = event.time;
+            }
+            break;
+        case LayerEvent::Type::AcquireFence:
+            if (TimeRecord* timeRecord = getWaitingTimeRecord(layerRecord, event.frameNumber)) {
+                timeRecord->acquireFence = event.fence;
+            }
+            break;
+        case LayerEvent::Type::Present:
+        case LayerEvent::Type::PresentFence:
+            setPresentLocked(event.layerId, layerRecord, event.frameNumber, event.time,
+                             event.fence);
+            break;
+        case LayerEvent::Type::RemoveTimeRecord:
+            removeTimeRecordLocked(layerRecord, event.frameNumber);
+            break;
+    }
+}
+
 void TimeStats::setPostTime(int32_t layerId, uint64_t frameNumber, const std::string& layerName,
                             nsecs_t postTime) {
     if (!mEnabled.load()) return;
@@ -470,7 +640,27 @@ void TimeStats::setPostTime(int32_t layerId, uint64_t frameNumber, const std::st
     ALOGV("[%d]-[%" PRIu64 "]-[%s]-PostTime[%" PRId64 "]", layerId, frameNumber, layerName.c_str(),
           postTime);
 
+    LayerSlot* slot = findLayerSlot(layerId);
+    if (slot != nullptr) {
+        LayerEvent event{.type = LayerEvent::Type::Post,
+                         .layerId = layerId,
+                         .frameNumber = frameNumber,
+                         .time = postTime};
+        if (slot->events->push(event)) return;
+    }
+
     std::lock_guard<std::mutex> lock(mMutex);
+    if (slot != nullptr) {
+        drainLayerEventsLocked(*slot);
+    }
+    setPostTimeLocked(layerId, frameNumber, layerName, postTime);
+    if (slot == nullptr) {
+        claimLayerSlotLocked(layerId, layerName);
+    }
+}
+
+void TimeStats::setPostTimeLocked(int32_t layerId, uint64_t frameNumber,
+                                  const std::string& layerName, nsecs_t postTime) {
     if (!mTimeStats.stats.count(layerName) && mTimeStats.stats.size() >= MAX_NUM_LAYER_STATS) {
         return;
     }
@@ -505,22 +695,26 @@ void TimeStats::setPostTime(int32_t layerId, uint64_t frameNumber, const std::st
         layerRecord.waitData = layerRecord.timeRecords.size() - 1;
 }
 
+TimeStats::TimeRecord* TimeStats::getWaitingTimeRecord(LayerRecord& layerRecord,
+                                                       uint64_t frameNumber) {
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return nullptr;
+    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
+    return timeRecord.frameTime.frameNumber == frameNumber ? &timeRecord : nullptr;
+}
+
 void TimeStats::setLatchTime(int32_t layerId, uint64_t frameNumber, nsecs_t latchTime) {
     if (!mEnabled.load()) return;
 
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-LatchTime[%" PRId64 "]", layerId, frameNumber, latchTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    if (layerRecord.waitData < 0 ||
-        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
-        return;
-    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
-    if (timeRecord.frameTime.frameNumber == frameNumber) {
-        timeRecord.frameTime.latchTime = latchTime;
-    }
+    LayerEvent event{.type = LayerEvent::Type::Latch,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber,
+                     .time = latchTime};
+    recordLayerEvent(event);
 }
 
 void TimeStats::incrementLatchSkipped(int32_t layerId, LatchSkipReason reason) {
@@ -530,15 +724,10 @@ void TimeStats::incrementLatchSkipped(int32_t layerId, LatchSkipReason reason) {
     ALOGV("[%d]-LatchSkipped-Reason[%d]", layerId,
           static_cast<std::underlying_type<LatchSkipReason>::type>(reason));
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-
-    switch (reason) {
-        case LatchSkipReason::LateAcquire:
-            layerRecord.lateAcquireFrames++;
-            break;
-    }
+    LayerEvent event{.type = LayerEvent::Type::LatchSkipped,
+                     .layerId = layerId,
+                     .latchSkipReason = reason};
+    recordLayerEvent(event);
 }
 
 void TimeStats::incrementBadDesiredPresent(int32_t layerId) {
@@ -547,10 +736,8 @@ void TimeStats::incrementBadDesiredPresent(int32_t layerId) {
     ATRACE_CALL();
     ALOGV("[%d]-BadDesiredPresent", layerId);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    layerRecord.badDesiredPresentFrames++;
+    LayerEvent event{.type = LayerEvent::Type::BadDesiredPresent, .layerId = layerId};
+    recordLayerEvent(event);
 }
 
 void TimeStats::setDesiredTime(int32_t layerId, uint64_t frameNumber, nsecs_t desiredTime) {
@@ -559,16 +746,11 @@ void TimeStats::setDesiredTime(int32_t layerId, uint64_t frameNumber, nsecs_t de
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-DesiredTime[%" PRId64 "]", layerId, frameNumber, desiredTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    if (layerRecord.waitData < 0 ||
-        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
-        return;
-    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
-    if (timeRecord.frameTime.frameNumber == frameNumber) {
-        timeRecord.frameTime.desiredTime = desiredTime;
-    }
+    LayerEvent event{.type = LayerEvent::Type::Desired,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber,
+                     .time = desiredTime};
+    recordLayerEvent(event);
 }
 
 void TimeStats::setAcquireTime(int32_t layerId, uint64_t frameNumber, nsecs_t acquireTime) {
@@ -577,16 +759,11 @@ void TimeStats::setAcquireTime(int32_t layerId, uint64_t frameNumber, nsecs_t ac
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-AcquireTime[%" PRId64 "]", layerId, frameNumber, acquireTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    if (layerRecord.waitData < 0 ||
-        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
-        return;
-    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
-    if (timeRecord.frameTime.frameNumber == frameNumber) {
-        timeRecord.frameTime.acquireTime = acquireTime;
-    }
+    LayerEvent event{.type = LayerEvent::Type::Acquire,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber,
+                     .time = acquireTime};
+    recordLayerEvent(event);
 }
 
 void TimeStats::setAcquireFence(int32_t layerId, uint64_t frameNumber,
@@ -597,16 +774,11 @@ void TimeStats::setAcquireFence(int32_t layerId, uint64_t frameNumber,
     ALOGV("[%d]-[%" PRIu64 "]-AcquireFenceTime[%" PRId64 "]", layerId, frameNumber,
           acquireFence->getSignalTime());
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    if (layerRecord.waitData < 0 ||
-        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
-        return;
-    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
-    if (timeRecord.frameTime.frameNumber == frameNumber) {
-        timeRecord.acquireFence = acquireFence;
-    }
+    LayerEvent event{.type = LayerEvent::Type::AcquireFence,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber,
+                     .fence = acquireFence};
+    recordLayerEvent(event);
 }
 
 void TimeStats::setPresentTime(int32_t layerId, uint64_t frameNumber, nsecs_t presentTime) {
@@ -615,20 +787,11 @@ void TimeStats::setPresentTime(int32_t layerId, uint64_t frameNumber, nsecs_t pr
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-PresentTime[%" PRId64 "]", layerId, frameNumber, presentTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    if (layerRecord.waitData < 0 ||
-        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
-        return;
-    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
-    if (timeRecord.frameTime.frameNumber == frameNumber) {
-        timeRecord.frameTime.presentTime = presentTime;
-        timeRecord.ready = true;
-        layerRecord.waitData++;
-    }
-
-    flushAvailableRecordsToStatsLocked(layerId);
+    LayerEvent event{.type = LayerEvent::Type::Present,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber,
+                     .time = presentTime};
+    recordLayerEvent(event);
 }
 
 void TimeStats::setPresentFence(int32_t layerId, uint64_t frameNumber,
@@ -639,26 +802,37 @@ void TimeStats::setPresentFence(int32_t layerId, uint64_t frameNumber,
     ALOGV("[%d]-[%" PRIu64 "]-PresentFenceTime[%" PRId64 "]", layerId, frameNumber,
           presentFence->getSignalTime());
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
-    if (layerRecord.waitData < 0 ||
-        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
-        return;
-    TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
-    if (timeRecord.frameTime.frameNumber == frameNumber) {
-        timeRecord.presentFence = presentFence;
-        timeRecord.ready = true;
+    LayerEvent event{.type = LayerEvent::Type::PresentFence,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber,
+                     .fence = presentFence};
+    recordLayerEvent(event);
+}
+
+void TimeStats::setPresentLocked(int32_t layerId, LayerRecord& layerRecord, uint64_t frameNumber,
+                                 nsecs_t presentTime,
+                                 const std::shared_ptr<FenceTime>& presentFence) {
+    if (TimeRecord* timeRecord = getWaitingTimeRecord(layerRecord, frameNumber)) {
+        if (presentFence != nullptr) {
+            timeRecord->presentFence = presentFence;
+        } else {
+            timeRecord->frameTime.presentTime = presentTime;
+        }
+        timeRecord->ready = true;
         layerRecord.waitData++;
     }
 
-    flushAvailableRecordsToStatsLocked(layerId);
+    flushAvailableRecordsToStatsLocked(layerId, layerRecord);
 }
 
 void TimeStats::onDestroy(int32_t layerId) {
     ATRACE_CALL();
     ALOGV("[%d]-onDestroy", layerId);
     std::lock_guard<std::mutex> lock(mMutex);
+    if (LayerSlot* slot = findLayerSlot(layerId)) {
+        drainLayerEventsLocked(*slot);
+        slot->layerId.store(LayerSlot::kFree, std::memory_order_release);
+    }
     mTimeStatsTracker.erase(layerId);
 }
 
@@ -668,9 +842,13 @@ void TimeStats::removeTimeRecord(int32_t layerId, uint64_t frameNumber) {
     ATRACE_CALL();
     ALOGV("[%d]-[%" PRIu64 "]-removeTimeRecord", layerId, frameNumber);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!mTimeStatsTracker.count(layerId)) return;
-    LayerRecord& layerRecord = mTimeStatsTracker[layerId];
+    LayerEvent event{.type = LayerEvent::Type::RemoveTimeRecord,
+                     .layerId = layerId,
+                     .frameNumber = frameNumber};
+    recordLayerEvent(event);
+}
+
+void TimeStats::removeTimeRecordLocked(LayerRecord& layerRecord, uint64_t frameNumber) {
     size_t removeAt = 0;
     for (const TimeRecord& record : layerRecord.timeRecords) {
         if (record.frameTime.frameNumber == frameNumber) break;
@@ -789,6 +967,8 @@ void TimeStats::setPresentFenceGlobal(const std::shared_ptr<FenceTime>& presentF
 
     ATRACE_CALL();
     std::lock_guard<std::mutex> lock(mMutex);
+    // Once per frame, apply the per-layer calls queued since the previous one.
+    drainAllLayerEventsLocked();
     if (presentFence == nullptr || !presentFence->isValid()) {
         mGlobalRecord.prevPresentTime = 0;
         return;
@@ -840,6 +1020,7 @@ void TimeStats::disable() {
 
 void TimeStats::clearAll() {
     std::lock_guard<std::mutex> lock(mMutex);
+    drainAllLayerEventsLocked();
     clearGlobalLocked();
     clearLayersLocked();
 }
@@ -887,6 +1068,7 @@ void TimeStats::dump(bool asProto, std::optional<uint32_t> maxLayers, std::strin
         return;
     }
 
+    drainAllLayerEventsLocked();
     mTimeStats.statsEnd = static_cast<int64_t>(std::time(0));
 
     flushPowerTimeLocked();
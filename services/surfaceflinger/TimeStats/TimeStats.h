@@ -34,6 +34,8 @@
 #include <utils/String16.h>
 #include <utils/Vector.h>
 
+#include <array>
+#include <atomic>
 #include <deque>
 #include <mutex>
 #include <optional>
@@ -152,6 +154,17 @@ class TimeStats : public android::TimeStats {
         uint32_t badDesiredPresentFrames = 0;
         TimeRecord prevTimeRecord;
         std::deque<TimeRecord> timeRecords;
+        // Where the frames of the layer are aggregated, once it has one. Cached to save looking
+        // the layer name and histogram names up for every frame.
+        TimeStatsHelper::TimeStatsLayer* timeStatsLayer = nullptr;
+        struct {
+            TimeStatsHelper::Histogram* post2acquire;
+            TimeStatsHelper::Histogram* post2present;
+            TimeStatsHelper::Histogram* acquire2present;
+            TimeStatsHelper::Histogram* latch2present;
+            TimeStatsHelper::Histogram* desired2present;
+            TimeStatsHelper::Histogram* present2present;
+        } histograms = {};
     };
 
     struct PowerTime {
@@ -170,6 +183,67 @@ class TimeStats : public android::TimeStats {
         std::deque<RenderEngineDuration> renderEngineDurations;
     };
 
+    // A per-layer call, recorded to be applied to the LayerRecord later.
+    struct LayerEvent {
+        enum class Type {
+            Post,
+            Latch,
+            LatchSkipped,
+            BadDesiredPresent,
+            Desired,
+            Acquire,
+            AcquireFence,
+            Present,
+            PresentFence,
+            RemoveTimeRecord,
+        };
+
+        Type type;
+        int32_t layerId = 0;
+        uint64_t frameNumber = 0;
+        nsecs_t time = 0;
+        std::shared_ptr<FenceTime> fence;
+        LatchSkipReason latchSkipReason = LatchSkipReason::LateAcquire;
+    };
+
+    // Bounded queue of LayerEvents. push is lock-free and can be called from any thread, pop
+    // must only be called with mMutex held.
+    class LayerEventRing {
+    public:
+        static constexpr uint32_t kSize = 32;
+
+        LayerEventRing();
+
+        // Moves event into the ring, or returns false if it is full.
+        bool push(LayerEvent& event);
+        // Returns false if the ring is empty, or the oldest event is still being pushed.
+        bool pop(LayerEvent* event);
+
+    private:
+        struct Cell {
+            // Equal to the position of the cell in the sequence of pushes when it is free, and
+            // to that position plus one once an event was pushed there.
+            std::atomic<uint32_t> sequence;
+            LayerEvent event;
+        };
+
+        std::array<Cell, kSize> mCells;
+        std::atomic<uint32_t> mTail = 0;
+        uint32_t mHead = 0;
+    };
+
+    // Per-layer calls for a layer that owns a slot are queued in its ring without taking mMutex,
+    // and applied in batches: once per frame, and whenever the stats are read.
+    struct LayerSlot {
+        static constexpr int32_t kFree = -1;
+
+        // The layer that owns the slot. Only changed with mMutex held.
+        std::atomic<int32_t> layerId = kFree;
+        // Allocated when the slot is first claimed, and kept for the following owners.
+        std::unique_ptr<LayerEventRing> events;
+        std::string layerName;
+    };
+
 public:
     TimeStats();
 
@@ -272,8 +346,25 @@ private:
                                                                  void* cookie);
     AStatsManager_PullAtomCallbackReturn populateGlobalAtom(AStatsEventList* data);
     AStatsManager_PullAtomCallbackReturn populateLayerAtom(AStatsEventList* data);
+    void setPostTimeLocked(int32_t layerId, uint64_t frameNumber, const std::string& layerName,
+                           nsecs_t postTime);
+    // Returns the TimeRecord of layerRecord that is waiting for the timestamps of frameNumber,
+    // if there is one.
+    static TimeRecord* getWaitingTimeRecord(LayerRecord& layerRecord, uint64_t frameNumber);
+    void setPresentLocked(int32_t layerId, LayerRecord& layerRecord, uint64_t frameNumber,
+                          nsecs_t presentTime, const std::shared_ptr<FenceTime>& presentFence);
+    void removeTimeRecordLocked(LayerRecord& layerRecord, uint64_t frameNumber);
+    // Queues event in the ring of its layer, or applies it right away if the layer has no slot
+    // or its ring is full.
+    void recordLayerEvent(LayerEvent& event);
+    // Applies event, other than a post, to the record of its layer.
+    void applyLayerEventLocked(LayerRecord& layerRecord, const LayerEvent& event);
+    LayerSlot* findLayerSlot(int32_t layerId);
+    void claimLayerSlotLocked(int32_t layerId, const std::string& layerName);
+    void drainLayerEventsLocked(LayerSlot& slot);
+    void drainAllLayerEventsLocked();
     bool recordReadyLocked(int32_t layerId, TimeRecord* timeRecord);
-    void flushAvailableRecordsToStatsLocked(int32_t layerId);
+    void flushAvailableRecordsToStatsLocked(int32_t layerId, LayerRecord& layerRecord);
     void flushPowerTimeLocked();
     void flushAvailableGlobalRecordsToStatsLocked();
 
@@ -292,6 +383,11 @@ private:
     PowerTime mPowerTime;
     GlobalRecord mGlobalRecord;
 
+    // Layers are mapped to the slot at layerId % kNumLayerSlots. Since layer ids are handed out
+    // in sequence, live layers rarely collide, and those that do take mMutex for every call.
+    static constexpr size_t kNumLayerSlots = 256;
+    std::array<LayerSlot, kNumLayerSlots> mLayerSlots;
+
     static const size_t MAX_NUM_LAYER_RECORDS = 200;
     static const size_t MAX_NUM_LAYER_STATS = 200;
     std::unique_ptr<StatsEventDelegate> mStatsDelegate = std::make_unique<StatsEventDelegate>();
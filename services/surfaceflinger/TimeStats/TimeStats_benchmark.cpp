@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the per-frame cost of TimeStats for a number of layers that each
+// get a new buffer every frame. With colliding layer ids, all layers but one
+// share a slot and take the locked path, as every call did before per-layer
+// events were queued.
+
+#include <benchmark/benchmark.h>
+
+#include "TimeStats.h"
+
+namespace android {
+namespace {
+
+using PowerMode = hardware::graphics::composer::V2_4::IComposerClient::PowerMode;
+
+constexpr int32_t kSlotStride = 256;
+
+impl::TimeStats* gTimeStats = nullptr;
+
+void BM_Frame(benchmark::State& state) {
+    const int32_t layerCount = static_cast<int32_t>(state.range(0)) / state.threads;
+    const bool colliding = state.range(1) != 0;
+
+    if (state.thread_index == 0) {
+        gTimeStats = new impl::TimeStats();
+        std::string result;
+        Vector<String16> args;
+        args.add(String16("-enable"));
+        gTimeStats->parseArgs(false, args, result);
+        gTimeStats->setPowerMode(PowerMode::ON);
+    }
+
+    std::vector<int32_t> layerIds;
+    std::vector<std::string> layerNames;
+    for (int32_t i = 0; i < layerCount; i++) {
+        const int32_t index = state.thread_index * layerCount + i;
+        layerIds.push_back(colliding ? index * kSlotStride + 1 : index + 1);
+        layerNames.push_back("com.example.app/Activity#" + std::to_string(index));
+    }
+
+    uint64_t frameNumber = 0;
+    nsecs_t time = 1000000;
+    for (auto _ : state) {
+        frameNumber++;
+        for (int32_t i = 0; i < layerCount; i++) {
+            const int32_t layerId = layerIds[i];
+            gTimeStats->setPostTime(layerId, frameNumber, layerNames[i], time);
+            gTimeStats->setAcquireFence(layerId, frameNumber,
+                                        std::make_shared<FenceTime>(time + 1000000));
+            gTimeStats->setDesiredTime(layerId, frameNumber, time);
+            gTimeStats->setLatchTime(layerId, frameNumber, time + 2000000);
+            gTimeStats->setPresentFence(layerId, frameNumber,
+                                        std::make_shared<FenceTime>(time + 16000000));
+        }
+        if (state.thread_index == 0) {
+            gTimeStats->setPresentFenceGlobal(std::make_shared<FenceTime>(time + 16000000));
+        }
+        time += 16000000;
+    }
+
+    if (state.thread_index == 0) {
+        delete gTimeStats;
+        gTimeStats = nullptr;
+    }
+}
+BENCHMARK(BM_Frame)
+        ->ArgNames({"layers", "colliding"})
+        ->Args({100, 0})
+        ->Args({100, 1})
+        ->ThreadRange(1, 4)
+        ->UseRealTime();
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <layerproto/LayersTraceDiff.h>
+
+#include <unordered_set>
+
+namespace android {
+namespace surfaceflinger {
+
+bool LayersTraceDiff::encode(LayersTraceProto* entry, bool forceKeyframe) {
+    auto* layers = entry->mutable_layers()->mutable_layers();
+
+    std::unordered_map<int32_t, std::string> current;
+    current.reserve(layers->size());
+    std::vector<int32_t> ids;
+    ids.reserve(layers->size());
+    for (const auto& layer : *layers) {
+        ids.push_back(layer.id());
+        layer.SerializeToString(&current[layer.id()]);
+    }
+
+    // An incremental entry without layers would be ambiguous, since an empty layer_ids means
+    // the layers are unchanged, so a trace that loses all its layers gets a keyframe.
+    const bool keyframe = forceKeyframe || !mHasPrevious || ids.empty();
+    if (!keyframe) {
+        int kept = 0;
+        for (int i = 0; i < layers->size(); i++) {
+            const int32_t id = layers->Get(i).id();
+            const auto previous = mLayers.find(id);
+            if (previous != mLayers.end() && previous->second == current[id]) {
+                continue;
+            }
+            if (kept != i) {
+                layers->SwapElements(kept, i);
+            }
+            kept++;
+        }
+        layers->DeleteSubrange(kept, layers->size() - kept);
+
+        if (ids != mLayerIds) {
+            entry->mutable_layer_ids()->Add(ids.begin(), ids.end());
+        }
+        entry->set_incremental(true);
+    }
+
+    mLayers.swap(current);
+    mLayerIds.swap(ids);
+    mHasPrevious = true;
+    return keyframe;
+}
+
+void LayersTraceDiff::reset() {
+    mLayers.clear();
+    mLayerIds.clear();
+    mHasPrevious = false;
+}
+
+bool expandLayersTrace(LayersTraceFileProto* trace) {
+    auto* entries = trace->mutable_entry();
+    int firstKeyframe = 0;
+    while (firstKeyframe < entries->size() && entries->Get(firstKeyframe).incremental()) {
+        firstKeyframe++;
+    }
+    entries->DeleteSubrange(0, firstKeyframe);
+
+    std::unordered_map<int32_t, LayerProto> layers;
+    std::vector<int32_t> ids;
+    for (auto& entry : *entries) {
+        auto* entryLayers = entry.mutable_layers()->mutable_layers();
+        if (!entry.incremental()) {
+            layers.clear();
+            ids.clear();
+            for (const auto& layer : *entryLayers) {
+                ids.push_back(layer.id());
+                layers[layer.id()] = layer;
+            }
+            continue;
+        }
+
+        for (const auto& layer : *entryLayers) {
+            layers[layer.id()] = layer;
+        }
+        if (entry.layer_ids_size() > 0) {
+            ids.assign(entry.layer_ids().begin(), entry.layer_ids().end());
+            const std::unordered_set<int32_t> live(ids.begin(), ids.end());
+            for (auto it = layers.begin(); it != layers.end();) {
+                it = live.count(it->first) ? std::next(it) : layers.erase(it);
+            }
+        }
+
+        entryLayers->Clear();
+        entryLayers->Reserve(ids.size());
+        for (int32_t id : ids) {
+            const auto layer = layers.find(id);
+            if (layer == layers.end()) {
+                return false;
+            }
+            *entryLayers->Add() = layer->second;
+        }
+        entry.clear_incremental();
+        entry.clear_layer_ids();
+    }
+    return true;
+}
+
+} // namespace surfaceflinger
+} // namespace android
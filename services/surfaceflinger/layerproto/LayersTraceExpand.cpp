@@ -0,0 +1,66 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Expands a layers trace recorded in incremental mode into full snapshots, so that it can be
+// loaded by tools that expect one:
+//
+//   layers_trace_expand /data/misc/wmtrace/layers_trace.pb /data/local/tmp/layers_trace.pb
+
+#include <layerproto/LayersTraceDiff.h>
+
+#include <android-base/file.h>
+
+#include <stdio.h>
+
+#include <string>
+
+using namespace android::surfaceflinger;
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <incremental trace> <output trace>\n", argv[0]);
+        return 1;
+    }
+
+    std::string input;
+    if (!android::base::ReadFileToString(argv[1], &input)) {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+
+    LayersTraceFileProto trace;
+    if (!trace.ParseFromString(input)) {
+        fprintf(stderr, "%s is not a layers trace\n", argv[1]);
+        return 1;
+    }
+    input.clear();
+
+    const int entryCount = trace.entry_size();
+    if (!expandLayersTrace(&trace)) {
+        fprintf(stderr, "%s refers to layers that are not in the trace\n", argv[1]);
+        return 1;
+    }
+
+    std::string output;
+    if (!trace.SerializeToString(&output) || !android::base::WriteStringToFile(output, argv[2])) {
+        fprintf(stderr, "could not write %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("expanded %d entries, dropped %d without a keyframe\n", trace.entry_size(),
+           entryCount - trace.entry_size());
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <layerproto/LayerProtoHeader.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace surfaceflinger {
+
+/*
+ * Turns consecutive LayersTraceProto snapshots into incremental entries, which only hold the
+ * layers that changed since the previous entry.
+ */
+class LayersTraceDiff {
+public:
+    // Strips the layers of entry that are unchanged since the previous call, and marks it
+    // incremental. Entries are left as full snapshots (keyframes) after reset() and when
+    // forceKeyframe is set. Returns true if entry is a keyframe.
+    bool encode(LayersTraceProto* entry, bool forceKeyframe = false);
+
+    // Makes the next entry a keyframe.
+    void reset();
+
+private:
+    // Serialized LayerProto of each layer in the previous entry, by id.
+    std::unordered_map<int32_t, std::string> mLayers;
+    std::vector<int32_t> mLayerIds;
+    bool mHasPrevious = false;
+};
+
+// Replaces the incremental entries of trace with full snapshots. Leading incremental entries,
+// whose keyframe was dropped from the trace, are removed. Returns false if an entry refers to
+// a layer that is not in the entries before it.
+bool expandLayersTrace(LayersTraceFileProto* trace);
+
+} // namespace surfaceflinger
+} // namespace android
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stresses SurfaceFlinger with Transaction::apply calls from concurrent clients, each on its own
+// buffer layer, and reports the percentiles of the time apply blocks the client and of the time
+// from apply to the buffer being latched, as reported by the transaction completed callback.
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <gui/ISurfaceComposerClient.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace {
+
+constexpr uint32_t kBufferSize = 64;
+constexpr size_t kBufferCount = 3;
+constexpr int kTransactionsPerClient = 60;
+
+struct Latencies {
+    std::vector<nsecs_t> apply;
+    std::vector<nsecs_t> applyToLatch;
+};
+
+class Client {
+public:
+    explicit Client(int index) : mClient(new SurfaceComposerClient) {
+        mSurface = mClient->createSurface(String8::format("TransactionApply_benchmark %d", index),
+                                          0, 0, PIXEL_FORMAT_RGBA_8888,
+                                          ISurfaceComposerClient::eFXSurfaceBufferState);
+        for (size_t i = 0; i < kBufferCount; i++) {
+            mBuffers.push_back(new GraphicBuffer(kBufferSize, kBufferSize, PIXEL_FORMAT_RGBA_8888,
+                                                 1,
+                                                 GraphicBuffer::USAGE_SW_WRITE_OFTEN |
+                                                         GraphicBuffer::USAGE_HW_COMPOSER |
+                                                         GraphicBuffer::USAGE_HW_TEXTURE,
+                                                 "TransactionApply_benchmark"));
+        }
+        const int32_t offset = index * kBufferSize;
+        SurfaceComposerClient::Transaction()
+                .setLayer(mSurface, INT32_MAX - 1)
+                .setFrame(mSurface, Rect(offset, 0, offset + kBufferSize, kBufferSize))
+                .show(mSurface)
+                .apply(true);
+    }
+
+    bool isValid() const { return mSurface != nullptr && mSurface->isValid(); }
+
+    // Applies a new buffer, and waits for it to be latched.
+    void applyBuffer(size_t frame, Latencies* latencies) {
+        nsecs_t latchTime = -1;
+        bool completed = false;
+
+        const nsecs_t start = systemTime();
+        SurfaceComposerClient::Transaction()
+                .setBuffer(mSurface, mBuffers[frame % kBufferCount])
+                .addTransactionCompletedCallback(
+                        [&](void*, nsecs_t latch, const sp<Fence>&,
+                            const std::vector<SurfaceControlStats>&) {
+                            std::lock_guard<std::mutex> lock(mMutex);
+                            latchTime = latch;
+                            completed = true;
+                            mCondition.notify_one();
+                        },
+                        nullptr)
+                .apply();
+        const nsecs_t applied = systemTime();
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [&] { return completed; });
+        latencies->apply.push_back(applied - start);
+        if (latchTime >= start) {
+            latencies->applyToLatch.push_back(latchTime - start);
+        }
+    }
+
+private:
+    sp<SurfaceComposerClient> mClient;
+    sp<SurfaceControl> mSurface;
+    std::vector<sp<GraphicBuffer>> mBuffers;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+};
+
+double percentileUs(std::vector<nsecs_t>* values, double percentile) {
+    if (values->empty()) {
+        return 0;
+    }
+    const size_t index = std::min(values->size() - 1, size_t(values->size() * percentile));
+    std::nth_element(values->begin(), values->begin() + index, values->end());
+    return ns2us((*values)[index]);
+}
+
+// Arg: the number of concurrent clients.
+void BM_ConcurrentApply(benchmark::State& state) {
+    const int clientCount = state.range(0);
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < clientCount; i++) {
+        clients.push_back(std::make_unique<Client>(i));
+        if (!clients.back()->isValid()) {
+            state.SkipWithError("Unable to create a layer");
+            return;
+        }
+    }
+
+    std::vector<Latencies> latencies(clientCount);
+    size_t frame = 0;
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < clientCount; i++) {
+            threads.emplace_back([&, i, frame] {
+                for (int j = 0; j < kTransactionsPerClient; j++) {
+                    clients[i]->applyBuffer(frame + j, &latencies[i]);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        frame += kTransactionsPerClient;
+    }
+
+    Latencies all;
+    for (auto& client : latencies) {
+        all.apply.insert(all.apply.end(), client.apply.begin(), client.apply.end());
+        all.applyToLatch.insert(all.applyToLatch.end(), client.applyToLatch.begin(),
+                                client.applyToLatch.end());
+    }
+    state.SetItemsProcessed(state.iterations() * clientCount * kTransactionsPerClient);
+    state.counters["apply_p50_us"] = percentileUs(&all.apply, 0.5);
+    state.counters["apply_p99_us"] = percentileUs(&all.apply, 0.99);
+    state.counters["latch_p50_us"] = percentileUs(&all.applyToLatch, 0.5);
+    state.counters["latch_p99_us"] = percentileUs(&all.applyToLatch, 0.99);
+}
+BENCHMARK(BM_ConcurrentApply)
+        ->RangeMultiplier(2)
+        ->Range(1, 16)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
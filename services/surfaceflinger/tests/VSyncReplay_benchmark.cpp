@@ -0,0 +1,216 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays traces of HW vsync timestamps through VSyncReactor, with each model of VSyncPredictor,
+// and reports the CPU time per sample along with the error of the vsync predicted just before
+// each sample comes in.
+//
+// The built-in traces are simulated, and their errors are measured against the ideal vsync the
+// samples are jittered from. Recorded traces can be replayed as well, with errors measured
+// against the recorded samples, by passing files of "<timestamp ns> <hwc period ns>" lines:
+//
+//   SurfaceFlinger_vsync_replay_benchmark --trace=/data/local/tmp/vsync.txt
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Scheduler/TimeKeeper.h"
+#include "Scheduler/VSyncDispatchTimerQueue.h"
+#include "Scheduler/VSyncPredictor.h"
+#include "Scheduler/VSyncReactor.h"
+
+namespace android::scheduler {
+namespace {
+
+// The tunables of createDispSync.
+constexpr nsecs_t kInitialPeriod = 16666667;
+constexpr size_t kHistorySize = 20;
+constexpr size_t kMinimumSamplesForPrediction = 6;
+constexpr uint32_t kDiscardOutlierPercent = 20;
+constexpr size_t kPendingFenceLimit = 20;
+
+struct Sample {
+    nsecs_t timestamp;
+    nsecs_t hwcPeriod;
+    // The vsync the timestamp is a sample of, which errors are measured against.
+    nsecs_t vsync;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Sample> samples;
+};
+
+class FixedClock : public TimeKeeper {
+public:
+    nsecs_t now() const final { return 0; }
+    void alarmIn(std::function<void()> const&, nsecs_t) final {}
+    void alarmCancel() final {}
+    void dump(std::string&) const final {}
+};
+
+// Vsyncs at the given rates for the given counts in turn, with their actual period off from the
+// ideal by periodError, and samples with a gaussian jitter. A fraction of the samples are moved
+// by a sizeable part of the period, and another is dropped, as when the HWC misses a vsync.
+Trace simulate(std::string name, std::vector<std::pair<float, int>> const& rates,
+               double periodError, double jitterNs, double outlierRate, double missRate) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> jitter(0, jitterNs);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    Trace trace{std::move(name), {}};
+    double vsync = 1e9;
+    for (auto const& [rate, count] : rates) {
+        const auto hwcPeriod = static_cast<nsecs_t>(1e9 / rate);
+        const double period = static_cast<double>(hwcPeriod) * (1 + periodError);
+        for (int i = 0; i < count; i++) {
+            vsync += period;
+            if (uniform(rng) < missRate) continue;
+            double timestamp = vsync + jitter(rng);
+            if (uniform(rng) < outlierRate) {
+                timestamp += period * (0.08 + 0.08 * uniform(rng));
+            }
+            trace.samples.push_back({static_cast<nsecs_t>(timestamp), hwcPeriod,
+                                     static_cast<nsecs_t>(vsync)});
+        }
+    }
+    return trace;
+}
+
+std::vector<Trace> simulatedTraces() {
+    return {
+            simulate("60hz", {{60.f, 2000}}, 0.0005, 50000, 0, 0),
+            simulate("60hz_jittery", {{60.f, 2000}}, 0.0005, 400000, 0, 0.02),
+            simulate("90hz_outliers", {{90.f, 2000}}, -0.0003, 100000, 0.03, 0.01),
+            simulate("mode_switches",
+                     {{60.f, 120}, {90.f, 180}, {120.f, 240}, {60.f, 120}, {90.f, 180},
+                      {120.f, 240}, {60.f, 120}},
+                     0.001, 150000, 0.01, 0.01),
+    };
+}
+
+bool readTrace(std::string const& path, Trace* trace) {
+    std::ifstream file(path);
+    if (!file) return false;
+    trace->name = path.substr(path.find_last_of('/') + 1);
+    Sample sample;
+    while (file >> sample.timestamp >> sample.hwcPeriod) {
+        sample.vsync = sample.timestamp;
+        trace->samples.push_back(sample);
+    }
+    return !trace->samples.empty();
+}
+
+std::unique_ptr<VSyncReactor> createReactor(VSyncPredictor::Model model) {
+    auto tracker = std::make_unique<VSyncPredictor>(kInitialPeriod, kHistorySize,
+                                                    kMinimumSamplesForPrediction,
+                                                    kDiscardOutlierPercent, model);
+    auto dispatch =
+            std::make_unique<VSyncDispatchTimerQueue>(std::make_unique<FixedClock>(), *tracker,
+                                                      500000 /* timerSlack */,
+                                                      3000000 /* vsyncMoveThreshold */);
+    return std::make_unique<VSyncReactor>(std::make_unique<FixedClock>(), std::move(dispatch),
+                                          std::move(tracker), kPendingFenceLimit,
+                                          false /* supportKernelIdleTimer */);
+}
+
+// Feeds the samples to reactor as the Scheduler would with HW vsync always on, and returns the
+// error of the vsync predicted half a period before each sample, if errors is set.
+void replay(VSyncReactor& reactor, std::vector<Sample> const& samples,
+            std::vector<nsecs_t>* errors) {
+    nsecs_t period = 0;
+    for (auto const& sample : samples) {
+        if (sample.hwcPeriod != period) {
+            period = sample.hwcPeriod;
+            reactor.setPeriod(period);
+        }
+        const nsecs_t prediction = reactor.computeNextRefresh(0, sample.vsync - period / 2);
+        if (errors) {
+            errors->push_back(std::abs(prediction - sample.vsync));
+        }
+        bool periodFlushed = false;
+        reactor.addResyncSample(sample.timestamp, period, &periodFlushed);
+    }
+}
+
+void BM_Replay(benchmark::State& state, Trace const& trace, VSyncPredictor::Model model) {
+    std::vector<nsecs_t> errors;
+    replay(*createReactor(model), trace.samples, &errors);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto reactor = createReactor(model);
+        state.ResumeTiming();
+        replay(*reactor, trace.samples, nullptr);
+    }
+
+    const auto percentile = [&errors](double p) {
+        auto nth = errors.begin() + static_cast<ptrdiff_t>(p * static_cast<double>(errors.size()));
+        std::nth_element(errors.begin(), nth, errors.end());
+        return static_cast<double>(*nth) / 1000;
+    };
+    double sum = 0;
+    for (nsecs_t error : errors) {
+        sum += static_cast<double>(error);
+    }
+    state.counters["err_mean_us"] = sum / static_cast<double>(errors.size()) / 1000;
+    state.counters["err_p50_us"] = percentile(0.5);
+    state.counters["err_p99_us"] = percentile(0.99);
+    state.counters["ns_per_sample"] =
+            benchmark::Counter(static_cast<double>(trace.samples.size()),
+                               benchmark::Counter::kIsIterationInvariantRate |
+                                       benchmark::Counter::kInvert);
+}
+
+} // namespace
+} // namespace android::scheduler
+
+int main(int argc, char** argv) {
+    using namespace android::scheduler;
+
+    std::vector<Trace> traces = simulatedTraces();
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const std::string flag = "--trace=";
+        if (arg.compare(0, flag.size(), flag) != 0) continue;
+        Trace trace;
+        if (!readTrace(arg.substr(flag.size()), &trace)) {
+            fprintf(stderr, "could not read a vsync trace from %s\n", arg.c_str() + flag.size());
+            return 1;
+        }
+        traces.push_back(std::move(trace));
+    }
+
+    for (auto const& trace : traces) {
+        for (auto const& [model, name] :
+             {std::make_pair(VSyncPredictor::Model::LeastSquares, "LeastSquares"),
+              std::make_pair(VSyncPredictor::Model::RobustKalman, "RobustKalman")}) {
+            benchmark::RegisterBenchmark(("BM_Replay/" + trace.name + "/" + name).c_str(),
+                                         BM_Replay, trace, model)
+                    ->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -21,6 +21,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <log/log.h>
+#include <random>
 
 #include "Scheduler/LayerHistory.h"
 #include "Scheduler/LayerInfoV2.h"
@@ -41,6 +42,9 @@ protected:
     static constexpr auto PRESENT_TIME_HISTORY_DURATION = LayerInfoV2::HISTORY_DURATION;
     static constexpr auto REFRESH_RATE_AVERAGE_HISTORY_DURATION =
             LayerInfoV2::RefreshRateHistory::HISTORY_DURATION;
+    static constexpr size_t REFRESH_RATE_HISTORY_SIZE =
+            LayerInfoV2::RefreshRateHistory::HISTORY_SIZE;
+    static constexpr auto REFRESH_RATE_MARGIN_FPS = LayerInfoV2::RefreshRateHistory::MARGIN_FPS;
 
     static constexpr float LO_FPS = 30.f;
     static constexpr auto LO_FPS_PERIOD = static_cast<nsecs_t>(1e9f / LO_FPS);
@@ -103,6 +107,78 @@ protected:
                 << "Frame rate is " << frameRate;
     }
 
+    static size_t frameCount(const LayerInfoV2& info) { return info.mFrameTimes.size(); }
+
+    static bool hasFrameTimeTotals(const LayerInfoV2& info) {
+        const auto& totals = info.mFrameTimeTotals;
+        return totals.queueTimeDeltas != 0 || totals.presentTimeDeltas != 0 ||
+                totals.missingPresentTimes != 0 || totals.pendingConfigChanges != 0;
+    }
+
+    static void setReportedRefreshRate(LayerInfoV2& info, float refreshRate) {
+        info.mLastRefreshRate.reported = refreshRate;
+    }
+
+    static std::optional<nsecs_t> averageFrameTime(const LayerInfoV2& info) {
+        return info.calculateAverageFrameTime();
+    }
+
+    // Averages the frame times by going through the whole history, as was done before the
+    // totals were kept up to date as frames came and went.
+    static std::optional<nsecs_t> expectedAverageFrameTime(const LayerInfoV2& info) {
+        const auto& frameTimes = info.mFrameTimes;
+        nsecs_t totalPresentTimeDeltas = 0;
+        nsecs_t totalQueueTimeDeltas = 0;
+        bool missingPresentTime = false;
+        int numFrames = 0;
+        for (auto it = frameTimes.begin(); it != frameTimes.end() - 1; ++it) {
+            if (it->pendingConfigChange || (it + 1)->pendingConfigChange) {
+                return std::nullopt;
+            }
+
+            totalQueueTimeDeltas +=
+                    std::max(((it + 1)->queueTime - it->queueTime), info.mHighRefreshRatePeriod);
+            numFrames++;
+
+            if (!missingPresentTime && (it->presetTime == 0 || (it + 1)->presetTime == 0)) {
+                missingPresentTime = true;
+                if (info.mLastRefreshRate.reported == 0) {
+                    return std::nullopt;
+                }
+                continue;
+            }
+
+            totalPresentTimeDeltas +=
+                    std::max(((it + 1)->presetTime - it->presetTime), info.mHighRefreshRatePeriod);
+        }
+
+        const auto averageFrameTime =
+                static_cast<float>(missingPresentTime ? totalQueueTimeDeltas
+                                                      : totalPresentTimeDeltas) /
+                numFrames;
+        return static_cast<nsecs_t>(averageFrameTime);
+    }
+
+    static bool addRefreshRate(LayerInfoV2& info, float refreshRate, nsecs_t now) {
+        return info.mRefreshRateHistory.add(refreshRate, now);
+    }
+
+    static size_t refreshRateCount(const LayerInfoV2& info) {
+        return info.mRefreshRateHistory.mRefreshRates.size();
+    }
+
+    // The smallest and largest refresh rates in the history, as kept and by going through it.
+    static std::pair<float, float> refreshRateRange(const LayerInfoV2& info) {
+        const auto& history = info.mRefreshRateHistory;
+        return {history.mMinima.front().refreshRate, history.mMaxima.front().refreshRate};
+    }
+
+    static std::pair<float, float> expectedRefreshRateRange(const LayerInfoV2& info) {
+        const auto& refreshRates = info.mRefreshRateHistory.mRefreshRates;
+        return {std::min_element(refreshRates.begin(), refreshRates.end())->refreshRate,
+                std::max_element(refreshRates.begin(), refreshRates.end())->refreshRate};
+    }
+
     Hwc2::mock::Display mDisplay;
     RefreshRateConfigs mConfigs{{HWC2::Display::Config::Builder(mDisplay, 0)
                                          .setVsyncPeriod(int32_t(LO_FPS_PERIOD))
@@ -671,6 +747,161 @@ TEST_F(LayerHistoryTestV2, heuristicLayerNotOscillating) {
     recordFramesAndExpect(layer, time, 27.10f, 30.0f, PRESENT_TIME_HISTORY_SIZE);
 }
 
+// The average frame time is rounded through a float.
+constexpr nsecs_t FRAME_TIME_TOLERANCE = 1000;
+
+TEST_F(LayerHistoryTestV2, frameTimeTotalsEvictedAtHistorySize) {
+    LayerInfoV2 info("layer", HI_FPS_PERIOD, LayerHistory::LayerVoteType::Heuristic);
+    std::mt19937 random(0);
+    nsecs_t time = systemTime();
+
+    // Some frames are closer together than the high refresh rate period, so the deltas
+    // leaving the totals are clamped too.
+    for (size_t i = 0; i < 3 * PRESENT_TIME_HISTORY_SIZE; i++) {
+        time += HI_FPS_PERIOD / 2 + static_cast<nsecs_t>(random() % LO_FPS_PERIOD);
+        info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer, false);
+        ASSERT_EQ(std::min(i + 1, PRESENT_TIME_HISTORY_SIZE), frameCount(info));
+        if (frameCount(info) > 1) {
+            ASSERT_EQ(expectedAverageFrameTime(info), averageFrameTime(info)) << "frame " << i;
+        }
+    }
+
+    // Nothing is left of the frames above once a whole history of new ones is in.
+    for (size_t i = 0; i < PRESENT_TIME_HISTORY_SIZE; i++) {
+        time += LO_FPS_PERIOD;
+        info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer, false);
+    }
+    ASSERT_TRUE(averageFrameTime(info).has_value());
+    EXPECT_NEAR(LO_FPS_PERIOD, *averageFrameTime(info), FRAME_TIME_TOLERANCE);
+}
+
+TEST_F(LayerHistoryTestV2, averageFrameTimeWithMissingPresentTimes) {
+    LayerInfoV2 info("layer", HI_FPS_PERIOD, LayerHistory::LayerVoteType::Heuristic);
+
+    // Buffers are queued twice as far apart as they are presented, so the average shows which
+    // of the two it was taken over.
+    const nsecs_t start = systemTime();
+    size_t frame = 0;
+    const auto recordFrame = [&](bool withPresentTime) {
+        const nsecs_t presentTime = start + static_cast<nsecs_t>(frame) * LO_FPS_PERIOD;
+        const nsecs_t queueTime = presentTime + static_cast<nsecs_t>(frame + 1) * LO_FPS_PERIOD;
+        frame++;
+        info.setLastPresentTime(withPresentTime ? presentTime : 0, queueTime,
+                                LayerHistory::LayerUpdateType::Buffer, false);
+    };
+
+    for (size_t i = 0; i < PRESENT_TIME_HISTORY_SIZE; i++) {
+        recordFrame(true);
+    }
+    ASSERT_TRUE(averageFrameTime(info).has_value());
+    EXPECT_NEAR(LO_FPS_PERIOD, *averageFrameTime(info), FRAME_TIME_TOLERANCE);
+
+    // Without a refresh rate reported before, there is nothing to go on.
+    recordFrame(false);
+    EXPECT_EQ(std::nullopt, averageFrameTime(info));
+    EXPECT_EQ(expectedAverageFrameTime(info), averageFrameTime(info));
+
+    // With one, the queue times are used for as long as the frame is in the history.
+    setReportedRefreshRate(info, LO_FPS);
+    for (size_t i = 0; i < PRESENT_TIME_HISTORY_SIZE; i++) {
+        ASSERT_EQ(expectedAverageFrameTime(info), averageFrameTime(info)) << "frame " << i;
+        ASSERT_TRUE(averageFrameTime(info).has_value());
+        ASSERT_NEAR(2 * LO_FPS_PERIOD, *averageFrameTime(info), FRAME_TIME_TOLERANCE);
+        recordFrame(true);
+    }
+    ASSERT_TRUE(averageFrameTime(info).has_value());
+    EXPECT_NEAR(LO_FPS_PERIOD, *averageFrameTime(info), FRAME_TIME_TOLERANCE);
+    EXPECT_EQ(expectedAverageFrameTime(info), averageFrameTime(info));
+}
+
+TEST_F(LayerHistoryTestV2, averageFrameTimeWithPendingConfigChange) {
+    LayerInfoV2 info("layer", HI_FPS_PERIOD, LayerHistory::LayerVoteType::Heuristic);
+    nsecs_t time = systemTime();
+    const auto recordFrame = [&](bool pendingConfigChange) {
+        time += LO_FPS_PERIOD;
+        info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer,
+                                pendingConfigChange);
+    };
+
+    for (size_t i = 0; i < PRESENT_TIME_HISTORY_SIZE; i++) {
+        recordFrame(false);
+    }
+
+    // A frame captured during a config change counts from the moment it is recorded until it
+    // leaves the history.
+    recordFrame(true);
+    EXPECT_EQ(std::nullopt, averageFrameTime(info));
+    EXPECT_EQ(expectedAverageFrameTime(info), averageFrameTime(info));
+
+    for (size_t i = 1; i < PRESENT_TIME_HISTORY_SIZE; i++) {
+        recordFrame(false);
+        ASSERT_EQ(std::nullopt, averageFrameTime(info)) << "frame " << i;
+        ASSERT_EQ(expectedAverageFrameTime(info), averageFrameTime(info)) << "frame " << i;
+    }
+
+    recordFrame(false);
+    EXPECT_EQ(expectedAverageFrameTime(info), averageFrameTime(info));
+    ASSERT_TRUE(averageFrameTime(info).has_value());
+    EXPECT_NEAR(LO_FPS_PERIOD, *averageFrameTime(info), FRAME_TIME_TOLERANCE);
+}
+
+TEST_F(LayerHistoryTestV2, clearHistoryResetsFrameTimeTotals) {
+    LayerInfoV2 info("layer", HI_FPS_PERIOD, LayerHistory::LayerVoteType::Heuristic);
+    nsecs_t time = systemTime();
+
+    for (size_t i = 0; i < PRESENT_TIME_HISTORY_SIZE; i++) {
+        time += HI_FPS_PERIOD;
+        info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer, false);
+        addRefreshRate(info, HI_FPS, time);
+    }
+    time += HI_FPS_PERIOD;
+    info.setLastPresentTime(0, time, LayerHistory::LayerUpdateType::Buffer, true);
+    time += HI_FPS_PERIOD;
+    info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer, false);
+    setReportedRefreshRate(info, HI_FPS);
+    ASSERT_TRUE(hasFrameTimeTotals(info));
+
+    info.clearHistory(time);
+    EXPECT_EQ(0u, frameCount(info));
+    EXPECT_EQ(0u, refreshRateCount(info));
+    EXPECT_FALSE(hasFrameTimeTotals(info));
+
+    // Only the frames from after are averaged...
+    time += LO_FPS_PERIOD;
+    info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer, false);
+    time += LO_FPS_PERIOD;
+    info.setLastPresentTime(time, time, LayerHistory::LayerUpdateType::Buffer, false);
+    ASSERT_TRUE(averageFrameTime(info).has_value());
+    EXPECT_NEAR(LO_FPS_PERIOD, *averageFrameTime(info), FRAME_TIME_TOLERANCE);
+
+    // ...and the refresh rate reported before is forgotten too.
+    time += LO_FPS_PERIOD;
+    info.setLastPresentTime(0, time, LayerHistory::LayerUpdateType::Buffer, false);
+    EXPECT_EQ(std::nullopt, averageFrameTime(info));
+}
+
+TEST_F(LayerHistoryTestV2, refreshRateHistoryWithEqualRefreshRates) {
+    LayerInfoV2 info("layer", HI_FPS_PERIOD, LayerHistory::LayerVoteType::Heuristic);
+    std::mt19937 random(0);
+    nsecs_t time = systemTime();
+
+    // Only a few refresh rates are added, so the same minimum and maximum are in the history
+    // many times over, and leave it one at a time or, after a long gap, several at once.
+    const float refreshRates[] = {59.5f, 60.f, 60.f, 60.5f, 61.f};
+    for (size_t i = 0; i < 10 * REFRESH_RATE_HISTORY_SIZE; i++) {
+        time += random() % 50 == 0 ? REFRESH_RATE_AVERAGE_HISTORY_DURATION.count() * 3 / 4
+                                   : HI_FPS_PERIOD;
+        const float refreshRate = refreshRates[random() % std::size(refreshRates)];
+        const bool consistent = addRefreshRate(info, refreshRate, time);
+
+        ASSERT_GT(REFRESH_RATE_HISTORY_SIZE, refreshRateCount(info));
+        const auto [min, max] = expectedRefreshRateRange(info);
+        ASSERT_EQ(min, refreshRateRange(info).first) << "refresh rate " << i;
+        ASSERT_EQ(max, refreshRateRange(info).second) << "refresh rate " << i;
+        ASSERT_EQ(max - min <= REFRESH_RATE_MARGIN_FPS, consistent) << "refresh rate " << i;
+    }
+}
+
 class LayerHistoryTestV2Parameterized
       : public LayerHistoryTestV2,
         public testing::WithParamInterface<std::chrono::nanoseconds> {};
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayersTraceDiffTest"
+
+#include <gtest/gtest.h>
+#include <layerproto/LayersTraceDiff.h>
+
+#include <vector>
+
+namespace android {
+namespace {
+
+using namespace android::surfaceflinger;
+
+LayersTraceProto makeEntry(const std::vector<std::pair<int32_t, int32_t>>& idsAndZ) {
+    LayersTraceProto entry;
+    for (const auto& [id, z] : idsAndZ) {
+        auto* layer = entry.mutable_layers()->add_layers();
+        layer->set_id(id);
+        layer->set_name("layer" + std::to_string(id));
+        layer->set_z(z);
+    }
+    return entry;
+}
+
+std::vector<int32_t> getIds(const LayersTraceProto& entry) {
+    std::vector<int32_t> ids;
+    for (const auto& layer : entry.layers().layers()) {
+        ids.push_back(layer.id());
+    }
+    return ids;
+}
+
+TEST(LayersTraceDiffTest, keepsOnlyChangedLayers) {
+    LayersTraceDiff diff;
+    auto entry = makeEntry({{1, 0}, {2, 1}, {3, 2}});
+    EXPECT_TRUE(diff.encode(&entry));
+    EXPECT_FALSE(entry.incremental());
+    EXPECT_EQ(3, entry.layers().layers_size());
+
+    entry = makeEntry({{1, 0}, {2, 5}, {3, 2}});
+    EXPECT_FALSE(diff.encode(&entry));
+    EXPECT_TRUE(entry.incremental());
+    EXPECT_EQ(std::vector<int32_t>{2}, getIds(entry));
+    EXPECT_EQ(0, entry.layer_ids_size());
+
+    entry = makeEntry({{1, 0}, {3, 2}, {4, 3}});
+    EXPECT_FALSE(diff.encode(&entry));
+    EXPECT_EQ(std::vector<int32_t>{4}, getIds(entry));
+    EXPECT_EQ(3, entry.layer_ids_size());
+}
+
+TEST(LayersTraceDiffTest, keyframeAfterResetOrWhenForced) {
+    LayersTraceDiff diff;
+    auto entry = makeEntry({{1, 0}});
+    EXPECT_TRUE(diff.encode(&entry));
+
+    entry = makeEntry({{1, 0}});
+    EXPECT_TRUE(diff.encode(&entry, true /* forceKeyframe */));
+    EXPECT_EQ(1, entry.layers().layers_size());
+
+    diff.reset();
+    entry = makeEntry({{1, 0}});
+    EXPECT_TRUE(diff.encode(&entry));
+    EXPECT_EQ(1, entry.layers().layers_size());
+
+    entry = makeEntry({});
+    EXPECT_TRUE(diff.encode(&entry));
+}
+
+TEST(LayersTraceDiffTest, expandRestoresSnapshots) {
+    const std::vector<LayersTraceProto> snapshots = {
+            makeEntry({{1, 0}, {2, 1}}),         makeEntry({{1, 0}, {2, 1}}),
+            makeEntry({{1, 3}, {2, 1}, {5, 4}}), makeEntry({{5, 4}, {1, 3}}),
+            makeEntry({{5, 4}, {1, 3}}),         makeEntry({{7, 0}}),
+    };
+
+    LayersTraceDiff diff;
+    LayersTraceFileProto trace;
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        auto entry = snapshots[i];
+        entry.set_elapsed_realtime_nanos(i);
+        diff.encode(&entry);
+        *trace.add_entry() = entry;
+    }
+
+    ASSERT_TRUE(expandLayersTrace(&trace));
+    ASSERT_EQ(static_cast<int>(snapshots.size()), trace.entry_size());
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        const auto& entry = trace.entry(i);
+        EXPECT_EQ(i, entry.elapsed_realtime_nanos());
+        EXPECT_FALSE(entry.incremental());
+        EXPECT_EQ(snapshots[i].layers().SerializeAsString(), entry.layers().SerializeAsString());
+    }
+}
+
+TEST(LayersTraceDiffTest, expandDropsEntriesWithoutKeyframe) {
+    LayersTraceDiff diff;
+    LayersTraceFileProto trace;
+    for (int32_t z = 0; z < 4; z++) {
+        auto entry = makeEntry({{1, z}});
+        diff.encode(&entry, z == 2 /* forceKeyframe */);
+        *trace.add_entry() = entry;
+    }
+    // As if the ring buffer evicted the first keyframe.
+    trace.mutable_entry()->DeleteSubrange(0, 1);
+
+    ASSERT_TRUE(expandLayersTrace(&trace));
+    ASSERT_EQ(2, trace.entry_size());
+    EXPECT_EQ(2, trace.entry(0).layers().layers(0).z());
+    EXPECT_EQ(3, trace.entry(1).layers().layers(0).z());
+}
+
+TEST(LayersTraceDiffTest, expandFailsOnMissingLayer) {
+    LayersTraceFileProto trace;
+    *trace.add_entry() = makeEntry({{1, 0}});
+    auto entry = makeEntry({});
+    entry.set_incremental(true);
+    entry.add_layer_ids(1);
+    entry.add_layer_ids(2);
+    *trace.add_entry() = entry;
+
+    EXPECT_FALSE(expandLayersTrace(&trace));
+}
+
+} // namespace
+} // namespace android
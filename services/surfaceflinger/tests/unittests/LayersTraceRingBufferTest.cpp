@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayersTraceRingBufferTest"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <layerproto/LayersTraceDiff.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SurfaceTracing.h"
+
+namespace android {
+
+using namespace android::surfaceflinger;
+
+class LayersTraceRingBufferTest : public testing::Test {
+protected:
+    using RingBuffer = SurfaceTracing::LayersTraceRingBuffer;
+
+    static constexpr size_t kBufferSize = 16 * 1024;
+    static constexpr int kEntryCount = 400;
+    // Entries are diffed against the previous one, with a full snapshot this often.
+    static constexpr uint32_t kKeyframeInterval = 16;
+
+    // Full snapshots of layers that come and go, and change their z from one entry to the next.
+    static std::vector<LayersTraceProto> makeSnapshots() {
+        std::mt19937 rng(1);
+        std::vector<std::pair<int32_t, int32_t>> idsAndZ;
+        int32_t nextId = 0;
+        std::vector<LayersTraceProto> snapshots;
+        for (int i = 0; i < kEntryCount; i++) {
+            if (idsAndZ.empty() || rng() % 5 == 0) {
+                idsAndZ.emplace_back(nextId++, 0);
+            }
+            if (idsAndZ.size() > 3 && rng() % 7 == 0) {
+                idsAndZ.erase(idsAndZ.begin() + rng() % idsAndZ.size());
+            }
+            idsAndZ[rng() % idsAndZ.size()].second = rng() % 100;
+
+            LayersTraceProto& entry = snapshots.emplace_back();
+            entry.set_elapsed_realtime_nanos(i);
+            for (const auto& [id, z] : idsAndZ) {
+                auto* layer = entry.mutable_layers()->add_layers();
+                layer->set_id(id);
+                layer->set_name("layer" + std::to_string(id));
+                layer->set_z(z);
+            }
+        }
+        return snapshots;
+    }
+
+    // Records the snapshots the way SurfaceTracing does in incremental mode.
+    static void record(const std::vector<LayersTraceProto>& snapshots, RingBuffer* buffer) {
+        LayersTraceDiff diff;
+        uint32_t entriesSinceKeyframe = 0;
+        for (auto entry : snapshots) {
+            const bool forceKeyframe =
+                    !buffer->hasKeyframe() || entriesSinceKeyframe >= kKeyframeInterval;
+            const bool keyframe = diff.encode(&entry, forceKeyframe);
+            entriesSinceKeyframe = keyframe ? 0 : entriesSinceKeyframe + 1;
+            ASSERT_TRUE(buffer->emplace(entry, keyframe));
+            ASSERT_LE(buffer->used(), buffer->size());
+        }
+    }
+
+    static void readTrace(const std::string& path, LayersTraceFileProto* trace) {
+        std::string contents;
+        ASSERT_TRUE(base::ReadFileToString(path, &contents));
+        ASSERT_TRUE(trace->ParseFromString(contents));
+        EXPECT_EQ(uint64_t(LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_H) << 32 |
+                          LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_L,
+                  trace->magic_number());
+    }
+};
+
+TEST_F(LayersTraceRingBufferTest, flushedTraceExpandsToFullTrace) {
+    const auto snapshots = makeSnapshots();
+    RingBuffer buffer;
+    ASSERT_TRUE(buffer.reset(kBufferSize));
+    ASSERT_NO_FATAL_FAILURE(record(snapshots, &buffer));
+    // The buffer wrapped around.
+    ASSERT_LT(buffer.frameCount(), snapshots.size());
+
+    TemporaryFile file;
+    ASSERT_EQ(NO_ERROR, buffer.writeToFile(file.path));
+    LayersTraceFileProto trace;
+    ASSERT_NO_FATAL_FAILURE(readTrace(file.path, &trace));
+    ASSERT_TRUE(expandLayersTrace(&trace));
+
+    // The flushed trace is the tail of the full trace, from the oldest keyframe kept on.
+    ASSERT_GT(trace.entry_size(), 0);
+    ASSERT_LE(static_cast<size_t>(trace.entry_size()), buffer.frameCount());
+    const size_t first = snapshots.size() - trace.entry_size();
+    for (int i = 0; i < trace.entry_size(); i++) {
+        const auto& entry = trace.entry(i);
+        const auto& snapshot = snapshots[first + i];
+        EXPECT_EQ(snapshot.elapsed_realtime_nanos(), entry.elapsed_realtime_nanos());
+        EXPECT_FALSE(entry.incremental());
+        EXPECT_EQ(snapshot.layers().SerializeAsString(), entry.layers().SerializeAsString());
+    }
+    // No more than a keyframe interval of the entries still in the buffer is dropped.
+    EXPECT_LE(buffer.frameCount() - trace.entry_size(), kKeyframeInterval);
+}
+
+TEST_F(LayersTraceRingBufferTest, clearedBufferFlushesEmptyTrace) {
+    RingBuffer buffer;
+    ASSERT_TRUE(buffer.reset(kBufferSize));
+    ASSERT_NO_FATAL_FAILURE(record(makeSnapshots(), &buffer));
+    buffer.clear();
+    EXPECT_EQ(0U, buffer.frameCount());
+    EXPECT_EQ(0U, buffer.used());
+
+    TemporaryFile file;
+    ASSERT_EQ(NO_ERROR, buffer.writeToFile(file.path));
+    LayersTraceFileProto trace;
+    ASSERT_NO_FATAL_FAILURE(readTrace(file.path, &trace));
+    EXPECT_EQ(0, trace.entry_size());
+}
+
+TEST_F(LayersTraceRingBufferTest, rejectsEntryLargerThanBuffer) {
+    RingBuffer buffer;
+    ASSERT_TRUE(buffer.reset(64));
+    const auto snapshots = makeSnapshots();
+    const auto& entry = snapshots.back();
+    ASSERT_GT(entry.ByteSizeLong(), buffer.size());
+    EXPECT_FALSE(buffer.emplace(entry, true /* keyframe */));
+    EXPECT_EQ(0U, buffer.frameCount());
+    EXPECT_FALSE(buffer.hasKeyframe());
+}
+
+} // namespace android
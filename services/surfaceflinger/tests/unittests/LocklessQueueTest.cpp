@@ -0,0 +1,105 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "LocklessQueue.h"
+
+namespace android {
+namespace {
+
+TEST(LocklessQueueTest, drainsInPushOrder) {
+    LocklessQueue<int> queue;
+    EXPECT_TRUE(queue.empty());
+
+    for (int i = 0; i < 5; i++) {
+        queue.push(i);
+    }
+    EXPECT_FALSE(queue.empty());
+
+    std::vector<int> values;
+    queue.drain([&](int&& value) { values.push_back(value); });
+    EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), values);
+    EXPECT_TRUE(queue.empty());
+
+    queue.drain([](int&&) { FAIL(); });
+}
+
+TEST(LocklessQueueTest, movesValues) {
+    LocklessQueue<std::unique_ptr<int>> queue;
+    queue.push(std::make_unique<int>(42));
+
+    std::unique_ptr<int> value;
+    queue.drain([&](std::unique_ptr<int>&& pushed) { value = std::move(pushed); });
+    ASSERT_NE(nullptr, value);
+    EXPECT_EQ(42, *value);
+}
+
+TEST(LocklessQueueTest, destructorFreesPendingValues) {
+    auto value = std::make_shared<int>(0);
+    {
+        LocklessQueue<std::shared_ptr<int>> queue;
+        queue.push(value);
+        queue.push(value);
+        EXPECT_EQ(3, value.use_count());
+    }
+    EXPECT_EQ(1, value.use_count());
+}
+
+TEST(LocklessQueueTest, keepsOrderOfEachProducer) {
+    constexpr int kProducerCount = 4;
+    constexpr int kValueCount = 10000;
+
+    struct Value {
+        int producer;
+        int sequence;
+    };
+    LocklessQueue<Value> queue;
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < kProducerCount; producer++) {
+        producers.emplace_back([&queue, producer] {
+            for (int i = 0; i < kValueCount; i++) {
+                queue.push({producer, i});
+            }
+        });
+    }
+
+    // Drain concurrently with the producers.
+    std::vector<int> next(kProducerCount, 0);
+    int received = 0;
+    const auto consume = [&](Value&& value) {
+        EXPECT_EQ(next[value.producer], value.sequence);
+        next[value.producer] = value.sequence + 1;
+        received++;
+    };
+    while (received < kProducerCount * kValueCount) {
+        queue.drain(consume);
+        std::this_thread::yield();
+    }
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+} // namespace
+} // namespace android
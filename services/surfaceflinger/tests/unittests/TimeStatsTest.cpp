@@ -31,6 +31,7 @@
 
 #include <chrono>
 #include <random>
+#include <thread>
 #include <unordered_set>
 
 #include "libsurfaceflinger_unittest_main.h"
@@ -585,6 +586,76 @@ TEST_F(TimeStatsTest, canInsertMultipleLayersTimeStats) {
     EXPECT_EQ(2, globalProto.stats_size());
 }
 
+TEST_F(TimeStatsTest, canInsertLayersWithCollidingSlots) {
+    EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
+
+    // Layers share a slot when their ids are 256 apart. Only the first gets it, and the
+    // others take the locked path.
+    constexpr int32_t kLayerIds[] = {3, 3 + 256, 3 + 512};
+    for (uint64_t frameNumber = 1; frameNumber <= 3; frameNumber++) {
+        for (int32_t layerId : kLayerIds) {
+            insertTimeRecord(NORMAL_SEQUENCE, layerId, frameNumber, frameNumber * 1000000);
+        }
+    }
+
+    SFTimeStatsGlobalProto globalProto;
+    ASSERT_TRUE(globalProto.ParseFromString(inputCommand(InputCommand::DUMP_ALL, FMT_PROTO)));
+
+    ASSERT_EQ(3, globalProto.stats_size());
+    for (const auto& layerProto : globalProto.stats()) {
+        EXPECT_EQ(2, layerProto.total_frames());
+    }
+}
+
+TEST_F(TimeStatsTest, canInsertMoreTimestampsThanQueuedBetweenFrames) {
+    EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
+
+    // Without a global present fence, nothing drains the per-layer queue until the dump.
+    constexpr uint64_t kFrames = 100;
+    for (uint64_t frameNumber = 1; frameNumber <= kFrames; frameNumber++) {
+        insertTimeRecord(NORMAL_SEQUENCE, LAYER_ID_0, frameNumber, frameNumber * 1000000);
+    }
+
+    SFTimeStatsGlobalProto globalProto;
+    ASSERT_TRUE(globalProto.ParseFromString(inputCommand(InputCommand::DUMP_ALL, FMT_PROTO)));
+
+    ASSERT_EQ(1, globalProto.stats_size());
+    EXPECT_EQ(kFrames - 1, globalProto.stats().Get(0).total_frames());
+}
+
+TEST_F(TimeStatsTest, canInsertTimestampsFromMultipleThreads) {
+    EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
+    ASSERT_NO_FATAL_FAILURE(mTimeStats->setPowerMode(PowerMode::ON));
+
+    constexpr int32_t kThreads = 4;
+    constexpr uint64_t kFrames = 200;
+    std::atomic<int32_t> running = kThreads;
+    std::vector<std::thread> threads;
+    for (int32_t layerId = 0; layerId < kThreads; layerId++) {
+        threads.emplace_back([this, layerId, &running] {
+            for (uint64_t frameNumber = 1; frameNumber <= kFrames; frameNumber++) {
+                insertTimeRecord(NORMAL_SEQUENCE, layerId, frameNumber, frameNumber * 1000000);
+            }
+            running--;
+        });
+    }
+    // Drain the queues as the main thread does every frame, while they are being filled.
+    for (nsecs_t presentTime = 1000000; running > 0; presentTime += 1000000) {
+        mTimeStats->setPresentFenceGlobal(std::make_shared<FenceTime>(presentTime));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    SFTimeStatsGlobalProto globalProto;
+    ASSERT_TRUE(globalProto.ParseFromString(inputCommand(InputCommand::DUMP_ALL, FMT_PROTO)));
+
+    ASSERT_EQ(kThreads, globalProto.stats_size());
+    for (const auto& layerProto : globalProto.stats()) {
+        EXPECT_EQ(kFrames - 1, layerProto.total_frames());
+    }
+}
+
 TEST_F(TimeStatsTest, canInsertUnorderedLayerTimeStats) {
     EXPECT_TRUE(inputCommand(InputCommand::ENABLE, FMT_STRING).empty());
 
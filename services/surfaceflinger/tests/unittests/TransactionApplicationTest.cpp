@@ -21,6 +21,11 @@
 #undef LOG_TAG
 #define LOG_TAG "CompositionTest"
 
+#include <chrono>
+#include <future>
+#include <iterator>
+
+#include <binder/Binder.h>
 #include <compositionengine/Display.h>
 #include <compositionengine/mock/DisplaySurface.h>
 #include <gmock/gmock.h>
@@ -182,9 +187,8 @@ public:
         // called in SurfaceFlinger::signalTransaction
         nsecs_t time = systemTime();
         EXPECT_CALL(*mMessageQueue, invalidate()).Times(1);
-        EXPECT_CALL(*mPrimaryDispSync, expectedPresentTime(_))
-                .WillOnce(Return(time + nsecs_t(5 * 1e8)));
-        // transaction that should go on the pending thread
+        // transaction that should go on the pending thread, which is left to the main thread
+        // without checking its desired present time
         TransactionInfo transactionA;
         setupSingle(transactionA, /*flags*/ 0, /*syncInputWindows*/ false,
                     /*desiredPresentTime*/ time + s2ns(1));
@@ -246,10 +250,6 @@ TEST_F(TransactionApplicationTest, Flush_RemovesFromQueue) {
     // called in SurfaceFlinger::signalTransaction
     EXPECT_CALL(*mMessageQueue, invalidate()).Times(1);
 
-    // nsecs_t time = systemTime();
-    EXPECT_CALL(*mPrimaryDispSync, expectedPresentTime(_))
-            .WillOnce(Return(nsecs_t(5 * 1e8)))
-            .WillOnce(Return(s2ns(2)));
     TransactionInfo transactionA; // transaction to go on pending queue
     setupSingle(transactionA, /*flags*/ 0, /*syncInputWindows*/ false,
                 /*desiredPresentTime*/ s2ns(1));
@@ -258,6 +258,11 @@ TEST_F(TransactionApplicationTest, Flush_RemovesFromQueue) {
                                  transactionA.desiredPresentTime, transactionA.uncacheBuffer,
                                  mHasListenerCallbacks, mCallbacks);
 
+    // flushing uses the expected present time cached on invalidate, so the transaction stays
+    // on the queue until its desiredPresentTime has passed
+    mFlinger.mutableExpectedPresentTime() = nsecs_t(5 * 1e8);
+    EXPECT_FALSE(mFlinger.flushTransactionQueues());
+
     auto& transactionQueue = mFlinger.getTransactionQueue();
     ASSERT_EQ(1, transactionQueue.size());
 
@@ -267,22 +272,109 @@ TEST_F(TransactionApplicationTest, Flush_RemovesFromQueue) {
     auto& transactionState = transactionStates.front();
     checkEqual(transactionA, transactionState);
 
-    // because flushing uses the cached expected present time, we send an empty
-    // transaction here (sending a null applyToken to fake it as from a
-    // different process) to re-query and reset the cached expected present time
-    TransactionInfo empty;
-    empty.applyToken = sp<IBinder>();
-    mFlinger.setTransactionState(empty.states, empty.displays, empty.flags, empty.applyToken,
-                                 empty.inputWindowCommands, empty.desiredPresentTime,
-                                 empty.uncacheBuffer, mHasListenerCallbacks, mCallbacks);
-
     // flush transaction queue should flush as desiredPresentTime has
     // passed
-    mFlinger.flushTransactionQueues();
+    mFlinger.mutableExpectedPresentTime() = s2ns(2);
+    EXPECT_TRUE(mFlinger.flushTransactionQueues());
 
     EXPECT_EQ(0, transactionQueue.size());
 }
 
+TEST_F(TransactionApplicationTest, Async_QueuedWithoutStateLock) {
+    // called in SurfaceFlinger::signalTransaction
+    EXPECT_CALL(*mMessageQueue, invalidate()).Times(1);
+    TransactionInfo transaction;
+    setupSingle(transaction, /*flags*/ 0, /*syncInputWindows*/ false,
+                /*desiredPresentTime*/ -1);
+
+    // the main thread holds mStateLock for most of a frame, which must not block the caller
+    std::future<void> applied;
+    {
+        Mutex::Autolock lock(mFlinger.mutableStateLock());
+        applied = std::async(std::launch::async, [&] {
+            mFlinger.setTransactionState(transaction.states, transaction.displays,
+                                         transaction.flags, transaction.applyToken,
+                                         transaction.inputWindowCommands,
+                                         transaction.desiredPresentTime,
+                                         transaction.uncacheBuffer, mHasListenerCallbacks,
+                                         mCallbacks);
+        });
+        EXPECT_EQ(std::future_status::ready, applied.wait_for(std::chrono::seconds(5)));
+    }
+    applied.wait();
+    EXPECT_NE(0, mFlinger.mutableTransactionFlags() & eTransactionFlushNeeded);
+
+    // it is moved to the pending transactions once the lock is taken again
+    auto& transactionQueue = mFlinger.getTransactionQueue();
+    ASSERT_EQ(1, transactionQueue.size());
+    EXPECT_EQ(transaction.applyToken, transactionQueue.begin()->first);
+    ASSERT_EQ(1, transactionQueue.begin()->second.size());
+    checkEqual(transaction, transactionQueue.begin()->second.front());
+}
+
+TEST_F(TransactionApplicationTest, Async_KeepsOrderPerApplyToken) {
+    // called in SurfaceFlinger::signalTransaction
+    EXPECT_CALL(*mMessageQueue, invalidate()).Times(1);
+    const sp<IBinder> tokens[] = {new BBinder(), new BBinder()};
+
+    // the desired present times identify the transactions, and keep them from being applied
+    constexpr int kTransactionsPerToken = 5;
+    for (int i = 0; i < kTransactionsPerToken; i++) {
+        for (size_t t = 0; t < std::size(tokens); t++) {
+            TransactionInfo transaction;
+            transaction.applyToken = tokens[t];
+            setupSingle(transaction, /*flags*/ 0, /*syncInputWindows*/ false,
+                        /*desiredPresentTime*/ s2ns(1) + 100 * t + i);
+            mFlinger.setTransactionState(transaction.states, transaction.displays,
+                                         transaction.flags, transaction.applyToken,
+                                         transaction.inputWindowCommands,
+                                         transaction.desiredPresentTime,
+                                         transaction.uncacheBuffer, mHasListenerCallbacks,
+                                         mCallbacks);
+        }
+    }
+    mFlinger.mutableExpectedPresentTime() = s2ns(1);
+    EXPECT_FALSE(mFlinger.flushTransactionQueues());
+
+    auto& transactionQueue = mFlinger.getTransactionQueue();
+    ASSERT_EQ(std::size(tokens), transactionQueue.size());
+    for (size_t t = 0; t < std::size(tokens); t++) {
+        auto transactionStates = transactionQueue[tokens[t]];
+        ASSERT_EQ(kTransactionsPerToken, transactionStates.size());
+        for (int i = 0; i < kTransactionsPerToken; i++) {
+            EXPECT_EQ(s2ns(1) + 100 * t + i, transactionStates.front().desiredPresentTime);
+            transactionStates.pop();
+        }
+    }
+}
+
+TEST_F(TransactionApplicationTest, Async_AppliedByFlush) {
+    // called in SurfaceFlinger::signalTransaction
+    EXPECT_CALL(*mMessageQueue, invalidate()).Times(1);
+    const sp<IBinder> tokens[] = {new BBinder(), new BBinder()};
+
+    for (int i = 0; i < 3; i++) {
+        for (const auto& token : tokens) {
+            TransactionInfo transaction;
+            transaction.applyToken = token;
+            setupSingle(transaction, /*flags*/ 0, /*syncInputWindows*/ false,
+                        /*desiredPresentTime*/ -1);
+            mFlinger.setTransactionState(transaction.states, transaction.displays,
+                                         transaction.flags, transaction.applyToken,
+                                         transaction.inputWindowCommands,
+                                         transaction.desiredPresentTime,
+                                         transaction.uncacheBuffer, mHasListenerCallbacks,
+                                         mCallbacks);
+        }
+    }
+    EXPECT_NE(0, mFlinger.mutableTransactionFlags() & eTransactionFlushNeeded);
+
+    // nothing is applied on the binder thread, it is all left to flushTransactionQueues
+    EXPECT_TRUE(mFlinger.flushTransactionQueues());
+    EXPECT_EQ(0, mFlinger.getTransactionQueue().size());
+    EXPECT_FALSE(mFlinger.flushTransactionQueues());
+}
+
 TEST_F(TransactionApplicationTest, NotPlacedOnTransactionQueue_Synchronous) {
     NotPlacedOnTransactionQueue(ISurfaceComposer::eSynchronous, /*syncInputWindows*/ false);
 }
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures VSyncDispatchTimerQueue with each backend as the number of registered callbacks grows,
+// against a VSyncPredictor with a full history of samples:
+//  - BM_Frame runs a vsync period in which every callback fires once and reschedules itself for
+//    the next vsync, as the Scheduler's do.
+//  - BM_ScheduleCancel schedules a callback ahead of all the others and cancels it, which both
+//    rearm the timer.
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Scheduler/TimeKeeper.h"
+#include "Scheduler/VSyncDispatchTimerQueue.h"
+#include "Scheduler/VSyncPredictor.h"
+
+namespace android::scheduler {
+namespace {
+
+using Backend = VSyncDispatchTimerQueue::Backend;
+
+constexpr nsecs_t kPeriod = 16666667;
+constexpr nsecs_t kTimerSlack = 500000;
+constexpr nsecs_t kVsyncMoveThreshold = 3000000;
+
+// Fires the alarm only when told to, as if it went off right on time.
+class ManualTimeKeeper : public TimeKeeper {
+public:
+    nsecs_t now() const final { return mNow; }
+    void alarmIn(std::function<void()> const& callback, nsecs_t time) final {
+        mCallback = callback;
+        mAlarm = mNow + time;
+    }
+    void alarmCancel() final { mCallback = nullptr; }
+    void dump(std::string&) const final {}
+
+    // Moves time to the alarm and runs it, if it is set to go off by the given time.
+    bool fireBy(nsecs_t time) {
+        if (!mCallback || mAlarm > time) {
+            return false;
+        }
+        mNow = std::max(mNow, mAlarm);
+        auto callback = std::move(mCallback);
+        mCallback = nullptr;
+        callback();
+        return true;
+    }
+
+    void advanceTo(nsecs_t time) { mNow = std::max(mNow, time); }
+
+private:
+    nsecs_t mNow = 0;
+    nsecs_t mAlarm = 0;
+    std::function<void()> mCallback;
+};
+
+std::unique_ptr<VSyncPredictor> createTracker() {
+    auto tracker = std::make_unique<VSyncPredictor>(kPeriod, 20 /* historySize */,
+                                                    6 /* minimumSamplesForPrediction */,
+                                                    20 /* outlierTolerancePercent */);
+    for (nsecs_t i = 1; i <= 20; i++) {
+        tracker->addVsyncTimestamp(i * kPeriod);
+    }
+    return tracker;
+}
+
+// The work durations of the callbacks, spread over a couple of periods.
+nsecs_t workDuration(size_t index, size_t count) {
+    return kPeriod / 4 + static_cast<nsecs_t>(index) * 2 * kPeriod / static_cast<nsecs_t>(count);
+}
+
+void BM_Frame(benchmark::State& state, Backend backend) {
+    const auto count = static_cast<size_t>(state.range(0));
+    auto tracker = createTracker();
+    auto timeKeeperOwner = std::make_unique<ManualTimeKeeper>();
+    auto& timeKeeper = *timeKeeperOwner;
+    timeKeeper.advanceTo(21 * kPeriod);
+    VSyncDispatchTimerQueue dispatch(std::move(timeKeeperOwner), *tracker, kTimerSlack,
+                                     kVsyncMoveThreshold, backend);
+
+    std::vector<VSyncDispatch::CallbackToken> tokens(count);
+    for (size_t i = 0; i < count; i++) {
+        tokens[i] = dispatch.registerCallback(
+                [&, i](nsecs_t vsync, nsecs_t) {
+                    dispatch.schedule(tokens[i], workDuration(i, count), vsync + kPeriod / 2);
+                },
+                "callback" + std::to_string(i));
+        dispatch.schedule(tokens[i], workDuration(i, count), timeKeeper.now());
+    }
+
+    size_t wakeups = 0;
+    nsecs_t frameEnd = timeKeeper.now();
+    for (auto _ : state) {
+        frameEnd += kPeriod;
+        while (timeKeeper.fireBy(frameEnd)) {
+            wakeups++;
+        }
+        timeKeeper.advanceTo(frameEnd);
+    }
+
+    state.counters["wakeups_per_frame"] =
+            static_cast<double>(wakeups) / static_cast<double>(state.iterations());
+    for (auto const& token : tokens) {
+        dispatch.unregisterCallback(token);
+    }
+}
+
+void BM_ScheduleCancel(benchmark::State& state, Backend backend) {
+    const auto count = static_cast<size_t>(state.range(0));
+    auto tracker = createTracker();
+    auto timeKeeper = std::make_unique<ManualTimeKeeper>();
+    timeKeeper->advanceTo(21 * kPeriod);
+    const nsecs_t now = timeKeeper->now();
+    VSyncDispatchTimerQueue dispatch(std::move(timeKeeper), *tracker, kTimerSlack,
+                                     kVsyncMoveThreshold, backend);
+
+    std::vector<VSyncDispatch::CallbackToken> tokens;
+    for (size_t i = 0; i < count; i++) {
+        tokens.push_back(dispatch.registerCallback([](nsecs_t, nsecs_t) {},
+                                                   "callback" + std::to_string(i)));
+        dispatch.schedule(tokens.back(), workDuration(i, count), now + 4 * kPeriod);
+    }
+    const auto early = dispatch.registerCallback([](nsecs_t, nsecs_t) {}, "early");
+
+    for (auto _ : state) {
+        dispatch.schedule(early, kPeriod / 4, now);
+        dispatch.cancel(early);
+    }
+
+    dispatch.unregisterCallback(early);
+    for (auto const& token : tokens) {
+        dispatch.unregisterCallback(token);
+    }
+}
+
+BENCHMARK_CAPTURE(BM_Frame, Linear, Backend::Linear)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK_CAPTURE(BM_Frame, Ordered, Backend::Ordered)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK_CAPTURE(BM_ScheduleCancel, Linear, Backend::Linear)->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK_CAPTURE(BM_ScheduleCancel, Ordered, Backend::Ordered)->RangeMultiplier(4)->Range(1, 256);
+
+} // namespace
+} // namespace android::scheduler
+
+BENCHMARK_MAIN();
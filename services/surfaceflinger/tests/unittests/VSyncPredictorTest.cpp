@@ -450,6 +450,114 @@ TEST_F(VSyncPredictorTest, aPhoneThatHasBeenAroundAWhileCanStillComputePeriod) {
     EXPECT_THAT(intercept, Eq(0));
 }
 
+struct VSyncPredictorRobustKalmanTest : VSyncPredictorTest {
+    VSyncPredictor tracker{mPeriod, kHistorySize, kMinimumSamplesForPrediction,
+                           kOutlierTolerancePercent, VSyncPredictor::Model::RobustKalman};
+};
+
+TEST_F(VSyncPredictorRobustKalmanTest, reportsSamplesNeededWhenHasNoDataPoints) {
+    for (auto i = 0u; i < kMinimumSamplesForPrediction; i++) {
+        EXPECT_TRUE(tracker.needsMoreSamples());
+        EXPECT_THAT(tracker.getVSyncPredictionModel(), Eq(std::make_tuple(mPeriod, 0)));
+        tracker.addVsyncTimestamp(mNow += mPeriod);
+    }
+    EXPECT_FALSE(tracker.needsMoreSamples());
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), Eq(mPeriod));
+    EXPECT_THAT(tracker.nextAnticipatedVSyncTimeFrom(mNow + 1), Eq(mNow + mPeriod));
+}
+
+TEST_F(VSyncPredictorRobustKalmanTest, convergesOnJitteryTimeline) {
+    // 16.6ms vsyncs, off from the ideal by 0.3%, with uniformly distributed +/- 1.6ms error.
+    auto constexpr idealPeriod = 16600000;
+    auto constexpr realPeriod = 16649800;
+    std::vector<nsecs_t> const jitter{
+            -1107349, 1023311,  -402291,  1489960,  -1298420, 774210,  183733,  -1583011,
+            1208118,  -66093,   -984512,  1377106,  620885,   -1420374, 301998, 1101876,
+            -731095,  -199402,  1570934,  -1214790, 467121,   -5331,   -1531167, 880473,
+            1310057,  -853018,  142211,   -263410,  1054308,  -1477220, 699581, -1042663,
+    };
+
+    tracker.setPeriod(idealPeriod);
+    nsecs_t vsync = 1000000000;
+    for (auto const error : jitter) {
+        vsync += realPeriod;
+        tracker.addVsyncTimestamp(vsync + error);
+    }
+
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), IsCloseTo(realPeriod, 50000));
+    EXPECT_THAT(tracker.nextAnticipatedVSyncTimeFrom(vsync + realPeriod / 2),
+                IsCloseTo(vsync + realPeriod, 500000));
+}
+
+TEST_F(VSyncPredictorRobustKalmanTest, limitsEffectOfOutliers) {
+    for (auto i = 0u; i < kHistorySize * 2; i++) {
+        tracker.addVsyncTimestamp(mNow += mPeriod);
+    }
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), Eq(mPeriod));
+
+    // Within the outlier tolerance, so it is taken into the model.
+    auto const lateBy = mPeriod * (kOutlierTolerancePercent - 5) / 100;
+    EXPECT_TRUE(tracker.addVsyncTimestamp(mNow + mPeriod + lateBy));
+    mNow += mPeriod;
+
+    auto const [slope, intercept] = tracker.getVSyncPredictionModel();
+    EXPECT_THAT(slope, IsCloseTo(mPeriod, mPeriod / 100));
+    EXPECT_THAT(tracker.nextAnticipatedVSyncTimeFrom(mNow + mPeriod / 2),
+                IsCloseTo(mNow + mPeriod, lateBy / 4));
+}
+
+TEST_F(VSyncPredictorRobustKalmanTest, handlesSamplesOutOfOrder) {
+    auto const simulatedVsyncs = generateVsyncTimestamps(kHistorySize, mPeriod, 0);
+    std::vector<nsecs_t> shuffled = simulatedVsyncs;
+    std::swap(shuffled[6], shuffled[9]);
+    std::swap(shuffled[7], shuffled[8]);
+    for (auto const timestamp : shuffled) {
+        tracker.addVsyncTimestamp(timestamp);
+    }
+
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), IsCloseTo(mPeriod, 1));
+    EXPECT_THAT(tracker.nextAnticipatedVSyncTimeFrom(simulatedVsyncs.back() + 1),
+                IsCloseTo(simulatedVsyncs.back() + mPeriod, 1));
+}
+
+TEST_F(VSyncPredictorRobustKalmanTest, startsFromPeriodLearnedBeforePeriodChange) {
+    auto const fastPeriod = 1010;
+    auto const slowPeriod = 2000;
+    for (auto const timestamp : generateVsyncTimestamps(kHistorySize * 2, fastPeriod, 0)) {
+        tracker.addVsyncTimestamp(timestamp);
+    }
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), IsCloseTo(fastPeriod, 1));
+
+    tracker.setPeriod(slowPeriod);
+    for (auto const timestamp : generateVsyncTimestamps(kHistorySize, slowPeriod, 100000)) {
+        tracker.addVsyncTimestamp(timestamp);
+    }
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), IsCloseTo(slowPeriod, 1));
+
+    // Back at the ideal period that was learned to be fastPeriod, the first prediction is
+    // already accurate.
+    tracker.setPeriod(mPeriod);
+    auto const simulatedVsyncs =
+            generateVsyncTimestamps(kMinimumSamplesForPrediction, fastPeriod, 200000);
+    for (auto const timestamp : simulatedVsyncs) {
+        tracker.addVsyncTimestamp(timestamp);
+    }
+    EXPECT_THAT(std::get<0>(tracker.getVSyncPredictionModel()), IsCloseTo(fastPeriod, 1));
+    EXPECT_THAT(tracker.nextAnticipatedVSyncTimeFrom(simulatedVsyncs.back() + 1),
+                IsCloseTo(simulatedVsyncs.back() + fastPeriod, 1));
+}
+
+TEST_F(VSyncPredictorRobustKalmanTest, aPhoneThatHasBeenAroundAWhileCanStillComputePeriod) {
+    constexpr nsecs_t timeBase = 100_years;
+
+    for (auto i = 0; i < kHistorySize; i++) {
+        tracker.addVsyncTimestamp(timeBase + i * mPeriod);
+    }
+    auto [slope, intercept] = tracker.getVSyncPredictionModel();
+    EXPECT_THAT(slope, Eq(mPeriod));
+    EXPECT_THAT(intercept, Eq(0));
+}
+
 } // namespace android::scheduler
 
 // TODO(b/129481165): remove the #pragma below and fix conversion issues